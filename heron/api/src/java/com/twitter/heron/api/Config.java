@@ -172,6 +172,13 @@ public class Config extends HashMap<String, Object> {
    */
   public static final String TOPOLOGY_STATEFUL_START_CLEAN =
                              "topology.stateful.start.clean";
+  /**
+   * How fields grouping hashes the grouping fields to pick a task. "legacy",
+   * the default, or "fast", which is cheaper but sends keys to other tasks
+   * than legacy does, so it must not be changed for a topology with keyed state
+   */
+  public static final String TOPOLOGY_FIELDS_GROUPING_HASH =
+                             "topology.fields.grouping.hash";
   /**
    * Name of the topology. This config is automatically set by Heron when the topology is submitted.
    */
@@ -240,6 +247,7 @@ public class Config extends HashMap<String, Object> {
     apiVars.add(TOPOLOGY_STATEFUL_PROVIDER_TYPE);
     apiVars.add(TOPOLOGY_STATEFUL_PROVIDER_CONFIG);
     apiVars.add(TOPOLOGY_STATEFUL);
+    apiVars.add(TOPOLOGY_FIELDS_GROUPING_HASH);
     apiVars.add(TOPOLOGY_NAME);
     apiVars.add(TOPOLOGY_TEAM_NAME);
     apiVars.add(TOPOLOGY_TEAM_EMAIL);
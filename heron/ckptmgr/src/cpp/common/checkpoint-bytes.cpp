@@ -0,0 +1,180 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common/checkpoint-bytes.h"
+#include <sys/mman.h>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#include "basics/basics.h"
+
+namespace heron {
+namespace ckptmgr {
+
+CheckpointBytes::~CheckpointBytes() {
+  for (auto& mapping : mappings_) {
+    if (mapping.first) {
+      ::munmap(mapping.first, mapping.second);
+    }
+  }
+}
+
+size_t CheckpointBytes::map(void* _addr, size_t _len) {
+  mappings_.push_back(std::make_pair(_addr, _len));
+  return mappings_.size() - 1;
+}
+
+std::string* CheckpointBytes::buffer() {
+  buffers_.push_back(std::string());
+  return &buffers_.back();
+}
+
+void CheckpointBytes::append(const char* _data, size_t _len, int _mapping) {
+  if (_len == 0) return;
+  Piece piece = {_data, _len, _mapping};
+  pieces_.push_back(piece);
+  size_ += _len;
+}
+
+namespace {
+
+// Walks the protobuf wire format of a message that is spread over pieces
+template <typename Piece>
+class WireCursor {
+ public:
+  WireCursor(const std::vector<Piece>& _pieces, size_t _first)
+      : pieces_(_pieces), piece_(_first), offset_(0) {}
+
+  bool done() {
+    while (piece_ < pieces_.size() && offset_ == pieces_[piece_].len_) {
+      ++piece_;
+      offset_ = 0;
+    }
+    return piece_ == pieces_.size();
+  }
+
+  bool readVarint(sp_uint64& _value) {
+    _value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (done()) return false;
+      unsigned char byte = pieces_[piece_].data_[offset_++];
+      _value |= static_cast<sp_uint64>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+  }
+
+  // skip _len bytes, and add the pieces they are in to _skipped if given
+  bool skip(sp_uint64 _len, std::vector<Piece>* _skipped = NULL) {
+    while (_len > 0) {
+      if (done()) return false;
+      const Piece& piece = pieces_[piece_];
+      size_t n = std::min(static_cast<size_t>(_len), piece.len_ - offset_);
+      if (_skipped) {
+        Piece part = {piece.data_ + offset_, n, piece.mapping_};
+        _skipped->push_back(part);
+      }
+      offset_ += n;
+      _len -= n;
+    }
+    return true;
+  }
+
+ private:
+  const std::vector<Piece>& pieces_;
+  size_t piece_;
+  size_t offset_;
+};
+
+}  // namespace
+
+int CheckpointBytes::narrow(sp_uint32 _field) {
+  WireCursor<Piece> cursor(pieces_, first_);
+  while (!cursor.done()) {
+    sp_uint64 tag = 0;
+    sp_uint64 value = 0;
+    if (!cursor.readVarint(tag)) break;
+    bool skipped = false;
+    switch (tag & 7) {
+      case 0:  // varint
+        skipped = cursor.readVarint(value);
+        break;
+      case 1:  // fixed64
+        skipped = cursor.skip(8);
+        break;
+      case 2:  // length delimited
+        if (!cursor.readVarint(value)) break;
+        if ((tag >> 3) == _field) {
+          std::vector<Piece> field;
+          if (!cursor.skip(value, &field)) return SP_NOTOK;
+          pieces_.swap(field);
+          first_ = 0;
+          size_ = value;
+          unmapUnused();
+          return SP_OK;
+        }
+        skipped = cursor.skip(value);
+        break;
+      case 5:  // fixed32
+        skipped = cursor.skip(4);
+        break;
+    }
+    if (!skipped) break;
+  }
+  return SP_NOTOK;
+}
+
+size_t CheckpointBytes::read(char* _dest, size_t _len) {
+  size_t copied = 0;
+  while (copied < _len && first_ < pieces_.size()) {
+    Piece& piece = pieces_[first_];
+    size_t n = std::min(_len - copied, piece.len_);
+    memcpy(_dest + copied, piece.data_, n);
+    copied += n;
+    piece.data_ += n;
+    piece.len_ -= n;
+    if (piece.len_ > 0) break;
+
+    int mapping = piece.mapping_;
+    ++first_;
+    bool last = first_ == pieces_.size() || pieces_[first_].mapping_ != mapping;
+    if (mapping >= 0 && last) {
+      CHECK(mappings_[mapping].first);
+      ::munmap(mappings_[mapping].first, mappings_[mapping].second);
+      mappings_[mapping].first = NULL;
+    }
+  }
+  size_ -= copied;
+  return copied;
+}
+
+void CheckpointBytes::unmapUnused() {
+  std::vector<bool> used(mappings_.size(), false);
+  for (size_t i = first_; i < pieces_.size(); ++i) {
+    if (pieces_[i].mapping_ >= 0) used[pieces_[i].mapping_] = true;
+  }
+  for (size_t i = 0; i < mappings_.size(); ++i) {
+    if (!used[i] && mappings_[i].first) {
+      ::munmap(mappings_[i].first, mappings_[i].second);
+      mappings_[i].first = NULL;
+    }
+  }
+}
+
+}  // namespace ckptmgr
+}  // namespace heron
@@ -0,0 +1,87 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if !defined(CHECKPOINT_BYTES_H)
+#define CHECKPOINT_BYTES_H
+
+#include <list>
+#include <string>
+#include <utility>
+#include <vector>
+#include "basics/basics.h"
+
+namespace heron {
+namespace ckptmgr {
+
+// The serialized InstanceStateCheckpoint of a stored checkpoint, as it was
+// found in storage. It is made up of pieces of memory that this object
+// keeps alive, like mapped files, so that it can be written into an
+// outgoing packet without being parsed or put together first.
+class CheckpointBytes {
+ public:
+  CheckpointBytes() : first_(0), size_(0) {}
+
+  // unmaps what is still mapped
+  ~CheckpointBytes();
+
+  // keep the read only mapping of _len bytes at _addr until it is drained
+  // or this is destroyed. Returns its index for append.
+  size_t map(void* _addr, size_t _len);
+
+  // keep a buffer until this is destroyed, so that pieces can be in it
+  std::string* buffer();
+
+  // add the _len bytes at _data, which lie in the mapping with index
+  // _mapping, or in a buffer if that is -1
+  void append(const char* _data, size_t _len, int _mapping = -1);
+
+  // keep only the contents of the length delimited field _field of the
+  // message that the bytes hold, without parsing the rest of it
+  int narrow(sp_uint32 _field);
+
+  // get the number of bytes left
+  size_t size() const { return size_; }
+
+  // copy the next bytes, at most _len of them, to _dest, unmapping every
+  // mapping as soon as it has been copied, so that it does not add to the
+  // memory in use. Returns the number of bytes copied.
+  size_t read(char* _dest, size_t _len);
+
+  // copy all the bytes that are left to _dest
+  void drainTo(char* _dest) { read(_dest, size_); }
+
+ private:
+  struct Piece {
+    const char* data_;
+    size_t len_;
+    int mapping_;
+  };
+
+  // unmap the mappings that no piece is left in
+  void unmapUnused();
+
+  std::vector<Piece> pieces_;
+  // the piece that the next byte is in
+  size_t first_;
+  std::vector<std::pair<void*, size_t>> mappings_;
+  std::list<std::string> buffers_;
+  size_t size_;
+};
+
+}  // namespace ckptmgr
+}  // namespace heron
+
+#endif  // checkpoint-bytes.h
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common/checkpoint-codec.h"
+#include <zstd.h>
+#include <memory>
+#include <string>
+#include "basics/basics.h"
+
+namespace heron {
+namespace ckptmgr {
+
+namespace {
+
+const CheckpointCodec fast("zstd-fast", -3);
+const CheckpointCodec dense("zstd", 9);
+
+const CheckpointCodec* const codecs[] = {&fast, &dense};
+
+// Compression runs on the io workers. Each keeps its contexts, so that
+// their tables are not allocated again for every checkpoint.
+struct CCtxDeleter {
+  void operator()(ZSTD_CCtx* _ctx) const { ZSTD_freeCCtx(_ctx); }
+};
+
+struct DCtxDeleter {
+  void operator()(ZSTD_DCtx* _ctx) const { ZSTD_freeDCtx(_ctx); }
+};
+
+ZSTD_CCtx* compressContext() {
+  thread_local std::unique_ptr<ZSTD_CCtx, CCtxDeleter> ctx(ZSTD_createCCtx());
+  return ctx.get();
+}
+
+ZSTD_DCtx* decompressContext() {
+  thread_local std::unique_ptr<ZSTD_DCtx, DCtxDeleter> ctx(ZSTD_createDCtx());
+  return ctx.get();
+}
+
+}  // namespace
+
+const CheckpointCodec* CheckpointCodec::get(const std::string& _name) {
+  for (auto codec : codecs) {
+    if (codec->name() == _name) return codec;
+  }
+  return NULL;
+}
+
+void CheckpointCodec::compress(const char* _data, size_t _len, std::string& _out) const {
+  size_t offset = _out.size();
+  _out.resize(offset + ZSTD_compressBound(_len));
+  size_t written = ZSTD_compressCCtx(compressContext(), &_out[offset], _out.size() - offset,
+                                     _data, _len, level_);
+  // Only running out of memory fails with a buffer of the bound
+  LOG_IF(FATAL, ZSTD_isError(written)) << "Could not " << name_ << " compress " << _len
+                                       << " bytes: " << ZSTD_getErrorName(written);
+  _out.resize(offset + written);
+}
+
+int CheckpointCodec::uncompressedSize(const char* _data, size_t _len, size_t& _size) {
+  unsigned long long size = ZSTD_getFrameContentSize(_data, _len);  // NOLINT
+  if (size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN) {
+    LOG(ERROR) << "No frame header in the " << _len << " bytes of compressed data";
+    return SP_NOTOK;
+  }
+  _size = size;
+  return SP_OK;
+}
+
+int CheckpointCodec::decompress(const char* _data, size_t _len, char* _dest, size_t _dest_len) {
+  size_t size = 0;
+  if (uncompressedSize(_data, _len, size) != SP_OK) {
+    return SP_NOTOK;
+  }
+  if (size != _dest_len) {
+    LOG(ERROR) << "Compressed data of " << size << " bytes does not fit " << _dest_len;
+    return SP_NOTOK;
+  }
+
+  size_t read = ZSTD_decompressDCtx(decompressContext(), _dest, _dest_len, _data, _len);
+  if (ZSTD_isError(read)) {
+    LOG(ERROR) << "Corrupt compressed data: " << ZSTD_getErrorName(read);
+    return SP_NOTOK;
+  }
+  if (read != _dest_len) {
+    LOG(ERROR) << "Compressed data decompressed to " << read << " bytes instead of "
+               << _dest_len;
+    return SP_NOTOK;
+  }
+  return SP_OK;
+}
+
+}  // namespace ckptmgr
+}  // namespace heron
@@ -0,0 +1,64 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if !defined(CHECKPOINT_CODEC_H)
+#define CHECKPOINT_CODEC_H
+
+#include <string>
+#include "basics/basics.h"
+
+namespace heron {
+namespace ckptmgr {
+
+// Compresses checkpoint data before it goes to storage.
+//
+// Compressed data is a Zstandard frame. The frame header records how large
+// the data was, so that it can be decompressed without knowing the codec
+// the topology is using now, and straight into a buffer of the right size.
+// The codecs are:
+//
+//   zstd-fast  zstd's fast levels, about as fast as LZ4, for states that
+//              are written often
+//   zstd       slower to compress but denser, and just as fast to decompress
+class CheckpointCodec {
+ public:
+  // compress at the zstd _level
+  CheckpointCodec(const std::string& _name, int _level) : name_(_name), level_(_level) {}
+
+  // get the codec with the name, or NULL if there is none
+  static const CheckpointCodec* get(const std::string& _name);
+
+  const std::string& name() const { return name_; }
+
+  // append the compressed _len bytes at _data to _out
+  void compress(const char* _data, size_t _len, std::string& _out) const;
+
+  // get the size that the compressed data at _data decompresses to
+  static int uncompressedSize(const char* _data, size_t _len, size_t& _size);
+
+  // decompress the compressed data at _data into _dest, which must be
+  // exactly as large as its uncompressed size
+  static int decompress(const char* _data, size_t _len, char* _dest, size_t _dest_len);
+
+ private:
+  std::string name_;
+  int level_;
+};
+
+}  // namespace ckptmgr
+}  // namespace heron
+
+#endif  // checkpoint-codec.h
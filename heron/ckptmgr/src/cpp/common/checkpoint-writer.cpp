@@ -0,0 +1,52 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common/checkpoint-writer.h"
+#include <string>
+#include "common/storage.h"
+
+namespace heron {
+namespace ckptmgr {
+
+BufferedCheckpointWriter::BufferedCheckpointWriter(Storage* _storage, const Checkpoint& _ckpt,
+                                                   size_t _state_size)
+    : storage_(_storage), topology_(_ckpt.getTopology()), state_size_(_state_size) {
+  checkpoint_.CopyFrom(*_ckpt.checkpoint());
+  checkpoint_.mutable_checkpoint()->mutable_state()->reserve(_state_size);
+}
+
+int BufferedCheckpointWriter::append(const char* _data, size_t _len) {
+  std::string* state = checkpoint_.mutable_checkpoint()->mutable_state();
+  if (state->size() + _len > state_size_) {
+    LOG(ERROR) << "Got more than the " << state_size_ << " bytes of state expected";
+    return SP_NOTOK;
+  }
+  state->append(_data, _len);
+  return SP_OK;
+}
+
+int BufferedCheckpointWriter::commit() {
+  if (checkpoint_.checkpoint().state().size() != state_size_) {
+    LOG(ERROR) << "Got " << checkpoint_.checkpoint().state().size() << " of the "
+               << state_size_ << " bytes of state expected";
+    return SP_NOTOK;
+  }
+  Checkpoint ckpt(topology_, &checkpoint_);
+  return storage_->store(ckpt);
+}
+
+}  // namespace ckptmgr
+}  // namespace heron
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if !defined(CHECKPOINT_WRITER_H)
+#define CHECKPOINT_WRITER_H
+
+#include <string>
+#include "basics/basics.h"
+#include "common/checkpoint.h"
+#include "proto/messages.h"
+
+namespace heron {
+namespace ckptmgr {
+
+class Storage;
+
+// Stores a checkpoint whose state arrives in pieces, in order. Destroying
+// the writer before commit abandons the checkpoint.
+class CheckpointWriter {
+ public:
+  CheckpointWriter() {}
+
+  virtual ~CheckpointWriter() {}
+
+  // add the next _len bytes of the state
+  virtual int append(const char* _data, size_t _len) = 0;
+
+  // store the checkpoint, once all of the state has been appended
+  virtual int commit() = 0;
+};
+
+// The writer for storages that can only store a checkpoint as a whole.
+// It keeps the state in memory till commit.
+class BufferedCheckpointWriter : public CheckpointWriter {
+ public:
+  BufferedCheckpointWriter(Storage* _storage, const Checkpoint& _ckpt, size_t _state_size);
+
+  virtual ~BufferedCheckpointWriter() {}
+
+  virtual int append(const char* _data, size_t _len);
+
+  virtual int commit();
+
+ private:
+  Storage* storage_;
+  std::string topology_;
+  ::heron::proto::ckptmgr::SaveInstanceStateRequest checkpoint_;
+  size_t state_size_;
+};
+
+}  // namespace ckptmgr
+}  // namespace heron
+
+#endif  // checkpoint-writer.h
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common/io-workers.h"
+#include <utility>
+
+namespace heron {
+namespace ckptmgr {
+
+IOWorkers::IOWorkers(EventLoop* _eventLoop, sp_int32 _num_threads)
+    : stopping_(false) {
+  CHECK_GT(_num_threads, 0);
+  piper_ = new Piper(_eventLoop);
+  for (sp_int32 i = 0; i < _num_threads; ++i) {
+    threads_.push_back(std::thread([this]() { Run(); }));
+  }
+}
+
+IOWorkers::~IOWorkers() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cond_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+  delete piper_;
+}
+
+void IOWorkers::Execute(std::function<sp_int32()> _work, VCallback<sp_int32> _done) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    work_.push_back(std::make_pair(std::move(_work), std::move(_done)));
+  }
+  cond_.notify_one();
+}
+
+void IOWorkers::Run() {
+  while (true) {
+    std::pair<std::function<sp_int32()>, VCallback<sp_int32>> work;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait(lock, [this]() { return stopping_ || !work_.empty(); });
+      if (work_.empty()) return;
+      work = std::move(work_.front());
+      work_.pop_front();
+    }
+
+    sp_int32 result = work.first();
+    VCallback<sp_int32> done = std::move(work.second);
+    piper_->ExecuteInEventLoop([done, result]() { done(result); });
+  }
+}
+
+}  // namespace ckptmgr
+}  // namespace heron
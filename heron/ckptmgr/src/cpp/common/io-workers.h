@@ -0,0 +1,66 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if !defined(CHECKPOINT_IO_WORKERS_H)
+#define CHECKPOINT_IO_WORKERS_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "basics/basics.h"
+#include "network/network.h"
+
+namespace heron {
+namespace ckptmgr {
+
+// A fixed number of threads that run blocking storage I/O on behalf of
+// an event loop. Work is picked up in the order it was submitted, so at
+// most num_threads of it is in progress at any time. When a piece of work
+// is done, its completion callback is run in the event loop thread.
+class IOWorkers {
+ public:
+  IOWorkers(EventLoop* _eventLoop, sp_int32 _num_threads);
+
+  // Finishes the work that was already submitted. Completion callbacks
+  // that have not run by then are dropped.
+  virtual ~IOWorkers();
+
+  // Run _work on one of the threads, and then _done with what it returned
+  // in the event loop thread
+  void Execute(std::function<sp_int32()> _work, VCallback<sp_int32> _done);
+
+  sp_int32 num_threads() const { return threads_.size(); }
+
+ private:
+  void Run();
+
+  Piper* piper_;
+  std::vector<std::thread> threads_;
+
+  std::deque<std::pair<std::function<sp_int32()>, VCallback<sp_int32>>> work_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool stopping_;
+};
+
+}  // namespace ckptmgr
+}  // namespace heron
+
+#endif  // io-workers.h
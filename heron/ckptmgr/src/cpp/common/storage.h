@@ -18,6 +18,11 @@
 #define CHECKPOINT_STORAGE_H
 
 #include <string>
+#include <utility>
+#include "common/checkpoint.h"
+#include "common/checkpoint-bytes.h"
+#include "common/checkpoint-writer.h"
+#include "common/io-workers.h"
 
 namespace heron {
 namespace ckptmgr {
@@ -31,8 +36,54 @@ class Storage {
   // store the checkpoint
   virtual int store(const Checkpoint& _ckpt) = 0;
 
+  // get a writer that stores the checkpoint as its state arrives in
+  // pieces. The state is left out of _ckpt, and is _state_size bytes. The
+  // caller owns the writer.
+  virtual CheckpointWriter* storeStream(const Checkpoint& _ckpt, size_t _state_size) {
+    return new BufferedCheckpointWriter(this, _ckpt, _state_size);
+  }
+
   // retrieve the checkpoint
   virtual int restore(Checkpoint& _ckpt) = 0;
+
+  // retrieve the serialized InstanceStateCheckpoint of the checkpoint into
+  // _bytes, without parsing it if the storage can help it. If it can't,
+  // _ckpt is left with the restored checkpoint like after restore.
+  virtual int restoreBytes(Checkpoint& _ckpt, CheckpointBytes& _bytes) {
+    int ret = restore(_ckpt);
+    if (ret == SP_OK) {
+      std::string* buf = _bytes.buffer();
+      _ckpt.checkpoint()->checkpoint().SerializeToString(buf);
+      _bytes.append(buf->data(), buf->size());
+    }
+    return ret;
+  }
+
+  // remove the checkpoints older than _oldest_ckpt, or all of them
+  virtual int dispose(const std::string& _oldest_ckpt, bool _clean_all) = 0;
+
+  // store the checkpoint on one of the _workers threads, and call _cb
+  // with what store returned once it is done. _ckpt must stay around
+  // till then.
+  virtual void storeAsync(const Checkpoint* _ckpt, IOWorkers* _workers, VCallback<int> _cb) {
+    _workers->Execute([this, _ckpt]() { return store(*_ckpt); }, std::move(_cb));
+  }
+
+  // retrieve the checkpoint on one of the _workers threads, and call _cb
+  // with what restore returned once it is done. _ckpt must stay around
+  // till then.
+  virtual void restoreAsync(Checkpoint* _ckpt, IOWorkers* _workers, VCallback<int> _cb) {
+    _workers->Execute([this, _ckpt]() { return restore(*_ckpt); }, std::move(_cb));
+  }
+
+  // dispose of old checkpoints on one of the _workers threads, and call
+  // _cb with what dispose returned once it is done
+  virtual void disposeAsync(const std::string& _oldest_ckpt, bool _clean_all,
+                            IOWorkers* _workers, VCallback<int> _cb) {
+    _workers->Execute([this, _oldest_ckpt, _clean_all]() {
+      return dispose(_oldest_ckpt, _clean_all);
+    }, std::move(_cb));
+  }
 };
 
 }  // namespace ckptmgr
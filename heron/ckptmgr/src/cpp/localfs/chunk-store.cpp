@@ -0,0 +1,313 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "localfs/chunk-store.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace heron {
+namespace ckptmgr {
+
+// Chunks are cut where the rolling hash has the top 16 bits clear, so they
+// are 64K on average, but never smaller or larger than these
+const size_t MIN_CHUNK_SIZE = 16 * 1024;
+const size_t MAX_CHUNK_SIZE = 256 * 1024;
+const sp_uint64 CHUNK_BOUNDARY_MASK = 0xffff000000000000ULL;
+
+namespace {
+
+// The random values that the gear rolling hash adds up for every byte
+struct GearTable {
+  GearTable() {
+    // splitmix64, so that the boundaries are the same on every run
+    sp_uint64 seed = 0x9e3779b97f4a7c15ULL;
+    for (int i = 0; i < 256; ++i) {
+      sp_uint64 z = (seed += 0x9e3779b97f4a7c15ULL);
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      values[i] = z ^ (z >> 31);
+    }
+  }
+  sp_uint64 values[256];
+};
+
+const GearTable gear;
+
+inline sp_uint64 rotl64(sp_uint64 x, int r) { return (x << r) | (x >> (64 - r)); }
+
+inline sp_uint64 fmix64(sp_uint64 k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+// MurmurHash3_x64_128
+void murmur3(const char* _data, size_t _len, sp_uint64& _h1, sp_uint64& _h2) {
+  const unsigned char* data = reinterpret_cast<const unsigned char*>(_data);
+  const size_t nblocks = _len / 16;
+  const sp_uint64 c1 = 0x87c37b91114253d5ULL;
+  const sp_uint64 c2 = 0x4cf5ad432745937fULL;
+  sp_uint64 h1 = 0;
+  sp_uint64 h2 = 0;
+
+  for (size_t i = 0; i < nblocks; ++i) {
+    sp_uint64 k1;
+    sp_uint64 k2;
+    memcpy(&k1, data + i * 16, 8);
+    memcpy(&k2, data + i * 16 + 8, 8);
+
+    k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+    h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+    k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+    h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+  }
+
+  const unsigned char* tail = data + nblocks * 16;
+  sp_uint64 k1 = 0;
+  sp_uint64 k2 = 0;
+  switch (_len & 15) {
+    case 15: k2 ^= sp_uint64(tail[14]) << 48;
+    case 14: k2 ^= sp_uint64(tail[13]) << 40;
+    case 13: k2 ^= sp_uint64(tail[12]) << 32;
+    case 12: k2 ^= sp_uint64(tail[11]) << 24;
+    case 11: k2 ^= sp_uint64(tail[10]) << 16;
+    case 10: k2 ^= sp_uint64(tail[9]) << 8;
+    case 9:  k2 ^= sp_uint64(tail[8]);
+             k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+    case 8:  k1 ^= sp_uint64(tail[7]) << 56;
+    case 7:  k1 ^= sp_uint64(tail[6]) << 48;
+    case 6:  k1 ^= sp_uint64(tail[5]) << 40;
+    case 5:  k1 ^= sp_uint64(tail[4]) << 32;
+    case 4:  k1 ^= sp_uint64(tail[3]) << 24;
+    case 3:  k1 ^= sp_uint64(tail[2]) << 16;
+    case 2:  k1 ^= sp_uint64(tail[1]) << 8;
+    case 1:  k1 ^= sp_uint64(tail[0]);
+             k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+  }
+
+  h1 ^= _len; h2 ^= _len;
+  h1 += h2; h2 += h1;
+  h1 = fmix64(h1); h2 = fmix64(h2);
+  h1 += h2; h2 += h1;
+  _h1 = h1;
+  _h2 = h2;
+}
+
+// Makes the names of partially written chunks unique across threads
+std::atomic<sp_uint64> temp_file_counter(0);
+
+}  // namespace
+
+ChunkStore::ChunkStore(const std::string& _directory, const CheckpointCodec* _codec)
+    : directory_(_directory), codec_(_codec) {}
+
+void ChunkStore::split(const char* _data, size_t _len, std::vector<size_t>& _ends) {
+  const unsigned char* data = reinterpret_cast<const unsigned char*>(_data);
+  size_t start = 0;
+  while (_len - start > MIN_CHUNK_SIZE) {
+    size_t limit = std::min(_len, start + MAX_CHUNK_SIZE);
+    size_t end = start + MIN_CHUNK_SIZE;
+    sp_uint64 h = 0;
+    for (; end < limit; ++end) {
+      h = (h << 1) + gear.values[data[end]];
+      if ((h & CHUNK_BOUNDARY_MASK) == 0) {
+        ++end;
+        break;
+      }
+    }
+    _ends.push_back(end);
+    start = end;
+  }
+  if (start < _len) {
+    _ends.push_back(_len);
+  }
+}
+
+std::string ChunkStore::hash(const char* _data, size_t _len) {
+  sp_uint64 h[2];
+  murmur3(_data, _len, h[0], h[1]);
+  static const char digits[] = "0123456789abcdef";
+  std::string name(32, '0');
+  for (int i = 0; i < 2; ++i) {
+    for (int j = 0; j < 16; ++j) {
+      name[i * 16 + j] = digits[(h[i] >> (60 - 4 * j)) & 0xf];
+    }
+  }
+  return name;
+}
+
+std::string ChunkStore::chunkFile(const std::string& _hash, const std::string& _codec) {
+  std::string path(directory_ + "/");
+  path.append(_hash, 0, 2).append("/").append(_hash);
+  if (!_codec.empty()) path.append(".").append(_codec);
+  return path;
+}
+
+int ChunkStore::put(const std::string& _hash, const char* _data, size_t _len,
+                    std::string& _codec, size_t& _written) {
+  _written = 0;
+  // Either form of the chunk will do
+  if (codec_) {
+    _codec = codec_->name();
+    if (::access(chunkFile(_hash, _codec).c_str(), F_OK) == 0) {
+      return SP_OK;
+    }
+  }
+  _codec.clear();
+  if (::access(chunkFile(_hash, _codec).c_str(), F_OK) == 0) {
+    return SP_OK;
+  }
+
+  if (codec_) {
+    std::string compressed;
+    codec_->compress(_data, _len, compressed);
+    if (compressed.size() < _len) {
+      _codec = codec_->name();
+      _written = compressed.size();
+      return writeChunk(_hash, chunkFile(_hash, _codec), compressed.data(), compressed.size());
+    }
+  }
+  _written = _len;
+  return writeChunk(_hash, chunkFile(_hash, _codec), _data, _len);
+}
+
+int ChunkStore::writeChunk(const std::string& _hash, const std::string& _path,
+                           const char* _data, size_t _len) {
+  std::string directory(directory_ + "/");
+  directory.append(_hash, 0, 2);
+  if (FileUtils::makePath(directory) != SP_OK) {
+    LOG(ERROR) << "Unable to create directory " << directory;
+    return SP_NOTOK;
+  }
+
+  // Another thread might be writing the same chunk, so write to a file of
+  // our own and rename it into place
+  std::string temp(directory + "/.");
+  temp.append(_hash).append(".").append(std::to_string(temp_file_counter++));
+  if (!FileUtils::writeSyncAll(temp, _data, _len) || !FileUtils::rename(temp, _path)) {
+    LOG(ERROR) << "Failed to store chunk " << _path;
+    return SP_NOTOK;
+  }
+  return SP_OK;
+}
+
+int ChunkStore::get(const std::string& _hash, const std::string& _codec, size_t _len,
+                    std::string& _buf) {
+  std::string path = chunkFile(_hash, _codec);
+  std::ifstream ifile(path, std::ifstream::in | std::ifstream::binary);
+  if (!ifile.is_open()) {
+    PLOG(ERROR) << "Failed to open chunk " << path;
+    return SP_NOTOK;
+  }
+
+  if (_codec.empty()) {
+    size_t offset = _buf.size();
+    _buf.resize(offset + _len);
+    if (!ifile.read(&_buf[offset], _len) ||
+        ifile.peek() != std::ifstream::traits_type::eof()) {
+      LOG(ERROR) << "Chunk " << path << " is not " << _len << " bytes long";
+      return SP_NOTOK;
+    }
+    return SP_OK;
+  }
+
+  std::string compressed((std::istreambuf_iterator<char>(ifile)),
+                         std::istreambuf_iterator<char>());
+  size_t offset = _buf.size();
+  _buf.resize(offset + _len);
+  if (CheckpointCodec::decompress(compressed.data(), compressed.size(), &_buf[offset], _len)
+      != SP_OK) {
+    LOG(ERROR) << "Failed to decompress chunk " << path;
+    return SP_NOTOK;
+  }
+  return SP_OK;
+}
+
+int ChunkStore::map(const std::string& _hash, size_t _len, void*& _addr) {
+  std::string path = chunkFile(_hash, "");
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    PLOG(ERROR) << "Failed to open chunk " << path;
+    return SP_NOTOK;
+  }
+
+  struct stat info;
+  if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) != _len || _len == 0) {
+    LOG(ERROR) << "Chunk " << path << " is not " << _len << " bytes long";
+    ::close(fd);
+    return SP_NOTOK;
+  }
+
+  _addr = ::mmap(NULL, _len, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (_addr == MAP_FAILED) {
+    PLOG(ERROR) << "Failed to map chunk " << path;
+    return SP_NOTOK;
+  }
+  // It is going to be read once, front to back
+  ::madvise(_addr, _len, MADV_SEQUENTIAL);
+  return SP_OK;
+}
+
+int ChunkStore::collect(const std::unordered_set<std::string>& _live) {
+  if (::access(directory_.c_str(), F_OK) != 0) {
+    return SP_OK;
+  }
+
+  std::vector<std::string> directories;
+  if (FileUtils::listFiles(directory_, directories) != SP_OK) {
+    return SP_NOTOK;
+  }
+
+  sp_int32 removed = 0;
+  for (auto& name : directories) {
+    std::string directory(directory_ + "/" + name);
+    std::vector<std::string> chunks;
+    if (FileUtils::listFiles(directory, chunks) != SP_OK) {
+      return SP_NOTOK;
+    }
+    // This also removes what a failed put left behind, whose names start
+    // with a dot
+    for (auto& chunk : chunks) {
+      if (_live.find(chunk.substr(0, chunk.find('.'))) == _live.end()) {
+        if (FileUtils::removeFile(directory + "/" + chunk) != SP_OK) {
+          return SP_NOTOK;
+        }
+        ++removed;
+      }
+    }
+  }
+
+  LOG(INFO) << "Removed " << removed << " chunks from " << directory_ << ", "
+            << _live.size() << " are still in use";
+  return SP_OK;
+}
+
+}  // namespace ckptmgr
+}  // namespace heron
@@ -0,0 +1,87 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if !defined(LOCAL_FILE_SYSTEM_CHUNK_STORE_H)
+#define LOCAL_FILE_SYSTEM_CHUNK_STORE_H
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "basics/basics.h"
+#include "common/checkpoint-codec.h"
+
+namespace heron {
+namespace ckptmgr {
+
+// A content addressed store of checkpoint chunks under a directory.
+//
+// Checkpoints are split at content defined boundaries, so that a change
+// to part of a large state only changes the chunks around it. Every chunk
+// is named by the hash of its contents, and is only written if no earlier
+// checkpoint had it already.
+//
+// Chunks are compressed with the codec, if there is one, unless that does
+// not make them smaller. A compressed chunk is kept in a file of its own,
+// named by the hash and the codec, so that what was stored without it
+// stays as it is.
+class ChunkStore {
+ public:
+  ChunkStore(const std::string& _directory, const CheckpointCodec* _codec);
+
+  ~ChunkStore() {}
+
+  // split the data into content defined chunks, appending the end offset
+  // of every chunk to _ends
+  static void split(const char* _data, size_t _len, std::vector<size_t>& _ends);
+
+  // get the name of a chunk with these contents
+  static std::string hash(const char* _data, size_t _len);
+
+  // store the chunk, unless it is there already, compressed or not.
+  // _codec is set to the codec it is compressed with, or cleared, and
+  // _written to the bytes written for it, which is 0 if it was there.
+  int put(const std::string& _hash, const char* _data, size_t _len, std::string& _codec,
+          size_t& _written);
+
+  // append the _len bytes of contents of the chunk to _buf
+  int get(const std::string& _hash, const std::string& _codec, size_t _len,
+          std::string& _buf);
+
+  // map the uncompressed chunk read only into memory at _addr. The caller
+  // unmaps it.
+  int map(const std::string& _hash, size_t _len, void*& _addr);
+
+  // remove every chunk whose hash is not in _live. Must not run alongside
+  // put.
+  int collect(const std::unordered_set<std::string>& _live);
+
+ private:
+  // get the name of the file the chunk is kept in
+  std::string chunkFile(const std::string& _hash, const std::string& _codec);
+
+  // write the chunk file, going through a file of our own
+  int writeChunk(const std::string& _hash, const std::string& _path, const char* _data,
+                 size_t _len);
+
+  std::string directory_;
+  const CheckpointCodec* codec_;
+};
+
+}  // namespace ckptmgr
+}  // namespace heron
+
+#endif  // chunk-store.h
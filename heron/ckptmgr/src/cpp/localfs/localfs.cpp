@@ -16,23 +16,63 @@
 
 #include "localfs/localfs.h"
 #include <fcntl.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/wire_format_lite.h>
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <unordered_set>
+#include <vector>
 
+#include "common/checkpoint-codec.h"
 #include "config/config.h"
+#include "config/environ-vars.h"
 #include "localfs/localfs-config-vars.h"
 
 namespace heron {
 namespace ckptmgr {
 
-LocalFS::LocalFS(const heron::config::Config& _config) {
+// The directory under the root that holds the chunks. It sorts before any
+// checkpoint id, and is not one itself.
+const char CHUNKS_DIRECTORY[] = ".chunks";
+
+namespace {
+
+// get the codec to compress chunks with, or NULL to store them as they are
+const CheckpointCodec* GetCodec(const heron::config::Config& _config) {
+  std::string name = _config.getstr(heron::config::StatefulConfigVars::STORAGE_CODEC);
+  if (name.empty() || name == "none") {
+    return NULL;
+  }
+  const CheckpointCodec* codec = CheckpointCodec::get(name);
+  LOG_IF(FATAL, codec == NULL) << "Unknown checkpoint codec " << name;
+  return codec;
+}
+
+// get the directory of the topology under the root, which is all that
+// it stores and removes, as the root may be shared with other topologies
+std::string GetTopologyDirectory(const heron::config::Config& _config) {
+  std::string root = _config.getstr(LocalfsConfigVars::ROOT_DIR);
+  LOG_IF(FATAL, root.empty()) << "Local File System root directory not set";
+  std::string topology = _config.getstr(heron::config::EnvironVars::TOPOLOGY_NAME);
+  LOG_IF(FATAL, topology.empty()) << "Topology name not set";
+  return root + "/" + topology;
+}
+
+}  // namespace
+
+LocalFS::LocalFS(const heron::config::Config& _config)
+    : base_dir_(GetTopologyDirectory(_config)),
+      chunks_(base_dir_ + "/" + CHUNKS_DIRECTORY, GetCodec(_config)),
+      num_storing_(0),
+      disposing_(false) {
   std::string stype = _config.getstr(heron::config::StatefulConfigVars::STORAGE_TYPE);
   CHECK_EQ(storage_type(), stype);
 
-  // get the root directory for storing checkpoints
-  base_dir_ = _config.getstr(LocalfsConfigVars::ROOT_DIR);
-  LOG_IF(FATAL, base_dir_.empty()) << "Local File System root directory not set";
+  const CheckpointCodec* codec = GetCodec(_config);
+  LOG(INFO) << "Storing checkpoints under " << base_dir_ << " "
+            << (codec ? "compressed with " + codec->name() : "uncompressed");
 }
 
 std::string LocalFS::ckptDirectory(const Checkpoint& _ckpt) {
@@ -69,7 +109,28 @@ int LocalFS::createCkptDirectory(const Checkpoint& _ckpt) {
   return SP_OK;
 }
 
+void LocalFS::beginStore() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cond_.wait(lock, [this]() { return !disposing_; });
+  ++num_storing_;
+}
+
+void LocalFS::endStore() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    --num_storing_;
+  }
+  cond_.notify_all();
+}
+
 int LocalFS::store(const Checkpoint& _ckpt) {
+  beginStore();
+  int ret = storeChunks(_ckpt);
+  endStore();
+  return ret;
+}
+
+int LocalFS::storeChunks(const Checkpoint& _ckpt) {
   std::string path = ckptFile(_ckpt);
   // create the checkpoint directory, if not there
   if (createCkptDirectory(_ckpt) == SP_NOTOK) {
@@ -78,20 +139,184 @@ int LocalFS::store(const Checkpoint& _ckpt) {
     return SP_NOTOK;
   }
 
-  // write the contents atomically to file
-  size_t len = _ckpt.nbytes();
   std::string buf;
   _ckpt.checkpoint()->SerializeToString(&buf);
 
-  if (!FileUtils::writeAtomicAll(path, buf.c_str(), len)) {
+  // store the chunks that earlier checkpoints did not have already
+  std::vector<size_t> ends;
+  ChunkStore::split(buf.data(), buf.size(), ends);
+  ::heron::proto::ckptmgr::CheckpointManifest manifest;
+  size_t written = 0;
+  if (putChunks(buf.data(), ends, manifest, written, NULL) != SP_OK) {
+    LOG(ERROR) << "Failed to store chunk for " << logMessageFragment(_ckpt);
+    return SP_NOTOK;
+  }
+
+  // write the manifest atomically to file, once all of its chunks are there
+  if (writeManifest(path, manifest) != SP_OK) {
     LOG(ERROR) << "Failed to checkpoint " << path << " for " << logMessageFragment(_ckpt);
     return SP_NOTOK;
   }
 
+  LOG(INFO) << "Wrote " << written << " bytes for the " << buf.size() << " bytes in "
+            << manifest.chunks_size() << " chunks for " << logMessageFragment(_ckpt);
   return SP_OK;
 }
 
-int LocalFS::restore(Checkpoint& _ckpt) {
+int LocalFS::putChunks(const char* _data, const std::vector<size_t>& _ends,
+                       ::heron::proto::ckptmgr::CheckpointManifest& _manifest, size_t& _written,
+                       std::vector<std::string>* _pinned) {
+  size_t start = 0;
+  for (size_t end : _ends) {
+    auto chunk = _manifest.add_chunks();
+    chunk->set_hash(ChunkStore::hash(_data + start, end - start));
+    chunk->set_size(end - start);
+    if (_pinned) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pinned_.insert(chunk->hash());
+      _pinned->push_back(chunk->hash());
+    }
+    std::string codec;
+    size_t written = 0;
+    if (chunks_.put(chunk->hash(), _data + start, end - start, codec, written) != SP_OK) {
+      return SP_NOTOK;
+    }
+    if (!codec.empty()) chunk->set_codec(codec);
+    _written += written;
+    start = end;
+  }
+  return SP_OK;
+}
+
+void LocalFS::unpinChunks(const std::vector<std::string>& _pinned) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& hash : _pinned) {
+    pinned_.erase(pinned_.find(hash));
+  }
+}
+
+int LocalFS::writeManifest(const std::string& _path,
+                           const ::heron::proto::ckptmgr::CheckpointManifest& _manifest) {
+  std::string buf;
+  _manifest.SerializeToString(&buf);
+  return FileUtils::writeAtomicAll(_path, buf.data(), buf.size()) ? SP_OK : SP_NOTOK;
+}
+
+// Splits the SaveInstanceStateRequest into chunks as its state arrives.
+// The chunks come out the same as if it had been stored as a whole, so
+// they dedup against earlier checkpoints just the same.
+class LocalFS::StreamWriter : public CheckpointWriter {
+ public:
+  StreamWriter(LocalFS* _localfs, const Checkpoint& _ckpt, size_t _state_size)
+      : localfs_(_localfs),
+        directory_(_localfs->ckptDirectory(_ckpt)),
+        path_(_localfs->ckptFile(_ckpt)),
+        log_fragment_(_localfs->logMessageFragment(_ckpt)),
+        state_left_(_state_size),
+        total_(0),
+        written_(0) {
+    using google::protobuf::io::CodedOutputStream;
+    using google::protobuf::internal::WireFormatLite;
+
+    // The state is the last field of the checkpoint, which is the last
+    // field of the request, so all that comes before it is known already
+    ::heron::proto::ckptmgr::SaveInstanceStateRequest request;
+    request.mutable_instance()->CopyFrom(_ckpt.checkpoint()->instance());
+    ::heron::proto::ckptmgr::InstanceStateCheckpoint checkpoint;
+    checkpoint.set_checkpoint_id(_ckpt.getCkptId());
+    const sp_uint32 state_tag = WireFormatLite::MakeTag(
+        ::heron::proto::ckptmgr::InstanceStateCheckpoint::kStateFieldNumber,
+        WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+    sp_uint64 checkpoint_size = checkpoint.ByteSize() + CodedOutputStream::VarintSize32(state_tag) +
+                                CodedOutputStream::VarintSize64(_state_size) + _state_size;
+    {
+      google::protobuf::io::StringOutputStream output(&pending_);
+      CodedOutputStream coded(&output);
+      request.SerializePartialToCodedStream(&coded);
+      coded.WriteTag(WireFormatLite::MakeTag(
+          ::heron::proto::ckptmgr::SaveInstanceStateRequest::kCheckpointFieldNumber,
+          WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+      coded.WriteVarint64(checkpoint_size);
+      checkpoint.SerializePartialToCodedStream(&coded);
+      coded.WriteTag(state_tag);
+      coded.WriteVarint64(_state_size);
+    }
+    total_ = pending_.size() + _state_size;
+  }
+
+  virtual ~StreamWriter() {
+    localfs_->unpinChunks(pinned_);
+  }
+
+  virtual int append(const char* _data, size_t _len) {
+    if (_len > state_left_) {
+      LOG(ERROR) << "Got more state than expected for " << log_fragment_;
+      return SP_NOTOK;
+    }
+    pending_.append(_data, _len);
+    state_left_ -= _len;
+    return putPending(false);
+  }
+
+  virtual int commit() {
+    if (state_left_ > 0) {
+      LOG(ERROR) << "Missing " << state_left_ << " bytes of state for " << log_fragment_;
+      return SP_NOTOK;
+    }
+    if (putPending(true) != SP_OK) {
+      return SP_NOTOK;
+    }
+
+    if (FileUtils::makePath(directory_) != SP_OK ||
+        localfs_->writeManifest(path_, manifest_) != SP_OK) {
+      LOG(ERROR) << "Failed to checkpoint " << path_ << " for " << log_fragment_;
+      return SP_NOTOK;
+    }
+
+    LOG(INFO) << "Wrote " << written_ << " bytes for the " << total_ << " bytes in "
+              << manifest_.chunks_size() << " chunks for " << log_fragment_;
+    return SP_OK;
+  }
+
+ private:
+  // store the chunks in pending_ that can't change anymore, or all of them
+  int putPending(bool _all) {
+    std::vector<size_t> ends;
+    ChunkStore::split(pending_.data(), pending_.size(), ends);
+    // The last chunk might go on in what is still to come
+    if (!_all && !ends.empty()) ends.pop_back();
+    if (ends.empty()) return SP_OK;
+
+    localfs_->beginStore();
+    int ret = localfs_->putChunks(pending_.data(), ends, manifest_, written_, &pinned_);
+    localfs_->endStore();
+    if (ret != SP_OK) {
+      LOG(ERROR) << "Failed to store chunk for " << log_fragment_;
+      return SP_NOTOK;
+    }
+    pending_.erase(0, ends.back());
+    return SP_OK;
+  }
+
+  LocalFS* localfs_;
+  std::string directory_;
+  std::string path_;
+  std::string log_fragment_;
+  // what has not been split into chunks yet
+  std::string pending_;
+  size_t state_left_;
+  size_t total_;
+  size_t written_;
+  ::heron::proto::ckptmgr::CheckpointManifest manifest_;
+  std::vector<std::string> pinned_;
+};
+
+CheckpointWriter* LocalFS::storeStream(const Checkpoint& _ckpt, size_t _state_size) {
+  return new StreamWriter(this, _ckpt, _state_size);
+}
+
+int LocalFS::readManifest(const Checkpoint& _ckpt,
+                          ::heron::proto::ckptmgr::CheckpointManifest& _manifest) {
   std::string path = ckptFile(_ckpt);
 
   // open the checkpoint file
@@ -102,19 +327,171 @@ int LocalFS::restore(Checkpoint& _ckpt) {
     return SP_NOTOK;
   }
 
-  // read the protobuf from checkpoint file
+  // read the manifest from checkpoint file
+  if (!_manifest.ParseFromIstream(&ifile)) {
+    LOG(ERROR) << "Failed to read checkpoint manifest from " << path
+      << " for "<< logMessageFragment(_ckpt);
+    return SP_NOTOK;
+  }
+  return SP_OK;
+}
+
+int LocalFS::restore(Checkpoint& _ckpt) {
+  std::string path = ckptFile(_ckpt);
+  ::heron::proto::ckptmgr::CheckpointManifest manifest;
+  if (readManifest(_ckpt, manifest) != SP_OK) {
+    return SP_NOTOK;
+  }
+
+  // put the chunks back together
+  size_t nbytes = 0;
+  for (auto& chunk : manifest.chunks()) {
+    nbytes += chunk.size();
+  }
+  std::string buf;
+  buf.reserve(nbytes);
+  for (auto& chunk : manifest.chunks()) {
+    if (chunks_.get(chunk.hash(), chunk.codec(), chunk.size(), buf) != SP_OK) {
+      LOG(ERROR) << "Failed to restore checkpoint from " << path
+        << " for "<< logMessageFragment(_ckpt);
+      return SP_NOTOK;
+    }
+  }
+
   auto savedbytes = new ::heron::proto::ckptmgr::SaveInstanceStateRequest;
-  if (!savedbytes->ParseFromIstream(&ifile)) {
+  if (!savedbytes->ParseFromString(buf)) {
     LOG(ERROR) << "Failed to restore checkpoint from " << path
       << " for "<< logMessageFragment(_ckpt);
+    delete savedbytes;
     return SP_NOTOK;
   }
 
   // pass the retrieved bytes to checkpoint
   _ckpt.set_checkpoint(savedbytes);
+  return SP_OK;
+}
 
-  // close the checkpoint file
-  ifile.close();
+int LocalFS::restoreBytes(Checkpoint& _ckpt, CheckpointBytes& _bytes) {
+  ::heron::proto::ckptmgr::CheckpointManifest manifest;
+  if (readManifest(_ckpt, manifest) != SP_OK) {
+    return SP_NOTOK;
+  }
+
+  // Map all the chunks. _bytes takes care of unmapping them. Compressed
+  // ones are decompressed into buffers that _bytes keeps instead.
+  for (auto& chunk : manifest.chunks()) {
+    if (chunk.has_codec()) {
+      std::string* buffer = _bytes.buffer();
+      if (chunks_.get(chunk.hash(), chunk.codec(), chunk.size(), *buffer) != SP_OK) {
+        LOG(ERROR) << "Failed to restore checkpoint for " << logMessageFragment(_ckpt);
+        return SP_NOTOK;
+      }
+      _bytes.append(buffer->data(), buffer->size());
+      continue;
+    }
+    void* addr = NULL;
+    if (chunks_.map(chunk.hash(), chunk.size(), addr) != SP_OK) {
+      LOG(ERROR) << "Failed to restore checkpoint for " << logMessageFragment(_ckpt);
+      return SP_NOTOK;
+    }
+    _bytes.append(static_cast<const char*>(addr), chunk.size(),
+                  _bytes.map(addr, chunk.size()));
+  }
+
+  // Keep the checkpoint field of the SaveInstanceStateRequest
+  if (_bytes.narrow(::heron::proto::ckptmgr::SaveInstanceStateRequest::kCheckpointFieldNumber)
+      != SP_OK) {
+    LOG(ERROR) << "No checkpoint found in the chunks of " << logMessageFragment(_ckpt);
+    return SP_NOTOK;
+  }
+  return SP_OK;
+}
+
+int LocalFS::dispose(const std::string& _oldest_ckpt, bool _clean_all) {
+  // wait for the stores in progress, and hold off new ones
+  std::unordered_set<std::string> live;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this]() { return !disposing_; });
+    disposing_ = true;
+    cond_.wait(lock, [this]() { return num_storing_ == 0; });
+    live.insert(pinned_.begin(), pinned_.end());
+  }
+
+  int ret = SP_OK;
+  if (::access(base_dir_.c_str(), F_OK) != 0) {
+    LOG(INFO) << "No checkpoints under " << base_dir_ << " to remove";
+  } else if (_clean_all && live.empty()) {
+    LOG(INFO) << "Removing all checkpoints under " << base_dir_;
+    ret = FileUtils::removeRecursive(base_dir_, false);
+  } else {
+    // keep the chunks that stream writers still need
+    LOG(INFO) << "Removing checkpoints older than "
+              << (_clean_all ? "now" : _oldest_ckpt) << " under " << base_dir_;
+    if (removeCkptDirectories(_clean_all ? "" : _oldest_ckpt, _clean_all) != SP_OK ||
+        (!_clean_all && liveChunks(live) != SP_OK) || chunks_.collect(live) != SP_OK) {
+      ret = SP_NOTOK;
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    disposing_ = false;
+  }
+  cond_.notify_all();
+  return ret;
+}
+
+int LocalFS::removeCkptDirectories(const std::string& _oldest_ckpt, bool _all) {
+  std::vector<std::string> ckpts;
+  if (FileUtils::listFiles(base_dir_, ckpts) != SP_OK) {
+    return SP_NOTOK;
+  }
+
+  for (auto& ckpt : ckpts) {
+    if (ckpt != CHUNKS_DIRECTORY && (_all || ckpt < _oldest_ckpt)) {
+      if (FileUtils::removeRecursive(base_dir_ + "/" + ckpt, true) != SP_OK) {
+        return SP_NOTOK;
+      }
+    }
+  }
+  return SP_OK;
+}
+
+int LocalFS::liveChunks(std::unordered_set<std::string>& _live) {
+  std::vector<std::string> ckpts;
+  if (FileUtils::listFiles(base_dir_, ckpts) != SP_OK) {
+    return SP_NOTOK;
+  }
+
+  for (auto& ckpt : ckpts) {
+    if (ckpt == CHUNKS_DIRECTORY) continue;
+    std::string ckpt_dir(base_dir_ + "/" + ckpt);
+    std::vector<std::string> components;
+    if (FileUtils::listFiles(ckpt_dir, components) != SP_OK) {
+      return SP_NOTOK;
+    }
+    for (auto& component : components) {
+      std::string component_dir(ckpt_dir + "/" + component);
+      std::vector<std::string> tasks;
+      if (FileUtils::listFiles(component_dir, tasks) != SP_OK) {
+        return SP_NOTOK;
+      }
+      for (auto& task : tasks) {
+        // skip what a failed store left behind
+        if (task[0] == '.') continue;
+        std::string path(component_dir + "/" + task);
+        ::heron::proto::ckptmgr::CheckpointManifest manifest;
+        if (!manifest.ParseFromString(FileUtils::readAll(path))) {
+          LOG(ERROR) << "Failed to read checkpoint manifest from " << path;
+          return SP_NOTOK;
+        }
+        for (auto& chunk : manifest.chunks()) {
+          _live.insert(chunk.hash());
+        }
+      }
+    }
+  }
   return SP_OK;
 }
 
@@ -18,11 +18,16 @@
 #define LOCAL_FILE_SYSTEM_H
 
 #include <unistd.h>
+#include <condition_variable>
+#include <mutex>
 #include <string>
+#include <unordered_set>
+#include <vector>
 
 #include "common/checkpoint.h"
 #include "common/storage.h"
 #include "config/config.h"
+#include "localfs/chunk-store.h"
 
 namespace heron {
 namespace ckptmgr {
@@ -42,10 +47,23 @@ class LocalFS : public Storage {
   // store the checkpoint
   virtual int store(const Checkpoint& _ckpt);
 
+  // get a writer that stores the chunks of the checkpoint as they fill up
+  virtual CheckpointWriter* storeStream(const Checkpoint& _ckpt, size_t _state_size);
+
   // retrieve the checkpoint
   virtual int restore(Checkpoint& _ckpt);
 
+  // map the chunks of the checkpoint, and hand out the part of them that
+  // holds the serialized InstanceStateCheckpoint
+  virtual int restoreBytes(Checkpoint& _ckpt, CheckpointBytes& _bytes);
+
+  // remove the checkpoints older than _oldest_ckpt, or all of them, along
+  // with the chunks that only they used
+  virtual int dispose(const std::string& _oldest_ckpt, bool _clean_all);
+
  private:
+  class StreamWriter;
+
   // get the name of the checkpoint directory
   std::string ckptDirectory(const Checkpoint& _ckpt);
 
@@ -58,12 +76,58 @@ class LocalFS : public Storage {
   // create the checkpoint directory
   int createCkptDirectory(const Checkpoint& _ckpt);
 
+  // read the manifest of the checkpoint
+  int readManifest(const Checkpoint& _ckpt, ::heron::proto::ckptmgr::CheckpointManifest& _manifest);
+
+  // store the checkpoint as a manifest of chunks
+  int storeChunks(const Checkpoint& _ckpt);
+
+  // wait till no dispose is running, and keep new ones from starting till
+  // endStore
+  void beginStore();
+  void endStore();
+
+  // store the chunks of _data that end at _ends, and add them to _manifest.
+  // _written adds up the bytes written for the chunks that no earlier
+  // checkpoint had. If _pinned is given, the chunks are pinned first and
+  // added to it.
+  int putChunks(const char* _data, const std::vector<size_t>& _ends,
+                ::heron::proto::ckptmgr::CheckpointManifest& _manifest, size_t& _written,
+                std::vector<std::string>* _pinned);
+
+  // unpin the chunks that a stream writer pinned
+  void unpinChunks(const std::vector<std::string>& _pinned);
+
+  // write the manifest atomically to _path
+  int writeManifest(const std::string& _path,
+                    const ::heron::proto::ckptmgr::CheckpointManifest& _manifest);
+
+  // remove the checkpoint directories older than _oldest_ckpt, or all of them
+  int removeCkptDirectories(const std::string& _oldest_ckpt, bool _all);
+
+  // add the chunks used by the remaining checkpoints to _live
+  int liveChunks(std::unordered_set<std::string>& _live);
+
  private:
   // generate the log message prefix/suffix for printing
   std::string logMessageFragment(const Checkpoint& _ckpt);
 
  private:
+  // the directory of the topology under the root
   std::string   base_dir_;
+
+  // where the contents of all checkpoints are kept
+  ChunkStore    chunks_;
+
+  // dispose must not drop chunks that a store in progress relies on, so
+  // the two never run at the same time. A stream writer only stores now
+  // and then, so it pins its chunks till its manifest is there, to keep
+  // dispose from dropping them in between.
+  std::mutex    mutex_;
+  std::condition_variable cond_;
+  sp_int32      num_storing_;
+  bool          disposing_;
+  std::unordered_multiset<std::string> pinned_;
 };
 
 }  // namespace ckptmgr
@@ -15,11 +15,65 @@
  */
 
 #include "manager/ckptmgr-server.h"
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+#include <algorithm>
+#include <deque>
 #include <iostream>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace heron {
 namespace ckptmgr {
 
+// A state that a stmgr saves or restores in chunks. The chunks are queued
+// as they arrive, and stored or retrieved one at a time on the workers.
+struct CkptMgrServer::StateTransfer {
+  struct Chunk {
+    REQID id_;
+    sp_int64 offset_;
+    std::string data_;  // what a save stores, or what a restore retrieved
+    sp_int32 size_;     // how much a restore retrieves
+  };
+
+  StateTransfer(Connection* _conn, const std::string& _key,
+                const proto::system::Instance& _instance, const std::string& _checkpoint_id,
+                sp_int64 _state_size)
+      : conn_(_conn), key_(_key), checkpoint_id_(_checkpoint_id), state_size_(_state_size),
+        next_offset_(0), checkpoint_(nullptr), writer_(nullptr), bytes_(nullptr),
+        busy_(false), dropped_(false) {
+    instance_.CopyFrom(_instance);
+  }
+
+  ~StateTransfer() {
+    delete writer_;
+    delete bytes_;
+    delete checkpoint_;
+  }
+
+  bool save() const { return writer_ != nullptr; }
+
+  Connection* conn_;
+  std::string key_;
+  proto::system::Instance instance_;
+  std::string checkpoint_id_;
+  sp_int64 state_size_;
+  // where the next chunk to arrive has to start
+  sp_int64 next_offset_;
+  // what a save stores besides the state
+  proto::ckptmgr::SaveInstanceStateRequest head_;
+  Checkpoint* checkpoint_;
+  CheckpointWriter* writer_;  // set for a save
+  CheckpointBytes* bytes_;    // set for a restore
+  std::deque<Chunk> chunks_;
+  // the chunk at the head of the queue is on the workers
+  bool busy_;
+  // delete it once the workers are done with it
+  bool dropped_;
+};
+
 CkptMgrServer::CkptMgrServer(EventLoop* eventloop, const NetworkOptions& _options,
                              const sp_string& _topology_name, const sp_string& _topology_id,
                              const sp_string& _ckptmgr_id, CkptMgr* _ckptmgr)
@@ -32,12 +86,22 @@ CkptMgrServer::CkptMgrServer(EventLoop* eventloop, const NetworkOptions& _option
 
     // handlers
     InstallRequestHandler(&CkptMgrServer::HandleStMgrRegisterRequest);
+    InstallRequestHandler(&CkptMgrServer::HandleTMasterRegisterRequest);
+    InstallRequestHandler(&CkptMgrServer::HandleCleanStatefulCheckpointRequest);
     InstallRequestHandler(&CkptMgrServer::HandleSaveInstanceStateRequest);
     InstallRequestHandler(&CkptMgrServer::HandleGetInstanceStateRequest);
+    InstallRequestHandler(&CkptMgrServer::HandleSaveInstanceStateChunkRequest);
+    InstallRequestHandler(&CkptMgrServer::HandleGetInstanceStateChunkRequest);
 }
 
 CkptMgrServer::~CkptMgrServer() {
   Stop();
+  // The workers might still have a chunk of some
+  for (StateTransferMap* transfers : {&saves_, &restores_}) {
+    for (auto& transfer : *transfers) {
+      if (!transfer.second->busy_) delete transfer.second;
+    }
+  }
 }
 
 void CkptMgrServer::HandleNewConnection(Connection* _conn) {
@@ -49,6 +113,24 @@ void CkptMgrServer::HandleNewConnection(Connection* _conn) {
 void CkptMgrServer::HandleConnectionClose(Connection* _conn, NetworkErrorCode) {
   LOG(INFO) << "Got connection close of " << _conn << " from " << _conn->getIPAddress() << ":"
             << _conn->getPort();
+
+  // The restores still on the workers are not to respond on it
+  for (PendingRestore* restore : pending_restores_) {
+    if (restore->conn_ == _conn) restore->conn_ = NULL;
+  }
+
+  // Drop the transfers of the connection, without responding on it
+  for (StateTransferMap* transfers : {&saves_, &restores_}) {
+    std::vector<StateTransfer*> dropped;
+    for (auto& transfer : *transfers) {
+      if (transfer.second->conn_ == _conn) dropped.push_back(transfer.second);
+    }
+    for (StateTransfer* transfer : dropped) {
+      LOG(INFO) << "Dropping the transfer of the state for " << transfer->key_;
+      transfer->conn_ = NULL;
+      DropTransfer(*transfers, transfer);
+    }
+  }
 }
 
 void CkptMgrServer::HandleStMgrRegisterRequest(REQID _id, Connection* _conn,
@@ -76,6 +158,30 @@ void CkptMgrServer::HandleStMgrRegisterRequest(REQID _id, Connection* _conn,
   } else {
     stmgr_conn_ = _conn;
     response->mutable_status()->set_status(proto::system::OK);
+    response->set_takes_state_chunks(true);
+  }
+
+  SendResponse(_id, _conn, *response);
+  __global_protobuf_pool_release__(response);
+  __global_protobuf_pool_release__(_req);
+}
+
+void CkptMgrServer::HandleTMasterRegisterRequest(REQID _id, Connection* _conn,
+                                            proto::ckptmgr::RegisterTMasterRequest* _req) {
+  LOG(INFO) << "Got a register message from tmaster on connection " << _conn;
+
+  proto::ckptmgr::RegisterTMasterResponse* response = nullptr;
+  response = __global_protobuf_pool_acquire__(response);
+
+  if (_req->topology_name() != topology_name_) {
+    LOG(ERROR) << "The register message was from a different topology " << _req->topology_name();
+    response->mutable_status()->set_status(proto::system::NOTOK);
+  } else if (_req->topology_id() != topology_id_) {
+    LOG(ERROR) << "The register message was from a different topology id "
+               << _req->topology_id();
+    response->mutable_status()->set_status(proto::system::NOTOK);
+  } else {
+    response->mutable_status()->set_status(proto::system::OK);
   }
 
   SendResponse(_id, _conn, *response);
@@ -83,18 +189,55 @@ void CkptMgrServer::HandleStMgrRegisterRequest(REQID _id, Connection* _conn,
   __global_protobuf_pool_release__(_req);
 }
 
+void CkptMgrServer::HandleCleanStatefulCheckpointRequest(REQID _id, Connection* _conn,
+                                heron::proto::ckptmgr::CleanStatefulCheckpointRequest* _req) {
+  LOG(INFO) << "Got a clean request with oldest checkpoint " << _req->oldest_checkpoint_preserved()
+            << " and clean all " << _req->clean_all_checkpoints() << " on connection " << _conn;
+
+  ckptmgr_->storage()->disposeAsync(_req->oldest_checkpoint_preserved(),
+      _req->clean_all_checkpoints(), ckptmgr_->io_workers(), [this, _id, _conn](int _ret) {
+    HandleCleanStatefulCheckpointDone(_id, _conn, _ret);
+  });
+  __global_protobuf_pool_release__(_req);
+}
+
+void CkptMgrServer::HandleCleanStatefulCheckpointDone(REQID _id, Connection* _conn, int _ret) {
+  heron::proto::ckptmgr::CleanStatefulCheckpointResponse* response = nullptr;
+  response = __global_protobuf_pool_acquire__(response);
+  if (_ret == SP_OK) {
+    LOG(INFO) << "Dispose checkpoint successful";
+    response->mutable_status()->set_status(proto::system::OK);
+  } else {
+    LOG(INFO) << "Dispose checkpoint not successful";
+    response->mutable_status()->set_status(proto::system::NOTOK);
+  }
+
+  SendResponse(_id, _conn, *response);
+  __global_protobuf_pool_release__(response);
+}
+
 void CkptMgrServer::HandleSaveInstanceStateRequest(REQID _id, Connection* _conn,
                                         heron::proto::ckptmgr::SaveInstanceStateRequest* _req) {
-  Checkpoint checkpoint(topology_name_, _req);
-  LOG(INFO) << "Got a save checkpoint for " << checkpoint.getCkptId() << " "
-            << checkpoint.getComponent() << " " << checkpoint.getInstance() << " "
+  Checkpoint* checkpoint = new Checkpoint(topology_name_, _req);
+  LOG(INFO) << "Got a save checkpoint for " << checkpoint->getCkptId() << " "
+            << checkpoint->getComponent() << " " << checkpoint->getInstance() << " "
             << "on connection " << _conn;
 
-  auto ret = ckptmgr_->storage()->store(checkpoint);
+  // Store it off the event loop, so that a large state does not hold up
+  // the other requests
+  ckptmgr_->storage()->storeAsync(checkpoint, ckptmgr_->io_workers(),
+      [this, _id, _conn, _req, checkpoint](int _ret) {
+    HandleSaveInstanceStateDone(_id, _conn, _req, checkpoint, _ret);
+  });
+}
+
+void CkptMgrServer::HandleSaveInstanceStateDone(REQID _id, Connection* _conn,
+                                        heron::proto::ckptmgr::SaveInstanceStateRequest* _req,
+                                        Checkpoint* _checkpoint, int _ret) {
   proto::system::StatusCode status;
-  if (ret != SP_OK) {
-    LOG(ERROR) << "Checkpoint failed for " << checkpoint.getCkptId() << " "
-            << checkpoint.getComponent() << " " << checkpoint.getInstance();
+  if (_ret != SP_OK) {
+    LOG(ERROR) << "Checkpoint failed for " << _checkpoint->getCkptId() << " "
+            << _checkpoint->getComponent() << " " << _checkpoint->getInstance();
     status = proto::system::NOTOK;
   } else {
     status = proto::system::OK;
@@ -107,23 +250,25 @@ void CkptMgrServer::HandleSaveInstanceStateRequest(REQID _id, Connection* _conn,
   response->mutable_instance()->CopyFrom(_req->instance());
 
   if (status == proto::system::OK) {
-    LOG(INFO) << "Checkpoint successful for " << checkpoint.getCkptId() << " "
-              << checkpoint.getComponent() << " " << checkpoint.getInstance();
+    LOG(INFO) << "Checkpoint successful for " << _checkpoint->getCkptId() << " "
+              << _checkpoint->getComponent() << " " << _checkpoint->getInstance();
   } else {
-    LOG(INFO) << "Checkpoint not successful for " << checkpoint.getCkptId() << " "
-              << checkpoint.getComponent() << " " << checkpoint.getInstance();
+    LOG(INFO) << "Checkpoint not successful for " << _checkpoint->getCkptId() << " "
+              << _checkpoint->getComponent() << " " << _checkpoint->getInstance();
   }
 
+  // This is a no-op if the connection has gone away in the meantime
   SendResponse(_id, _conn, *response);
   __global_protobuf_pool_release__(response);
+  delete _checkpoint;
   __global_protobuf_pool_release__(_req);
 }
 
 void CkptMgrServer::HandleGetInstanceStateRequest(REQID _id, Connection* _conn,
                                         heron::proto::ckptmgr::GetInstanceStateRequest* _req) {
-  Checkpoint checkpoint(topology_name_, _req);
-  LOG(INFO) << "Got a get checkpoint for " << checkpoint.getCkptId() << " "
-            << checkpoint.getComponent() << " " << checkpoint.getInstance() << " "
+  Checkpoint* checkpoint = new Checkpoint(topology_name_, _req);
+  LOG(INFO) << "Got a get checkpoint for " << checkpoint->getCkptId() << " "
+            << checkpoint->getComponent() << " " << checkpoint->getInstance() << " "
             << "on connection " << _conn;
 
   if (_req->checkpoint_id().empty()) {
@@ -138,43 +283,310 @@ void CkptMgrServer::HandleGetInstanceStateRequest(REQID _id, Connection* _conn,
     SendResponse(_id, _conn, *dummy);
 
     __global_protobuf_pool_release__(dummy);
+    delete checkpoint;
     __global_protobuf_pool_release__(_req);
     return;
   }
 
-  auto ret = ckptmgr_->storage()->restore(checkpoint);
-  proto::system::StatusCode status;
-  if (ret != SP_OK) {
-    LOG(ERROR) << "Get checkpoint failed for " << checkpoint.getCkptId() << " "
-               << checkpoint.getComponent() << " " << checkpoint.getInstance();
-    status = proto::system::NOTOK;
+  // Restore it off the event loop, so that a large state does not hold up
+  // the other requests. The response is packed there as well, straight from
+  // the stored bytes, so the state is not parsed or copied on the way out.
+  // A state that is larger than the stmgr takes in one chunk is kept for it
+  // to fetch in chunks instead.
+  auto restored = new PendingRestore();
+  restored->conn_ = _conn;
+  restored->packet_ = NULL;
+  restored->bytes_ = new CheckpointBytes();
+  pending_restores_.insert(restored);
+  sp_int64 max_chunk_size = _req->has_max_chunk_size() ? _req->max_chunk_size() : 0;
+  ckptmgr_->io_workers()->Execute([_id, _req, checkpoint, restored, max_chunk_size, this]()
+                                  -> int {
+    CheckpointBytes* bytes = restored->bytes_;
+    int ret = ckptmgr_->storage()->restoreBytes(*checkpoint, *bytes);
+    if (ret != SP_OK) return ret;
+    if (max_chunk_size > 0 && static_cast<sp_int64>(bytes->size()) > max_chunk_size) {
+      return bytes->narrow(proto::ckptmgr::InstanceStateCheckpoint::kStateFieldNumber);
+    }
+    restored->packet_ = PackGetInstanceStateResponse(_id, *_req, *bytes);
+    delete bytes;
+    restored->bytes_ = NULL;
+    return restored->packet_ ? SP_OK : SP_NOTOK;
+  }, [this, _id, _req, checkpoint, restored](int _ret) {
+    pending_restores_.erase(restored);
+    HandleGetInstanceStateDone(_id, restored->conn_, _req, checkpoint, restored->packet_,
+                               restored->bytes_, _ret);
+    delete restored;
+  });
+}
+
+OutgoingPacket* CkptMgrServer::PackGetInstanceStateResponse(REQID _id,
+                                  const proto::ckptmgr::GetInstanceStateRequest& _req,
+                                  CheckpointBytes& _bytes) {
+  using google::protobuf::io::CodedOutputStream;
+  using google::protobuf::internal::WireFormatLite;
+
+  proto::ckptmgr::GetInstanceStateResponse head;
+  head.mutable_status()->set_status(proto::system::OK);
+  head.mutable_instance()->CopyFrom(_req.instance());
+  head.set_checkpoint_id(_req.checkpoint_id());
+
+  // The checkpoint goes last, as the length delimited field 4
+  const sp_uint32 tag = WireFormatLite::MakeTag(
+      proto::ckptmgr::GetInstanceStateResponse::kCheckpointFieldNumber,
+      WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+  sp_int64 checkpoint_size = _bytes.size();
+  sp_int64 byte_size = head.ByteSize() + CodedOutputStream::VarintSize32(tag) +
+                       CodedOutputStream::VarintSize64(checkpoint_size) + checkpoint_size;
+  const sp_string& type_name = head.GetTypeName();
+  sp_int64 packet_size = OutgoingPacket::SizeRequiredToPackType(type_name, 0) + REQID_size +
+                         OutgoingPacket::SizeRequiredToPackProtocolBuffer(0) + byte_size;
+  if (packet_size > std::numeric_limits<sp_int32>::max()) {
+    LOG(ERROR) << "Checkpoint of " << checkpoint_size << " bytes is too large to send";
+    return NULL;
+  }
+
+  auto packet = new OutgoingPacket(packet_size);
+  CHECK_EQ(packet->PackType(type_name, 0), 0);
+  CHECK_EQ(packet->PackREQID(_id), 0);
+  auto data = reinterpret_cast<google::protobuf::uint8*>(
+      packet->ReserveProtocolBuffer(static_cast<sp_int32>(byte_size)));
+  CHECK(data);
+  data = head.SerializeWithCachedSizesToArray(data);
+  data = CodedOutputStream::WriteVarint32ToArray(tag, data);
+  data = CodedOutputStream::WriteVarint64ToArray(checkpoint_size, data);
+  _bytes.drainTo(reinterpret_cast<char*>(data));
+  return packet;
+}
+
+void CkptMgrServer::HandleGetInstanceStateDone(REQID _id, Connection* _conn,
+                                        heron::proto::ckptmgr::GetInstanceStateRequest* _req,
+                                        Checkpoint* _checkpoint, OutgoingPacket* _packet,
+                                        CheckpointBytes* _bytes, int _ret) {
+  if (!_conn) {
+    LOG(INFO) << "Dropping the restored checkpoint " << _checkpoint->getCkptId() << " "
+              << _checkpoint->getComponent() << " " << _checkpoint->getInstance()
+              << " since its connection has closed";
+    delete _packet;
+    delete _bytes;
+  } else if (_ret == SP_OK && _packet) {
+    LOG(INFO) << "Get checkpoint success for " << _checkpoint->getCkptId() << " "
+              << _checkpoint->getComponent() << " " << _checkpoint->getInstance();
+    SendResponse(_conn, _packet);
   } else {
-    status = proto::system::OK;
+    heron::proto::ckptmgr::GetInstanceStateResponse* response = nullptr;
+    response = __global_protobuf_pool_acquire__(response);
+    response->mutable_instance()->CopyFrom(_req->instance());
+    response->set_checkpoint_id(_req->checkpoint_id());
+
+    if (_ret == SP_OK) {
+      // Keep the state for the stmgr to fetch in chunks
+      std::string key = TransferKey(_req->instance(), _req->checkpoint_id());
+      auto iter = restores_.find(key);
+      if (iter != restores_.end()) DropTransfer(restores_, iter->second);
+      auto transfer = new StateTransfer(_conn, key, _req->instance(), _req->checkpoint_id(),
+                                        _bytes->size());
+      transfer->bytes_ = _bytes;
+      _bytes = NULL;
+      restores_[key] = transfer;
+
+      LOG(INFO) << "Get checkpoint success for " << _checkpoint->getCkptId() << " "
+                << _checkpoint->getComponent() << " " << _checkpoint->getInstance()
+                << ", its " << transfer->state_size_ << " bytes of state go in chunks";
+      response->mutable_status()->set_status(proto::system::OK);
+      response->set_state_size(transfer->state_size_);
+    } else {
+      LOG(ERROR) << "Get checkpoint failed for " << _checkpoint->getCkptId() << " "
+                 << _checkpoint->getComponent() << " " << _checkpoint->getInstance();
+      response->mutable_status()->set_status(proto::system::NOTOK);
+    }
+
+    SendResponse(_id, _conn, *response);
+    __global_protobuf_pool_release__(response);
+    delete _packet;
+    delete _bytes;
   }
 
-  heron::proto::ckptmgr::GetInstanceStateResponse* response = nullptr;
-  response = __global_protobuf_pool_acquire__(response);
-  response->mutable_status()->set_status(status);
-  response->mutable_instance()->CopyFrom(_req->instance());
-  response->set_checkpoint_id(_req->checkpoint_id());
+  // Only set if the storage had to parse the checkpoint
+  delete _checkpoint->checkpoint();
+  delete _checkpoint;
+  __global_protobuf_pool_release__(_req);
+}
 
-  if (status == proto::system::OK) {
-    // padding the checkpoint into response
-    response->mutable_checkpoint()->CopyFrom(checkpoint.checkpoint()->checkpoint());
+std::string CkptMgrServer::TransferKey(const proto::system::Instance& _instance,
+                                       const std::string& _checkpoint_id) {
+  return _checkpoint_id + "/" + std::to_string(_instance.info().task_id());
+}
 
-    LOG(INFO) << "Get checkpoint success for " << checkpoint.getCkptId() << " "
-              << checkpoint.getComponent() << " " << checkpoint.getInstance();
-  } else {
-    LOG(INFO) << "Get checkpoint failed for " << checkpoint.getCkptId() << " "
-              << checkpoint.getComponent() << " " << checkpoint.getInstance();
+void CkptMgrServer::HandleSaveInstanceStateChunkRequest(REQID _id, Connection* _conn,
+                                heron::proto::ckptmgr::SaveInstanceStateChunkRequest* _req) {
+  std::string key = TransferKey(_req->instance(), _req->checkpoint_id());
+  auto iter = saves_.find(key);
+  StateTransfer* transfer = iter == saves_.end() ? NULL : iter->second;
+  if (_req->offset() == 0) {
+    // A save that starts over replaces the one before
+    if (transfer) DropTransfer(saves_, transfer);
+    LOG(INFO) << "Got a save checkpoint for " << key << " in chunks of "
+              << _req->state_size() << " bytes of state on connection " << _conn;
+    transfer = new StateTransfer(_conn, key, _req->instance(), _req->checkpoint_id(),
+                                 _req->state_size());
+    transfer->head_.mutable_instance()->CopyFrom(_req->instance());
+    transfer->head_.mutable_checkpoint()->set_checkpoint_id(_req->checkpoint_id());
+    transfer->checkpoint_ = new Checkpoint(topology_name_, &transfer->head_);
+    transfer->writer_ = ckptmgr_->storage()->storeStream(*transfer->checkpoint_,
+                                                         _req->state_size());
+    saves_[key] = transfer;
   }
 
-  SendResponse(_id, _conn, *response);
+  sp_int64 size = _req->data().size();
+  if (!transfer || transfer->conn_ != _conn || _req->offset() != transfer->next_offset_ ||
+      _req->state_size() != transfer->state_size_ || _req->offset() + size > _req->state_size() ||
+      (size == 0 && _req->state_size() > 0)) {
+    LOG(ERROR) << "Got an unexpected chunk at " << _req->offset() << " of the state for " << key;
+    SendChunkResponse(_conn, _id, true, _req->instance(), _req->checkpoint_id(), _req->offset(),
+                      NULL, proto::system::NOTOK);
+    // What is left of the state would not make sense anymore
+    if (transfer && transfer->conn_ == _conn) DropTransfer(saves_, transfer);
+  } else {
+    transfer->next_offset_ += size;
+    EnqueueChunk(transfer, _id, _req->offset(), _req->mutable_data(), 0);
+  }
+  __global_protobuf_pool_release__(_req);
+}
 
-  __global_protobuf_pool_release__(response);
+void CkptMgrServer::HandleGetInstanceStateChunkRequest(REQID _id, Connection* _conn,
+                                heron::proto::ckptmgr::GetInstanceStateChunkRequest* _req) {
+  std::string key = TransferKey(_req->instance(), _req->checkpoint_id());
+  auto iter = restores_.find(key);
+  StateTransfer* transfer = iter == restores_.end() ? NULL : iter->second;
+  if (!transfer || transfer->conn_ != _conn || _req->offset() != transfer->next_offset_ ||
+      _req->offset() >= transfer->state_size_ || _req->size() <= 0) {
+    LOG(ERROR) << "Got an unexpected request for a chunk at " << _req->offset()
+               << " of the state for " << key;
+    SendChunkResponse(_conn, _id, false, _req->instance(), _req->checkpoint_id(),
+                      _req->offset(), NULL, proto::system::NOTOK);
+    if (transfer && transfer->conn_ == _conn) DropTransfer(restores_, transfer);
+  } else {
+    sp_int64 size = std::min<sp_int64>(_req->size(), transfer->state_size_ - _req->offset());
+    transfer->next_offset_ += size;
+    EnqueueChunk(transfer, _id, _req->offset(), NULL, size);
+  }
   __global_protobuf_pool_release__(_req);
 }
 
+void CkptMgrServer::EnqueueChunk(StateTransfer* _transfer, REQID _id, sp_int64 _offset,
+                                 std::string* _data, sp_int32 _size) {
+  _transfer->chunks_.push_back(StateTransfer::Chunk());
+  StateTransfer::Chunk& chunk = _transfer->chunks_.back();
+  chunk.id_ = _id;
+  chunk.offset_ = _offset;
+  if (_data) chunk.data_.swap(*_data);
+  chunk.size_ = _size;
+  if (!_transfer->busy_) {
+    ProcessChunk(_transfer);
+  }
+}
+
+void CkptMgrServer::ProcessChunk(StateTransfer* _transfer) {
+  _transfer->busy_ = true;
+  // The workers have the chunk to themselves till it is done, and pushing
+  // more chunks on the queue does not move it
+  StateTransfer::Chunk* chunk = &_transfer->chunks_.front();
+  ckptmgr_->io_workers()->Execute([_transfer, chunk]() -> int {
+    if (_transfer->save()) {
+      int ret = _transfer->writer_->append(chunk->data_.data(), chunk->data_.size());
+      bool last = chunk->offset_ + static_cast<sp_int64>(chunk->data_.size()) ==
+                  _transfer->state_size_;
+      if (ret == SP_OK && last) ret = _transfer->writer_->commit();
+      return ret;
+    }
+    chunk->data_.resize(chunk->size_);
+    size_t read = _transfer->bytes_->read(&chunk->data_[0], chunk->size_);
+    return read == static_cast<size_t>(chunk->size_) ? SP_OK : SP_NOTOK;
+  }, [this, _transfer](int _ret) {
+    HandleChunkDone(_transfer, _ret);
+  });
+}
+
+void CkptMgrServer::HandleChunkDone(StateTransfer* _transfer, int _ret) {
+  _transfer->busy_ = false;
+  StateTransfer::Chunk chunk;
+  std::swap(chunk, _transfer->chunks_.front());
+  _transfer->chunks_.pop_front();
+  if (_transfer->dropped_) {
+    // The chunks queued behind it have been failed already
+    SendChunkResponse(_transfer->conn_, chunk.id_, _transfer->save(), _transfer->instance_,
+                      _transfer->checkpoint_id_, chunk.offset_, NULL, proto::system::NOTOK);
+    delete _transfer;
+    return;
+  }
+
+  StateTransferMap& transfers = _transfer->save() ? saves_ : restores_;
+  sp_int64 size = _transfer->save() ? chunk.data_.size() : chunk.size_;
+  bool last = chunk.offset_ + size == _transfer->state_size_;
+  SendChunkResponse(_transfer->conn_, chunk.id_, _transfer->save(), _transfer->instance_,
+                    _transfer->checkpoint_id_, chunk.offset_,
+                    _transfer->save() ? NULL : &chunk.data_,
+                    _ret == SP_OK ? proto::system::OK : proto::system::NOTOK);
+
+  if (_ret != SP_OK) {
+    LOG(ERROR) << "Failed to " << (_transfer->save() ? "save" : "get") << " the chunk at "
+               << chunk.offset_ << " of the state for " << _transfer->key_;
+    DropTransfer(transfers, _transfer);
+  } else if (last) {
+    LOG(INFO) << (_transfer->save() ? "Saved" : "Sent") << " all " << _transfer->state_size_
+              << " bytes of state for " << _transfer->key_;
+    transfers.erase(_transfer->key_);
+    delete _transfer;
+  } else if (!_transfer->chunks_.empty()) {
+    ProcessChunk(_transfer);
+  }
+}
+
+void CkptMgrServer::SendChunkResponse(Connection* _conn, REQID _id, bool _save,
+                                      const proto::system::Instance& _instance,
+                                      const std::string& _checkpoint_id, sp_int64 _offset,
+                                      std::string* _data, proto::system::StatusCode _status) {
+  if (!_conn) return;
+  if (_save) {
+    proto::ckptmgr::SaveInstanceStateChunkResponse* response = nullptr;
+    response = __global_protobuf_pool_acquire__(response);
+    response->mutable_status()->set_status(_status);
+    response->mutable_instance()->CopyFrom(_instance);
+    response->set_checkpoint_id(_checkpoint_id);
+    response->set_offset(_offset);
+    SendResponse(_id, _conn, *response);
+    __global_protobuf_pool_release__(response);
+  } else {
+    proto::ckptmgr::GetInstanceStateChunkResponse* response = nullptr;
+    response = __global_protobuf_pool_acquire__(response);
+    response->mutable_status()->set_status(_status);
+    response->mutable_instance()->CopyFrom(_instance);
+    response->set_checkpoint_id(_checkpoint_id);
+    response->set_offset(_offset);
+    if (_data && _status == proto::system::OK) response->mutable_data()->swap(*_data);
+    SendResponse(_id, _conn, *response);
+    __global_protobuf_pool_release__(response);
+  }
+}
+
+void CkptMgrServer::DropTransfer(StateTransferMap& _transfers, StateTransfer* _transfer) {
+  _transfers.erase(_transfer->key_);
+  // Fail the chunks that are still queued. The one on the workers fails
+  // once they are done with it.
+  size_t busy = _transfer->busy_ ? 1 : 0;
+  while (_transfer->chunks_.size() > busy) {
+    StateTransfer::Chunk& chunk = _transfer->chunks_.back();
+    SendChunkResponse(_transfer->conn_, chunk.id_, _transfer->save(), _transfer->instance_,
+                      _transfer->checkpoint_id_, chunk.offset_, NULL, proto::system::NOTOK);
+    _transfer->chunks_.pop_back();
+  }
+  if (_transfer->busy_) {
+    _transfer->dropped_ = true;
+  } else {
+    delete _transfer;
+  }
+}
+
 }  // namespace ckptmgr
 }  // namespace heron
 
@@ -17,6 +17,10 @@
 #ifndef SRC_CPP_SVCS_CKPTMGR_SRC_CKPTMANAGER_CKPTMGR_SERVER_H_
 #define SRC_CPP_SVCS_CKPTMGR_SRC_CKPTMANAGER_CKPTMGR_SERVER_H_
 
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include "basics/basics.h"
 #include "manager/ckptmgr.h"
 #include "manager/ckptmgr-server.h"
@@ -35,28 +39,111 @@ class CkptMgrServer : public Server {
                 const sp_string& _ckptmgr_id, CkptMgr* _ckptmgr);
   virtual ~CkptMgrServer();
 
+  // Packs the GetInstanceStateResponse for _req around the serialized
+  // checkpoint in _bytes, so that the checkpoint is copied once, straight
+  // from storage into the packet. Returns NULL if it does not fit a packet.
+  static OutgoingPacket* PackGetInstanceStateResponse(REQID _id,
+                                  const proto::ckptmgr::GetInstanceStateRequest& _req,
+                                  CheckpointBytes& _bytes);
+
  protected:
   virtual void HandleNewConnection(Connection* newConnection);
   virtual void HandleConnectionClose(Connection* connection, NetworkErrorCode status);
 
  private:
+  friend class CkptMgrServerTest;
+
   // Handler for registering stmgr
   void HandleStMgrRegisterRequest(REQID _id, Connection* _conn,
                                   proto::ckptmgr::RegisterStMgrRequest* _req);
 
+  // Handler for registering tmaster
+  void HandleTMasterRegisterRequest(REQID _id, Connection* _conn,
+                                    proto::ckptmgr::RegisterTMasterRequest* _req);
+
+  // Handler for cleaning up old checkpoints
+  void HandleCleanStatefulCheckpointRequest(REQID _id, Connection* _conn,
+                                 heron::proto::ckptmgr::CleanStatefulCheckpointRequest* _req);
+
+  // Called in the event loop once the storage has cleaned up
+  void HandleCleanStatefulCheckpointDone(REQID _id, Connection* _conn, int _ret);
+
   // Handler for save checkpoint
   void HandleSaveInstanceStateRequest(REQID _id, Connection* _conn,
                                  heron::proto::ckptmgr::SaveInstanceStateRequest* _req);
 
+  // Called in the event loop once the storage has saved the checkpoint
+  void HandleSaveInstanceStateDone(REQID _id, Connection* _conn,
+                                 heron::proto::ckptmgr::SaveInstanceStateRequest* _req,
+                                 Checkpoint* _checkpoint, int _ret);
+
   // Handler for get checkpoint
   void HandleGetInstanceStateRequest(REQID _id, Connection* _conn,
                                  heron::proto::ckptmgr::GetInstanceStateRequest* _req);
 
+  // Called in the event loop once the storage has retrieved the checkpoint
+  // and packed it into _packet, or has found it too large for one packet
+  // and kept its state in _bytes. _conn is NULL if it closed in the meantime.
+  void HandleGetInstanceStateDone(REQID _id, Connection* _conn,
+                                 heron::proto::ckptmgr::GetInstanceStateRequest* _req,
+                                 Checkpoint* _checkpoint, OutgoingPacket* _packet,
+                                 CheckpointBytes* _bytes, int _ret);
+
+  // A restore that is on the workers, and what they restored
+  struct PendingRestore {
+    Connection* conn_;  // NULL once it has closed
+    OutgoingPacket* packet_;
+    CheckpointBytes* bytes_;
+  };
+
+  // A state that a stmgr saves or restores in chunks
+  struct StateTransfer;
+  typedef std::unordered_map<std::string, StateTransfer*> StateTransferMap;
+
+  // Handler for a chunk of a state being saved
+  void HandleSaveInstanceStateChunkRequest(REQID _id, Connection* _conn,
+                                 heron::proto::ckptmgr::SaveInstanceStateChunkRequest* _req);
+
+  // Handler for a chunk of a state being restored
+  void HandleGetInstanceStateChunkRequest(REQID _id, Connection* _conn,
+                                 heron::proto::ckptmgr::GetInstanceStateChunkRequest* _req);
+
+  // Queue a chunk of the transfer. The chunks of a transfer are stored or
+  // retrieved one at a time, in the order in which they arrive.
+  void EnqueueChunk(StateTransfer* _transfer, REQID _id, sp_int64 _offset, std::string* _data,
+                    sp_int32 _size);
+
+  // Store or retrieve the chunk at the head of the queue on the workers
+  void ProcessChunk(StateTransfer* _transfer);
+
+  // Called in the event loop once the chunk at the head of the queue has
+  // been stored or retrieved
+  void HandleChunkDone(StateTransfer* _transfer, int _ret);
+
+  // Send the response for a chunk of a save, or of a restore with _data
+  void SendChunkResponse(Connection* _conn, REQID _id, bool _save,
+                         const proto::system::Instance& _instance,
+                         const std::string& _checkpoint_id, sp_int64 _offset,
+                         std::string* _data, proto::system::StatusCode _status);
+
+  // Drop the transfer, failing the chunks that are still queued
+  void DropTransfer(StateTransferMap& _transfers, StateTransfer* _transfer);
+
+  // The key of the transfer for the state of _instance in _checkpoint_id
+  static std::string TransferKey(const proto::system::Instance& _instance,
+                                 const std::string& _checkpoint_id);
+
   sp_string topology_name_;
   sp_string topology_id_;
   sp_string ckptmgr_id_;
   CkptMgr* ckptmgr_;
   Connection* stmgr_conn_;
+
+  // The saves and restores in progress
+  StateTransferMap saves_;
+  StateTransferMap restores_;
+  // The restores on the workers. Their connection is cleared if it closes.
+  std::unordered_set<PendingRestore*> pending_restores_;
 };
 
 }  // namespace ckptmgr
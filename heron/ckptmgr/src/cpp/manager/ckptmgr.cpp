@@ -28,14 +28,17 @@ namespace heron {
 namespace ckptmgr {
 
 CkptMgr::CkptMgr(EventLoop* eventLoop, sp_int32 _myport, const sp_string& _topology_name,
-                 const sp_string& _topology_id, const sp_string& _ckptmgr_id, Storage* _storage)
+                 const sp_string& _topology_id, const sp_string& _ckptmgr_id, Storage* _storage,
+                 sp_int32 _num_io_threads)
     : topology_name_(_topology_name),
       topology_id_(_topology_id),
       ckptmgr_id_(_ckptmgr_id),
       ckptmgr_port_(_myport),
       storage_(_storage),
       server_(NULL),
-      eventLoop_(eventLoop) {}
+      eventLoop_(eventLoop) {
+  io_workers_ = new IOWorkers(eventLoop_, _num_io_threads);
+}
 
 void CkptMgr::Init() {
   LOG(INFO) << "Init Ckptmgr" << std::endl;
@@ -43,6 +46,8 @@ void CkptMgr::Init() {
 }
 
 CkptMgr::~CkptMgr() {
+  // Let the outstanding I/O finish before the server goes away
+  delete io_workers_;
   delete server_;
 }
 
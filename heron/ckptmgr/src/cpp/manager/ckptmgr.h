@@ -22,6 +22,7 @@
 #include "proto/messages.h"
 #include "common/checkpoint.h"
 #include "common/storage.h"
+#include "common/io-workers.h"
 
 namespace heron {
 namespace ckptmgr {
@@ -32,7 +33,7 @@ class CkptMgr {
  public:
   CkptMgr(EventLoop* eventLoop, sp_int32 _myport, const sp_string& _topology_name,
           const sp_string& _topology_id, const sp_string& _ckptmgr_id,
-          Storage* _storage);
+          Storage* _storage, sp_int32 _num_io_threads);
   virtual ~CkptMgr();
 
   void Init();
@@ -44,7 +45,14 @@ class CkptMgr {
     return storage_;
   }
 
+  // get the threads that the storage does its I/O on
+  IOWorkers* io_workers() {
+    return io_workers_;
+  }
+
  private:
+  friend class CkptMgrServerTest;
+
   void StartCkptmgrServer();
 
   sp_string topology_name_;
@@ -53,6 +61,7 @@ class CkptMgr {
   sp_int32 ckptmgr_port_;
 
   Storage* storage_;
+  IOWorkers* io_workers_;
 
   CkptMgrServer* server_;
   EventLoop* eventLoop_;
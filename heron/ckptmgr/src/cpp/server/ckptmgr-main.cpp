@@ -83,8 +83,14 @@ int main(int argc, char* argv[]) {
   // get an instance of the storage instance
   heron::ckptmgr::Storage* storage = ::GetStorageInstance(full_config);
 
+  // the number of checkpoints that can be stored or restored in parallel
+  sp_int32 num_io_threads =
+      full_config.getint32(heron::config::StatefulConfigVars::STORAGE_IO_THREADS, 4);
+  LOG(INFO) << "Storage I/O threads: " << num_io_threads;
+
   // start the check point manager
-  heron::ckptmgr::CkptMgr mgr(&ss, my_port, topology_name, topology_id, ckptmgr_id, storage);
+  heron::ckptmgr::CkptMgr mgr(&ss, my_port, topology_name, topology_id, ckptmgr_id, storage,
+                              num_io_threads);
   mgr.Init();
   ss.loop();
 
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common/checkpoint-bytes.h"
+#include <algorithm>
+#include <string>
+
+#include "proto/messages.h"
+#include "gtest/gtest.h"
+
+namespace heron {
+namespace ckptmgr {
+
+// Gets the serialized checkpoint into bytes, in pieces of _piece bytes
+void fill(CheckpointBytes& _bytes, const proto::ckptmgr::InstanceStateCheckpoint& _ckpt,
+          size_t _piece) {
+  std::string* buffer = _bytes.buffer();
+  _ckpt.SerializePartialToString(buffer);
+  for (size_t offset = 0; offset < buffer->size(); offset += _piece) {
+    _bytes.append(buffer->data() + offset, std::min(_piece, buffer->size() - offset));
+  }
+}
+
+std::string readAll(CheckpointBytes& _bytes) {
+  std::string data(_bytes.size(), '\0');
+  _bytes.drainTo(&data[0]);
+  return data;
+}
+
+TEST(CheckpointBytesTest, test_read) {
+  proto::ckptmgr::InstanceStateCheckpoint ckpt;
+  ckpt.set_checkpoint_id("checkpoint-1");
+  ckpt.set_state(std::string(1000, 'x'));
+  std::string expected;
+  ckpt.SerializeToString(&expected);
+
+  CheckpointBytes bytes;
+  fill(bytes, ckpt, 7);
+  EXPECT_EQ(bytes.size(), expected.size());
+
+  // Reads that end in the middle of pieces pick up where they left off
+  std::string data;
+  char buf[10];
+  size_t n;
+  while ((n = bytes.read(buf, sizeof(buf))) > 0) {
+    data.append(buf, n);
+    EXPECT_EQ(bytes.size(), expected.size() - data.size());
+  }
+  EXPECT_EQ(data, expected);
+  EXPECT_EQ(bytes.size(), 0);
+}
+
+TEST(CheckpointBytesTest, test_narrow) {
+  proto::ckptmgr::InstanceStateCheckpoint ckpt;
+  ckpt.set_checkpoint_id("checkpoint-1");
+  std::string state;
+  for (int i = 0; i < 5000; ++i) state.push_back(static_cast<char>(i * 31));
+  ckpt.set_state(state);
+
+  // The field is found wherever the pieces split it
+  for (size_t piece : {1, 3, 100, 100000}) {
+    CheckpointBytes bytes;
+    fill(bytes, ckpt, piece);
+    EXPECT_EQ(bytes.narrow(proto::ckptmgr::InstanceStateCheckpoint::kStateFieldNumber), SP_OK);
+    EXPECT_EQ(bytes.size(), state.size());
+    EXPECT_EQ(readAll(bytes), state);
+  }
+
+  CheckpointBytes bytes;
+  fill(bytes, ckpt, 10);
+  EXPECT_EQ(bytes.narrow(proto::ckptmgr::InstanceStateCheckpoint::kCheckpointIdFieldNumber),
+            SP_OK);
+  EXPECT_EQ(readAll(bytes), "checkpoint-1");
+}
+
+TEST(CheckpointBytesTest, test_narrow_failures) {
+  proto::ckptmgr::InstanceStateCheckpoint ckpt;
+  ckpt.set_checkpoint_id("checkpoint-1");
+  CheckpointBytes missing;
+  fill(missing, ckpt, 4);
+  EXPECT_NE(missing.narrow(proto::ckptmgr::InstanceStateCheckpoint::kStateFieldNumber), SP_OK);
+
+  // A field that is cut short
+  ckpt.set_state(std::string(100, 'x'));
+  std::string data;
+  ckpt.SerializeToString(&data);
+  CheckpointBytes truncated;
+  truncated.append(data.data(), data.size() - 1);
+  EXPECT_NE(truncated.narrow(proto::ckptmgr::InstanceStateCheckpoint::kStateFieldNumber),
+            SP_OK);
+}
+
+}  // namespace ckptmgr
+}  // namespace heron
+
+int main(int argc, char **argv) {
+  heron::common::Initialize(argv[0]);
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common/checkpoint-codec.h"
+#include <string>
+#include <vector>
+
+#include "basics/basics.h"
+#include "gtest/gtest.h"
+
+namespace heron {
+namespace ckptmgr {
+
+// Something like a serialized object graph: records that repeat with
+// small changes
+std::string makeRecords(size_t _size) {
+  std::string data;
+  for (int i = 0; data.size() < _size; ++i) {
+    data.append("com.twitter.heron.examples.WordCount$Record{word=word-");
+    data.append(std::to_string(i % 1000)).append(", count=");
+    data.append(std::to_string(i * 7)).append("}");
+  }
+  data.resize(_size);
+  return data;
+}
+
+std::string makeRandom(size_t _size) {
+  std::string data(_size, 0);
+  sp_uint32 x = 12345;
+  for (size_t i = 0; i < _size; ++i) {
+    x = x * 1103515245 + 12345;
+    data[i] = static_cast<char>(x >> 24);
+  }
+  return data;
+}
+
+std::string roundTrip(const CheckpointCodec* _codec, const std::string& _data,
+                      size_t* _compressed_size = NULL) {
+  std::string compressed;
+  _codec->compress(_data.data(), _data.size(), compressed);
+  if (_compressed_size) *_compressed_size = compressed.size();
+
+  size_t size = 0;
+  EXPECT_EQ(CheckpointCodec::uncompressedSize(compressed.data(), compressed.size(), size),
+            SP_OK);
+  EXPECT_EQ(size, _data.size());
+  std::string data(size, 0);
+  if (CheckpointCodec::decompress(compressed.data(), compressed.size(), &data[0], size)
+      != SP_OK) {
+    return "failed";
+  }
+  return data;
+}
+
+TEST(CheckpointCodecTest, test_get) {
+  ASSERT_TRUE(CheckpointCodec::get("zstd-fast") != NULL);
+  ASSERT_TRUE(CheckpointCodec::get("zstd") != NULL);
+  EXPECT_EQ(CheckpointCodec::get("zstd-fast")->name(), "zstd-fast");
+  EXPECT_EQ(CheckpointCodec::get("zstd")->name(), "zstd");
+  EXPECT_TRUE(CheckpointCodec::get("none") == NULL);
+  EXPECT_TRUE(CheckpointCodec::get("zip") == NULL);
+}
+
+TEST(CheckpointCodecTest, test_round_trip) {
+  std::vector<std::string> inputs = {"", "a", "abcdefghijkl", "abcdefghijklm",
+                                     std::string(100000, 'a'), makeRecords(12),
+                                     makeRecords(1000), makeRecords(300000),
+                                     makeRandom(100), makeRandom(300000),
+                                     makeRecords(100000) + makeRandom(100000)};
+  for (auto name : {"zstd-fast", "zstd"}) {
+    const CheckpointCodec* codec = CheckpointCodec::get(name);
+    for (auto& input : inputs) {
+      EXPECT_EQ(roundTrip(codec, input), input) << name << " " << input.size();
+    }
+  }
+}
+
+TEST(CheckpointCodecTest, test_ratio) {
+  std::string records = makeRecords(1024 * 1024);
+  size_t fast = 0;
+  size_t dense = 0;
+  EXPECT_EQ(roundTrip(CheckpointCodec::get("zstd-fast"), records, &fast), records);
+  EXPECT_EQ(roundTrip(CheckpointCodec::get("zstd"), records, &dense), records);
+  EXPECT_LT(fast, records.size() / 3);
+  EXPECT_LT(dense, fast);
+
+  // Data that does not compress grows by little
+  std::string random = makeRandom(1024 * 1024);
+  EXPECT_EQ(roundTrip(CheckpointCodec::get("zstd-fast"), random, &fast), random);
+  EXPECT_LT(fast, random.size() + random.size() / 100);
+}
+
+TEST(CheckpointCodecTest, test_corrupt) {
+  std::string records = makeRecords(10000);
+  std::string compressed;
+  CheckpointCodec::get("zstd-fast")->compress(records.data(), records.size(), compressed);
+  std::string data(records.size(), 0);
+
+  // The wrong size
+  EXPECT_NE(CheckpointCodec::decompress(compressed.data(), compressed.size(), &data[0],
+                                        data.size() - 1), SP_OK);
+  // Cut short
+  EXPECT_NE(CheckpointCodec::decompress(compressed.data(), compressed.size() / 2, &data[0],
+                                        data.size()), SP_OK);
+  // No frame header
+  EXPECT_NE(CheckpointCodec::decompress(records.data(), records.size(), &data[0],
+                                        data.size()), SP_OK);
+  // Another frame format
+  std::string unknown = compressed;
+  unknown[0] ^= 0x5a;
+  EXPECT_NE(CheckpointCodec::decompress(unknown.data(), unknown.size(), &data[0],
+                                        data.size()), SP_OK);
+  // Garbage does not read out of bounds
+  for (size_t i = 4; i < compressed.size(); i += 7) {
+    std::string garbled = compressed;
+    garbled[i] ^= 0x5a;
+    CheckpointCodec::decompress(garbled.data(), garbled.size(), &data[0], data.size());
+  }
+}
+
+}  // namespace ckptmgr
+}  // namespace heron
+
+int main(int argc, char **argv) {
+  heron::common::Initialize(argv[0]);
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
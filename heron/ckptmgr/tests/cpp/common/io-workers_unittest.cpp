@@ -0,0 +1,94 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common/io-workers.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "basics/basics.h"
+#include "network/network.h"
+#include "gtest/gtest.h"
+
+namespace heron {
+namespace ckptmgr {
+
+// All the work is done, and every completion is called in the event loop
+// thread with what its work returned
+TEST(IOWorkersTest, test_completions) {
+  EventLoopImpl ss;
+  IOWorkers workers(&ss, 3);
+  EXPECT_EQ(workers.num_threads(), 3);
+
+  const sp_int32 num_work = 100;
+  std::vector<sp_int32> results(num_work, -1);
+  sp_int32 num_done = 0;
+  std::thread::id loop_thread = std::this_thread::get_id();
+  bool in_loop_thread = true;
+  for (sp_int32 i = 0; i < num_work; ++i) {
+    workers.Execute([i]() { return i * 2; }, [&results, &in_loop_thread, loop_thread,
+                                               &num_done, &ss, i](sp_int32 _result) {
+      results[i] = _result;
+      in_loop_thread = in_loop_thread && std::this_thread::get_id() == loop_thread;
+      if (++num_done == num_work) ss.loopExit();
+    });
+  }
+  ss.loop();
+
+  EXPECT_TRUE(in_loop_thread);
+  for (sp_int32 i = 0; i < num_work; ++i) {
+    EXPECT_EQ(results[i], i * 2);
+  }
+}
+
+// Work runs in parallel, but never on more threads than asked for
+TEST(IOWorkersTest, test_bounded_concurrency) {
+  EventLoopImpl ss;
+  const sp_int32 num_threads = 4;
+  IOWorkers workers(&ss, num_threads);
+
+  std::atomic<sp_int32> running(0);
+  std::atomic<sp_int32> max_running(0);
+  const sp_int32 num_work = 32;
+  sp_int32 num_done = 0;
+  for (sp_int32 i = 0; i < num_work; ++i) {
+    workers.Execute([&running, &max_running]() {
+      sp_int32 now = ++running;
+      sp_int32 seen = max_running;
+      while (now > seen && !max_running.compare_exchange_weak(seen, now)) {}
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      --running;
+      return SP_OK;
+    }, [&num_done, &ss](sp_int32 _result) {
+      EXPECT_EQ(_result, SP_OK);
+      if (++num_done == num_work) ss.loopExit();
+    });
+  }
+  ss.loop();
+
+  EXPECT_LE(max_running, num_threads);
+  EXPECT_GT(max_running, 1);
+}
+
+}  // namespace ckptmgr
+}  // namespace heron
+
+int main(int argc, char **argv) {
+  heron::common::Initialize(argv[0]);
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,426 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "localfs/localfs.h"
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "basics/basics.h"
+#include "config/config.h"
+#include "config/environ-vars.h"
+#include "config/stateful-config-vars.h"
+#include "localfs/localfs-config-vars.h"
+#include "proto/messages.h"
+#include "gtest/gtest.h"
+
+namespace heron {
+namespace ckptmgr {
+
+class LocalFSTest : public ::testing::Test {
+ public:
+  LocalFSTest() {}
+  ~LocalFSTest() {}
+
+  void SetUp() {
+    char dpath[255];
+    snprintf(dpath, sizeof(dpath), "%s", "/tmp/XXXXXX");
+    mkdtemp(dpath);
+    root_ = dpath;
+    localfs_ = NULL;
+    reopen("none");
+  }
+
+  // Makes a new LocalFS over the same directory, with the codec
+  void reopen(const std::string& _codec) {
+    delete localfs_;
+    localfs_ = open("topology", _codec);
+  }
+
+  // Makes a LocalFS for the topology over the same directory
+  LocalFS* open(const std::string& _topology, const std::string& _codec) {
+    auto config = heron::config::Config::Builder()
+      .putstr(heron::config::StatefulConfigVars::STORAGE_TYPE, LocalFS::storage_type())
+      .putstr(heron::config::StatefulConfigVars::STORAGE_CODEC, _codec)
+      .putstr(LocalfsConfigVars::ROOT_DIR, root_)
+      .putstr(heron::config::EnvironVars::TOPOLOGY_NAME, _topology)
+      .build();
+    return new LocalFS(config);
+  }
+
+  void TearDown() {
+    delete localfs_;
+    FileUtils::removeRecursive(root_, true);
+  }
+
+  // A state like serialized objects, which compresses well
+  static std::string makeRecords(size_t _size) {
+    std::string state;
+    for (int i = 0; state.size() < _size; ++i) {
+      state.append("com.twitter.heron.examples.WordCount$Record{word=word-");
+      state.append(std::to_string(i % 1000)).append(", count=");
+      state.append(std::to_string(i * 7)).append("}");
+    }
+    state.resize(_size);
+    return state;
+  }
+
+  // A state that is the same from run to run, but does not repeat itself
+  static std::string makeState(size_t _size) {
+    std::string state(_size, 0);
+    sp_uint32 x = 12345;
+    for (size_t i = 0; i < _size; ++i) {
+      x = x * 1103515245 + 12345;
+      state[i] = static_cast<char>(x >> 24);
+    }
+    return state;
+  }
+
+  proto::ckptmgr::SaveInstanceStateRequest* createSaveMessage(const std::string& _ckpt_id,
+                                                              sp_int32 _task_id,
+                                                              const std::string& _state) {
+    auto protomsg = new proto::ckptmgr::SaveInstanceStateRequest;
+    auto instance = protomsg->mutable_instance();
+    instance->set_instance_id("instance-" + std::to_string(_task_id));
+    instance->set_stmgr_id("stmgr-1");
+    auto info = instance->mutable_info();
+    info->set_task_id(_task_id);
+    info->set_component_name("component");
+    info->set_component_index(_task_id);
+    protomsg->mutable_checkpoint()->set_checkpoint_id(_ckpt_id);
+    protomsg->mutable_checkpoint()->set_state(_state);
+    return protomsg;
+  }
+
+  int store(const std::string& _ckpt_id, sp_int32 _task_id, const std::string& _state) {
+    auto message = createSaveMessage(_ckpt_id, _task_id, _state);
+    Checkpoint ckpt("topology", message);
+    int ret = localfs_->store(ckpt);
+    delete message;
+    return ret;
+  }
+
+  CheckpointWriter* startStore(const std::string& _ckpt_id, sp_int32 _task_id,
+                               size_t _state_size) {
+    auto message = createSaveMessage(_ckpt_id, _task_id, "");
+    message->mutable_checkpoint()->clear_state();
+    Checkpoint ckpt("topology", message);
+    CheckpointWriter* writer = localfs_->storeStream(ckpt, _state_size);
+    delete message;
+    return writer;
+  }
+
+  // Stores the state through a writer, _piece bytes at a time
+  int storeStream(const std::string& _ckpt_id, sp_int32 _task_id, const std::string& _state,
+                  size_t _piece) {
+    CheckpointWriter* writer = startStore(_ckpt_id, _task_id, _state.size());
+    int ret = SP_OK;
+    for (size_t offset = 0; offset < _state.size() && ret == SP_OK; offset += _piece) {
+      ret = writer->append(_state.data() + offset, std::min(_piece, _state.size() - offset));
+    }
+    if (ret == SP_OK) ret = writer->commit();
+    delete writer;
+    return ret;
+  }
+
+  // Returns the restored state, or "failed"
+  std::string restore(const std::string& _ckpt_id, sp_int32 _task_id) {
+    auto save = createSaveMessage(_ckpt_id, _task_id, "");
+    proto::ckptmgr::GetInstanceStateRequest request;
+    request.mutable_instance()->CopyFrom(save->instance());
+    request.set_checkpoint_id(_ckpt_id);
+    delete save;
+    Checkpoint ckpt("topology", &request);
+    if (localfs_->restore(ckpt) != SP_OK) return "failed";
+    std::string state = ckpt.checkpoint()->checkpoint().state();
+    delete ckpt.checkpoint();
+    return state;
+  }
+
+  // Returns the restored checkpoint as it was serialized, or "failed"
+  std::string restoreBytes(const std::string& _ckpt_id, sp_int32 _task_id) {
+    auto save = createSaveMessage(_ckpt_id, _task_id, "");
+    proto::ckptmgr::GetInstanceStateRequest request;
+    request.mutable_instance()->CopyFrom(save->instance());
+    request.set_checkpoint_id(_ckpt_id);
+    delete save;
+    Checkpoint ckpt("topology", &request);
+    CheckpointBytes bytes;
+    if (localfs_->restoreBytes(ckpt, bytes) != SP_OK) return "failed";
+    EXPECT_TRUE(ckpt.checkpoint() == nullptr);
+    std::string serialized(bytes.size(), 0);
+    bytes.drainTo(&serialized[0]);
+    EXPECT_EQ(bytes.size(), 0u);
+    return serialized;
+  }
+
+  // The number of bytes kept in chunks
+  size_t chunkBytes() {
+    size_t total = 0;
+    std::string chunks_dir = root_ + "/topology/.chunks";
+    std::vector<std::string> directories;
+    FileUtils::listFiles(chunks_dir, directories);
+    for (auto& directory : directories) {
+      std::vector<std::string> chunks;
+      FileUtils::listFiles(chunks_dir + "/" + directory, chunks);
+      for (auto& chunk : chunks) {
+        total += FileUtils::readAll(chunks_dir + "/" + directory + "/" + chunk).size();
+      }
+    }
+    return total;
+  }
+
+ protected:
+  std::string root_;
+  LocalFS* localfs_;
+};
+
+TEST_F(LocalFSTest, test_split) {
+  std::string state = makeState(4 * 1024 * 1024);
+  std::vector<size_t> ends;
+  ChunkStore::split(state.data(), state.size(), ends);
+  ASSERT_GT(ends.size(), 1u);
+  EXPECT_EQ(ends.back(), state.size());
+  size_t start = 0;
+  for (size_t end : ends) {
+    EXPECT_GT(end, start);
+    EXPECT_LE(end - start, 256u * 1024);
+    start = end;
+  }
+
+  // Inserting bytes in front only moves the boundaries after it
+  std::string shifted = "some bytes in front" + state;
+  std::vector<size_t> shifted_ends;
+  ChunkStore::split(shifted.data(), shifted.size(), shifted_ends);
+  EXPECT_EQ(ends.back() + 19, shifted_ends.back());
+  EXPECT_EQ(ends[ends.size() - 2] + 19, shifted_ends[shifted_ends.size() - 2]);
+}
+
+TEST_F(LocalFSTest, test_store_restore) {
+  std::string small("abcdefghijklmnopqrstuvwxyz");
+  std::string large = makeState(3 * 1024 * 1024 + 17);
+  EXPECT_EQ(store("ckpt-1", 1, small), SP_OK);
+  EXPECT_EQ(store("ckpt-1", 2, large), SP_OK);
+  EXPECT_EQ(store("ckpt-1", 3, ""), SP_OK);
+
+  EXPECT_EQ(restore("ckpt-1", 1), small);
+  EXPECT_EQ(restore("ckpt-1", 2), large);
+  EXPECT_EQ(restore("ckpt-1", 3), "");
+  EXPECT_EQ(restore("ckpt-2", 1), "failed");
+}
+
+TEST_F(LocalFSTest, test_restore_bytes) {
+  std::vector<std::string> states = {"abcdefghijklmnopqrstuvwxyz",
+                                     makeState(3 * 1024 * 1024 + 17), ""};
+  for (size_t i = 0; i < states.size(); ++i) {
+    EXPECT_EQ(store("ckpt-1", i, states[i]), SP_OK);
+  }
+
+  // The bytes are the checkpoint exactly as it was saved
+  for (size_t i = 0; i < states.size(); ++i) {
+    auto message = createSaveMessage("ckpt-1", i, states[i]);
+    EXPECT_EQ(restoreBytes("ckpt-1", i), message->checkpoint().SerializeAsString());
+    delete message;
+  }
+  EXPECT_EQ(restoreBytes("ckpt-2", 0), "failed");
+}
+
+TEST_F(LocalFSTest, test_store_stream) {
+  std::vector<std::string> states = {"abcdefghijklmnopqrstuvwxyz",
+                                     makeState(3 * 1024 * 1024 + 17), ""};
+  for (size_t i = 0; i < states.size(); ++i) {
+    EXPECT_EQ(storeStream("ckpt-1", i, states[i], 1000), SP_OK);
+    EXPECT_EQ(restore("ckpt-1", i), states[i]);
+  }
+
+  // The chunks are the same as when the checkpoint is stored as a whole
+  size_t stored = chunkBytes();
+  EXPECT_EQ(store("ckpt-1", 1, states[1]), SP_OK);
+  EXPECT_EQ(storeStream("ckpt-1", 1, states[1], 100 * 1000), SP_OK);
+  EXPECT_EQ(chunkBytes(), stored);
+  EXPECT_EQ(restore("ckpt-1", 1), states[1]);
+
+  // Too much or too little state fails
+  CheckpointWriter* writer = startStore("ckpt-2", 1, 10);
+  EXPECT_EQ(writer->append(states[0].data(), 5), SP_OK);
+  EXPECT_EQ(writer->commit(), SP_NOTOK);
+  EXPECT_EQ(writer->append(states[0].data(), 6), SP_NOTOK);
+  delete writer;
+  EXPECT_EQ(restore("ckpt-2", 1), "failed");
+}
+
+TEST_F(LocalFSTest, test_dispose_while_streaming) {
+  std::string state1 = makeState(2 * 1024 * 1024);
+  std::string state2 = makeState(3 * 1024 * 1024);
+  EXPECT_EQ(store("ckpt-1", 1, state1), SP_OK);
+
+  // Disposing of everything keeps what the writer stored so far
+  CheckpointWriter* writer = startStore("ckpt-2", 1, state2.size());
+  EXPECT_EQ(writer->append(state2.data(), state2.size() / 2), SP_OK);
+  EXPECT_EQ(localfs_->dispose("", true), SP_OK);
+  EXPECT_EQ(restore("ckpt-1", 1), "failed");
+  EXPECT_GT(chunkBytes(), 0u);
+  EXPECT_EQ(writer->append(state2.data() + state2.size() / 2,
+                           state2.size() - state2.size() / 2), SP_OK);
+  EXPECT_EQ(writer->commit(), SP_OK);
+  delete writer;
+  EXPECT_EQ(restore("ckpt-2", 1), state2);
+
+  // Once the writer is gone, its chunks are kept by its manifest alone
+  EXPECT_EQ(localfs_->dispose("ckpt-3", false), SP_OK);
+  EXPECT_EQ(chunkBytes(), 0u);
+}
+
+TEST_F(LocalFSTest, test_dedup) {
+  std::string state = makeState(8 * 1024 * 1024);
+  EXPECT_EQ(store("ckpt-1", 1, state), SP_OK);
+  size_t first = chunkBytes();
+  EXPECT_GE(first, state.size());
+
+  // Change a few bytes in the middle. Only the chunks around them are new.
+  state[state.size() / 2] ^= 1;
+  EXPECT_EQ(store("ckpt-2", 1, state), SP_OK);
+  size_t added = chunkBytes() - first;
+  EXPECT_GT(added, 0u);
+  EXPECT_LT(added, state.size() / 10);
+
+  // The same state for another task only adds the chunk in front, which
+  // also holds the instance it belongs to
+  EXPECT_EQ(store("ckpt-2", 2, state), SP_OK);
+  EXPECT_LE(chunkBytes() - first - added, 256u * 1024);
+  EXPECT_EQ(restore("ckpt-2", 2), state);
+}
+
+TEST_F(LocalFSTest, test_dispose) {
+  std::string state1 = makeState(2 * 1024 * 1024);
+  std::string state2 = makeState(3 * 1024 * 1024);
+  EXPECT_EQ(store("ckpt-1", 1, state1), SP_OK);
+  EXPECT_EQ(store("ckpt-2", 1, state2), SP_OK);
+  size_t both = chunkBytes();
+
+  // The chunks state2 shares with state1 stay
+  EXPECT_EQ(localfs_->dispose("ckpt-2", false), SP_OK);
+  EXPECT_EQ(restore("ckpt-1", 1), "failed");
+  EXPECT_EQ(restore("ckpt-2", 1), state2);
+  EXPECT_LT(chunkBytes(), both);
+  EXPECT_GE(chunkBytes(), state2.size());
+
+  EXPECT_EQ(localfs_->dispose("", true), SP_OK);
+  EXPECT_EQ(restore("ckpt-2", 1), "failed");
+  EXPECT_EQ(chunkBytes(), 0u);
+
+  // Storing works again after everything is gone
+  EXPECT_EQ(store("ckpt-3", 1, state1), SP_OK);
+  EXPECT_EQ(restore("ckpt-3", 1), state1);
+}
+
+TEST_F(LocalFSTest, test_topologies_apart) {
+  std::string state1 = makeState(1024 * 1024);
+  std::string state2 = makeState(2 * 1024 * 1024);
+  EXPECT_EQ(store("ckpt-1", 1, state1), SP_OK);
+  size_t ours = chunkBytes();
+
+  // Another topology that keeps its checkpoints under the same root
+  LocalFS* mine = localfs_;
+  localfs_ = open("other", "none");
+  EXPECT_EQ(store("ckpt-1", 1, state2), SP_OK);
+  EXPECT_EQ(localfs_->dispose("", true), SP_OK);
+  EXPECT_EQ(restore("ckpt-1", 1), "failed");
+  EXPECT_EQ(store("ckpt-2", 1, state2), SP_OK);
+  LocalFS* other = localfs_;
+
+  // Removing the checkpoints of one leaves the other's alone
+  localfs_ = mine;
+  EXPECT_EQ(restore("ckpt-1", 1), state1);
+  EXPECT_EQ(chunkBytes(), ours);
+  EXPECT_EQ(localfs_->dispose("", true), SP_OK);
+  EXPECT_EQ(chunkBytes(), 0u);
+
+  localfs_ = other;
+  EXPECT_EQ(restore("ckpt-2", 1), state2);
+  delete other;
+  localfs_ = mine;
+}
+
+TEST_F(LocalFSTest, test_compressed) {
+  std::string records = makeRecords(3 * 1024 * 1024 + 17);
+  std::string random = makeState(1024 * 1024);
+  for (auto codec : {"zstd-fast", "zstd"}) {
+    reopen(codec);
+    EXPECT_EQ(store("ckpt-1", 1, records), SP_OK);
+    EXPECT_LT(chunkBytes(), records.size() / 3) << codec;
+    EXPECT_EQ(restore("ckpt-1", 1), records);
+    auto message = createSaveMessage("ckpt-1", 1, records);
+    EXPECT_EQ(restoreBytes("ckpt-1", 1), message->checkpoint().SerializeAsString());
+    delete message;
+
+    // Streamed chunks come out the same
+    size_t stored = chunkBytes();
+    EXPECT_EQ(storeStream("ckpt-1", 1, records, 100 * 1000), SP_OK);
+    EXPECT_EQ(chunkBytes(), stored);
+    EXPECT_EQ(restore("ckpt-1", 1), records);
+
+    // What does not compress is stored as it is
+    EXPECT_EQ(store("ckpt-1", 2, random), SP_OK);
+    EXPECT_GE(chunkBytes() - stored, random.size());
+    EXPECT_EQ(restore("ckpt-1", 2), random);
+
+    EXPECT_EQ(localfs_->dispose("", true), SP_OK);
+    EXPECT_EQ(chunkBytes(), 0u);
+  }
+}
+
+TEST_F(LocalFSTest, test_change_codec) {
+  std::string records = makeRecords(2 * 1024 * 1024);
+  EXPECT_EQ(store("ckpt-1", 1, records), SP_OK);
+  size_t uncompressed = chunkBytes();
+
+  // Checkpoints stored with another codec, or none, still restore, and
+  // their chunks still dedup. Only the chunk in front, which holds the
+  // checkpoint id and the instance, is new.
+  reopen("zstd-fast");
+  EXPECT_EQ(restore("ckpt-1", 1), records);
+  EXPECT_EQ(store("ckpt-2", 1, records), SP_OK);
+  EXPECT_LE(chunkBytes() - uncompressed, 256u * 1024);
+  EXPECT_EQ(store("ckpt-2", 2, records), SP_OK);
+  size_t mixed = chunkBytes();
+  EXPECT_LE(mixed - uncompressed, 2 * 256u * 1024);
+
+  reopen("zstd");
+  EXPECT_EQ(restore("ckpt-2", 2), records);
+  reopen("none");
+  EXPECT_EQ(restore("ckpt-2", 2), records);
+  auto message = createSaveMessage("ckpt-2", 2, records);
+  EXPECT_EQ(restoreBytes("ckpt-2", 2), message->checkpoint().SerializeAsString());
+  delete message;
+
+  // Dispose drops compressed chunks like any other
+  EXPECT_EQ(localfs_->dispose("ckpt-2", false), SP_OK);
+  EXPECT_LT(chunkBytes(), mixed);
+  EXPECT_EQ(restore("ckpt-2", 1), records);
+  EXPECT_EQ(localfs_->dispose("", true), SP_OK);
+  EXPECT_EQ(chunkBytes(), 0u);
+}
+
+}  // namespace ckptmgr
+}  // namespace heron
+
+int main(int argc, char **argv) {
+  heron::common::Initialize(argv[0]);
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
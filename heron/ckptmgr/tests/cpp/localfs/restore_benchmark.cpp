@@ -0,0 +1,194 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures what it takes the ckptmgr to turn a stored checkpoint into the
+// packet of its GetInstanceStateResponse, for states of several sizes. The
+// parse path restores the checkpoint into a proto and serializes a copy of
+// it into the packet, like the ckptmgr used to. The bytes path maps the
+// stored chunks and copies them straight into the packet. Every run is
+// made in a child process of its own, so that its peak resident memory can
+// be told apart, and prints one CSV line with the latency and that peak.
+// The chunks are read from a warm page cache in both paths.
+//
+// Usage: restore_benchmark [state_size_mb ...]
+
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "basics/basics.h"
+#include "config/config.h"
+#include "config/environ-vars.h"
+#include "config/stateful-config-vars.h"
+#include "localfs/localfs.h"
+#include "localfs/localfs-config-vars.h"
+#include "manager/ckptmgr-server.h"
+#include "network/network.h"
+#include "proto/messages.h"
+
+typedef std::chrono::high_resolution_clock Clock;
+
+namespace {
+
+const char* TOPOLOGY = "topology";
+const char* CHECKPOINT_ID = "ckpt-1";
+
+heron::proto::ckptmgr::GetInstanceStateRequest* CreateGetRequest() {
+  auto request = new heron::proto::ckptmgr::GetInstanceStateRequest;
+  auto instance = request->mutable_instance();
+  instance->set_instance_id("instance-1");
+  instance->set_stmgr_id("stmgr-1");
+  auto info = instance->mutable_info();
+  info->set_task_id(1);
+  info->set_component_name("component");
+  info->set_component_index(1);
+  request->set_checkpoint_id(CHECKPOINT_ID);
+  return request;
+}
+
+void StoreState(heron::ckptmgr::LocalFS* _localfs, size_t _size) {
+  auto request = CreateGetRequest();
+  heron::proto::ckptmgr::SaveInstanceStateRequest save;
+  save.mutable_instance()->CopyFrom(request->instance());
+  save.mutable_checkpoint()->set_checkpoint_id(CHECKPOINT_ID);
+  delete request;
+
+  // Random bytes, so that nothing dedups
+  std::string* state = save.mutable_checkpoint()->mutable_state();
+  state->resize(_size);
+  sp_uint64 x = 88172645463325252ULL;
+  for (size_t i = 0; i + sizeof(x) <= _size; i += sizeof(x)) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    memcpy(&(*state)[i], &x, sizeof(x));
+  }
+
+  heron::ckptmgr::Checkpoint ckpt(TOPOLOGY, &save);
+  CHECK_EQ(_localfs->store(ckpt), SP_OK);
+}
+
+// Returns the size of the packet
+sp_uint32 RestoreByParsing(heron::ckptmgr::LocalFS* _localfs) {
+  auto request = CreateGetRequest();
+  heron::ckptmgr::Checkpoint ckpt(TOPOLOGY, request);
+  CHECK_EQ(_localfs->restore(ckpt), SP_OK);
+
+  heron::proto::ckptmgr::GetInstanceStateResponse response;
+  response.mutable_status()->set_status(heron::proto::system::OK);
+  response.mutable_instance()->CopyFrom(request->instance());
+  response.set_checkpoint_id(request->checkpoint_id());
+  response.mutable_checkpoint()->CopyFrom(ckpt.checkpoint()->checkpoint());
+
+  // What Server::SendResponse does with it
+  sp_int32 byte_size = response.ByteSize();
+  OutgoingPacket packet(OutgoingPacket::SizeRequiredToPackType(response.GetTypeName(), 0) +
+                        REQID_size + OutgoingPacket::SizeRequiredToPackProtocolBuffer(byte_size));
+  CHECK_EQ(packet.PackType(response.GetTypeName(), 0), 0);
+  CHECK_EQ(packet.PackREQID(REQID_Generator::generate_zero_reqid()), 0);
+  CHECK_EQ(packet.PackProtocolBuffer(response, byte_size), 0);
+
+  delete ckpt.checkpoint();
+  delete request;
+  return packet.GetTotalPacketSize();
+}
+
+// Returns the size of the packet
+sp_uint32 RestoreBytes(heron::ckptmgr::LocalFS* _localfs) {
+  auto request = CreateGetRequest();
+  heron::ckptmgr::Checkpoint ckpt(TOPOLOGY, request);
+  heron::ckptmgr::CheckpointBytes bytes;
+  CHECK_EQ(_localfs->restoreBytes(ckpt, bytes), SP_OK);
+
+  OutgoingPacket* packet = heron::ckptmgr::CkptMgrServer::PackGetInstanceStateResponse(
+      REQID_Generator::generate_zero_reqid(), *request, bytes);
+  CHECK(packet);
+  sp_uint32 size = packet->GetTotalPacketSize();
+  delete packet;
+  delete request;
+  return size;
+}
+
+// Runs the path in a child process and prints its CSV line
+void Run(const std::string& _path, size_t _size_mb, heron::ckptmgr::LocalFS* _localfs) {
+  int fds[2];
+  CHECK_EQ(pipe(fds), 0);
+  pid_t pid = fork();
+  CHECK_GE(pid, 0);
+  if (pid == 0) {
+    close(fds[0]);
+    auto start = Clock::now();
+    sp_uint32 packet_size = _path == "parse" ? RestoreByParsing(_localfs)
+                                             : RestoreBytes(_localfs);
+    sp_int64 elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now() - start).count();
+    sp_int64 result[2] = {elapsed, packet_size};
+    CHECK_EQ(write(fds[1], result, sizeof(result)), static_cast<ssize_t>(sizeof(result)));
+    _exit(0);
+  }
+
+  close(fds[1]);
+  sp_int64 result[2] = {0, 0};
+  bool ok = read(fds[0], result, sizeof(result)) == static_cast<ssize_t>(sizeof(result));
+  close(fds[0]);
+  int status = 0;
+  struct rusage usage;
+  CHECK(wait4(pid, &status, 0, &usage) == pid);
+  if (!ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    LOG(ERROR) << "The " << _path << " run for " << _size_mb << "MB failed";
+    return;
+  }
+
+  // ru_maxrss is in kilobytes
+  std::cout << _size_mb << "," << _path << "," << result[1] << ","
+            << result[0] / 1000.0 << "," << usage.ru_maxrss / 1024 << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  heron::common::Initialize(argv[0]);
+  std::vector<size_t> sizes_mb;
+  for (int i = 1; i < argc; ++i) sizes_mb.push_back(atoll(argv[i]));
+  if (sizes_mb.empty()) sizes_mb = {100, 500};
+
+  std::cout << "state_mb,path,packet_bytes,latency_ms,peak_rss_mb" << std::endl;
+  for (size_t size_mb : sizes_mb) {
+    char dpath[255];
+    snprintf(dpath, sizeof(dpath), "%s", "/tmp/restore_benchmark_XXXXXX");
+    CHECK(mkdtemp(dpath));
+    auto config = heron::config::Config::Builder()
+      .putstr(heron::config::StatefulConfigVars::STORAGE_TYPE,
+              heron::ckptmgr::LocalFS::storage_type())
+      .putstr(heron::ckptmgr::LocalfsConfigVars::ROOT_DIR, dpath)
+      .putstr(heron::config::EnvironVars::TOPOLOGY_NAME, TOPOLOGY)
+      .build();
+    auto localfs = new heron::ckptmgr::LocalFS(config);
+
+    StoreState(localfs, size_mb * 1024 * 1024);
+    Run("parse", size_mb, localfs);
+    Run("bytes", size_mb, localfs);
+
+    delete localfs;
+    FileUtils::removeRecursive(dpath, true);
+  }
+  return 0;
+}
@@ -0,0 +1,390 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "manager/ckptmgr-server.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "basics/basics.h"
+#include "basics/modinit.h"
+#include "errors/modinit.h"
+#include "threads/modinit.h"
+#include "network/modinit.h"
+#include "network/network.h"
+#include "config/config.h"
+#include "config/environ-vars.h"
+#include "config/stateful-config-vars.h"
+#include "localfs/localfs.h"
+#include "localfs/localfs-config-vars.h"
+#include "manager/ckptmgr.h"
+#include "proto/messages.h"
+#include "gtest/gtest.h"
+
+namespace heron {
+namespace ckptmgr {
+
+const sp_string LOCALHOST = "127.0.0.1";
+const sp_string CHECKPOINT_ID = "ckpt-1";
+
+// Talks to the ckptmgr the way a stmgr does, and keeps what it answers
+class ChunkClient : public Client {
+ public:
+  ChunkClient(EventLoop* eventLoop, const NetworkOptions& _options)
+      : Client(eventLoop, _options), registered_(false), got_status_(proto::system::OK),
+        got_state_size_(-1), got_checkpoint_(false) {
+    InstallResponseHandler(new proto::ckptmgr::RegisterStMgrRequest(),
+                           &ChunkClient::HandleRegisterResponse);
+    InstallResponseHandler(new proto::ckptmgr::GetInstanceStateRequest(),
+                           &ChunkClient::HandleGetInstanceStateResponse);
+    InstallResponseHandler(new proto::ckptmgr::SaveInstanceStateChunkRequest(),
+                           &ChunkClient::HandleSaveChunkResponse);
+    InstallResponseHandler(new proto::ckptmgr::GetInstanceStateChunkRequest(),
+                           &ChunkClient::HandleGetChunkResponse);
+  }
+
+  static proto::system::Instance instance() {
+    proto::system::Instance instance;
+    instance.set_instance_id("instance-3");
+    instance.set_stmgr_id("stmgr-1");
+    instance.mutable_info()->set_task_id(3);
+    instance.mutable_info()->set_component_index(0);
+    instance.mutable_info()->set_component_name("word");
+    return instance;
+  }
+
+  void SaveChunk(const std::string& _state, sp_int64 _offset, sp_int64 _size) {
+    auto request = new proto::ckptmgr::SaveInstanceStateChunkRequest();
+    request->mutable_instance()->CopyFrom(instance());
+    request->set_checkpoint_id(CHECKPOINT_ID);
+    request->set_state_size(_state.size());
+    request->set_offset(_offset);
+    request->set_data(_state.data() + _offset, _size);
+    SendRequest(request, NULL);
+  }
+
+  void GetInstanceState(sp_int32 _max_chunk_size) {
+    auto request = new proto::ckptmgr::GetInstanceStateRequest();
+    request->mutable_instance()->CopyFrom(instance());
+    request->set_checkpoint_id(CHECKPOINT_ID);
+    request->set_max_chunk_size(_max_chunk_size);
+    SendRequest(request, NULL);
+  }
+
+  void GetChunk(sp_int64 _offset, sp_int32 _size) {
+    auto request = new proto::ckptmgr::GetInstanceStateChunkRequest();
+    request->mutable_instance()->CopyFrom(instance());
+    request->set_checkpoint_id(CHECKPOINT_ID);
+    request->set_offset(_offset);
+    request->set_size(_size);
+    SendRequest(request, NULL);
+  }
+
+  bool registered_;
+  // the offsets and statuses of the chunk responses, in the order they came
+  std::vector<std::pair<sp_int64, proto::system::StatusCode>> saved_chunks_;
+  std::vector<std::pair<sp_int64, proto::system::StatusCode>> got_chunks_;
+  std::string got_data_;
+  proto::system::StatusCode got_status_;
+  sp_int64 got_state_size_;
+  bool got_checkpoint_;
+
+ protected:
+  virtual void HandleConnect(NetworkErrorCode _status) {
+    EXPECT_EQ(_status, OK);
+    auto request = new proto::ckptmgr::RegisterStMgrRequest();
+    request->set_topology_name("mytopology");
+    request->set_topology_id("abcd-9999");
+    request->set_stmgr("stmgr-1");
+    SendRequest(request, NULL);
+  }
+
+  virtual void HandleClose(NetworkErrorCode) {}
+
+ private:
+  void HandleRegisterResponse(void*, proto::ckptmgr::RegisterStMgrResponse* _response,
+                              NetworkErrorCode _status) {
+    EXPECT_EQ(_status, OK);
+    EXPECT_EQ(_response->status().status(), proto::system::OK);
+    EXPECT_TRUE(_response->takes_state_chunks());
+    registered_ = true;
+    delete _response;
+  }
+
+  void HandleGetInstanceStateResponse(void*, proto::ckptmgr::GetInstanceStateResponse* _response,
+                                      NetworkErrorCode _status) {
+    EXPECT_EQ(_status, OK);
+    got_status_ = _response->status().status();
+    got_checkpoint_ = _response->has_checkpoint();
+    if (_response->has_checkpoint()) got_data_ = _response->checkpoint().state();
+    got_state_size_ = _response->has_state_size() ? _response->state_size() : 0;
+    delete _response;
+  }
+
+  void HandleSaveChunkResponse(void*, proto::ckptmgr::SaveInstanceStateChunkResponse* _response,
+                               NetworkErrorCode _status) {
+    EXPECT_EQ(_status, OK);
+    saved_chunks_.push_back(std::make_pair(_response->offset(), _response->status().status()));
+    delete _response;
+  }
+
+  void HandleGetChunkResponse(void*, proto::ckptmgr::GetInstanceStateChunkResponse* _response,
+                              NetworkErrorCode _status) {
+    EXPECT_EQ(_status, OK);
+    got_chunks_.push_back(std::make_pair(_response->offset(), _response->status().status()));
+    got_data_.append(_response->data());
+    delete _response;
+  }
+};
+
+// A LocalFS whose restores wait on the workers while they are held
+class HeldLocalFS : public LocalFS {
+ public:
+  explicit HeldLocalFS(const heron::config::Config& _config)
+      : LocalFS(_config), held_(false), restoring_(false) {}
+
+  virtual int restoreBytes(Checkpoint& _ckpt, CheckpointBytes& _bytes) {
+    restoring_ = true;
+    while (held_) usleep(1000);
+    return LocalFS::restoreBytes(_ckpt, _bytes);
+  }
+
+  std::atomic<bool> held_;
+  std::atomic<bool> restoring_;
+};
+
+class CkptMgrServerTest : public ::testing::Test {
+ public:
+  void SetUp() {
+    char dpath[255];
+    snprintf(dpath, sizeof(dpath), "%s", "/tmp/XXXXXX");
+    mkdtemp(dpath);
+    root_ = dpath;
+    auto config = heron::config::Config::Builder()
+      .putstr(heron::config::StatefulConfigVars::STORAGE_TYPE, LocalFS::storage_type())
+      .putstr(LocalfsConfigVars::ROOT_DIR, root_)
+      .putstr(heron::config::EnvironVars::TOPOLOGY_NAME, "mytopology")
+      .build();
+    localfs_ = new HeldLocalFS(config);
+
+    // Each test gets a port of its own, so it does not wait for the last
+    // one's to be let go of
+    static sp_int32 port = 63000;
+    port++;
+    ckptmgr_ = new CkptMgr(&loop_, port, "mytopology", "abcd-9999", "ckptmgr-1", localfs_, 2);
+    ckptmgr_->Init();
+
+    NetworkOptions options;
+    options.set_host(LOCALHOST);
+    options.set_port(port);
+    options.set_max_packet_size(64 * 1024 * 1024);
+    options.set_socket_family(PF_INET);
+    client_ = new ChunkClient(&loop_, options);
+    client_->Start();
+    runUntil([this]() { return client_->registered_; });
+  }
+
+  void TearDown() {
+    delete client_;
+    delete ckptmgr_;
+    delete localfs_;
+    FileUtils::removeRecursive(root_, true);
+  }
+
+  // Runs the loop till the condition holds, or it has run for too long
+  void runUntil(std::function<bool()> _done) {
+    sp_int32 ticks = 0;
+    sp_int64 timer = loop_.registerTimer([this, _done, &ticks](EventLoop::Status) {
+      if (_done() || ++ticks > 3000) loop_.loopExit();
+    }, true, 10 * 1000);
+    loop_.loop();
+    loop_.unRegisterTimer(timer);
+    EXPECT_TRUE(_done());
+  }
+
+  // Saves the state in chunks of _chunk_size, all sent at once
+  void saveInChunks(const std::string& _state, sp_int64 _chunk_size) {
+    size_t nchunks = 0;
+    for (sp_int64 offset = 0; offset < static_cast<sp_int64>(_state.size());
+         offset += _chunk_size) {
+      client_->SaveChunk(_state, offset,
+                         std::min<sp_int64>(_chunk_size, _state.size() - offset));
+      nchunks++;
+    }
+    runUntil([this, nchunks]() { return client_->saved_chunks_.size() == nchunks; });
+  }
+
+  CkptMgrServer* server() { return ckptmgr_->server_; }
+
+  size_t numPendingRestores() { return server()->pending_restores_.size(); }
+
+  size_t numRestores() { return server()->restores_.size(); }
+
+  // Has the connection of every restore on the workers closed
+  bool pendingRestoresClosed() {
+    for (auto restore : server()->pending_restores_) {
+      if (restore->conn_) return false;
+    }
+    return true;
+  }
+
+  static std::string makeState(size_t _size) {
+    std::string state(_size, 0);
+    for (size_t i = 0; i < _size; ++i) state[i] = static_cast<char>(i * 7 + i / 1000);
+    return state;
+  }
+
+ protected:
+  std::string root_;
+  EventLoopImpl loop_;
+  HeldLocalFS* localfs_;
+  CkptMgr* ckptmgr_;
+  ChunkClient* client_;
+};
+
+// Test that a state saved in chunks can be got back in chunks, with each
+// chunk answered in order
+TEST_F(CkptMgrServerTest, testSaveAndGetInChunks) {
+  const sp_int64 chunk_size = 100 * 1000;
+  std::string state = makeState(10 * chunk_size + 1234);
+  saveInChunks(state, chunk_size);
+
+  ASSERT_EQ(client_->saved_chunks_.size(), (size_t)11);
+  for (size_t i = 0; i < client_->saved_chunks_.size(); ++i) {
+    EXPECT_EQ(client_->saved_chunks_[i].first, static_cast<sp_int64>(i * chunk_size));
+    EXPECT_EQ(client_->saved_chunks_[i].second, proto::system::OK);
+  }
+
+  // The state is larger than the client takes at once, so it is kept for
+  // the client to get in chunks
+  client_->GetInstanceState(chunk_size);
+  runUntil([this]() { return client_->got_state_size_ >= 0; });
+  EXPECT_EQ(client_->got_status_, proto::system::OK);
+  EXPECT_FALSE(client_->got_checkpoint_);
+  EXPECT_EQ(client_->got_state_size_, static_cast<sp_int64>(state.size()));
+
+  for (sp_int64 offset = 0; offset < client_->got_state_size_; offset += chunk_size) {
+    client_->GetChunk(offset, chunk_size);
+  }
+  runUntil([this]() { return client_->got_chunks_.size() == 11; });
+  for (size_t i = 0; i < client_->got_chunks_.size(); ++i) {
+    EXPECT_EQ(client_->got_chunks_[i].first, static_cast<sp_int64>(i * chunk_size));
+    EXPECT_EQ(client_->got_chunks_[i].second, proto::system::OK);
+  }
+  EXPECT_TRUE(client_->got_data_ == state);
+
+  // Once all of it has been sent, the state is let go of
+  client_->GetChunk(0, chunk_size);
+  runUntil([this]() { return client_->got_chunks_.size() == 12; });
+  EXPECT_EQ(client_->got_chunks_.back().second, proto::system::NOTOK);
+}
+
+// Test that a state that fits in one response is sent whole
+TEST_F(CkptMgrServerTest, testGetWhole) {
+  const sp_int64 chunk_size = 100 * 1000;
+  std::string state = makeState(3 * chunk_size);
+  saveInChunks(state, chunk_size);
+
+  // What the client takes at once is the whole checkpoint, not just its state
+  client_->GetInstanceState(2 * state.size());
+  runUntil([this]() { return client_->got_state_size_ >= 0; });
+  EXPECT_EQ(client_->got_status_, proto::system::OK);
+  EXPECT_TRUE(client_->got_checkpoint_);
+  EXPECT_EQ(client_->got_state_size_, 0);
+  EXPECT_TRUE(client_->got_data_ == state);
+}
+
+// Test that a state restored for a connection that closed in the meantime
+// is let go of, rather than kept for it to fetch in chunks
+TEST_F(CkptMgrServerTest, testGetAfterClose) {
+  const sp_int64 chunk_size = 100 * 1000;
+  std::string state = makeState(3 * chunk_size);
+  saveInChunks(state, chunk_size);
+
+  localfs_->held_ = true;
+  client_->GetInstanceState(chunk_size);
+  runUntil([this]() { return localfs_->restoring_.load(); });
+  EXPECT_EQ(numPendingRestores(), (size_t)1);
+
+  client_->Stop();
+  runUntil([this]() { return pendingRestoresClosed(); });
+  localfs_->held_ = false;
+  runUntil([this]() { return numPendingRestores() == 0; });
+  EXPECT_EQ(numRestores(), (size_t)0);
+}
+
+// Test that a chunk that does not follow the last one fails, and drops
+// what was saved of the state
+TEST_F(CkptMgrServerTest, testSaveChunkOutOfOrder) {
+  const sp_int64 chunk_size = 100 * 1000;
+  std::string state = makeState(3 * chunk_size);
+  client_->SaveChunk(state, 0, chunk_size);
+  client_->SaveChunk(state, 2 * chunk_size, chunk_size);
+  client_->SaveChunk(state, chunk_size, chunk_size);
+  runUntil([this]() { return client_->saved_chunks_.size() == 3; });
+
+  // The first chunk may be done before the others come in, or fail with them
+  for (auto& chunk : client_->saved_chunks_) {
+    if (chunk.first != 0) {
+      EXPECT_EQ(chunk.second, proto::system::NOTOK);
+    }
+  }
+  client_->GetInstanceState(chunk_size);
+  runUntil([this]() { return client_->got_state_size_ >= 0; });
+  EXPECT_EQ(client_->got_status_, proto::system::NOTOK);
+}
+
+// Test that a chunk of a state that is not being restored fails
+TEST_F(CkptMgrServerTest, testGetChunkUnknown) {
+  client_->GetChunk(0, 1000);
+  runUntil([this]() { return client_->got_chunks_.size() == 1; });
+  EXPECT_EQ(client_->got_chunks_[0].second, proto::system::NOTOK);
+}
+
+// Test that a chunk asked for out of order fails, and drops the restore
+TEST_F(CkptMgrServerTest, testGetChunkOutOfOrder) {
+  const sp_int64 chunk_size = 100 * 1000;
+  std::string state = makeState(3 * chunk_size);
+  saveInChunks(state, chunk_size);
+  client_->GetInstanceState(chunk_size);
+  runUntil([this]() { return client_->got_state_size_ >= 0; });
+
+  client_->GetChunk(0, chunk_size);
+  client_->GetChunk(2 * chunk_size, chunk_size);
+  client_->GetChunk(chunk_size, chunk_size);
+  runUntil([this]() { return client_->got_chunks_.size() == 3; });
+
+  for (auto& chunk : client_->got_chunks_) {
+    if (chunk.first != 0) {
+      EXPECT_EQ(chunk.second, proto::system::NOTOK);
+    }
+  }
+}
+
+}  // namespace ckptmgr
+}  // namespace heron
+
+int main(int argc, char** argv) {
+  heron::common::Initialize(argv[0]);
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
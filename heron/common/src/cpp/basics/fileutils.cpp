@@ -208,7 +208,7 @@ bool FileUtils::writeAll(const std::string& filename, const char* data, size_t l
 
 bool FileUtils::writeSyncAll(const std::string& filename, const char* data, size_t len) {
   // open the file for creation and write only mode
-  auto fd = ::open(filename.c_str(), O_CREAT | O_WRONLY, 0644);
+  auto fd = ::open(filename.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
   if (fd < 0) {
     PLOG(ERROR) << "Unable to open file " << filename;
     return false;
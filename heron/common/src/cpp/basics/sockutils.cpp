@@ -18,6 +18,7 @@
 #include <fcntl.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <sys/socket.h>
 #include "glog/logging.h"
 #include "config/heron-config.h"
 #include "basics/sprcodes.h"
@@ -155,6 +156,14 @@ sp_int32 SockUtils::setSocketDefaults(sp_int32 fd) {
     return SP_NOTOK;
   }
 
+  // The rest only applies to tcp sockets, not to unix ones
+  struct sockaddr_storage addr;
+  socklen_t addr_len = sizeof(addr);
+  if (getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &addr_len) == 0 &&
+      addr.ss_family != AF_INET && addr.ss_family != AF_INET6) {
+    return SP_OK;
+  }
+
   // enable keepalive for this socket
   if (SockUtils::setKeepAlive(fd) < 0) {
     PLOG(ERROR) << "setsockopt for keepalive failed in server";
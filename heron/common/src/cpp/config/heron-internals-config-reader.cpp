@@ -204,6 +204,24 @@ sp_int32 HeronInternalsConfigReader::GetHeronStreammgrCheckpointDrainSizeMb() {
   return config_[HeronInternalsConfigVars::HERON_STREAMMGR_CHECKPOINT_DRAIN_SIZE_MB].as<int>();
 }
 
+sp_int32 HeronInternalsConfigReader::GetHeronStreammgrStatefulChunkSizeMb() {
+  return config_[HeronInternalsConfigVars::HERON_STREAMMGR_STATEFUL_CHUNK_SIZE_MB].as<int>();
+}
+
+sp_int32 HeronInternalsConfigReader::GetHeronStreammgrStatefulChunkWindow() {
+  return config_[HeronInternalsConfigVars::HERON_STREAMMGR_STATEFUL_CHUNK_WINDOW].as<int>();
+}
+
+sp_int32 HeronInternalsConfigReader::GetHeronStreammgrStatefulRestoreParallelism() {
+  return config_[HeronInternalsConfigVars::HERON_STREAMMGR_STATEFUL_RESTORE_PARALLELISM]
+      .as<int>();
+}
+
+sp_int32 HeronInternalsConfigReader::GetHeronStreammgrMempoolTupleSetHighwatermarkBytes() {
+  return config_[HeronInternalsConfigVars::HERON_STREAMMGR_MEMPOOL_TUPLE_SET_HIGHWATERMARK_BYTES]
+      .as<int>();
+}
+
 sp_int32 HeronInternalsConfigReader::GetHeronStreammgrXormgrRotatingmapNbuckets() {
   return config_[HeronInternalsConfigVars::HERON_STREAMMGR_XORMGR_ROTATINGMAP_NBUCKETS].as<int>();
 }
@@ -217,6 +235,10 @@ sp_int32 HeronInternalsConfigReader::GetHeronStreammgrClientReconnectTmasterInte
       .as<int>();
 }
 
+sp_int32 HeronInternalsConfigReader::GetHeronStreammgrClientThreads() {
+  return config_[HeronInternalsConfigVars::HERON_STREAMMGR_CLIENT_THREADS].as<int>();
+}
+
 sp_int32 HeronInternalsConfigReader::GetHeronStreammgrNetworkOptionsMaximumPacketMb() {
   return config_[HeronInternalsConfigVars::HERON_STREAMMGR_NETWORK_OPTIONS_MAXIMUM_PACKET_MB]
       .as<int>();
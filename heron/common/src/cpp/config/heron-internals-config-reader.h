@@ -155,6 +155,19 @@ class HeronInternalsConfigReader : public YamlFileReader {
   // The sized based threshold in MB for draining the checkpoint buffer
   sp_int32 GetHeronStreammgrCheckpointDrainSizeMb();
 
+  // The size in MB of the chunks that large instance states are saved and
+  // restored in
+  sp_int32 GetHeronStreammgrStatefulChunkSizeMb();
+
+  // The number of chunks of a state that can be in flight at once
+  sp_int32 GetHeronStreammgrStatefulChunkWindow();
+
+  // The number of instance states fetched at once during a restore
+  sp_int32 GetHeronStreammgrStatefulRestoreParallelism();
+
+  // Pooled tuple sets using more memory in bytes than this are freed instead of reused
+  sp_int32 GetHeronStreammgrMempoolTupleSetHighwatermarkBytes();
+
   // Get the Nbucket value, for efficient acknowledgement
   sp_int32 GetHeronStreammgrXormgrRotatingmapNbuckets();
 
@@ -164,6 +177,9 @@ class HeronInternalsConfigReader : public YamlFileReader {
   // The reconnect interval to tamster in second for stream manager client
   sp_int32 GetHeronStreammgrClientReconnectTmasterIntervalSec();
 
+  // The number of threads running the connections to other stream managers
+  sp_int32 GetHeronStreammgrClientThreads();
+
   // The maximum packet size in MB of stream manager's network options
   sp_int32 GetHeronStreammgrNetworkOptionsMaximumPacketMb();
 
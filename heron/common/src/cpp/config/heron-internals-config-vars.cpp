@@ -90,12 +90,22 @@ const sp_string HeronInternalsConfigVars::HERON_STREAMMGR_CACHE_DRAIN_SIZE_MB =
     "heron.streammgr.cache.drain.size.mb";
 const sp_string HeronInternalsConfigVars::HERON_STREAMMGR_CHECKPOINT_DRAIN_SIZE_MB =
     "heron.streammgr.checkpoint.drain.size.mb";
+const sp_string HeronInternalsConfigVars::HERON_STREAMMGR_STATEFUL_CHUNK_SIZE_MB =
+    "heron.streammgr.stateful.chunk.size.mb";
+const sp_string HeronInternalsConfigVars::HERON_STREAMMGR_STATEFUL_CHUNK_WINDOW =
+    "heron.streammgr.stateful.chunk.window";
+const sp_string HeronInternalsConfigVars::HERON_STREAMMGR_STATEFUL_RESTORE_PARALLELISM =
+    "heron.streammgr.stateful.restore.parallelism";
+const sp_string HeronInternalsConfigVars::HERON_STREAMMGR_MEMPOOL_TUPLE_SET_HIGHWATERMARK_BYTES =
+    "heron.streammgr.mempool.tuple.set.highwatermark.bytes";
 const sp_string HeronInternalsConfigVars::HERON_STREAMMGR_XORMGR_ROTATINGMAP_NBUCKETS =
     "heron.streammgr.xormgr.rotatingmap.nbuckets";
 const sp_string HeronInternalsConfigVars::HERON_STREAMMGR_CLIENT_RECONNECT_INTERVAL_SEC =
     "heron.streammgr.client.reconnect.interval.sec";
 const sp_string HeronInternalsConfigVars::HERON_STREAMMGR_CLIENT_RECONNECT_TMASTER_INTERVAL_SEC =
     "heron.streammgr.client.reconnect.tmaster.interval.sec";
+const sp_string HeronInternalsConfigVars::HERON_STREAMMGR_CLIENT_THREADS =
+    "heron.streammgr.client.threads";
 const sp_string HeronInternalsConfigVars::HERON_STREAMMGR_NETWORK_OPTIONS_MAXIMUM_PACKET_MB =
     "heron.streammgr.network.options.maximum.packet.mb";
 const sp_string HeronInternalsConfigVars::HERON_STREAMMGR_TMASTER_HEARTBEAT_INTERVAL_SEC =
@@ -143,6 +143,21 @@ class HeronInternalsConfigVars {
   // The sized based threshold in MB for draining the checkpoint buffering for stateful topologies
   static const sp_string HERON_STREAMMGR_CHECKPOINT_DRAIN_SIZE_MB;
 
+  // The size in MB of the chunks that instance states larger than it are
+  // saved to and restored from the checkpoint manager in
+  static const sp_string HERON_STREAMMGR_STATEFUL_CHUNK_SIZE_MB;
+
+  // The number of chunks of a state that can be on the way to or from the
+  // checkpoint manager at once
+  static const sp_string HERON_STREAMMGR_STATEFUL_CHUNK_WINDOW;
+
+  // The number of local instance states that are fetched from the
+  // checkpoint manager at once during a restore
+  static const sp_string HERON_STREAMMGR_STATEFUL_RESTORE_PARALLELISM;
+
+  // Pooled tuple sets using more memory in bytes than this are freed instead of reused
+  static const sp_string HERON_STREAMMGR_MEMPOOL_TUPLE_SET_HIGHWATERMARK_BYTES;
+
   // For efficient acknowledgement
   static const sp_string HERON_STREAMMGR_XORMGR_ROTATINGMAP_NBUCKETS;
 
@@ -152,6 +167,9 @@ class HeronInternalsConfigVars {
   // The reconnect interval to tamster in second for stream manager client
   static const sp_string HERON_STREAMMGR_CLIENT_RECONNECT_TMASTER_INTERVAL_SEC;
 
+  // The number of threads running the connections to other stream managers
+  static const sp_string HERON_STREAMMGR_CLIENT_THREADS;
+
   // The maximum packet size in MB of stream manager's network options
   static const sp_string HERON_STREAMMGR_NETWORK_OPTIONS_MAXIMUM_PACKET_MB;
 
@@ -17,6 +17,9 @@
 #include "config/physical-plan-helper.h"
 #include <map>
 #include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include "basics/basics.h"
 #include "errors/errors.h"
 #include "proto/messages.h"
@@ -115,5 +118,112 @@ void PhysicalPlanHelper::LogPhysicalPlan(const proto::system::PhysicalPlan& _ppl
 
   LOG(INFO) << "Topology State: " << _pplan.topology().state();
 }
+
+bool PhysicalPlanHelper::MakeDelta(const proto::system::PhysicalPlan& _old,
+                                   const proto::system::PhysicalPlan& _new,
+                                   proto::system::PhysicalPlanDelta& _delta) {
+  _delta.Clear();
+  _delta.set_topology_state(_new.topology().state());
+
+  // The topology may only change in its state
+  proto::api::Topology topology(_old.topology());
+  topology.set_state(_new.topology().state());
+  if (topology.SerializeAsString() != _new.topology().SerializeAsString()) {
+    return false;
+  }
+
+  std::unordered_map<std::string, const proto::system::StMgr*> old_stmgrs;
+  for (const auto& stmgr : _old.stmgrs()) {
+    old_stmgrs[stmgr.id()] = &stmgr;
+  }
+  for (const auto& stmgr : _new.stmgrs()) {
+    auto iter = old_stmgrs.find(stmgr.id());
+    if (iter == old_stmgrs.end() ||
+        iter->second->SerializeAsString() != stmgr.SerializeAsString()) {
+      _delta.add_stmgrs()->CopyFrom(stmgr);
+    }
+    if (iter != old_stmgrs.end()) old_stmgrs.erase(iter);
+  }
+  for (const auto& stmgr : _old.stmgrs()) {
+    if (old_stmgrs.count(stmgr.id())) _delta.add_removed_stmgrs(stmgr.id());
+  }
+
+  std::unordered_map<std::string, const proto::system::Instance*> old_instances;
+  for (const auto& instance : _old.instances()) {
+    old_instances[instance.instance_id()] = &instance;
+  }
+  for (const auto& instance : _new.instances()) {
+    auto iter = old_instances.find(instance.instance_id());
+    if (iter == old_instances.end() ||
+        iter->second->SerializeAsString() != instance.SerializeAsString()) {
+      _delta.add_instances()->CopyFrom(instance);
+    }
+    if (iter != old_instances.end()) old_instances.erase(iter);
+  }
+  for (const auto& instance : _old.instances()) {
+    if (old_instances.count(instance.instance_id())) {
+      _delta.add_removed_instances(instance.instance_id());
+    }
+  }
+
+  // The stmgrs keep the order of the plan they were sent, so the delta is
+  // only good if applying it gets exactly _new back
+  proto::system::PhysicalPlan applied(_old);
+  ApplyDelta(_delta, applied);
+  return applied.SerializeAsString() == _new.SerializeAsString();
+}
+
+void PhysicalPlanHelper::ApplyDelta(const proto::system::PhysicalPlanDelta& _delta,
+                                    proto::system::PhysicalPlan& _pplan) {
+  _pplan.mutable_topology()->set_state(_delta.topology_state());
+
+  // Changed entries are replaced where they are, removed ones are dropped
+  // and new ones go to the end
+  std::unordered_set<std::string> removed(_delta.removed_stmgrs().begin(),
+                                          _delta.removed_stmgrs().end());
+  std::unordered_map<std::string, const proto::system::StMgr*> stmgrs;
+  for (const auto& stmgr : _delta.stmgrs()) {
+    stmgrs[stmgr.id()] = &stmgr;
+  }
+  auto pplan_stmgrs = _pplan.mutable_stmgrs();
+  sp_int32 kept = 0;
+  for (sp_int32 i = 0; i < pplan_stmgrs->size(); ++i) {
+    proto::system::StMgr* stmgr = pplan_stmgrs->Mutable(i);
+    if (removed.count(stmgr->id())) continue;
+    auto iter = stmgrs.find(stmgr->id());
+    if (iter != stmgrs.end()) {
+      stmgr->CopyFrom(*iter->second);
+      stmgrs.erase(iter);
+    }
+    pplan_stmgrs->SwapElements(i, kept++);
+  }
+  while (pplan_stmgrs->size() > kept) pplan_stmgrs->RemoveLast();
+  for (const auto& stmgr : _delta.stmgrs()) {
+    if (stmgrs.count(stmgr.id())) pplan_stmgrs->Add()->CopyFrom(stmgr);
+  }
+
+  removed.clear();
+  removed.insert(_delta.removed_instances().begin(), _delta.removed_instances().end());
+  std::unordered_map<std::string, const proto::system::Instance*> instances;
+  for (const auto& instance : _delta.instances()) {
+    instances[instance.instance_id()] = &instance;
+  }
+  auto pplan_instances = _pplan.mutable_instances();
+  kept = 0;
+  for (sp_int32 i = 0; i < pplan_instances->size(); ++i) {
+    proto::system::Instance* instance = pplan_instances->Mutable(i);
+    if (removed.count(instance->instance_id())) continue;
+    auto iter = instances.find(instance->instance_id());
+    if (iter != instances.end()) {
+      instance->CopyFrom(*iter->second);
+      instances.erase(iter);
+    }
+    pplan_instances->SwapElements(i, kept++);
+  }
+  while (pplan_instances->size() > kept) pplan_instances->RemoveLast();
+  for (const auto& instance : _delta.instances()) {
+    if (instances.count(instance.instance_id())) pplan_instances->Add()->CopyFrom(instance);
+  }
+}
 }  // namespace config
 }  // namespace heron
@@ -65,6 +65,17 @@ class PhysicalPlanHelper {
                           std::set<sp_int32>& _return);
 
   static void LogPhysicalPlan(const proto::system::PhysicalPlan& _pplan);
+
+  // Fill _delta with what changed from _old to _new. Returns false if the
+  // change cannot be sent as a delta, like when the topology itself changed
+  // in more than its state, in which case the whole plan has to be sent.
+  static bool MakeDelta(const proto::system::PhysicalPlan& _old,
+                        const proto::system::PhysicalPlan& _new,
+                        proto::system::PhysicalPlanDelta& _delta);
+
+  // Apply a delta that MakeDelta made to the plan it was made from
+  static void ApplyDelta(const proto::system::PhysicalPlanDelta& _delta,
+                         proto::system::PhysicalPlan& _pplan);
 };
 }  // namespace config
 }  // namespace heron
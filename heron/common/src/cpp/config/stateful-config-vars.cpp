@@ -20,5 +20,9 @@ namespace heron {
 namespace config {
 
 const sp_string StatefulConfigVars::STORAGE_TYPE = "heron.stateful.checkpoint.storage";
+const sp_string StatefulConfigVars::STORAGE_IO_THREADS =
+    "heron.stateful.checkpoint.storage.io.threads";
+const sp_string StatefulConfigVars::STORAGE_CODEC =
+    "heron.stateful.checkpoint.storage.codec";
 }  // namespace config
 }  // namespace heron
@@ -25,6 +25,10 @@ namespace config {
 class StatefulConfigVars {
  public:
   static const sp_string STORAGE_TYPE;
+  // How many checkpoints can be stored or restored at the same time
+  static const sp_string STORAGE_IO_THREADS;
+  // The codec to compress checkpoints with: none, zstd-fast or zstd
+  static const sp_string STORAGE_CODEC;
 };
 }  // namespace config
 }  // namespace heron
@@ -260,6 +260,17 @@ sp_string TopologyConfigHelper::GetStatefulProviderConfig(const proto::api::Topo
   return "";
 }
 
+sp_string TopologyConfigHelper::GetFieldsGroupingHash(const proto::api::Topology& _topology) {
+  const proto::api::Config& cfg = _topology.topology_config();
+  for (sp_int32 i = 0; i < cfg.kvs_size(); ++i) {
+    if (cfg.kvs(i).key() == TopologyConfigVars::TOPOLOGY_FIELDS_GROUPING_HASH) {
+      return cfg.kvs(i).value();
+    }
+  }
+  // There was no value specified. The default is legacy.
+  return "legacy";
+}
+
 std::vector<sp_string> TopologyConfigHelper::GetSpoutComponentNames(
   const proto::api::Topology& _topology) {
   std::vector<sp_string> retval;
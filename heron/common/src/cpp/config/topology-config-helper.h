@@ -91,6 +91,9 @@ class TopologyConfigHelper {
   // Gets the state provider config for stateful topologies
   static sp_string GetStatefulProviderConfig(const proto::api::Topology& _topology);
 
+  // Gets how fields grouping hashes the grouping fields
+  static sp_string GetFieldsGroupingHash(const proto::api::Topology& _topology);
+
   // Gets the list of all spout component names
   static std::vector<sp_string> GetSpoutComponentNames(const proto::api::Topology& _topology);
 };
@@ -48,6 +48,8 @@ const sp_string TopologyConfigVars::TOPOLOGY_STATEFUL_PROVIDER_CONFIG =
                                     "topology.stateful.provider.config";
 const sp_string TopologyConfigVars::TOPOLOGY_STATEFUL_START_CLEAN =
                                     "topology.stateful.start.clean";
+const sp_string TopologyConfigVars::TOPOLOGY_FIELDS_GROUPING_HASH =
+                                    "topology.fields.grouping.hash";
 const sp_string TopologyConfigVars::TOPOLOGY_NAME = "topology.name";
 const sp_string TopologyConfigVars::TOPOLOGY_TEAM_NAME = "topology.team.name";
 const sp_string TopologyConfigVars::TOPOLOGY_TEAM_EMAIL = "topology.team.email";
@@ -49,6 +49,7 @@ class TopologyConfigVars {
   static const sp_string TOPOLOGY_STATEFUL_PROVIDER_TYPE;
   static const sp_string TOPOLOGY_STATEFUL_PROVIDER_CONFIG;
   static const sp_string TOPOLOGY_STATEFUL_START_CLEAN;
+  static const sp_string TOPOLOGY_FIELDS_GROUPING_HASH;
   static const sp_string TOPOLOGY_NAME;
   static const sp_string TOPOLOGY_TEAM_NAME;
   static const sp_string TOPOLOGY_TEAM_EMAIL;
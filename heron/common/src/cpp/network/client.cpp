@@ -22,7 +22,7 @@
 #include "basics/basics.h"
 
 Client::Client(EventLoop* eventLoop, const NetworkOptions& _options)
-    : BaseClient(eventLoop, _options) {
+    : BaseClient(eventLoop, _options), negotiate_type_ids_(false) {
   Init();
 }
 
@@ -44,10 +44,11 @@ void Client::SendRequest(google::protobuf::Message* _request, void* _ctx, sp_int
 
 void Client::SendResponse(REQID _id, const google::protobuf::Message& _response) {
   sp_int32 byte_size = _response.ByteSize();
-  sp_uint32 data_size = OutgoingPacket::SizeRequiredToPackString(_response.GetTypeName()) +
+  sp_int32 type_id = PeerTypeId(_response.GetTypeName());
+  sp_uint32 data_size = OutgoingPacket::SizeRequiredToPackType(_response.GetTypeName(), type_id) +
                         REQID_size + OutgoingPacket::SizeRequiredToPackProtocolBuffer(byte_size);
   auto opkt = new OutgoingPacket(data_size);
-  CHECK_EQ(opkt->PackString(_response.GetTypeName()), 0);
+  CHECK_EQ(opkt->PackType(_response.GetTypeName(), type_id), 0);
   CHECK_EQ(opkt->PackREQID(_id), 0);
   CHECK_EQ(opkt->PackProtocolBuffer(_response, byte_size), 0);
   InternalSendResponse(opkt);
@@ -84,7 +85,12 @@ BaseConnection* Client::CreateConnection(ConnectionEndPoint* _endpoint, Connecti
   return conn;
 }
 
-void Client::HandleConnect_Base(NetworkErrorCode _status) { HandleConnect(_status); }
+void Client::HandleConnect_Base(NetworkErrorCode _status) {
+  if (_status == OK && negotiate_type_ids_) {
+    InternalSendResponse(typeIds_.MakeHandshake());
+  }
+  HandleConnect(_status);
+}
 
 void Client::HandleClose_Base(NetworkErrorCode _status) { HandleClose(_status); }
 
@@ -108,10 +114,11 @@ void Client::InternalSendRequest(google::protobuf::Message* _request, void* _ctx
 
   // Make the outgoing packet
   sp_int32 byte_size = _request->ByteSize();
-  sp_uint32 sop = OutgoingPacket::SizeRequiredToPackString(_request->GetTypeName()) + REQID_size +
-                  OutgoingPacket::SizeRequiredToPackProtocolBuffer(byte_size);
+  sp_int32 type_id = PeerTypeId(_request->GetTypeName());
+  sp_uint32 sop = OutgoingPacket::SizeRequiredToPackType(_request->GetTypeName(), type_id) +
+                  REQID_size + OutgoingPacket::SizeRequiredToPackProtocolBuffer(byte_size);
   auto opkt = new OutgoingPacket(sop);
-  CHECK_EQ(opkt->PackString(_request->GetTypeName()), 0);
+  CHECK_EQ(opkt->PackType(_request->GetTypeName(), type_id), 0);
   CHECK_EQ(opkt->PackREQID(rid), 0);
   CHECK_EQ(opkt->PackProtocolBuffer(*_request, byte_size), 0);
 
@@ -144,10 +151,11 @@ void Client::InternalSendMessage(const google::protobuf::Message& _message) {
 
   // Make the outgoing packet
   sp_int32 byte_size = _message.ByteSize();
-  sp_uint32 sop = OutgoingPacket::SizeRequiredToPackString(_message.GetTypeName()) + REQID_size +
-                  OutgoingPacket::SizeRequiredToPackProtocolBuffer(byte_size);
+  sp_int32 type_id = PeerTypeId(_message.GetTypeName());
+  sp_uint32 sop = OutgoingPacket::SizeRequiredToPackType(_message.GetTypeName(), type_id) +
+                  REQID_size + OutgoingPacket::SizeRequiredToPackProtocolBuffer(byte_size);
   auto opkt = new OutgoingPacket(sop);
-  CHECK_EQ(opkt->PackString(_message.GetTypeName()), 0);
+  CHECK_EQ(opkt->PackType(_message.GetTypeName(), type_id), 0);
   CHECK_EQ(opkt->PackREQID(rid), 0);
   CHECK_EQ(opkt->PackProtocolBuffer(_message, byte_size), 0);
 
@@ -178,14 +186,27 @@ void Client::InternalSendResponse(OutgoingPacket* _packet) {
 
 void Client::OnNewPacket(IncomingPacket* _ipkt) {
   std::string typname;
+  sp_int32 type_id;
 
-  if (_ipkt->UnPackString(&typname) != 0) {
+  if (_ipkt->UnPackType(&typname, &type_id) != 0) {
     Connection* conn = static_cast<Connection*>(conn_);
-    LOG(FATAL) << "UnPackString failed from connection " << conn << " from hostport "
+    LOG(FATAL) << "UnPackType failed from connection " << conn << " from hostport "
                << conn->getIPAddress() << ":" << conn->getPort();
   }
 
-  if (requestHandlers.count(typname) > 0) {
+  if (type_id > 0) {
+    if (type_id <= static_cast<sp_int32>(typeIdHandlers_.size()) && typeIdHandlers_[type_id - 1]) {
+      typeIdHandlers_[type_id - 1](_ipkt);
+    } else {
+      LOG(ERROR) << "Dropping packet with unknown type id " << type_id;
+    }
+  } else if (typname == TypeIds::HANDSHAKE_TYPE_NAME) {
+    Connection* conn = static_cast<Connection*>(conn_);
+    if (conn->getPeerTypeIds()->UnPackHandshake(_ipkt) != 0) {
+      LOG(ERROR) << "Bad TypeIds handshake from " << conn->getIPAddress() << ":"
+                 << conn->getPort();
+    }
+  } else if (requestHandlers.count(typname) > 0) {
     // this is a request
     requestHandlers[typname](_ipkt);
   } else if (messageHandlers.count(typname) > 0) {
@@ -202,6 +223,19 @@ void Client::OnNewPacket(IncomingPacket* _ipkt) {
   delete _ipkt;
 }
 
+void Client::InstallTypeIdHandler(const sp_string& _type_name, handler _handler) {
+  sp_int32 type_id = typeIds_.Add(_type_name);
+  if (type_id > static_cast<sp_int32>(typeIdHandlers_.size())) {
+    typeIdHandlers_.resize(type_id);
+  }
+  typeIdHandlers_[type_id - 1] = std::move(_handler);
+}
+
+sp_int32 Client::PeerTypeId(const sp_string& _type_name) const {
+  if (!conn_) return 0;
+  return static_cast<Connection*>(conn_)->getPeerTypeId(_type_name);
+}
+
 void Client::OnPacketTimer(REQID _id, EventLoop::Status) {
   if (context_map_.find(_id) == context_map_.end()) {
     // most likely this was due to the requests being retired before the timer.
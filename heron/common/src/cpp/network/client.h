@@ -37,6 +37,7 @@
 #include <utility>
 #include <list>
 #include <typeindex>
+#include <vector>
 #include "basics/basics.h"
 #include "glog/logging.h"
 #include "network/connection.h"
@@ -46,6 +47,7 @@
 #include "network/networkoptions.h"
 #include "network/network_error.h"
 #include "network/packet.h"
+#include "network/typeids.h"
 #include "network/mempool.h"
 
 /*
@@ -131,6 +133,8 @@ class Client : public BaseClient {
     responseHandlers[m->GetTypeName()] = std::bind(&Client::dispatchResponse<T, M>, this, t, method,
                                                    std::placeholders::_1, std::placeholders::_2);
     requestResponseMap_[_request->GetTypeName()] = m->GetTypeName();
+    res_handler& h = responseHandlers[m->GetTypeName()];
+    InstallTypeIdHandler(m->GetTypeName(), [&h](IncomingPacket* _ipkt) { h(_ipkt, OK); });
     delete m;
     delete _request;
   }
@@ -142,6 +146,7 @@ class Client : public BaseClient {
     T* t = static_cast<T*>(this);
     requestHandlers[m->GetTypeName()] =
         std::bind(&Client::dispatchRequest<T, M>, this, t, method, std::placeholders::_1);
+    InstallTypeIdHandler(m->GetTypeName(), requestHandlers[m->GetTypeName()]);
     delete m;
   }
 
@@ -152,6 +157,13 @@ class Client : public BaseClient {
     T* t = static_cast<T*>(this);
     messageHandlers[m->GetTypeName()] =
         std::bind(&Client::dispatchMessage<T, M>, this, t, method, std::placeholders::_1);
+    handler& h = messageHandlers[m->GetTypeName()];
+    InstallTypeIdHandler(m->GetTypeName(), [&h](IncomingPacket* _ipkt) {
+      // We just ignore the reqid
+      REQID rid;
+      CHECK_EQ(_ipkt->UnPackREQID(&rid), 0);
+      h(_ipkt);
+    });
     delete m;
   }
 
@@ -195,6 +207,13 @@ class Client : public BaseClient {
   // friend classes that can access the protected functions
   friend void CallHandleSentRequestAndDelete(Client*, google::protobuf::Message*, void* ctx,
                                              NetworkErrorCode);
+  // Makes the client announce the ids of the message types it handles
+  // when it connects, and use the ids announced back by the server instead
+  // of the type names once it has them. Only enable this when talking to
+  // servers that understand the TypeIds handshake, since others may drop
+  // the connection on it. Must be called before Start.
+  void EnableTypeIds() { negotiate_type_ids_ = true; }
+
   // Backpressure handler
   virtual void StartBackPressureConnectionCb(Connection* connection);
   // Backpressure Reliever
@@ -214,6 +233,9 @@ class Client : public BaseClient {
   void InternalSendMessage(const google::protobuf::Message& _message);
   void InternalSendResponse(OutgoingPacket* _packet);
 
+  // The id that the server wants _type_name to be sent as. 0 means the name
+  sp_int32 PeerTypeId(const sp_string& _type_name) const;
+
   // Internal method to be called by the Connection class
   // when a new packet arrives
   void OnNewPacket(IncomingPacket* packet);
@@ -297,6 +319,12 @@ class Client : public BaseClient {
   std::unordered_map<std::string, res_handler> responseHandlers;
   std::unordered_map<std::string, std::string> requestResponseMap_;
 
+  // The same handlers, indexed by type id - 1
+  void InstallTypeIdHandler(const sp_string& _type_name, handler _handler);
+  bool negotiate_type_ids_;
+  TypeIds typeIds_;
+  std::vector<handler> typeIdHandlers_;
+
   // REQID generator
   REQID_Generator* message_rid_gen_;
 };
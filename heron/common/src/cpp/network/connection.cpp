@@ -15,6 +15,7 @@
  */
 
 #include "network/connection.h"
+#include <sys/socket.h>
 #include <list>
 #include <utility>
 
@@ -25,6 +26,10 @@
 #include "glog/logging.h"
 
 const sp_int32 __SYSTEM_NETWORK_READ_BATCH_SIZE__ = 1048576;           // 1M
+// Size of the slabs that packets are read into. Packets larger than a
+// quarter of that are read into buffers of their own instead.
+const sp_uint32 __SYSTEM_NETWORK_READ_SLAB_SIZE__ = 64 * 1024;         // 64K
+const sp_uint32 __SYSTEM_NETWORK_MAX_SLAB_PACKET_SIZE__ = __SYSTEM_NETWORK_READ_SLAB_SIZE__ / 4;
 const sp_int32 __SYSTEM_NETWORK_DEFAULT_WRITE_BATCH_SIZE__ = 1048576;  // 1M
 
 // How many times should we wait to see a buffer full while enqueueing data
@@ -40,7 +45,10 @@ sp_int64 Connection::systemLWMOutstandingBytes = 1024 * 1024 * 50;  // 50M
 Connection::Connection(ConnectionEndPoint* endpoint, ConnectionOptions* options,
                        EventLoop* eventLoop)
     : BaseConnection(endpoint, options, eventLoop) {
-  mIncomingPacket = new IncomingPacket(mOptions->max_packet_size_);
+  mIncomingPacket = NULL;
+  mReadSlab = new PacketSlab(__SYSTEM_NETWORK_READ_SLAB_SIZE__);
+  mReadStart = 0;
+  mReadEnd = 0;
   mOnNewPacket = NULL;
   mOnConnectionBufferEmpty = NULL;
   mOnConnectionBufferFull = NULL;
@@ -60,6 +68,7 @@ Connection::~Connection() {
     mOnConnectionBufferEmpty(this);
   }
   delete mIncomingPacket;
+  mReadSlab->Release();
   {
     for (auto iter = mOutstandingPackets.begin(); iter != mOutstandingPackets.end(); ++iter) {
       delete iter->first;
@@ -183,7 +192,22 @@ sp_int32 Connection::writeIntoEndPoint(sp_int32 fd) {
     sp_int32 toWrite = 0;
     sp_int32 simulWrites = writeIntoIOVector(stillToWrite, &toWrite);
 
-    ssize_t numWritten = ::writev(fd, mIOVector, simulWrites);
+    ssize_t numWritten;
+#if defined(MSG_MORE)
+    if (toWrite < mNumOutstandingBytes) {
+      // We know that more is coming, so let the kernel hold back a partial
+      // segment at the end until it does
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = mIOVector;
+      msg.msg_iovlen = simulWrites;
+      numWritten = ::sendmsg(fd, &msg, MSG_MORE);
+    } else {
+      numWritten = ::writev(fd, mIOVector, simulWrites);
+    }
+#else
+    numWritten = ::writev(fd, mIOVector, simulWrites);
+#endif
     if (numWritten >= 0) {
       afterWriteIntoIOVector(simulWrites, numWritten);
       bytesWritten += numWritten;
@@ -227,21 +251,103 @@ void Connection::handleDataWritten() {
 
 sp_int32 Connection::readFromEndPoint(sp_int32 fd) {
   sp_int32 bytesRead = 0;
+  bool drained = false;
   while (1) {
-    sp_int32 read_status = mIncomingPacket->Read(fd);
-    if (read_status == 0) {
-      // Packet was succcessfully read.
-      IncomingPacket* packet = mIncomingPacket;
-      mIncomingPacket = new IncomingPacket(mOptions->max_packet_size_);
-      mReceivedPackets.push_back(packet);
-      bytesRead += packet->GetTotalPacketSize();
-      if (bytesRead >= __SYSTEM_NETWORK_READ_BATCH_SIZE__) {
+    if (mIncomingPacket) {
+      // A large packet is read straight into its own buffer
+      sp_int32 read_status = mIncomingPacket->Read(fd);
+      if (read_status > 0) {
+        // packet was read partially
         return 0;
+      } else if (read_status < 0) {
+        return -1;
       }
-    } else if (read_status > 0) {
-      // packet was read partially
+      bytesRead += mIncomingPacket->GetTotalPacketSize();
+      mReceivedPackets.push_back(mIncomingPacket);
+      mIncomingPacket = NULL;
+    }
+
+    if (carveReadSlab(&bytesRead) != 0) {
+      return -1;
+    }
+    if (mIncomingPacket) {
+      continue;
+    }
+    if (drained || bytesRead >= __SYSTEM_NETWORK_READ_BATCH_SIZE__) {
+      // The event loop tells us when there is more to read
+      return 0;
+    }
+
+    sp_int32 read_status = fillReadSlab(fd);
+    if (read_status < 0) {
+      return -1;
+    }
+    drained = read_status > 0;
+  }
+}
+
+sp_int32 Connection::carveReadSlab(sp_int32* _bytesRead) {
+  while (mReadEnd - mReadStart >= PacketHeader::header_size()) {
+    char* start = mReadSlab->data() + mReadStart;
+    sp_uint32 size = PacketHeader::get_packet_size(start);
+    if (mOptions->max_packet_size_ != 0 && size > mOptions->max_packet_size_) {
+      LOG(ERROR) << "Too large packet size " << size << ". We only accept packet sizes <= "
+                 << mOptions->max_packet_size_;
+      return -1;
+    }
+    sp_uint32 total = PacketHeader::header_size() + size;
+    if (mReadEnd - mReadStart >= total) {
+      // Packet was succcessfully read.
+      mReceivedPackets.push_back(new IncomingPacket(start, mReadSlab));
+      mReadStart += total;
+      *_bytesRead += total;
+    } else if (total > __SYSTEM_NETWORK_MAX_SLAB_PACKET_SIZE__) {
+      // Read the rest of this one into a buffer of its own
+      mIncomingPacket =
+          new IncomingPacket(mOptions->max_packet_size_, start, mReadEnd - mReadStart);
+      mReadStart = mReadEnd;
       return 0;
     } else {
+      return 0;
+    }
+  }
+  return 0;
+}
+
+sp_int32 Connection::fillReadSlab(sp_int32 fd) {
+  sp_uint32 pending = mReadEnd - mReadStart;
+  if (!mReadSlab->IsShared()) {
+    // Nobody else is using the slab, so start over at its beginning
+    memmove(mReadSlab->data(), mReadSlab->data() + mReadStart, pending);
+    mReadStart = 0;
+    mReadEnd = pending;
+  } else if (mReadSlab->capacity() - mReadEnd < __SYSTEM_NETWORK_MAX_SLAB_PACKET_SIZE__) {
+    // Leave the slab to the packets carved out of it
+    auto slab = new PacketSlab(__SYSTEM_NETWORK_READ_SLAB_SIZE__);
+    memcpy(slab->data(), mReadSlab->data() + mReadStart, pending);
+    mReadSlab->Release();
+    mReadSlab = slab;
+    mReadStart = 0;
+    mReadEnd = pending;
+  }
+
+  sp_uint32 to_read = mReadSlab->capacity() - mReadEnd;
+  while (1) {
+    ssize_t num_read = read(fd, mReadSlab->data() + mReadEnd, to_read);
+    if (num_read > 0) {
+      mReadEnd += num_read;
+      // A short read means that the socket has been drained
+      return static_cast<sp_uint32>(num_read) < to_read ? 1 : 0;
+    } else if (num_read == 0) {
+      // remote end has done a shutdown.
+      LOG(ERROR) << "Remote end has done a shutdown";
+      return -1;
+    } else if (errno == EAGAIN) {
+      // The read would block.
+      return 1;
+    } else if (errno != EINTR) {
+      // something really bad happened. Bail out
+      LOG(ERROR) << "Something really bad happened while reading " << errno;
       return -1;
     }
   }
@@ -21,6 +21,7 @@
 #include <list>
 #include <utility>
 #include "network/packet.h"
+#include "network/typeids.h"
 #include "network/event_loop.h"
 #include "network/baseconnection.h"
 #include "network/network_error.h"
@@ -117,6 +118,13 @@ class Connection : public BaseConnection {
   sp_int32 putBackPressure();
   sp_int32 removeBackPressure();
 
+  // The TypeIds of the other end, if it has told us. See typeids.h
+  TypeIds* getPeerTypeIds() { return &mPeerTypeIds; }
+  // The id of _type_name at the other end, or 0 if it has none
+  sp_int32 getPeerTypeId(const sp_string& _type_name) const {
+    return mPeerTypeIds.Find(_type_name);
+  }
+
  public:
   // This is the high water mark on the num of bytes that can be left outstanding on a connection
   static sp_int64 systemHWMOutstandingBytes;
@@ -136,6 +144,16 @@ class Connection : public BaseConnection {
 
   virtual sp_int32 readFromEndPoint(sp_int32 _fd);
 
+  // Moves the complete packets in the read slab to mReceivedPackets, and
+  // starts mIncomingPacket if the next one is too large for the slab.
+  // Returns 0 on success, or a negative value for a bad packet.
+  sp_int32 carveReadSlab(sp_int32* _bytesRead);
+
+  // Reads as much as fits into the read slab, making room in it first.
+  // Returns 0 if more may be available, 1 if the socket has been drained
+  // and a negative value on errors.
+  sp_int32 fillReadSlab(sp_int32 _fd);
+
   virtual void handleDataRead();
 
   // The list of outstanding packets that need to be sent.
@@ -149,9 +167,15 @@ class Connection : public BaseConnection {
   // The list of packets that have been received but not yet delivered to the higher layer
   std::list<IncomingPacket*> mReceivedPackets;
 
-  // Incompletely read next packet
+  // Incompletely read next packet, when it is too large for the read slab
   IncomingPacket* mIncomingPacket;
 
+  // The slab that packets are read into. The bytes in
+  // [mReadStart, mReadEnd) have been read but not carved out yet.
+  PacketSlab* mReadSlab;
+  sp_uint32 mReadStart;
+  sp_uint32 mReadEnd;
+
   // The user registered callbacks
   VCallback<IncomingPacket*> mOnNewPacket;
   // This call back gets registered from the Server and gets called once the conneciton pipe
@@ -173,6 +197,8 @@ class Connection : public BaseConnection {
   // How many times have we enqueued data and found that we had outstanding bytes >
   // HWM of back pressure threshold
   sp_uint8 mNumEnqueuesWithBufferFull;
+
+  TypeIds mPeerTypeIds;
 };
 
 #endif  // HERON_COMMON_SRC_CPP_NETWORK_CONNECTION_H_
@@ -17,10 +17,10 @@
 #define MEM_POOL_H
 
 #include <google/protobuf/message.h>
-#include <vector>
-#include <unordered_map>
-#include <typeindex>
+#include <algorithm>
+#include <atomic>
 #include <mutex>
+#include <vector>
 
 template<typename T>
 class BaseMemPool {
@@ -50,60 +50,150 @@ class BaseMemPool {
 };
 
 
-template<typename B>
-class MemPool {
+// Pool of protobuf messages of type M. Every thread keeps its own cache of
+// free messages, so acquire and release don't take any lock as long as the
+// cache neither runs empty nor overflows. In those cases half a cache worth
+// of messages is moved from or to a global spill shared by all threads. The
+// spill is bounded, messages released beyond that are deleted.
+// Messages are not cleared on release. A message whose SpaceUsed() exceeds
+// the high water mark of its type is deleted instead of being pooled, so
+// that messages that once held a lot of data don't pin that memory forever.
+// SpaceUsed() walks the whole message, so release only calls it on every
+// kSpaceCheckInterval-th message of a thread. In between it goes by the
+// size cached by the last serialization, which costs nothing but misses
+// messages that were only parsed. A large message that gets past is caught
+// on one of its later releases.
+template<typename M>
+class ProtobufPool {
  public:
-  MemPool() {
-  }
+  // Number of free messages a thread caches per type
+  static const size_t kLocalCacheSize = 512;
+  // Number of free messages kept in the global spill per type
+  static const size_t kGlobalSpillSize = 8192;
+  // Every how many releases of a thread the SpaceUsed() is checked
+  static const size_t kSpaceCheckInterval = 64;
 
-  // TODO(cwang): we have a memory leak here.
-  ~MemPool() {
-    for (auto& m : map_) {
-      for (auto& n : m.second) {
-        delete n;
-      }
-      m.second.clear();
+  static M* acquire() {
+    std::vector<M*>& cache = local_cache().free_;
+    if (cache.empty() && !fill(&cache)) {
+      return new M();
     }
-    map_.clear();
+    M* m = cache.back();
+    cache.pop_back();
+    return m;
   }
 
-  template<typename M>
-  M* acquire(M* m) {
-    std::type_index type = typeid(M);
-    std::vector<B*>& pool = map_[type];
-
-    if (pool.empty()) {
-      return new M();
+  static void release(M* _m) {
+    LocalCache& local = local_cache();
+    size_t high_water_mark = high_water_mark_.load(std::memory_order_relaxed);
+    if (high_water_mark != 0 &&
+        (static_cast<size_t>(_m->GetCachedSize()) > high_water_mark ||
+         (++local.releases_ % kSpaceCheckInterval == 0 &&
+          static_cast<size_t>(_m->SpaceUsed()) > high_water_mark))) {
+      delete _m;
+      return;
+    }
+    std::vector<M*>& cache = local.free_;
+    if (cache.size() >= kLocalCacheSize) {
+      spill(&cache, kLocalCacheSize / 2);
     }
-    B* t = pool.back();
-    pool.pop_back();
-    return static_cast<M*>(t);
+    cache.push_back(_m);
   }
 
-  template<typename M>
-  void release(M* ptr) {
-    std::type_index type = typeid(M);
-    map_[type].push_back(static_cast<B*>(ptr));
+  // Sets the maximum SpaceUsed() in bytes of pooled messages. Zero means
+  // no limit, which is the default.
+  static void set_high_water_mark(size_t _bytes) {
+    high_water_mark_.store(_bytes, std::memory_order_relaxed);
+  }
+
+  static size_t get_high_water_mark() {
+    return high_water_mark_.load(std::memory_order_relaxed);
   }
 
  private:
-  std::unordered_map<std::type_index, std::vector<B*>> map_;
+  struct LocalCache {
+    LocalCache() : releases_(0) { free_.reserve(kLocalCacheSize); }
+    // Hand over the free messages when the thread exits
+    ~LocalCache() { spill(&free_, free_.size()); }
+    std::vector<M*> free_;
+    // Number of releases while there was a high water mark
+    size_t releases_;
+  };
+
+  struct GlobalSpill {
+    std::mutex mutex_;
+    std::vector<M*> free_;
+  };
+
+  static LocalCache& local_cache() {
+    static thread_local LocalCache cache;
+    return cache;
+  }
+
+  // Never destroyed, threads may still release messages during shutdown
+  static GlobalSpill& global_spill() {
+    static GlobalSpill* spill = new GlobalSpill();
+    return *spill;
+  }
+
+  // Moves up to half a cache worth of messages from the global spill into
+  // _cache. Returns false if there were none.
+  static bool fill(std::vector<M*>* _cache) {
+    GlobalSpill& global = global_spill();
+    std::lock_guard<std::mutex> guard(global.mutex_);
+    size_t count = std::min(global.free_.size(), kLocalCacheSize / 2);
+    _cache->insert(_cache->end(), global.free_.end() - count, global.free_.end());
+    global.free_.resize(global.free_.size() - count);
+    return count > 0;
+  }
+
+  // Moves the last _count messages of _cache to the global spill, deleting
+  // those that don't fit.
+  static void spill(std::vector<M*>* _cache, size_t _count) {
+    auto first = _cache->end() - _count;
+    {
+      GlobalSpill& global = global_spill();
+      std::lock_guard<std::mutex> guard(global.mutex_);
+      size_t room = kGlobalSpillSize - std::min(global.free_.size(), kGlobalSpillSize);
+      auto last = first + std::min(room, _count);
+      global.free_.insert(global.free_.end(), first, last);
+      first = last;
+    }
+    for (auto iter = first; iter != _cache->end(); ++iter) {
+      delete *iter;
+    }
+    _cache->resize(_cache->size() - _count);
+  }
+
+  static std::atomic<size_t> high_water_mark_;
 };
 
-extern MemPool<google::protobuf::Message>* __global_protobuf_pool__;
-extern std::mutex __global_protobuf_pool_mutex__;
+template<typename M>
+const size_t ProtobufPool<M>::kLocalCacheSize;
+
+template<typename M>
+const size_t ProtobufPool<M>::kGlobalSpillSize;
+
+template<typename M>
+const size_t ProtobufPool<M>::kSpaceCheckInterval;
+
+template<typename M>
+std::atomic<size_t> ProtobufPool<M>::high_water_mark_(0);
 
 template<typename T>
 T* __global_protobuf_pool_acquire__(T* _m) {
-  std::lock_guard<std::mutex> guard(__global_protobuf_pool_mutex__);
-  return __global_protobuf_pool__->acquire(_m);
+  return ProtobufPool<T>::acquire();
 }
 
 template<typename T>
 void __global_protobuf_pool_release__(T* _m) {
-  std::lock_guard<std::mutex> guard(__global_protobuf_pool_mutex__);
-  __global_protobuf_pool__->release(_m);
+  ProtobufPool<T>::release(_m);
 }
 
-#endif
+// Sets the high water mark of the pool of T, see ProtobufPool
+template<typename T>
+void __global_protobuf_pool_set_high_water_mark__(T*, size_t _bytes) {
+  ProtobufPool<T>::set_high_water_mark(_bytes);
+}
 
+#endif
@@ -30,6 +30,7 @@
 #include "network/event_loop_impl.h"
 #include "network/asyncdns.h"
 #include "network/packet.h"
+#include "network/typeids.h"
 #include "network/baseconnection.h"
 #include "network/connection.h"
 #include "network/baseserver.h"
@@ -37,23 +37,69 @@ sp_uint32 PacketHeader::get_packet_size(const char* header) {
 
 sp_uint32 PacketHeader::header_size() { return kSPPacketSize; }
 
+PacketSlab::PacketSlab(sp_uint32 _capacity) : refs_(1), capacity_(_capacity) {
+  data_ = new char[_capacity];
+}
+
+PacketSlab::~PacketSlab() { delete[] data_; }
+
+// Room left in front of the data of incoming packets
+static const sp_uint32 kIncomingPacketHeadroom = 64;
+
 // Constructor of the IncomingPacket. We only create the header buffer.
 IncomingPacket::IncomingPacket(sp_uint32 _max_packet_size) {
   max_packet_size_ = _max_packet_size;
   position_ = 0;
   // bzero(header_, PacketHeader::size());
   data_ = NULL;
+  buffer_ = NULL;
+  slab_ = NULL;
+}
+
+IncomingPacket::IncomingPacket(sp_uint32 _max_packet_size, const char* _bytes, sp_uint32 _size) {
+  max_packet_size_ = _max_packet_size;
+  memcpy(header_, _bytes, PacketHeader::header_size());
+  buffer_ = new char[kIncomingPacketHeadroom + PacketHeader::get_packet_size(header_)];
+  data_ = buffer_ + kIncomingPacketHeadroom;
+  position_ = _size - PacketHeader::header_size();
+  memcpy(data_, _bytes + PacketHeader::header_size(), position_);
+  slab_ = NULL;
+}
+
+IncomingPacket::IncomingPacket(char* _start, PacketSlab* _slab) {
+  max_packet_size_ = 0;
+  memcpy(header_, _start, PacketHeader::header_size());
+  data_ = _start + PacketHeader::header_size();
+  buffer_ = NULL;
+  slab_ = _slab;
+  slab_->AddRef();
+  position_ = 0;
 }
 
 // Construct an incoming from a raw data buffer - used for tests only
 IncomingPacket::IncomingPacket(char* _data) {
   memcpy(header_, _data, PacketHeader::header_size());
-  data_ = new char[PacketHeader::get_packet_size(header_)];
+  buffer_ = new char[kIncomingPacketHeadroom + PacketHeader::get_packet_size(header_)];
+  data_ = buffer_ + kIncomingPacketHeadroom;
   memcpy(data_, _data + PacketHeader::header_size(), PacketHeader::get_packet_size(header_));
   position_ = 0;
+  slab_ = NULL;
+}
+
+IncomingPacket::~IncomingPacket() {
+  delete[] buffer_;
+  if (slab_) slab_->Release();
 }
 
-IncomingPacket::~IncomingPacket() { delete[] data_; }
+void IncomingPacket::CopyOutOfSlab() {
+  if (!slab_) return;
+  sp_uint32 size = PacketHeader::get_packet_size(header_);
+  buffer_ = new char[kIncomingPacketHeadroom + size];
+  memcpy(buffer_ + kIncomingPacketHeadroom, data_, size);
+  data_ = buffer_ + kIncomingPacketHeadroom;
+  slab_->Release();
+  slab_ = NULL;
+}
 
 sp_int32 IncomingPacket::UnPackInt(sp_int32* i) {
   if (data_ == NULL) return -1;
@@ -74,6 +120,21 @@ sp_int32 IncomingPacket::UnPackString(sp_string* i) {
   return 0;
 }
 
+sp_int32 IncomingPacket::UnPackType(sp_string* _type_name, sp_int32* _type_id) {
+  sp_int32 size = 0;
+  if (UnPackInt(&size) != 0) return -1;
+  if (size < 0) {
+    // A type id, sent negated to tell it apart from the length of a name
+    *_type_id = -size;
+    return 0;
+  }
+  if (position_ + size > PacketHeader::get_packet_size(header_)) return -1;
+  *_type_name = std::string(data_ + position_, size);
+  position_ += size;
+  *_type_id = 0;
+  return 0;
+}
+
 sp_int32 IncomingPacket::UnPackProtocolBuffer(google::protobuf::Message* _proto) {
   sp_int32 sz;
   if (UnPackInt(&sz) != 0) return -1;
@@ -83,6 +144,16 @@ sp_int32 IncomingPacket::UnPackProtocolBuffer(google::protobuf::Message* _proto)
   return 0;
 }
 
+sp_int32 IncomingPacket::UnPackProtocolBuffer(const char** _message, sp_int32* _byte_size) {
+  sp_int32 sz;
+  if (UnPackInt(&sz) != 0) return -1;
+  if (sz < 0 || position_ + sz > PacketHeader::get_packet_size(header_)) return -1;
+  *_message = data_ + position_;
+  *_byte_size = sz;
+  position_ += sz;
+  return 0;
+}
+
 sp_int32 IncomingPacket::UnPackREQID(REQID* _rid) {
   if (position_ + REQID_size > PacketHeader::get_packet_size(header_)) return -1;
   _rid->assign(std::string(data_ + position_, REQID_size));
@@ -117,7 +188,8 @@ sp_int32 IncomingPacket::Read(sp_int32 _fd) {
 
       } else {
         // Create the data
-        data_ = new char[PacketHeader::get_packet_size(header_)];
+        buffer_ = new char[kIncomingPacketHeadroom + PacketHeader::get_packet_size(header_)];
+        data_ = buffer_ + kIncomingPacketHeadroom;
 
         // bzero(data_, PacketHeader::get_packet_size(header_));
         // reset the position to refer to the data_
@@ -176,11 +248,32 @@ sp_int32 IncomingPacket::InternalRead(sp_int32 _fd, char* _buffer, sp_uint32 _si
 OutgoingPacket::OutgoingPacket(sp_uint32 _packet_size) {
   total_packet_size_ = _packet_size + PacketHeader::header_size();
   data_ = new char[total_packet_size_];
+  buffer_ = data_;
+  PacketHeader::set_packet_size(data_, _packet_size);
+  position_ = PacketHeader::header_size();
+}
+
+OutgoingPacket::OutgoingPacket(sp_uint32 _packet_size, IncomingPacket* _ipkt,
+                               const char* _tail, sp_uint32 _tail_size) {
+  total_packet_size_ = _packet_size + PacketHeader::header_size();
+  CHECK_LE(_tail_size, total_packet_size_);
+  sp_uint32 prefix_size = total_packet_size_ - _tail_size;
+  const char* ipkt_data = _ipkt->data_;
+  if (_ipkt->buffer_ != NULL && _tail >= _ipkt->buffer_ + prefix_size &&
+      _tail + _tail_size <= ipkt_data + PacketHeader::get_packet_size(_ipkt->header_)) {
+    buffer_ = _ipkt->buffer_;
+    _ipkt->buffer_ = NULL;
+    _ipkt->data_ = NULL;
+    data_ = const_cast<char*>(_tail) - prefix_size;
+  } else {
+    data_ = new char[total_packet_size_];
+    buffer_ = data_;
+  }
   PacketHeader::set_packet_size(data_, _packet_size);
   position_ = PacketHeader::header_size();
 }
 
-OutgoingPacket::~OutgoingPacket() { delete[] data_; }
+OutgoingPacket::~OutgoingPacket() { delete[] buffer_; }
 
 sp_uint32 OutgoingPacket::GetTotalPacketSize() const { return total_packet_size_; }
 
@@ -220,11 +313,24 @@ sp_int32 OutgoingPacket::PackProtocolBuffer(const char* _message,
     return -1;
   }
 
-  memcpy(data_ + position_, _message, _byte_size);
+  // Nothing to copy if the packet was laid out around _message
+  if (data_ + position_ != _message) {
+    memcpy(data_ + position_, _message, _byte_size);
+  }
   position_ += _byte_size;
   return 0;
 }
 
+char* OutgoingPacket::ReserveProtocolBuffer(sp_int32 _byte_size) {
+  if (PackInt(_byte_size) != 0) return NULL;
+  if (_byte_size + position_ > total_packet_size_) {
+    return NULL;
+  }
+  char* reserved = data_ + position_;
+  position_ += _byte_size;
+  return reserved;
+}
+
 sp_int32 OutgoingPacket::PackREQID(const REQID& _rid) {
   if (REQID_size + position_ > total_packet_size_) {
     return -1;
@@ -248,6 +354,18 @@ sp_int32 OutgoingPacket::PackString(const sp_string& i) {
   return 0;
 }
 
+sp_uint32 OutgoingPacket::SizeRequiredToPackType(const sp_string& _type_name,
+                                                 sp_int32 _type_id) {
+  return _type_id > 0 ? sizeof(sp_int32) : SizeRequiredToPackString(_type_name);
+}
+
+sp_int32 OutgoingPacket::PackType(const sp_string& _type_name, sp_int32 _type_id) {
+  if (_type_id > 0) {
+    return PackInt(-_type_id);
+  }
+  return PackString(_type_name);
+}
+
 void OutgoingPacket::PrepareForWriting() {
   CHECK(position_ == total_packet_size_);
   position_ = 0;
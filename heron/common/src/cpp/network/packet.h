@@ -33,6 +33,7 @@
 #ifndef PACKET_H_
 #define PACKET_H_
 
+#include <atomic>
 #include <functional>
 #include <string>
 #include "basics/basics.h"
@@ -59,16 +60,46 @@ class PacketHeader {
   static sp_uint32 header_size();
 };
 
+/*
+ * Class PacketSlab - a reference counted chunk of memory that a Connection
+ * reads many packets into at once. The complete packets in it are carved
+ * out in place, each holding a reference to the slab, so that reading small
+ * packets takes neither a read call nor an allocation of its own. A packet
+ * that is kept around is to be copied out of the slab, see
+ * IncomingPacket::CopyOutOfSlab.
+ */
+class PacketSlab {
+ public:
+  // The slab starts out with one reference, held by its creator
+  explicit PacketSlab(sp_uint32 _capacity);
+
+  void AddRef() { refs_.fetch_add(1, std::memory_order_relaxed); }
+  // Deletes the slab once the last reference is gone
+  void Release() {
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+  }
+  // Is anyone besides the caller holding on to the slab
+  bool IsShared() const { return refs_.load(std::memory_order_acquire) > 1; }
+
+  char* data() { return data_; }
+  sp_uint32 capacity() const { return capacity_; }
+
+ private:
+  ~PacketSlab();
+
+  std::atomic<sp_int32> refs_;
+  char* data_;
+  sp_uint32 capacity_;
+};
+
 /*
  * Class IncomingPacket - Definition of incoming packet
  *
  * Servers and clients use this structure to receive request/respones.
- * The underlying implementation uses two buffers. One for the header
- * and one for the actual data. We first read the header(since it is of
- * a fixed size. The header contain the data length information that allows
- * us to read the right amount of data. This implementation has the side
- * effect that we will need atleast two read calls to completely read a
- * packet.
+ * The header is kept apart from the data. The data either lies in a
+ * PacketSlab that the packet was carved out of, or, for packets too large
+ * for that, in a buffer of its own that the packet reads itself into once
+ * it knows its size from the header.
  */
 class IncomingPacket {
  public:
@@ -93,9 +124,20 @@ class IncomingPacket {
   // unpack a string
   sp_int32 UnPackString(sp_string* i);
 
+  // unpack the type of a message. It is sent either as the type name or,
+  // if the receiver has told the sender its TypeIds, as the id of the type.
+  // In the latter case _type_id is set to that id and _type_name is left
+  // untouched, otherwise _type_id is set to 0.
+  sp_int32 UnPackType(sp_string* _type_name, sp_int32* _type_id);
+
   // unpack a protocol buffer
   sp_int32 UnPackProtocolBuffer(google::protobuf::Message* _proto);
 
+  // unpack a protocol buffer without parsing it. On success _message points
+  // to the serialized bytes inside this packet and _byte_size is their length.
+  // The pointer is valid only as long as the packet owns its data.
+  sp_int32 UnPackProtocolBuffer(const char** _message, sp_int32* _byte_size);
+
   // unpack a request id
   sp_int32 UnPackREQID(REQID* _rid);
 
@@ -108,10 +150,26 @@ class IncomingPacket {
   // Get the total size of the packet
   sp_uint32 GetTotalPacketSize() const;
 
+  // Copies the data into a buffer of the packet's own if it lies in a
+  // slab, and lets go of the slab. Whoever keeps a packet past the handler
+  // it was given to should call this, as otherwise the small packet keeps
+  // the whole slab from being freed. The read position is kept.
+  void CopyOutOfSlab();
+
  private:
   // Only Connection class can use the Read method to have
   // the packet read itself.
   friend class Connection;
+  friend class PacketSlabTest;
+
+  // A packet of max_packet_size len at most, whose first _size bytes,
+  // header included, are _bytes. The rest is to be Read.
+  IncomingPacket(sp_uint32 _max_packet_size, const char* _bytes, sp_uint32 _size);
+
+  // A packet whose header and data lie in _slab at _start
+  IncomingPacket(char* _start, PacketSlab* _slab);
+  // OutgoingPacket can take over the data buffer to forward bytes without copying
+  friend class OutgoingPacket;
 
   // Read the packet from the file descriptor fd.
   // Returns 0 if the packet has been read completely.
@@ -135,6 +193,14 @@ class IncomingPacket {
 
   // The pointer to the data.
   char* data_;
+
+  // The buffer that data_ was allocated in, if it has one of its own. It
+  // has some room in front of data_, so that forwarding the packet with a
+  // larger header than it came with can still reuse it.
+  char* buffer_;
+
+  // The slab that data_ lies in, otherwise
+  PacketSlab* slab_;
 };
 
 /*
@@ -150,6 +216,15 @@ class OutgoingPacket {
   // Constructor takes in a packet size parameter. The packet data
   // size must be exactly equal to the size specified.
   explicit OutgoingPacket(sp_uint32 packet_size);
+
+  // Constructs a packet whose last _tail_size bytes will be packed from
+  // _tail, a buffer inside _ipkt. When _ipkt has a buffer of its own and
+  // _tail is preceded by enough bytes of it for the rest of this packet,
+  // the buffer of _ipkt is taken over
+  // and the packet is laid out around _tail, so that packing _tail later
+  // doesn't copy it. _ipkt must not be unpacked after that.
+  OutgoingPacket(sp_uint32 packet_size, IncomingPacket* _ipkt,
+                 const char* _tail, sp_uint32 _tail_size);
   ~OutgoingPacket();
 
   // Packing functions
@@ -165,6 +240,14 @@ class OutgoingPacket {
   // pack a string
   sp_int32 PackString(const sp_string& i);
 
+  // helper function to determine how much space is needed to encode the type
+  // of a message. _type_id is the id of the type in the TypeIds of the
+  // receiver, or 0 if it has none.
+  static sp_uint32 SizeRequiredToPackType(const sp_string& _type_name, sp_int32 _type_id);
+
+  // pack the type of a message as its id if it has one, else as its name
+  sp_int32 PackType(const sp_string& _type_name, sp_int32 _type_id);
+
   // helper function to determine how much space is needed to encode a protobuf
   // The paramter byte_size is the whats reported by the ByteSize
   static sp_uint32 SizeRequiredToPackProtocolBuffer(sp_int32 _byte_size);
@@ -174,6 +257,10 @@ class OutgoingPacket {
 
   sp_int32 PackProtocolBuffer(const char* _message, sp_int32 _byte_size);
 
+  // pack the size of a proto buffer of _byte_size bytes, and return where
+  // the caller has to write its serialized bytes, or NULL if they don't fit
+  char* ReserveProtocolBuffer(sp_int32 _byte_size);
+
   // pack a request id
   sp_int32 PackREQID(const REQID& _rid);
 
@@ -213,6 +300,10 @@ class OutgoingPacket {
   // The header + data that makes the packet.
   char* data_;
 
+  // The buffer owned by this packet. This is data_ unless the buffer was
+  // taken over from an IncomingPacket, in which case data_ points inside it.
+  char* buffer_;
+
   // The packet size as specified in the constructor.
   sp_uint32 total_packet_size_;
 };
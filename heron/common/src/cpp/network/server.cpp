@@ -39,16 +39,21 @@ sp_int32 Server::Stop() { return Stop_Base(); }
 void Server::SendResponse(REQID _id, Connection* _connection,
                           const google::protobuf::Message& _response) {
   sp_int32 byte_size = _response.ByteSize();
-  sp_uint32 data_size = OutgoingPacket::SizeRequiredToPackString(_response.GetTypeName()) +
+  sp_int32 type_id = PeerTypeId(_connection, _response.GetTypeName());
+  sp_uint32 data_size = OutgoingPacket::SizeRequiredToPackType(_response.GetTypeName(), type_id) +
                         REQID_size + OutgoingPacket::SizeRequiredToPackProtocolBuffer(byte_size);
   auto opkt = new OutgoingPacket(data_size);
-  CHECK_EQ(opkt->PackString(_response.GetTypeName()), 0);
+  CHECK_EQ(opkt->PackType(_response.GetTypeName(), type_id), 0);
   CHECK_EQ(opkt->PackREQID(_id), 0);
   CHECK_EQ(opkt->PackProtocolBuffer(_response, byte_size), 0);
   InternalSendResponse(_connection, opkt);
   return;
 }
 
+void Server::SendResponse(Connection* _connection, OutgoingPacket* _packet) {
+  InternalSendResponse(_connection, _packet);
+}
+
 void Server::SendMessage(Connection* _connection,
                          sp_int32 _byte_size,
                          const sp_string _type_name,
@@ -56,14 +61,37 @@ void Server::SendMessage(Connection* _connection,
   // Generate a zero reqid
   REQID rid = REQID_Generator::generate_zero_reqid();
 
-  sp_uint32 data_size = OutgoingPacket::SizeRequiredToPackString(_type_name) +
+  sp_int32 type_id = PeerTypeId(_connection, _type_name);
+  sp_uint32 data_size = OutgoingPacket::SizeRequiredToPackType(_type_name, type_id) +
                           REQID_size + OutgoingPacket::SizeRequiredToPackProtocolBuffer(_byte_size);
 
   OutgoingPacket* opkt = new OutgoingPacket(data_size);
 
-  CHECK_EQ(opkt->PackString(_type_name), 0);
+  CHECK_EQ(opkt->PackType(_type_name, type_id), 0);
+  CHECK_EQ(opkt->PackREQID(rid), 0);
+  CHECK_EQ(opkt->PackProtocolBuffer(_message, _byte_size), 0);
+  InternalSendResponse(_connection, opkt);
+  return;
+}
+
+void Server::SendMessage(Connection* _connection,
+                         IncomingPacket* _packet,
+                         sp_int32 _byte_size,
+                         const sp_string& _type_name,
+                         const char* _message) {
+  // Generate a zero reqid
+  REQID rid = REQID_Generator::generate_zero_reqid();
+
+  sp_int32 type_id = PeerTypeId(_connection, _type_name);
+  sp_uint32 data_size = OutgoingPacket::SizeRequiredToPackType(_type_name, type_id) +
+                          REQID_size + OutgoingPacket::SizeRequiredToPackProtocolBuffer(_byte_size);
+
+  OutgoingPacket* opkt = new OutgoingPacket(data_size, _packet, _message, _byte_size);
+
+  CHECK_EQ(opkt->PackType(_type_name, type_id), 0);
   CHECK_EQ(opkt->PackREQID(rid), 0);
   CHECK_EQ(opkt->PackProtocolBuffer(_message, _byte_size), 0);
+  delete _packet;
   InternalSendResponse(_connection, opkt);
   return;
 }
@@ -132,13 +160,39 @@ void Server::OnNewPacket(Connection* _connection, IncomingPacket* _packet) {
   }
 
   std::string typname;
-  if (_packet->UnPackString(&typname) != 0) {
-    LOG(ERROR) << "UnPackString failed from connection " << _connection << " from hostport "
+  sp_int32 type_id;
+  if (_packet->UnPackType(&typname, &type_id) != 0) {
+    LOG(ERROR) << "UnPackType failed from connection " << _connection << " from hostport "
                << _connection->getIPAddress() << ":" << _connection->getPort();
     delete _packet;
     _connection->closeConnection();
     return;
   }
+  if (type_id > 0) {
+    if (type_id > static_cast<sp_int32>(typeIdHandlers_.size())) {
+      LOG(ERROR) << "Unknown type id " << type_id << " received from connection " << _connection
+                 << " from hostport " << _connection->getIPAddress() << ":"
+                 << _connection->getPort();
+      delete _packet;
+      _connection->closeConnection();
+      return;
+    }
+    const TypeIdHandler& h = typeIdHandlers_[type_id - 1];
+    h.handler_(_connection, _packet);
+    if (!h.raw_) delete _packet;
+    return;
+  }
+  if (typname == TypeIds::HANDSHAKE_TYPE_NAME) {
+    HandleTypeIdsHandshake(_connection, _packet);
+    delete _packet;
+    return;
+  }
+  auto raw_handler = rawMessageHandlers.find(typname);
+  if (raw_handler != rawMessageHandlers.end()) {
+    // The handler owns the packet from here on
+    raw_handler->second(_connection, _packet);
+    return;
+  }
   if (requestHandlers.count(typname) > 0) {
     // This is a request
     requestHandlers[typname](_connection, _packet);
@@ -168,6 +222,34 @@ void Server::OnNewPacket(Connection* _connection, IncomingPacket* _packet) {
   delete _packet;
 }
 
+void Server::HandleTypeIdsHandshake(Connection* _connection, IncomingPacket* _packet) {
+  if (_connection->getPeerTypeIds()->UnPackHandshake(_packet) != 0) {
+    LOG(ERROR) << "Bad TypeIds handshake from connection " << _connection << " from hostport "
+               << _connection->getIPAddress() << ":" << _connection->getPort();
+    _connection->closeConnection();
+    return;
+  }
+  InternalSendResponse(_connection, typeIds_.MakeHandshake());
+}
+
+void Server::InstallTypeIdHandler(const sp_string& _type_name, const handler& _handler,
+                                  bool _raw) {
+  sp_int32 type_id = typeIds_.Add(_type_name);
+  if (type_id > static_cast<sp_int32>(typeIdHandlers_.size())) {
+    typeIdHandlers_.resize(type_id);
+  }
+  typeIdHandlers_[type_id - 1].handler_ = _handler;
+  typeIdHandlers_[type_id - 1].raw_ = _raw;
+}
+
+sp_int32 Server::PeerTypeId(Connection* _connection, const sp_string& _type_name) {
+  // The connection may be gone already, in which case the packet gets dropped anyway
+  if (active_connections_.find(_connection) == active_connections_.end()) {
+    return 0;
+  }
+  return _connection->getPeerTypeId(_type_name);
+}
+
 // Backpressure here - works for sending to both worker and stmgr
 void Server::InternalSendResponse(Connection* _connection, OutgoingPacket* _packet) {
   if (active_connections_.find(_connection) == active_connections_.end()) {
@@ -206,10 +288,11 @@ void Server::InternalSendRequest(Connection* _conn, google::protobuf::Message* _
 
   // Make the outgoing packet
   sp_int32 byte_size = _request->ByteSize();
-  sp_uint32 sop = OutgoingPacket::SizeRequiredToPackString(_request->GetTypeName()) + REQID_size +
-                  OutgoingPacket::SizeRequiredToPackProtocolBuffer(byte_size);
+  sp_int32 type_id = _conn->getPeerTypeId(_request->GetTypeName());
+  sp_uint32 sop = OutgoingPacket::SizeRequiredToPackType(_request->GetTypeName(), type_id) +
+                  REQID_size + OutgoingPacket::SizeRequiredToPackProtocolBuffer(byte_size);
   auto opkt = new OutgoingPacket(sop);
-  CHECK_EQ(opkt->PackString(_request->GetTypeName()), 0);
+  CHECK_EQ(opkt->PackType(_request->GetTypeName(), type_id), 0);
   CHECK_EQ(opkt->PackREQID(rid), 0);
   CHECK_EQ(opkt->PackProtocolBuffer(*_request, byte_size), 0);
 
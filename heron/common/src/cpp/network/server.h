@@ -68,6 +68,7 @@
 #include <utility>
 #include <typeindex>
 #include <list>
+#include <vector>
 #include "basics/basics.h"
 #include "glog/logging.h"
 #include "network/connection.h"
@@ -77,6 +78,7 @@
 #include "network/networkoptions.h"
 #include "network/network_error.h"
 #include "network/packet.h"
+#include "network/typeids.h"
 #include "network/mempool.h"
 
 /*
@@ -127,6 +129,10 @@ class Server : public BaseServer {
   // but that it was merely queued up. Server now owns the response object
   void SendResponse(REQID id, Connection* connection, const google::protobuf::Message& response);
 
+  // Send a response that was packed elsewhere, possibly on another thread.
+  // Its type has to be packed by name. The server now owns _packet.
+  void SendResponse(Connection* _connection, OutgoingPacket* _packet);
+
   // Send a message to initiate a non request-response style communication
   // message is now owned by the Server class
   void SendMessage(Connection* connection, const google::protobuf::Message& message);
@@ -136,6 +142,15 @@ class Server : public BaseServer {
                    const sp_string _type_name,
                    const char* _message);
 
+  // Same as above, but _message points inside _packet, a packet received on
+  // some connection, whose buffer is reused for the outgoing packet whenever
+  // possible. The server now owns _packet.
+  void SendMessage(Connection* _connection,
+                   IncomingPacket* _packet,
+                   sp_int32 _byte_size,
+                   const sp_string& _type_name,
+                   const char* _message);
+
   // Close a connection. This function doesn't return anything.
   // When the connection is attempted to be closed(which can happen
   // at a later time if using thread pool), The HandleConnectionClose
@@ -152,6 +167,7 @@ class Server : public BaseServer {
     T* t = static_cast<T*>(this);
     requestHandlers[m->GetTypeName()] = std::bind(&Server::dispatchRequest<T, M>, this, t, method,
                                                   std::placeholders::_1, std::placeholders::_2);
+    InstallTypeIdHandler(m->GetTypeName(), requestHandlers[m->GetTypeName()], false);
     delete m;
   }
 
@@ -162,6 +178,22 @@ class Server : public BaseServer {
     T* t = static_cast<T*>(this);
     messageHandlers[m->GetTypeName()] = std::bind(&Server::dispatchMessage<T, M>, this, t, method,
                                                   std::placeholders::_1, std::placeholders::_2);
+    InstallTypeIdHandler(m->GetTypeName(), messageHandlers[m->GetTypeName()], false);
+    delete m;
+  }
+
+  // Register a handler for a particular message type that is invoked with
+  // the packet positioned at the serialized message, which is left unparsed.
+  // The handler owns the packet. This lets servers that only forward
+  // messages avoid parsing and re-serializing them.
+  template <typename M, typename T>
+  void InstallRawMessageHandler(void (T::*method)(Connection* conn, IncomingPacket*)) {
+    google::protobuf::Message* m = new M();
+    T* t = static_cast<T*>(this);
+    rawMessageHandlers[m->GetTypeName()] = std::bind(&Server::dispatchRawMessage<T>, this, t,
+                                                     method, std::placeholders::_1,
+                                                     std::placeholders::_2);
+    InstallTypeIdHandler(m->GetTypeName(), rawMessageHandlers[m->GetTypeName()], true);
     delete m;
   }
 
@@ -211,6 +243,12 @@ class Server : public BaseServer {
 
   void InternalSendResponse(Connection* _connection, OutgoingPacket* _packet);
 
+  // The id that _connection wants _type_name to be sent as. 0 means the name
+  sp_int32 PeerTypeId(Connection* _connection, const sp_string& _type_name);
+
+  // Answers the TypeIds handshake of a client with ours
+  void HandleTypeIdsHandshake(Connection* _connection, IncomingPacket* _packet);
+
   template <typename T, typename M>
   void dispatchRequest(T* _t, void (T::*method)(REQID id, Connection* conn, M*), Connection* _conn,
                        IncomingPacket* _ipkt) {
@@ -252,6 +290,17 @@ class Server : public BaseServer {
     cb();
   }
 
+  template <typename T>
+  void dispatchRawMessage(T* _t, void (T::*method)(Connection* conn, IncomingPacket*),
+                          Connection* _conn, IncomingPacket* _ipkt) {
+    REQID rid;
+    CHECK(_ipkt->UnPackREQID(&rid) == 0) << "REQID unpacking failed";
+
+    std::function<void()> cb = std::bind(method, _t, _conn, _ipkt);
+
+    cb();
+  }
+
   void InternalSendRequest(Connection* _conn, google::protobuf::Message* _request, sp_int64 _msecs,
                            google::protobuf::Message* _response_placeholder, void* _ctx);
   void OnPacketTimer(REQID _id, EventLoop::Status status);
@@ -259,6 +308,18 @@ class Server : public BaseServer {
   typedef std::function<void(Connection*, IncomingPacket*)> handler;
   std::unordered_map<std::string, handler> requestHandlers;
   std::unordered_map<std::string, handler> messageHandlers;
+  // Handlers that take over the packet
+  std::unordered_map<std::string, handler> rawMessageHandlers;
+
+  // The same handlers, indexed by type id - 1
+  struct TypeIdHandler {
+    handler handler_;
+    // Does the handler take over the packet
+    bool raw_;
+  };
+  void InstallTypeIdHandler(const sp_string& _type_name, const handler& _handler, bool _raw);
+  TypeIds typeIds_;
+  std::vector<TypeIdHandler> typeIdHandlers_;
 
   // For acting like a client
   std::unordered_map<REQID, std::pair<google::protobuf::Message*, void*> > context_map_;
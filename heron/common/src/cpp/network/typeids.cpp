@@ -0,0 +1,82 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+////////////////////////////////////////////////////////////////////////////////
+// Please see typeids.h for details.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "network/typeids.h"
+#include <string>
+#include <vector>
+#include "glog/logging.h"
+#include "network/packet.h"
+
+const sp_string TypeIds::HANDSHAKE_TYPE_NAME = "heron.network.TypeIds";
+
+TypeIds::TypeIds() {}
+
+TypeIds::~TypeIds() {}
+
+sp_int32 TypeIds::Add(const sp_string& _type_name) {
+  auto iter = ids_.find(_type_name);
+  if (iter != ids_.end()) {
+    return iter->second;
+  }
+  names_.push_back(_type_name);
+  ids_[_type_name] = names_.size();
+  return names_.size();
+}
+
+sp_int32 TypeIds::Find(const sp_string& _type_name) const {
+  auto iter = ids_.find(_type_name);
+  return iter == ids_.end() ? 0 : iter->second;
+}
+
+// The handshake is laid out like a message, with a zero REQID, so that
+// servers that don't know it take it for an unknown message
+OutgoingPacket* TypeIds::MakeHandshake() const {
+  sp_uint32 size = OutgoingPacket::SizeRequiredToPackString(HANDSHAKE_TYPE_NAME) + REQID_size +
+                   sizeof(sp_int32);
+  for (auto& name : names_) {
+    size += OutgoingPacket::SizeRequiredToPackString(name);
+  }
+  auto opkt = new OutgoingPacket(size);
+  CHECK_EQ(opkt->PackString(HANDSHAKE_TYPE_NAME), 0);
+  CHECK_EQ(opkt->PackREQID(REQID_Generator::generate_zero_reqid()), 0);
+  CHECK_EQ(opkt->PackInt(names_.size()), 0);
+  for (auto& name : names_) {
+    CHECK_EQ(opkt->PackString(name), 0);
+  }
+  return opkt;
+}
+
+sp_int32 TypeIds::UnPackHandshake(IncomingPacket* _packet) {
+  REQID rid;
+  sp_int32 count;
+  if (_packet->UnPackREQID(&rid) != 0 || _packet->UnPackInt(&count) != 0 || count < 0) {
+    return -1;
+  }
+  names_.clear();
+  ids_.clear();
+  for (sp_int32 i = 0; i < count; ++i) {
+    sp_string name;
+    if (_packet->UnPackString(&name) != 0) {
+      return -1;
+    }
+    Add(name);
+  }
+  return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+////////////////////////////////////////////////////////////////////////////////
+// TypeIds assigns small integer ids to the names of the message types that
+// one end of a connection handles. The ends of a connection can tell each
+// other their TypeIds in a handshake packet, after which a sender packs the
+// id of the type of a message instead of its full name. This saves the bytes
+// of the name on every packet as well as the lookup of the name on receipt.
+//
+// The handshake is initiated by a Client that asked for it and answered by
+// any Server. A peer that doesn't know the handshake drops it (C++ servers)
+// or closes the connection (Java servers), so clients must only ask for it
+// when they talk to a C++ Server. Either end keeps packing names for as long
+// as it hasn't received the TypeIds of the other end.
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HERON_COMMON_SRC_CPP_NETWORK_TYPEIDS_H_
+#define HERON_COMMON_SRC_CPP_NETWORK_TYPEIDS_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "basics/basics.h"
+
+class IncomingPacket;
+class OutgoingPacket;
+
+class TypeIds {
+ public:
+  // The type name that the handshake packet is sent with
+  static const sp_string HANDSHAKE_TYPE_NAME;
+
+  TypeIds();
+  ~TypeIds();
+
+  // Returns the id of _type_name, assigning it the next free id
+  // if it has none. Ids are assigned from 1 onwards and never change.
+  sp_int32 Add(const sp_string& _type_name);
+
+  // Returns the id of _type_name, or 0 if it has none
+  sp_int32 Find(const sp_string& _type_name) const;
+
+  // The number of ids assigned
+  sp_int32 size() const { return names_.size(); }
+
+  // Returns a handshake packet that carries these ids
+  OutgoingPacket* MakeHandshake() const;
+
+  // Replaces these ids with the ones carried by a handshake packet, whose
+  // type has already been unpacked. Returns 0 on success.
+  sp_int32 UnPackHandshake(IncomingPacket* _packet);
+
+ private:
+  // names_[i] is the name of the type with id i + 1
+  std::vector<sp_string> names_;
+  std::unordered_map<sp_string, sp_int32> ids_;
+};
+
+#endif  // HERON_COMMON_SRC_CPP_NETWORK_TYPEIDS_H_
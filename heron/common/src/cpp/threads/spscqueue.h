@@ -0,0 +1,88 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+////////////////////////////////////////////////////////////////////
+//
+// This file defines a bounded, lock-free single producer single
+// consumer queue. Exactly one thread may push and exactly one
+// (possibly different) thread may pop at any given time.
+//
+/////////////////////////////////////////////////////////////////////
+
+#if !defined(__SPSC_QUEUE_H)
+#define __SPSC_QUEUE_H
+
+#include <atomic>
+#include <utility>
+#include <vector>
+#include "basics/sptypes.h"
+
+template <typename T>
+class SPSCQueue {
+ public:
+  // The capacity is rounded up to a power of two
+  explicit SPSCQueue(sp_uint32 _capacity) {
+    sp_uint64 capacity = 1;
+    while (capacity < _capacity) capacity <<= 1;
+    items_.resize(capacity);
+    mask_ = capacity - 1;
+  }
+
+  SPSCQueue(const SPSCQueue& spscqueue) = delete;
+  SPSCQueue& operator=(const SPSCQueue& spscqueue) = delete;
+
+  // Called by the producer. Returns false if the queue is full.
+  template <typename U>
+  bool push(U&& _item) {
+    sp_uint64 tail = tail_.value_.load(std::memory_order_relaxed);
+    if (tail - head_.value_.load(std::memory_order_acquire) > mask_) return false;
+    items_[tail & mask_] = std::forward<U>(_item);
+    tail_.value_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Called by the consumer. Returns false if the queue is empty.
+  bool pop(T* _item) {
+    sp_uint64 head = head_.value_.load(std::memory_order_relaxed);
+    if (head == tail_.value_.load(std::memory_order_acquire)) return false;
+    *_item = std::move(items_[head & mask_]);
+    head_.value_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  sp_uint64 capacity() const { return mask_ + 1; }
+
+ private:
+  static const sp_uint32 kCacheLineSize = 64;
+
+  // The padding keeps an index off the cache lines of whatever lies around
+  // it, as each index is written by one side only. Aligning the index would
+  // do the same with less room, but new does not honor such an alignment
+  // before C++17.
+  struct Index {
+    Index() : value_(0) {}
+    char before_[kCacheLineSize - sizeof(std::atomic<sp_uint64>)];
+    std::atomic<sp_uint64> value_;
+    char after_[kCacheLineSize - sizeof(std::atomic<sp_uint64>)];
+  };
+
+  std::vector<T> items_;
+  sp_uint64 mask_;
+  Index head_;
+  Index tail_;
+};
+
+#endif
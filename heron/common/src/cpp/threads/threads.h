@@ -27,5 +27,6 @@
 
 #include "basics/callback.h"
 #include "threads/pcqueue.h"
+#include "threads/spscqueue.h"
 
 #endif  // __SP_THREADS_H
@@ -0,0 +1,161 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string>
+#include "gtest/gtest.h"
+#include "basics/basics.h"
+#include "config/physical-plan-helper.h"
+#include "proto/messages.h"
+
+using heron::config::PhysicalPlanHelper;
+
+namespace {
+
+void AddStMgr(heron::proto::system::PhysicalPlan& _pplan, const std::string& _id,
+              const std::string& _host) {
+  heron::proto::system::StMgr* stmgr = _pplan.add_stmgrs();
+  stmgr->set_id(_id);
+  stmgr->set_host_name(_host);
+  stmgr->set_data_port(10000);
+  stmgr->set_local_endpoint("/unused");
+}
+
+void AddInstance(heron::proto::system::PhysicalPlan& _pplan, sp_int32 _task_id,
+                 const std::string& _stmgr) {
+  heron::proto::system::Instance* instance = _pplan.add_instances();
+  instance->set_instance_id("instance-" + std::to_string(_task_id));
+  instance->set_stmgr_id(_stmgr);
+  instance->mutable_info()->set_task_id(_task_id);
+  instance->mutable_info()->set_component_index(_task_id);
+  instance->mutable_info()->set_component_name("word");
+}
+
+heron::proto::system::PhysicalPlan CreatePlan() {
+  heron::proto::system::PhysicalPlan pplan;
+  pplan.mutable_topology()->set_id("topology-id");
+  pplan.mutable_topology()->set_name("topology");
+  pplan.mutable_topology()->set_state(heron::proto::api::RUNNING);
+  AddStMgr(pplan, "stmgr-1", "host-1");
+  AddStMgr(pplan, "stmgr-2", "host-2");
+  AddStMgr(pplan, "stmgr-3", "host-3");
+  for (sp_int32 i = 0; i < 6; ++i) {
+    AddInstance(pplan, i, "stmgr-" + std::to_string(i % 3 + 1));
+  }
+  return pplan;
+}
+
+// Make the delta from _old to _new, and check that it gets _new back
+void ExpectDelta(const heron::proto::system::PhysicalPlan& _old,
+                 const heron::proto::system::PhysicalPlan& _new,
+                 heron::proto::system::PhysicalPlanDelta& _delta) {
+  ASSERT_TRUE(PhysicalPlanHelper::MakeDelta(_old, _new, _delta));
+  heron::proto::system::PhysicalPlan applied(_old);
+  PhysicalPlanHelper::ApplyDelta(_delta, applied);
+  EXPECT_EQ(_new.SerializeAsString(), applied.SerializeAsString());
+}
+
+}  // namespace
+
+// Only the state of the topology changes
+TEST(PhysicalPlanHelperTest, test_delta_state) {
+  heron::proto::system::PhysicalPlan old_pplan = CreatePlan();
+  heron::proto::system::PhysicalPlan new_pplan(old_pplan);
+  new_pplan.mutable_topology()->set_state(heron::proto::api::PAUSED);
+
+  heron::proto::system::PhysicalPlanDelta delta;
+  ExpectDelta(old_pplan, new_pplan, delta);
+  EXPECT_EQ(heron::proto::api::PAUSED, delta.topology_state());
+  EXPECT_EQ(0, delta.stmgrs_size());
+  EXPECT_EQ(0, delta.removed_stmgrs_size());
+  EXPECT_EQ(0, delta.instances_size());
+  EXPECT_EQ(0, delta.removed_instances_size());
+}
+
+// A stmgr comes back up on another host
+TEST(PhysicalPlanHelperTest, test_delta_moved_stmgr) {
+  heron::proto::system::PhysicalPlan old_pplan = CreatePlan();
+  heron::proto::system::PhysicalPlan new_pplan(old_pplan);
+  new_pplan.mutable_stmgrs(1)->set_host_name("host-4");
+
+  heron::proto::system::PhysicalPlanDelta delta;
+  ExpectDelta(old_pplan, new_pplan, delta);
+  ASSERT_EQ(1, delta.stmgrs_size());
+  EXPECT_EQ("host-4", delta.stmgrs(0).host_name());
+  EXPECT_EQ(0, delta.instances_size());
+}
+
+// A stmgr goes away, another one takes over its instances
+TEST(PhysicalPlanHelperTest, test_delta_replaced_stmgr) {
+  heron::proto::system::PhysicalPlan old_pplan = CreatePlan();
+  heron::proto::system::PhysicalPlan new_pplan = CreatePlan();
+  new_pplan.mutable_stmgrs()->SwapElements(1, 2);
+  new_pplan.mutable_stmgrs()->RemoveLast();
+  AddStMgr(new_pplan, "stmgr-4", "host-4");
+  for (sp_int32 i = 0; i < new_pplan.instances_size(); ++i) {
+    if (new_pplan.instances(i).stmgr_id() == "stmgr-2") {
+      new_pplan.mutable_instances(i)->set_stmgr_id("stmgr-4");
+    }
+  }
+
+  heron::proto::system::PhysicalPlanDelta delta;
+  ExpectDelta(old_pplan, new_pplan, delta);
+  ASSERT_EQ(1, delta.stmgrs_size());
+  EXPECT_EQ("stmgr-4", delta.stmgrs(0).id());
+  ASSERT_EQ(1, delta.removed_stmgrs_size());
+  EXPECT_EQ("stmgr-2", delta.removed_stmgrs(0));
+  EXPECT_EQ(2, delta.instances_size());
+}
+
+// Instances are added and removed
+TEST(PhysicalPlanHelperTest, test_delta_instances) {
+  heron::proto::system::PhysicalPlan old_pplan = CreatePlan();
+  heron::proto::system::PhysicalPlan new_pplan = CreatePlan();
+  new_pplan.mutable_instances()->DeleteSubrange(0, 1);
+  AddInstance(new_pplan, 6, "stmgr-1");
+
+  heron::proto::system::PhysicalPlanDelta delta;
+  ExpectDelta(old_pplan, new_pplan, delta);
+  EXPECT_EQ(1, delta.instances_size());
+  ASSERT_EQ(1, delta.removed_instances_size());
+  EXPECT_EQ("instance-0", delta.removed_instances(0));
+}
+
+// The order of the plan changes, which a delta cannot tell
+TEST(PhysicalPlanHelperTest, test_delta_reordered) {
+  heron::proto::system::PhysicalPlan old_pplan = CreatePlan();
+  heron::proto::system::PhysicalPlan new_pplan(old_pplan);
+  new_pplan.mutable_stmgrs()->SwapElements(0, 1);
+
+  heron::proto::system::PhysicalPlanDelta delta;
+  EXPECT_FALSE(PhysicalPlanHelper::MakeDelta(old_pplan, new_pplan, delta));
+}
+
+// The topology changes in more than its state
+TEST(PhysicalPlanHelperTest, test_delta_topology) {
+  heron::proto::system::PhysicalPlan old_pplan = CreatePlan();
+  heron::proto::system::PhysicalPlan new_pplan(old_pplan);
+  new_pplan.mutable_topology()->set_name("another-topology");
+
+  heron::proto::system::PhysicalPlanDelta delta;
+  EXPECT_FALSE(PhysicalPlanHelper::MakeDelta(old_pplan, new_pplan, delta));
+}
+
+int main(int argc, char **argv) {
+  heron::common::Initialize(argv[0]);
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
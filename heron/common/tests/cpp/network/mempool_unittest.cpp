@@ -0,0 +1,152 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <set>
+#include <thread>
+#include <vector>
+#include "network/unittests.pb.h"
+#include "gtest/gtest.h"
+#include "basics/basics.h"
+#include "errors/errors.h"
+#include "threads/threads.h"
+#include "network/network.h"
+#include "basics/modinit.h"
+#include "errors/modinit.h"
+#include "threads/modinit.h"
+#include "network/modinit.h"
+
+// Verify a released message is handed out again on the same thread
+TEST(ProtobufPoolTest, test_reuse) {
+  TestMessage* m = NULL;
+  m = __global_protobuf_pool_acquire__(m);
+  __global_protobuf_pool_release__(m);
+  TestMessage* n = NULL;
+  n = __global_protobuf_pool_acquire__(n);
+  EXPECT_EQ(m, n);
+  __global_protobuf_pool_release__(n);
+}
+
+// Verify messages of different types are pooled separately
+TEST(ProtobufPoolTest, test_per_type) {
+  TestMessage* m = NULL;
+  m = __global_protobuf_pool_acquire__(m);
+  __global_protobuf_pool_release__(m);
+  OrderMessage* o = NULL;
+  o = __global_protobuf_pool_acquire__(o);
+  EXPECT_NE(static_cast<void*>(m), static_cast<void*>(o));
+  __global_protobuf_pool_release__(o);
+}
+
+// Verify serialized messages above the high water mark are not pooled
+TEST(ProtobufPoolTest, test_high_water_mark) {
+  TestMessage* m = NULL;
+  __global_protobuf_pool_set_high_water_mark__(m, 4096);
+
+  // Empty the local cache so that acquire has to allocate
+  std::vector<TestMessage*> cached;
+  for (size_t i = 0; i < ProtobufPool<TestMessage>::kLocalCacheSize; ++i) {
+    cached.push_back(__global_protobuf_pool_acquire__(m));
+  }
+
+  TestMessage* large = new TestMessage();
+  large->add_message(sp_string(8192, 'a'));
+  large->ByteSize();
+  __global_protobuf_pool_release__(large);
+  TestMessage* small = new TestMessage();
+  small->add_message("abc");
+  small->ByteSize();
+  __global_protobuf_pool_release__(small);
+
+  m = __global_protobuf_pool_acquire__(m);
+  EXPECT_EQ(small, m);
+  __global_protobuf_pool_release__(m);
+
+  for (auto message : cached) {
+    __global_protobuf_pool_release__(message);
+  }
+  __global_protobuf_pool_set_high_water_mark__(m, 0);
+}
+
+// Verify unserialized messages above the high water mark are dropped within
+// a check interval of releases
+TEST(ProtobufPoolTest, test_high_water_mark_sampled) {
+  TestMessage* m = NULL;
+  __global_protobuf_pool_set_high_water_mark__(m, 4096);
+
+  std::vector<TestMessage*> cached;
+  for (size_t i = 0; i < ProtobufPool<TestMessage>::kLocalCacheSize; ++i) {
+    cached.push_back(__global_protobuf_pool_acquire__(m));
+  }
+
+  // Messages are not cleared on release, so the large message is handed out
+  // again with its contents until a size check drops it.
+  m = new TestMessage();
+  m->add_message(sp_string(8192, 'a'));
+  size_t releases = 0;
+  while (m->message_size() > 0 && releases <= ProtobufPool<TestMessage>::kSpaceCheckInterval) {
+    __global_protobuf_pool_release__(m);
+    ++releases;
+    m = __global_protobuf_pool_acquire__(m);
+  }
+  EXPECT_EQ(0, m->message_size());
+  EXPECT_LE(releases, ProtobufPool<TestMessage>::kSpaceCheckInterval);
+  __global_protobuf_pool_release__(m);
+
+  for (auto message : cached) {
+    __global_protobuf_pool_release__(message);
+  }
+  __global_protobuf_pool_set_high_water_mark__(m, 0);
+}
+
+// Verify messages released on one thread can be acquired on another
+TEST(ProtobufPoolTest, test_cross_thread) {
+  const size_t count = 2 * ProtobufPool<OrderMessage>::kLocalCacheSize;
+  std::set<OrderMessage*> released;
+  std::thread producer([&released, count]() {
+    std::vector<OrderMessage*> messages;
+    for (size_t i = 0; i < count; ++i) {
+      messages.push_back(new OrderMessage());
+    }
+    for (auto message : messages) {
+      released.insert(message);
+      __global_protobuf_pool_release__(message);
+    }
+  });
+  producer.join();
+
+  // The producer's messages went to the global spill, partly when its cache
+  // overflowed and the rest when it exited.
+  std::thread consumer([&released, count]() {
+    std::vector<OrderMessage*> messages;
+    for (size_t i = 0; i < count; ++i) {
+      OrderMessage* message = NULL;
+      messages.push_back(__global_protobuf_pool_acquire__(message));
+    }
+    size_t reused = 0;
+    for (auto message : messages) {
+      reused += released.count(message);
+      __global_protobuf_pool_release__(message);
+    }
+    EXPECT_EQ(count, reused);
+  });
+  consumer.join();
+}
+
+int main(int argc, char **argv) {
+  heron::common::Initialize(argv[0]);
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,390 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures traffic between a Client and a Server over loopback TCP and over
+// a Unix socket, in two patterns. In the echo pattern the server echoes
+// every request back, and the batch size is the number of requests the
+// client keeps outstanding. In the stream pattern the client sends one way
+// messages, a batch of them in every turn of its event loop, like a stmgr
+// does with tuples. For every transport, pattern, message size and batch
+// size it prints one CSV line with the throughput and, for echo, the round
+// trip latency percentiles, so that the results can be compared across
+// releases. On Linux it also reports the read and write system calls made
+// per message, counting both the client and the server.
+//
+// Usage: packet_benchmark [max_requests_per_run]
+
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "network/unittests.pb.h"
+#include "basics/basics.h"
+#include "errors/errors.h"
+#include "threads/threads.h"
+#include "network/network.h"
+#include "basics/modinit.h"
+#include "errors/modinit.h"
+#include "threads/modinit.h"
+#include "network/modinit.h"
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static const sp_int32 BENCHMARK_PORT = 61010;
+static const sp_int32 MAX_PACKET_SIZE = 16 * 1024 * 1024;
+// Caps the bytes sent per run, so that large messages don't take forever
+static const sp_int64 MAX_BYTES_PER_RUN = 256 * 1024 * 1024;
+
+class BenchmarkServer : public Server {
+ public:
+  BenchmarkServer(EventLoopImpl* _eventLoop, const NetworkOptions& _options)
+      : Server(_eventLoop, _options) {
+    InstallRequestHandler(&BenchmarkServer::HandleEchoRequest);
+    InstallMessageHandler(&BenchmarkServer::HandleTestMessage);
+    InstallMessageHandler(&BenchmarkServer::HandleTerminateMessage);
+  }
+
+  virtual ~BenchmarkServer() {}
+
+ protected:
+  virtual void HandleNewConnection(Connection* _conn) {}
+
+  virtual void HandleConnectionClose(Connection*, NetworkErrorCode) {}
+
+ private:
+  void HandleEchoRequest(REQID _id, Connection* _connection, EchoServerRequest* _request) {
+    response_.set_echo_response(_request->echo_request());
+    SendResponse(_id, _connection, response_);
+    __global_protobuf_pool_release__(_request);
+  }
+
+  void HandleTestMessage(Connection*, TestMessage* _message) {
+    __global_protobuf_pool_release__(_message);
+  }
+
+  void HandleTerminateMessage(Connection*, TerminateMessage* _message) {
+    __global_protobuf_pool_release__(_message);
+    AddTimer([this]() { this->Terminate(); }, 1);
+  }
+
+  void Terminate() {
+    Stop();
+    getEventLoop()->loopExit();
+  }
+
+  EchoServerResponse response_;
+};
+
+// Sends _nrequests requests of _message_size bytes, keeping _batch_size of
+// them outstanding, and records the round trip time of each. The first
+// _nwarmup requests are not measured.
+class BenchmarkClient : public Client {
+ public:
+  BenchmarkClient(EventLoopImpl* _eventLoop, const NetworkOptions& _options,
+                  sp_int32 _message_size, sp_int32 _batch_size, sp_int32 _nrequests,
+                  sp_int32 _nwarmup)
+      : Client(_eventLoop, _options),
+        payload_(_message_size, 'x'),
+        batch_size_(_batch_size),
+        nrequests_(_nrequests),
+        nwarmup_(_nwarmup),
+        nsent_(0),
+        nrecv_(0),
+        send_times_(_nrequests) {
+    InstallResponseHandler(new EchoServerRequest(), &BenchmarkClient::HandleEchoResponse);
+    latencies_.reserve(_nrequests);
+  }
+
+  virtual ~BenchmarkClient() {}
+
+  // Round trip times of the measured requests, in nanoseconds
+  std::vector<sp_int64>& latencies() { return latencies_; }
+  // Time from the first measured request to the last response
+  std::chrono::nanoseconds elapsed() const { return stop_time_ - start_time_; }
+
+ protected:
+  virtual void HandleConnect(NetworkErrorCode _status) {
+    if (_status != OK) {
+      // The server may not be listening yet
+      AddTimer([this]() { this->Start(); }, 100 * 1000);
+      return;
+    }
+    start_time_ = Clock::now();
+    while (nsent_ < nrequests_ && nsent_ < batch_size_) {
+      SendEchoRequest();
+    }
+  }
+
+  virtual void HandleClose(NetworkErrorCode) { getEventLoop()->loopExit(); }
+
+ private:
+  void SendEchoRequest() {
+    if (nsent_ == nwarmup_) start_time_ = Clock::now();
+    auto request = new EchoServerRequest();
+    request->set_echo_request(payload_);
+    send_times_[nsent_] = Clock::now();
+    SendRequest(request, reinterpret_cast<void*>(static_cast<intptr_t>(nsent_)));
+    ++nsent_;
+  }
+
+  void HandleEchoResponse(void* _ctx, EchoServerResponse* _response, NetworkErrorCode _status) {
+    CHECK_EQ(_status, OK);
+    sp_int32 index = static_cast<sp_int32>(reinterpret_cast<intptr_t>(_ctx));
+    if (index >= nwarmup_) {
+      latencies_.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+          Clock::now() - send_times_[index]).count());
+    }
+    __global_protobuf_pool_release__(_response);
+    if (nsent_ < nrequests_) {
+      SendEchoRequest();
+    } else if (++nrecv_ == batch_size_) {
+      // All the outstanding requests came back
+      stop_time_ = Clock::now();
+      Stop();
+    }
+  }
+
+  sp_string payload_;
+  sp_int32 batch_size_;
+  sp_int32 nrequests_;
+  sp_int32 nwarmup_;
+  sp_int32 nsent_;
+  // Responses received after the last request was sent
+  sp_int32 nrecv_;
+  std::vector<Clock::time_point> send_times_;
+  std::vector<sp_int64> latencies_;
+  Clock::time_point start_time_;
+  Clock::time_point stop_time_;
+};
+
+// Sends _nmessages messages of _message_size bytes, _batch_size of them at a
+// time, and then a request. The response to that tells that the server has
+// received all of them.
+class StreamClient : public Client {
+ public:
+  StreamClient(EventLoopImpl* _eventLoop, const NetworkOptions& _options,
+               sp_int32 _message_size, sp_int32 _batch_size, sp_int32 _nmessages)
+      : Client(_eventLoop, _options),
+        batch_size_(_batch_size),
+        nmessages_(_nmessages),
+        nsent_(0) {
+    InstallResponseHandler(new EchoServerRequest(), &StreamClient::HandleEchoResponse);
+    message_.add_message(sp_string(_message_size, 'x'));
+  }
+
+  virtual ~StreamClient() {}
+
+  std::chrono::nanoseconds elapsed() const { return stop_time_ - start_time_; }
+
+ protected:
+  virtual void HandleConnect(NetworkErrorCode _status) {
+    if (_status != OK) {
+      AddTimer([this]() { this->Start(); }, 100 * 1000);
+      return;
+    }
+    start_time_ = Clock::now();
+    SendBatch();
+  }
+
+  virtual void HandleClose(NetworkErrorCode) { getEventLoop()->loopExit(); }
+
+ private:
+  void SendBatch() {
+    for (sp_int32 i = 0; i < batch_size_ && nsent_ < nmessages_; ++i, ++nsent_) {
+      SendMessage(message_);
+    }
+    if (nsent_ < nmessages_) {
+      AddTimer([this]() { this->SendBatch(); }, 0);
+    } else {
+      auto request = new EchoServerRequest();
+      request->set_echo_request("");
+      SendRequest(request, NULL);
+    }
+  }
+
+  void HandleEchoResponse(void*, EchoServerResponse* _response, NetworkErrorCode _status) {
+    CHECK_EQ(_status, OK);
+    __global_protobuf_pool_release__(_response);
+    stop_time_ = Clock::now();
+    Stop();
+  }
+
+  TestMessage message_;
+  sp_int32 batch_size_;
+  sp_int32 nmessages_;
+  sp_int32 nsent_;
+  Clock::time_point start_time_;
+  Clock::time_point stop_time_;
+};
+
+// Sends the server the message to stop
+class Terminator : public Client {
+ public:
+  Terminator(EventLoopImpl* _eventLoop, const NetworkOptions& _options)
+      : Client(_eventLoop, _options) {}
+
+  virtual ~Terminator() {}
+
+ protected:
+  virtual void HandleConnect(NetworkErrorCode _status) {
+    CHECK_EQ(_status, OK);
+    TerminateMessage message;
+    SendMessage(message);
+  }
+
+  virtual void HandleClose(NetworkErrorCode) { getEventLoop()->loopExit(); }
+};
+
+static void RunServer(NetworkOptions _options) {
+  EventLoopImpl ss;
+  BenchmarkServer server(&ss, _options);
+  CHECK_EQ(server.Start(), 0);
+  ss.loop();
+}
+
+// Returns the read and write system calls made by this process so far, or
+// zeros where /proc/self/io is not available
+static std::pair<sp_int64, sp_int64> SysCalls() {
+  std::ifstream io("/proc/self/io");
+  std::pair<sp_int64, sp_int64> calls(0, 0);
+  sp_string key;
+  sp_int64 value;
+  while (io >> key >> value) {
+    if (key == "syscr:") calls.first = value;
+    if (key == "syscw:") calls.second = value;
+  }
+  return calls;
+}
+
+static double Percentile(const std::vector<sp_int64>& _sorted, double _p) {
+  if (_sorted.empty()) return 0;
+  size_t index = std::min(_sorted.size() - 1, static_cast<size_t>(_sorted.size() * _p));
+  return _sorted[index] / 1000.0;
+}
+
+static sp_int32 NumMessages(sp_int32 _message_size, sp_int32 _batch_size,
+                            sp_int32 _max_requests) {
+  return std::max<sp_int64>(
+      10 * _batch_size, std::min<sp_int64>(_max_requests, MAX_BYTES_PER_RUN / _message_size));
+}
+
+// _nmessages were measured for _elapsed, out of _ntotal sent in the run
+static void Print(const sp_string& _transport, const sp_string& _pattern,
+                  sp_int32 _message_size, sp_int32 _batch_size, sp_int32 _nmessages,
+                  sp_int32 _ntotal, std::chrono::nanoseconds _elapsed,
+                  const std::vector<sp_int64>& _latencies,
+                  const std::pair<sp_int64, sp_int64>& _start_calls,
+                  const std::pair<sp_int64, sp_int64>& _stop_calls) {
+  double msgs_per_sec = _nmessages / (_elapsed.count() / 1e9);
+  std::cout << _transport << "," << _pattern << "," << _message_size << "," << _batch_size
+            << "," << _nmessages << "," << std::fixed << std::setprecision(0) << msgs_per_sec
+            << "," << msgs_per_sec * _message_size << "," << std::setprecision(1)
+            << Percentile(_latencies, 0.5) << "," << Percentile(_latencies, 0.99) << ","
+            << Percentile(_latencies, 0.999) << std::setprecision(2) << ","
+            << (_stop_calls.first - _start_calls.first) / static_cast<double>(_ntotal) << ","
+            << (_stop_calls.second - _start_calls.second) / static_cast<double>(_ntotal)
+            << std::endl;
+}
+
+static void RunEcho(const sp_string& _transport, const NetworkOptions& _options,
+                    sp_int32 _message_size, sp_int32 _batch_size, sp_int32 _max_requests) {
+  sp_int32 nrequests = NumMessages(_message_size, _batch_size, _max_requests);
+  sp_int32 nwarmup = nrequests / 10;
+
+  EventLoopImpl ss;
+  BenchmarkClient client(&ss, _options, _message_size, _batch_size, nrequests, nwarmup);
+  std::pair<sp_int64, sp_int64> start_calls = SysCalls();
+  client.Start();
+  ss.loop();
+  std::pair<sp_int64, sp_int64> stop_calls = SysCalls();
+
+  std::vector<sp_int64>& latencies = client.latencies();
+  std::sort(latencies.begin(), latencies.end());
+  Print(_transport, "echo", _message_size, _batch_size, latencies.size(), nrequests,
+        client.elapsed(),
+        latencies, start_calls, stop_calls);
+}
+
+static void RunStream(const sp_string& _transport, const NetworkOptions& _options,
+                      sp_int32 _message_size, sp_int32 _batch_size, sp_int32 _max_requests) {
+  sp_int32 nmessages = NumMessages(_message_size, _batch_size, _max_requests);
+
+  EventLoopImpl ss;
+  StreamClient client(&ss, _options, _message_size, _batch_size, nmessages);
+  std::pair<sp_int64, sp_int64> start_calls = SysCalls();
+  client.Start();
+  ss.loop();
+  std::pair<sp_int64, sp_int64> stop_calls = SysCalls();
+
+  Print(_transport, "stream", _message_size, _batch_size, nmessages, nmessages, client.elapsed(),
+        std::vector<sp_int64>(), start_calls, stop_calls);
+}
+
+static void RunAll(const sp_string& _transport, const NetworkOptions& _options,
+                   sp_int32 _max_requests) {
+  std::thread server(RunServer, _options);
+
+  const sp_int32 message_sizes[] = {16, 256, 4 * 1024, 64 * 1024, 1024 * 1024};
+  const sp_int32 batch_sizes[] = {1, 16, 128};
+  for (sp_int32 message_size : message_sizes) {
+    for (sp_int32 batch_size : batch_sizes) {
+      RunEcho(_transport, _options, message_size, batch_size, _max_requests);
+    }
+  }
+  const sp_int32 stream_message_sizes[] = {16, 256, 4 * 1024};
+  const sp_int32 stream_batch_sizes[] = {16, 1024};
+  for (sp_int32 message_size : stream_message_sizes) {
+    for (sp_int32 batch_size : stream_batch_sizes) {
+      RunStream(_transport, _options, message_size, batch_size, _max_requests);
+    }
+  }
+
+  EventLoopImpl ss;
+  Terminator terminator(&ss, _options);
+  terminator.Start();
+  ss.loop();
+  server.join();
+}
+
+int main(int argc, char** argv) {
+  heron::common::Initialize(argv[0]);
+  sp_int32 max_requests = argc > 1 ? atoi(argv[1]) : 100000;
+
+  std::cout << "transport,pattern,message_size,batch_size,messages,msgs_per_sec,bytes_per_sec,"
+            << "p50_us,p99_us,p999_us,reads_per_msg,writes_per_msg" << std::endl;
+
+  NetworkOptions tcp;
+  tcp.set_host("127.0.0.1");
+  tcp.set_port(BENCHMARK_PORT);
+  tcp.set_max_packet_size(MAX_PACKET_SIZE);
+  tcp.set_socket_family(PF_INET);
+  RunAll("tcp", tcp, max_requests);
+
+  NetworkOptions unix_socket;
+  unix_socket.set_sin_path("/tmp/packet_benchmark_" + std::to_string(getpid()) + ".sock");
+  unix_socket.set_max_packet_size(MAX_PACKET_SIZE);
+  unix_socket.set_socket_family(PF_UNIX);
+  RunAll("unix", unix_socket, max_requests);
+  unlink(unix_socket.get_sin_path().c_str());
+  return 0;
+}
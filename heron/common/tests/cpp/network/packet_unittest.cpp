@@ -14,6 +14,10 @@
  * limitations under the License.
  */
 
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
 #include "network/unittests.pb.h"
 #include "gtest/gtest.h"
 #include "basics/basics.h"
@@ -79,6 +83,27 @@ TEST(OutgoingPacketTest, test_protobuf) {
   EXPECT_EQ(explen, op.GetBytesFilled());
 }
 
+// Test a reserved protobuf region unpacks like a packed protobuf
+TEST(OutgoingPacketTest, test_reserve_protobuf) {
+  TestMessage tm;
+  tm.add_message("abcdefghijklmnopqrstuvwxyz");
+  sp_int32 byte_size = tm.ByteSize();
+  OutgoingPacket op(OutgoingPacket::SizeRequiredToPackProtocolBuffer(byte_size));
+
+  char* reserved = op.ReserveProtocolBuffer(byte_size);
+  ASSERT_TRUE(reserved != NULL);
+  tm.SerializeWithCachedSizesToArray(reinterpret_cast<google::protobuf::uint8*>(reserved));
+  EXPECT_EQ(op.GetTotalPacketSize(), op.GetBytesFilled());
+
+  // Nothing more fits
+  EXPECT_TRUE(op.ReserveProtocolBuffer(0) == NULL);
+
+  IncomingPacket ip(op.get_header());
+  TestMessage unpacked;
+  EXPECT_EQ(0, ip.UnPackProtocolBuffer(&unpacked));
+  EXPECT_EQ(tm.SerializeAsString(), unpacked.SerializeAsString());
+}
+
 // Test pack returns < 0 when the max packet size is
 // exceeded for integers
 TEST(OutgoingPacketTest, test_max_ints) {
@@ -181,6 +206,256 @@ TEST(IncomingPacketTest, test_reqid) {
   EXPECT_EQ(reqida, reqidb);
 }
 
+// Packs a message of the given type into a packet and returns it as received
+static IncomingPacket* MakeIncomingMessage(const sp_string& _type_name, const TestMessage& _tm) {
+  sp_uint32 size = OutgoingPacket::SizeRequiredToPackString(_type_name) + REQID_size +
+                   OutgoingPacket::SizeRequiredToPackProtocolBuffer(_tm.ByteSize());
+  OutgoingPacket op(size);
+  op.PackString(_type_name);
+  op.PackREQID(REQID_Generator::generate_zero_reqid());
+  op.PackProtocolBuffer(_tm, _tm.ByteSize());
+  return new IncomingPacket(op.get_header());
+}
+
+// Forwards the message in _ip under a different type name and verifies it
+static void VerifyForwardedMessage(IncomingPacket* _ip, const sp_string& _type_name,
+                                   const TestMessage& _tm, bool _expect_in_place) {
+  sp_string type_name;
+  REQID reqid;
+  const char* message = NULL;
+  sp_int32 byte_size = 0;
+  EXPECT_EQ(0, _ip->UnPackString(&type_name));
+  EXPECT_EQ(0, _ip->UnPackREQID(&reqid));
+  EXPECT_EQ(0, _ip->UnPackProtocolBuffer(&message, &byte_size));
+  EXPECT_EQ(_tm.ByteSize(), byte_size);
+
+  sp_uint32 size = OutgoingPacket::SizeRequiredToPackString(_type_name) + REQID_size +
+                   OutgoingPacket::SizeRequiredToPackProtocolBuffer(byte_size);
+  OutgoingPacket op(size, _ip, message, byte_size);
+  EXPECT_EQ(0, op.PackString(_type_name));
+  EXPECT_EQ(0, op.PackREQID(reqid));
+  EXPECT_EQ(0, op.PackProtocolBuffer(message, byte_size));
+  EXPECT_EQ(op.GetTotalPacketSize(), op.GetBytesFilled());
+
+  // The incoming packet loses its buffer only if it was reused
+  sp_int32 i;
+  _ip->Reset();
+  EXPECT_EQ(_expect_in_place, _ip->UnPackInt(&i) != 0);
+
+  IncomingPacket ip(op.get_header());
+  sp_string forwarded_type_name;
+  REQID forwarded_reqid;
+  TestMessage forwarded;
+  EXPECT_EQ(0, ip.UnPackString(&forwarded_type_name));
+  EXPECT_EQ(0, ip.UnPackREQID(&forwarded_reqid));
+  EXPECT_EQ(0, ip.UnPackProtocolBuffer(&forwarded));
+  EXPECT_EQ(_type_name, forwarded_type_name);
+  EXPECT_EQ(reqid, forwarded_reqid);
+  EXPECT_EQ(_tm.SerializeAsString(), forwarded.SerializeAsString());
+}
+
+// Verify forwarding a message reuses the incoming buffer when it fits
+TEST(OutgoingPacketTest, test_forward_in_place) {
+  TestMessage tm;
+  tm.add_message("abcdefghijklmnopqrstuvwxyz");
+  IncomingPacket* ip = MakeIncomingMessage("a.rather.long.type.Name", tm);
+  VerifyForwardedMessage(ip, "short.Name", tm, true);
+  delete ip;
+}
+
+// Verify forwarding a message copies it when the incoming buffer is too small
+TEST(OutgoingPacketTest, test_forward_copy) {
+  TestMessage tm;
+  tm.add_message("abcdefghijklmnopqrstuvwxyz");
+  IncomingPacket* ip = MakeIncomingMessage("short.Name", tm);
+  // Longer than the name plus the headroom of the incoming buffer
+  VerifyForwardedMessage(ip, "a.very." + sp_string(128, 'x') + ".Name", tm, false);
+  delete ip;
+}
+
+// Verify the headroom of the incoming buffer takes a somewhat longer name
+TEST(OutgoingPacketTest, test_forward_in_headroom) {
+  TestMessage tm;
+  tm.add_message("abcdefghijklmnopqrstuvwxyz");
+  IncomingPacket* ip = MakeIncomingMessage("short.Name", tm);
+  VerifyForwardedMessage(ip, "a.rather.long.type.Name", tm, true);
+  delete ip;
+}
+
+class PacketSlabTest : public ::testing::Test {
+ protected:
+  void SetUp() { slab_ = new PacketSlab(1024); }
+  void TearDown() { slab_->Release(); }
+
+  // Copies the packet _op into the slab and carves it out like a
+  // Connection would
+  IncomingPacket* Carve(OutgoingPacket* _op) {
+    memcpy(slab_->data(), _op->get_header(), _op->GetTotalPacketSize());
+    return new IncomingPacket(slab_->data(), slab_);
+  }
+
+  // The slab the packet lies in, or NULL if it has a buffer of its own
+  static PacketSlab* SlabOf(IncomingPacket* _ip) { return _ip->slab_; }
+
+  PacketSlab* slab_;
+};
+
+// Verify a packet copied out of its slab no longer holds on to it
+TEST_F(PacketSlabTest, test_copy_out_of_slab) {
+  TestMessage tm;
+  tm.add_message("abcdefghijklmnopqrstuvwxyz");
+  sp_uint32 size = OutgoingPacket::SizeRequiredToPackString("a.Name") + REQID_size +
+                   OutgoingPacket::SizeRequiredToPackProtocolBuffer(tm.ByteSize());
+  OutgoingPacket op(size);
+  op.PackString("a.Name");
+  op.PackREQID(REQID_Generator::generate_zero_reqid());
+  op.PackProtocolBuffer(tm, tm.ByteSize());
+
+  IncomingPacket* ip = Carve(&op);
+  EXPECT_TRUE(slab_->IsShared());
+  sp_string type_name;
+  EXPECT_EQ(0, ip->UnPackString(&type_name));
+  EXPECT_EQ("a.Name", type_name);
+
+  ip->CopyOutOfSlab();
+  EXPECT_FALSE(slab_->IsShared());
+  // The slab may now be read into again
+  memset(slab_->data(), 0, slab_->capacity());
+
+  // The read position is kept
+  REQID reqid;
+  EXPECT_EQ(0, ip->UnPackREQID(&reqid));
+  TestMessage received;
+  EXPECT_EQ(0, ip->UnPackProtocolBuffer(&received));
+  EXPECT_EQ(tm.SerializeAsString(), received.SerializeAsString());
+
+  // And a packet copied out can still be forwarded in place
+  ip->Reset();
+  VerifyForwardedMessage(ip, "b.Name", tm, true);
+  delete ip;
+}
+
+// Packs _data as a string into a packet and appends it to _bytes as it goes
+// out on the wire
+static void AppendPacket(const sp_string& _data, sp_string* _bytes) {
+  OutgoingPacket op(OutgoingPacket::SizeRequiredToPackString(_data));
+  op.PackString(_data);
+  _bytes->append(op.get_header(), op.GetTotalPacketSize());
+}
+
+// Verify a Connection carves the packets it reads out of one slab, and
+// reads one too large for the slab, that has only partly come in, into a
+// buffer of its own
+TEST_F(PacketSlabTest, test_connection_reads) {
+  std::vector<sp_string> sent;
+  sent.push_back(sp_string(100, 'a'));
+  sent.push_back(sp_string(200, 'b'));
+  // Larger than a quarter of the slab, but read in whole
+  sent.push_back(sp_string(20000, 'c'));
+  // Larger than a quarter of the slab, and read in two goes
+  sent.push_back(sp_string(30000, 'd'));
+  sent.push_back(sp_string(300, 'e'));
+
+  sp_string first;
+  for (size_t i = 0; i < 4; ++i) AppendPacket(sent[i], &first);
+  sp_string second;
+  AppendPacket(sent[4], &second);
+  // Hold back the end of the fourth packet
+  second.insert(0, first, first.size() - 10000, 10000);
+  first.resize(first.size() - 10000);
+
+  sp_int32 fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  ASSERT_EQ(0, SockUtils::setNonBlocking(fds[0]));
+
+  EventLoopImpl ss;
+  ConnectionEndPoint endpoint(true);
+  endpoint.set_fd(fds[0]);
+  ConnectionOptions options;
+  options.max_packet_size_ = 1024 * 1024;
+  Connection* conn = new Connection(&endpoint, &options, &ss);
+
+  std::vector<sp_string> received;
+  std::vector<PacketSlab*> slabs;
+  conn->registerForNewPacket([&sent, &second, &received, &slabs, &fds, &ss](
+      IncomingPacket* _ip) {
+    sp_string data;
+    EXPECT_EQ(0, _ip->UnPackString(&data));
+    received.push_back(data);
+    slabs.push_back(SlabOf(_ip));
+    delete _ip;
+    if (received.size() == 3) {
+      // Send the rest only once the fourth packet has been started
+      ASSERT_EQ(static_cast<ssize_t>(second.size()),
+                write(fds[1], second.data(), second.size()));
+    } else if (received.size() == sent.size()) {
+      ss.loopExit();
+    }
+  });
+  ASSERT_EQ(static_cast<ssize_t>(first.size()), write(fds[1], first.data(), first.size()));
+  ASSERT_EQ(0, conn->start());
+  ss.loop();
+
+  ASSERT_EQ(sent.size(), received.size());
+  for (size_t i = 0; i < sent.size(); ++i) EXPECT_EQ(sent[i], received[i]);
+  EXPECT_TRUE(slabs[0] != NULL);
+  EXPECT_EQ(slabs[0], slabs[1]);
+  EXPECT_EQ(slabs[0], slabs[2]);
+  EXPECT_TRUE(slabs[3] == NULL);
+  EXPECT_TRUE(slabs[4] != NULL);
+
+  conn->closeConnection();
+  delete conn;
+  close(fds[1]);
+}
+
+// Verify a type packs as its id when it has one and as its name otherwise
+TEST(OutgoingPacketTest, test_type) {
+  const sp_string name = "heron.proto.stmgr.TupleStreamMessage2";
+  EXPECT_EQ(sizeof(sp_int32), OutgoingPacket::SizeRequiredToPackType(name, 3));
+  EXPECT_EQ(OutgoingPacket::SizeRequiredToPackString(name),
+            OutgoingPacket::SizeRequiredToPackType(name, 0));
+
+  OutgoingPacket op(OutgoingPacket::SizeRequiredToPackType(name, 3) +
+                    OutgoingPacket::SizeRequiredToPackType(name, 0));
+  EXPECT_EQ(0, op.PackType(name, 3));
+  EXPECT_EQ(0, op.PackType(name, 0));
+
+  IncomingPacket ip(op.get_header());
+  sp_string type_name;
+  sp_int32 type_id;
+  EXPECT_EQ(0, ip.UnPackType(&type_name, &type_id));
+  EXPECT_EQ(3, type_id);
+  EXPECT_EQ(0, ip.UnPackType(&type_name, &type_id));
+  EXPECT_EQ(0, type_id);
+  EXPECT_EQ(name, type_name);
+}
+
+// Verify the TypeIds survive a handshake
+TEST(TypeIdsTest, test_handshake) {
+  TypeIds ours;
+  EXPECT_EQ(1, ours.Add("a.Message"));
+  EXPECT_EQ(2, ours.Add("another.Message"));
+  EXPECT_EQ(1, ours.Add("a.Message"));
+  EXPECT_EQ(2, ours.size());
+
+  OutgoingPacket* op = ours.MakeHandshake();
+  IncomingPacket ip(op->get_header());
+  delete op;
+
+  TypeIds theirs;
+  EXPECT_EQ(0, theirs.Find("a.Message"));
+  sp_string type_name;
+  sp_int32 type_id;
+  EXPECT_EQ(0, ip.UnPackType(&type_name, &type_id));
+  EXPECT_EQ(TypeIds::HANDSHAKE_TYPE_NAME, type_name);
+  EXPECT_EQ(0, theirs.UnPackHandshake(&ip));
+  EXPECT_EQ(2, theirs.size());
+  EXPECT_EQ(1, theirs.Find("a.Message"));
+  EXPECT_EQ(2, theirs.Find("another.Message"));
+  EXPECT_EQ(0, theirs.Find("unknown.Message"));
+}
+
 int main(int argc, char **argv) {
   heron::common::Initialize(argv[0]);
   testing::InitGoogleTest(&argc, argv);
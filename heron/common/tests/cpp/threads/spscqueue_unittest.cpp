@@ -0,0 +1,92 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "threads/spscqueue.h"
+
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "basics/basics.h"
+#include "errors/errors.h"
+
+#include "basics/modinit.h"
+#include "errors/modinit.h"
+
+TEST(SPSCQueueTest, testCapacity) {
+  SPSCQueue<sp_int32> queue(5);
+  EXPECT_EQ(queue.capacity(), static_cast<sp_uint64>(8));
+
+  for (sp_int32 i = 0; i < 8; ++i) {
+    EXPECT_TRUE(queue.push(i));
+  }
+  // The queue is full
+  EXPECT_FALSE(queue.push(8));
+
+  sp_int32 item;
+  EXPECT_TRUE(queue.pop(&item));
+  EXPECT_EQ(item, 0);
+  EXPECT_TRUE(queue.push(8));
+}
+
+TEST(SPSCQueueTest, testOrder) {
+  SPSCQueue<std::string> queue(4);
+  sp_string item;
+  EXPECT_FALSE(queue.pop(&item));
+
+  // Wrap around a few times
+  for (sp_int32 i = 0; i < 10; ++i) {
+    EXPECT_TRUE(queue.push(std::to_string(2 * i)));
+    EXPECT_TRUE(queue.push(std::to_string(2 * i + 1)));
+    EXPECT_TRUE(queue.pop(&item));
+    EXPECT_EQ(item, std::to_string(2 * i));
+    EXPECT_TRUE(queue.pop(&item));
+    EXPECT_EQ(item, std::to_string(2 * i + 1));
+  }
+  EXPECT_FALSE(queue.pop(&item));
+}
+
+TEST(SPSCQueueTest, testProducerConsumer) {
+  const sp_int64 count = 1000000;
+  SPSCQueue<sp_int64> queue(1024);
+
+  std::thread producer([&queue, count]() {
+    for (sp_int64 i = 0; i < count; ++i) {
+      while (!queue.push(i)) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  // Every item has to come out exactly once and in order
+  sp_int64 expected = 0;
+  while (expected < count) {
+    sp_int64 item;
+    if (queue.pop(&item)) {
+      ASSERT_EQ(item, expected);
+      ++expected;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+}
+
+int main(int argc, char** argv) {
+  heron::common::Initialize(argv[0]);
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -36,7 +36,9 @@ HeronZKStateMgr::HeronZKStateMgr(const std::string& zkhostport, const std::strin
       zkclient_factory_(new DefaultZKClientFactory()),
       eventLoop_(eventLoop),
       tmaster_location_watcher_info_(NULL),
-      exitOnSessionExpiry_(exitOnSessionExpiry) {
+      exitOnSessionExpiry_(exitOnSessionExpiry),
+      cache_hits_(0),
+      cache_misses_(0) {
   Init();
 }
 
@@ -49,7 +51,9 @@ HeronZKStateMgr::HeronZKStateMgr(const std::string& zkhostport, const std::strin
       zkclient_factory_(zkclient_factory),
       eventLoop_(eventLoop),
       tmaster_location_watcher_info_(NULL),
-      exitOnSessionExpiry_(exitOnSessionExpiry) {
+      exitOnSessionExpiry_(exitOnSessionExpiry),
+      cache_hits_(0),
+      cache_misses_(0) {
   Init();
 }
 
@@ -94,6 +98,7 @@ void HeronZKStateMgr::SetTMasterLocation(const proto::tmaster::TMasterLocation&
   _location.SerializeToString(&value);
 
   auto wCb = [cb, this](sp_int32 rc) { this->SetTMasterLocationDone(std::move(cb), rc); };
+  InvalidateNode(path);
   zkclient_->CreateNode(path, value, true, std::move(wCb));
 }
 
@@ -101,13 +106,9 @@ void HeronZKStateMgr::GetTMasterLocation(const std::string& _topology_name,
                                          proto::tmaster::TMasterLocation* _return,
                                          VCallback<proto::system::StatusCode> cb) {
   std::string path = GetTMasterLocationPath(_topology_name);
-  std::string* contents = new std::string();
-
-  auto wCb = [contents, _return, cb, this](sp_int32 rc) {
-    this->GetTMasterLocationDone(contents, _return, std::move(cb), rc);
-  };
+  auto wCb = [cb, this](sp_int32 rc) { this->GetTMasterLocationDone(std::move(cb), rc); };
 
-  zkclient_->Get(path, contents, std::move(wCb));
+  GetNode(path, _return, std::move(wCb));
 }
 
 void HeronZKStateMgr::CreateTopology(const proto::api::Topology& _topology,
@@ -116,6 +117,7 @@ void HeronZKStateMgr::CreateTopology(const proto::api::Topology& _topology,
   std::string value;
   _topology.SerializeToString(&value);
   auto wCb = [cb, this](sp_int32 rc) { this->CreateTopologyDone(std::move(cb), rc); };
+  InvalidateNode(path);
   zkclient_->CreateNode(path, value, false, std::move(wCb));
 }
 
@@ -123,6 +125,7 @@ void HeronZKStateMgr::DeleteTopology(const std::string& _topology_name,
                                      VCallback<proto::system::StatusCode> cb) {
   std::string path = GetTopologyPath(_topology_name);
   auto wCb = [cb, this](sp_int32 rc) { this->DeleteTopologyDone(std::move(cb), rc); };
+  InvalidateNode(path);
   zkclient_->DeleteNode(path, std::move(wCb));
 }
 
@@ -132,19 +135,16 @@ void HeronZKStateMgr::SetTopology(const proto::api::Topology& _topology,
   std::string value;
   _topology.SerializeToString(&value);
   auto wCb = [cb, this](sp_int32 rc) { this->SetTopologyDone(std::move(cb), rc); };
+  InvalidateNode(path);
   zkclient_->Set(path, value, std::move(wCb));
 }
 
 void HeronZKStateMgr::GetTopology(const std::string& _topology_name, proto::api::Topology* _return,
                                   VCallback<proto::system::StatusCode> cb) {
   std::string path = GetTopologyPath(_topology_name);
-  std::string* contents = new std::string();
+  auto wCb = [cb, this](sp_int32 rc) { this->GetTopologyDone(std::move(cb), rc); };
 
-  auto wCb = [contents, _return, cb, this](sp_int32 rc) {
-    this->GetTopologyDone(contents, _return, std::move(cb), rc);
-  };
-
-  zkclient_->Get(path, contents, std::move(wCb));
+  GetNode(path, _return, std::move(wCb));
 }
 
 void HeronZKStateMgr::CreatePhysicalPlan(const proto::system::PhysicalPlan& _pplan,
@@ -154,6 +154,7 @@ void HeronZKStateMgr::CreatePhysicalPlan(const proto::system::PhysicalPlan& _ppl
   _pplan.SerializeToString(&contents);
 
   auto wCb = [cb, this](sp_int32 rc) { this->CreatePhysicalPlanDone(std::move(cb), rc); };
+  InvalidateNode(path);
   zkclient_->CreateNode(path, contents, false, std::move(wCb));
 }
 
@@ -161,6 +162,7 @@ void HeronZKStateMgr::DeletePhysicalPlan(const std::string& _topology_name,
                                          VCallback<proto::system::StatusCode> cb) {
   std::string path = GetPhysicalPlanPath(_topology_name);
   auto wCb = [cb, this](sp_int32 rc) { this->DeletePhysicalPlanDone(std::move(cb), rc); };
+  InvalidateNode(path);
   zkclient_->DeleteNode(path, std::move(wCb));
 }
 
@@ -172,6 +174,7 @@ void HeronZKStateMgr::SetPhysicalPlan(const proto::system::PhysicalPlan& _pplan,
 
   auto wCb = [cb, this](sp_int32 rc) { this->SetPhysicalPlanDone(std::move(cb), rc); };
 
+  InvalidateNode(path);
   zkclient_->Set(path, contents, std::move(wCb));
 }
 
@@ -179,12 +182,9 @@ void HeronZKStateMgr::GetPhysicalPlan(const std::string& _topology_name,
                                       proto::system::PhysicalPlan* _return,
                                       VCallback<proto::system::StatusCode> cb) {
   std::string path = GetPhysicalPlanPath(_topology_name);
-  std::string* contents = new std::string();
-  auto wCb = [contents, _return, cb, this](sp_int32 rc) {
-    this->GetPhysicalPlanDone(contents, _return, std::move(cb), rc);
-  };
+  auto wCb = [cb, this](sp_int32 rc) { this->GetPhysicalPlanDone(std::move(cb), rc); };
 
-  zkclient_->Get(path, contents, std::move(wCb));
+  GetNode(path, _return, std::move(wCb));
 }
 
 void HeronZKStateMgr::CreateExecutionState(const proto::system::ExecutionState& _state,
@@ -194,6 +194,7 @@ void HeronZKStateMgr::CreateExecutionState(const proto::system::ExecutionState&
   _state.SerializeToString(&contents);
   auto wCb = [cb, this](sp_int32 rc) { this->CreateExecutionStateDone(std::move(cb), rc); };
 
+  InvalidateNode(path);
   zkclient_->CreateNode(path, contents, false, std::move(wCb));
 }
 
@@ -202,6 +203,7 @@ void HeronZKStateMgr::DeleteExecutionState(const std::string& _topology_name,
   std::string path = GetExecutionStatePath(_topology_name);
   auto wCb = [cb, this](sp_int32 rc) { this->DeleteExecutionStateDone(std::move(cb), rc); };
 
+  InvalidateNode(path);
   zkclient_->DeleteNode(path, std::move(wCb));
 }
 
@@ -212,6 +214,7 @@ void HeronZKStateMgr::SetExecutionState(const proto::system::ExecutionState& _st
   _state.SerializeToString(&contents);
   auto wCb = [cb, this](sp_int32 rc) { this->SetExecutionStateDone(std::move(cb), rc); };
 
+  InvalidateNode(path);
   zkclient_->Set(path, contents, std::move(wCb));
 }
 
@@ -219,12 +222,9 @@ void HeronZKStateMgr::GetExecutionState(const std::string& _topology_name,
                                         proto::system::ExecutionState* _return,
                                         VCallback<proto::system::StatusCode> cb) {
   std::string path = GetExecutionStatePath(_topology_name);
-  std::string* contents = new std::string();
-  auto wCb = [contents, _return, cb, this](sp_int32 rc) {
-    this->GetExecutionStateDone(contents, _return, std::move(cb), rc);
-  };
+  auto wCb = [cb, this](sp_int32 rc) { this->GetExecutionStateDone(std::move(cb), rc); };
 
-  zkclient_->Get(path, contents, std::move(wCb));
+  GetNode(path, _return, std::move(wCb));
 }
 
 void HeronZKStateMgr::CreateStatefulCheckpoint(const std::string& _topology_name,
@@ -235,6 +235,7 @@ void HeronZKStateMgr::CreateStatefulCheckpoint(const std::string& _topology_name
   _ckpt.SerializeToString(&contents);
   auto wCb = [cb, this](sp_int32 rc) { this->CreateStatefulCheckpointDone(std::move(cb), rc); };
 
+  InvalidateNode(path);
   zkclient_->CreateNode(path, contents, false, std::move(wCb));
 }
 
@@ -243,6 +244,7 @@ void HeronZKStateMgr::DeleteStatefulCheckpoint(const std::string& _topology_name
   std::string path = GetStatefulCheckpointPath(_topology_name);
   auto wCb = [cb, this](sp_int32 rc) { this->DeleteStatefulCheckpointDone(std::move(cb), rc); };
 
+  InvalidateNode(path);
   zkclient_->DeleteNode(path, std::move(wCb));
 }
 
@@ -254,6 +256,7 @@ void HeronZKStateMgr::SetStatefulCheckpoint(const std::string& _topology_name,
   _ckpt.SerializeToString(&contents);
   auto wCb = [cb, this](sp_int32 rc) { this->SetStatefulCheckpointDone(std::move(cb), rc); };
 
+  InvalidateNode(path);
   zkclient_->Set(path, contents, std::move(wCb));
 }
 
@@ -261,12 +264,9 @@ void HeronZKStateMgr::GetStatefulCheckpoint(const std::string& _topology_name,
                                    proto::ckptmgr::StatefulConsistentCheckpoints* _return,
                                    VCallback<proto::system::StatusCode> cb) {
   std::string path = GetStatefulCheckpointPath(_topology_name);
-  std::string* contents = new std::string();
-  auto wCb = [contents, _return, cb, this](sp_int32 rc) {
-    this->GetStatefulCheckpointDone(contents, _return, std::move(cb), rc);
-  };
+  auto wCb = [cb, this](sp_int32 rc) { this->GetStatefulCheckpointDone(std::move(cb), rc); };
 
-  zkclient_->Get(path, contents, std::move(wCb));
+  GetNode(path, _return, std::move(wCb));
 }
 
 void HeronZKStateMgr::ListTopologies(std::vector<sp_string>* _return,
@@ -304,6 +304,8 @@ void HeronZKStateMgr::GlobalWatchEventHandler(const ZKClient::ZkWatchEvent event
     LOG(INFO) << "Deleted current zk client, creating a new one...";
     zkclient_ = zkclient_factory_->create(zkhostport_, eventLoop_, watch_event_cb_);
     LOG(INFO) << "New zk client created";
+    // The watches on the cached nodes went away with the session
+    InvalidateAllNodes();
     // set tmaster watch and notify the client watcher
     // NOTE: It isn't enough to just set the watch here, since we could
     // have lost a tmaster node change when the session expired. This is needed
@@ -332,24 +334,19 @@ void HeronZKStateMgr::SetTMasterLocationDone(VCallback<proto::system::StatusCode
   cb(code);
 }
 
-void HeronZKStateMgr::GetTMasterLocationDone(std::string* _contents,
-                                             proto::tmaster::TMasterLocation* _return,
-                                             VCallback<proto::system::StatusCode> cb,
+void HeronZKStateMgr::GetTMasterLocationDone(VCallback<proto::system::StatusCode> cb,
                                              sp_int32 _rc) {
   proto::system::StatusCode code = proto::system::OK;
-  if (_rc == ZOK) {
-    if (!_return->ParseFromString(*_contents)) {
-      LOG(ERROR) << "Error parsing tmaster location" << std::endl;
-      code = proto::system::STATE_CORRUPTED;
-    }
+  if (_rc == ZMARSHALLINGERROR) {
+    LOG(ERROR) << "Error parsing tmaster location" << std::endl;
+    code = proto::system::STATE_CORRUPTED;
   } else if (_rc == ZNONODE) {
     LOG(ERROR) << "Error getting tmaster location because the tmaster does not exist" << std::endl;
     code = proto::system::PATH_DOES_NOT_EXIST;
-  } else {
+  } else if (_rc != ZOK) {
     LOG(ERROR) << "Getting TMaster Location failed with error " << _rc << std::endl;
     code = proto::system::STATE_READ_ERROR;
   }
-  delete _contents;
   cb(code);
 }
 
@@ -389,22 +386,18 @@ void HeronZKStateMgr::SetTopologyDone(VCallback<proto::system::StatusCode> cb, s
   cb(code);
 }
 
-void HeronZKStateMgr::GetTopologyDone(std::string* _contents, proto::api::Topology* _return,
-                                      VCallback<proto::system::StatusCode> cb, sp_int32 _rc) {
+void HeronZKStateMgr::GetTopologyDone(VCallback<proto::system::StatusCode> cb, sp_int32 _rc) {
   proto::system::StatusCode code = proto::system::OK;
-  if (_rc == ZOK) {
-    if (!_return->ParseFromString(*_contents)) {
-      LOG(ERROR) << "topology parsing failed; zk corruption?" << std::endl;
-      code = proto::system::STATE_CORRUPTED;
-    }
+  if (_rc == ZMARSHALLINGERROR) {
+    LOG(ERROR) << "topology parsing failed; zk corruption?" << std::endl;
+    code = proto::system::STATE_CORRUPTED;
   } else if (_rc == ZNONODE) {
     LOG(ERROR) << "Error getting topology because the topology does not exist" << std::endl;
     code = proto::system::PATH_DOES_NOT_EXIST;
-  } else {
+  } else if (_rc != ZOK) {
     LOG(ERROR) << "Getting Topology failed with error " << _rc << std::endl;
     code = proto::system::STATE_READ_ERROR;
   }
-  delete _contents;
   cb(code);
 }
 
@@ -446,21 +439,17 @@ void HeronZKStateMgr::SetPhysicalPlanDone(VCallback<proto::system::StatusCode> c
   cb(code);
 }
 
-void HeronZKStateMgr::GetPhysicalPlanDone(std::string* _contents,
-                                          proto::system::PhysicalPlan* _return,
-                                          VCallback<proto::system::StatusCode> cb, sp_int32 _rc) {
+void HeronZKStateMgr::GetPhysicalPlanDone(VCallback<proto::system::StatusCode> cb,
+                                          sp_int32 _rc) {
   proto::system::StatusCode code = proto::system::OK;
-  if (_rc == ZOK) {
-    if (!_return->ParseFromString(*_contents)) {
-      code = proto::system::STATE_CORRUPTED;
-    }
+  if (_rc == ZMARSHALLINGERROR) {
+    code = proto::system::STATE_CORRUPTED;
   } else if (_rc == ZNONODE) {
     code = proto::system::PATH_DOES_NOT_EXIST;
-  } else {
+  } else if (_rc != ZOK) {
     LOG(ERROR) << "Getting PhysicalPlan failed with error " << _rc << std::endl;
     code = proto::system::STATE_READ_ERROR;
   }
-  delete _contents;
   cb(code);
 }
 
@@ -505,21 +494,17 @@ void HeronZKStateMgr::SetExecutionStateDone(VCallback<proto::system::StatusCode>
   cb(code);
 }
 
-void HeronZKStateMgr::GetExecutionStateDone(std::string* _contents,
-                                            proto::system::ExecutionState* _return,
-                                            VCallback<proto::system::StatusCode> cb, sp_int32 _rc) {
+void HeronZKStateMgr::GetExecutionStateDone(VCallback<proto::system::StatusCode> cb,
+                                            sp_int32 _rc) {
   proto::system::StatusCode code = proto::system::OK;
-  if (_rc == ZOK) {
-    if (!_return->ParseFromString(*_contents)) {
-      code = proto::system::STATE_CORRUPTED;
-    }
+  if (_rc == ZMARSHALLINGERROR) {
+    code = proto::system::STATE_CORRUPTED;
   } else if (_rc == ZNONODE) {
     code = proto::system::PATH_DOES_NOT_EXIST;
-  } else {
+  } else if (_rc != ZOK) {
     LOG(ERROR) << "Getting ExecutionState failed with error " << _rc << std::endl;
     code = proto::system::STATE_READ_ERROR;
   }
-  delete _contents;
   cb(code);
 }
 
@@ -565,21 +550,17 @@ void HeronZKStateMgr::SetStatefulCheckpointDone(VCallback<proto::system::StatusC
   cb(code);
 }
 
-void HeronZKStateMgr::GetStatefulCheckpointDone(std::string* _contents,
-                                     proto::ckptmgr::StatefulConsistentCheckpoints* _return,
-                                     VCallback<proto::system::StatusCode> cb, sp_int32 _rc) {
+void HeronZKStateMgr::GetStatefulCheckpointDone(VCallback<proto::system::StatusCode> cb,
+                                                sp_int32 _rc) {
   proto::system::StatusCode code = proto::system::OK;
-  if (_rc == ZOK) {
-    if (!_return->ParseFromString(*_contents)) {
-      code = proto::system::STATE_CORRUPTED;
-    }
+  if (_rc == ZMARSHALLINGERROR) {
+    code = proto::system::STATE_CORRUPTED;
   } else if (_rc == ZNONODE) {
     code = proto::system::PATH_DOES_NOT_EXIST;
-  } else {
+  } else if (_rc != ZOK) {
     LOG(ERROR) << "Getting StatefulCheckpoint failed with error " << _rc;
     code = proto::system::STATE_READ_ERROR;
   }
-  delete _contents;
   cb(code);
 }
 
@@ -600,6 +581,90 @@ void HeronZKStateMgr::ListExecutionStateTopologiesDone(VCallback<proto::system::
   cb(code);
 }
 
+void HeronZKStateMgr::GetNode(const std::string& _path, google::protobuf::Message* _return,
+                              VCallback<sp_int32> cb) {
+  CachedNode& node = node_cache_[_path];
+  if (node.message) {
+    cache_hits_++;
+    _return->CopyFrom(*node.message);
+    // Call back from the event loop, just like a read from zk does
+    auto wCb = [cb](EventLoop::Status) { cb(ZOK); };
+    CHECK_GT(eventLoop_->registerTimer(std::move(wCb), false, 0), 0);
+    return;
+  }
+
+  cache_misses_++;
+  sp_int64 generation = node.generation;
+  if (node.watched) {
+    ReadNode(_path, generation, _return, std::move(cb));
+    return;
+  }
+
+  // The watch is set with an exists rather than with the get. A get of a
+  // node that is not there sets no watch, and its watcher is never called
+  // nor freed. An exists sets one either way.
+  node.watched = true;
+  auto watcher = [_path, this]() {
+    this->node_cache_[_path].watched = false;
+    this->InvalidateNode(_path);
+  };
+  auto wCb = [_path, generation, _return, cb, this](sp_int32 rc) {
+    if (rc == ZOK) {
+      this->ReadNode(_path, generation, _return, std::move(cb));
+      return;
+    }
+    // No watch is set on any other error
+    if (rc != ZNONODE) this->node_cache_[_path].watched = false;
+    cb(rc);
+  };
+  zkclient_->Exists(_path, std::move(watcher), std::move(wCb));
+}
+
+void HeronZKStateMgr::ReadNode(const std::string& _path, sp_int64 _generation,
+                               google::protobuf::Message* _return, VCallback<sp_int32> cb) {
+  std::string* contents = new std::string();
+  auto wCb = [_path, _generation, contents, _return, cb, this](sp_int32 rc) {
+    this->GetNodeDone(_path, _generation, contents, _return, std::move(cb), rc);
+  };
+  zkclient_->Get(_path, contents, std::move(wCb));
+}
+
+void HeronZKStateMgr::GetNodeDone(const std::string& _path, sp_int64 _generation,
+                                  std::string* _contents, google::protobuf::Message* _return,
+                                  VCallback<sp_int32> cb, sp_int32 _rc) {
+  if (_rc == ZOK) {
+    if (!_return->ParseFromString(*_contents)) {
+      _rc = ZMARSHALLINGERROR;
+    } else {
+      // Unless the node changed since it was asked for, what we got is
+      // current till the watch on it fires
+      CachedNode& node = node_cache_[_path];
+      if (node.generation == _generation) {
+        node.message.reset(_return->New());
+        node.message->CopyFrom(*_return);
+      }
+    }
+  }
+  delete _contents;
+  cb(_rc);
+}
+
+void HeronZKStateMgr::InvalidateNode(const std::string& _path) {
+  auto iter = node_cache_.find(_path);
+  if (iter != node_cache_.end()) {
+    iter->second.generation++;
+    iter->second.message.reset();
+  }
+}
+
+void HeronZKStateMgr::InvalidateAllNodes() {
+  for (auto& node : node_cache_) {
+    node.second.generation++;
+    node.second.watched = false;
+    node.second.message.reset();
+  }
+}
+
 bool HeronZKStateMgr::IsTmasterWatchDefined() {
   return (tmaster_location_watcher_info_ != NULL && tmaster_location_watcher_info_->watcher_cb &&
           !tmaster_location_watcher_info_->topology_name.empty());
@@ -653,6 +718,9 @@ void HeronZKStateMgr::SetTMasterLocationWatchInternal() {
 }
 
 void HeronZKStateMgr::TMasterLocationWatch() {
+  // The watch of the cache on the node may only fire after this one, so
+  // make sure the watcher reads the new location
+  InvalidateNode(GetTMasterLocationPath(tmaster_location_watcher_info_->topology_name));
   // First setup watch again
   SetTMasterLocationWatchInternal();
   // Then run the watcher
@@ -34,11 +34,17 @@
 //    to see if some assignment exists or not. We also keep track
 //    of this. So that the next time a SetAssignment is called,
 //    we know whether to do createnode or setnode
+// 4. Reads are cached. A read that goes to zk makes sure a watch is set
+//    on the node, and the node is served from the cache till the watch
+//    fires, or it is written through us. Nodes that are not there are
+//    not cached.
 //////////////////////////////////////////////////////////////////////////////
 #ifndef __HERON_ZKSTATE_H
 #define __HERON_ZKSTATE_H
 
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <utility>
 
@@ -119,6 +125,10 @@ class HeronZKStateMgr : public HeronStateMgr {
 
   virtual std::string GetStateLocation() { return zkhostport_; }
 
+  // The number of reads served from the cache, and that went to zk
+  sp_int64 GetCacheHits() const { return cache_hits_; }
+  sp_int64 GetCacheMisses() const { return cache_misses_; }
+
  protected:
   // A test ONLY constructor used to pass a ZKClientFactory which could
   // return a MockZKClient
@@ -129,37 +139,46 @@ class HeronZKStateMgr : public HeronStateMgr {
  private:
   // Done methods
   void SetTMasterLocationDone(VCallback<proto::system::StatusCode> _cb, sp_int32 _rc);
-  void GetTMasterLocationDone(std::string* _contents, proto::tmaster::TMasterLocation* _return,
-                              VCallback<proto::system::StatusCode> _cb, sp_int32 _rc);
+  void GetTMasterLocationDone(VCallback<proto::system::StatusCode> _cb, sp_int32 _rc);
 
   void CreateTopologyDone(VCallback<proto::system::StatusCode> _cb, sp_int32 _rc);
   void DeleteTopologyDone(VCallback<proto::system::StatusCode> _cb, sp_int32 _rc);
   void SetTopologyDone(VCallback<proto::system::StatusCode> _cb, sp_int32 _rc);
-  void GetTopologyDone(std::string* _contents, proto::api::Topology* _return,
-                       VCallback<proto::system::StatusCode> _cb, sp_int32 _rc);
+  void GetTopologyDone(VCallback<proto::system::StatusCode> _cb, sp_int32 _rc);
 
   void CreatePhysicalPlanDone(VCallback<proto::system::StatusCode> _cb, sp_int32 _rc);
   void DeletePhysicalPlanDone(VCallback<proto::system::StatusCode> _cb, sp_int32 _rc);
   void SetPhysicalPlanDone(VCallback<proto::system::StatusCode> _cb, sp_int32 _rc);
-  void GetPhysicalPlanDone(std::string* _contents, proto::system::PhysicalPlan* _return,
-                           VCallback<proto::system::StatusCode> _cb, sp_int32 _rc);
+  void GetPhysicalPlanDone(VCallback<proto::system::StatusCode> _cb, sp_int32 _rc);
 
   void CreateExecutionStateDone(VCallback<proto::system::StatusCode> _cb, sp_int32 _rc);
   void DeleteExecutionStateDone(VCallback<proto::system::StatusCode> _cb, sp_int32 _rc);
   void SetExecutionStateDone(VCallback<proto::system::StatusCode> _cb, sp_int32 _rc);
-  void GetExecutionStateDone(std::string* _contents, proto::system::ExecutionState* _return,
-                             VCallback<proto::system::StatusCode> _cb, sp_int32 _rc);
+  void GetExecutionStateDone(VCallback<proto::system::StatusCode> _cb, sp_int32 _rc);
 
   void CreateStatefulCheckpointDone(VCallback<proto::system::StatusCode> _cb, sp_int32 _rc);
   void DeleteStatefulCheckpointDone(VCallback<proto::system::StatusCode> _cb, sp_int32 _rc);
   void SetStatefulCheckpointDone(VCallback<proto::system::StatusCode> _cb, sp_int32 _rc);
-  void GetStatefulCheckpointDone(std::string* _contents,
-                           proto::ckptmgr::StatefulConsistentCheckpoints* _return,
-                           VCallback<proto::system::StatusCode> _cb, sp_int32 _rc);
+  void GetStatefulCheckpointDone(VCallback<proto::system::StatusCode> _cb, sp_int32 _rc);
 
   void ListTopologiesDone(VCallback<proto::system::StatusCode> _cb, sp_int32 _rc);
   void ListExecutionStateTopologiesDone(VCallback<proto::system::StatusCode> _cb, sp_int32 _rc);
 
+  // Reads the node at _path into _return, from the cache if it is there.
+  // _cb is called with the zk return code, or ZMARSHALLINGERROR if the
+  // node could not be parsed.
+  void GetNode(const std::string& _path, google::protobuf::Message* _return,
+               VCallback<sp_int32> _cb);
+  // Reads the node from zk, once a watch is set on it
+  void ReadNode(const std::string& _path, sp_int64 _generation,
+                google::protobuf::Message* _return, VCallback<sp_int32> _cb);
+  void GetNodeDone(const std::string& _path, sp_int64 _generation, std::string* _contents,
+                   google::protobuf::Message* _return, VCallback<sp_int32> _cb, sp_int32 _rc);
+  // Drops the node at _path from the cache, when it changed or is about to
+  void InvalidateNode(const std::string& _path);
+  // Drops all nodes from the cache, when their watches are gone
+  void InvalidateAllNodes();
+
   // This is the callback passed to ZkClient, to handle tmaster location
   // changes. It inturn calls the tmaster_location_watcher to notify the
   // clients about the change.
@@ -214,6 +233,23 @@ class HeronZKStateMgr : public HeronStateMgr {
   const TMasterLocationWatchInfo* tmaster_location_watcher_info_;
   // If true, we exit on zookeeper session expired event
   const bool exitOnSessionExpiry_;
+
+  // The nodes that were read, parsed
+  struct CachedNode {
+    CachedNode() : generation(0), watched(false) {}
+    // Bumped every time the node is dropped, so that a read that was in
+    // flight by then does not cache what it got
+    sp_int64 generation;
+    // Whether a watch is set on the node, so that reads of a node that is
+    // not there do not pile up watches
+    bool watched;
+    // NULL if the node is not cached
+    std::unique_ptr<google::protobuf::Message> message;
+  };
+  std::unordered_map<std::string, CachedNode> node_cache_;
+  sp_int64 cache_hits_;
+  sp_int64 cache_misses_;
+
   // Retry interval if setting a watch on zk node fails.
   static const sp_int32 SET_WATCH_RETRY_INTERVAL_S;
   // For easier unit testing, to allow access to private methods.
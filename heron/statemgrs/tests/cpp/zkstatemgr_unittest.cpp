@@ -32,6 +32,7 @@
 using ::testing::_;
 using ::testing::AtLeast;
 using ::testing::Mock;
+using ::testing::Invoke;
 using ::testing::InvokeWithoutArgs;
 
 namespace heron {
@@ -190,6 +191,205 @@ TEST_F(HeronZKStateMgrTest, testGlobalWatchEventHandler) {
 
   delete heron_zkstatemgr;
 }
+
+// Gets the tmaster location, and runs the event loop till it is there when
+// it is served from the cache
+static proto::system::StatusCode GetTMasterLocation(HeronZKStateMgr* heron_zkstatemgr,
+                                                    EventLoopImpl* ss,
+                                                    const std::string& topology_name,
+                                                    proto::tmaster::TMasterLocation* location) {
+  proto::system::StatusCode status = proto::system::NOTOK;
+  bool done = false;
+  heron_zkstatemgr->GetTMasterLocation(topology_name, location,
+                                       [&status, &done, ss](proto::system::StatusCode code) {
+    status = code;
+    done = true;
+    ss->loopExit();
+  });
+  if (!done) ss->loop();
+  return status;
+}
+
+static void MakeTMasterLocation(const std::string& topology_name, sp_int32 port,
+                                std::string* contents) {
+  proto::tmaster::TMasterLocation location;
+  location.set_topology_name(topology_name);
+  location.set_topology_id("dummy_topology_id");
+  location.set_host("dummy_host");
+  location.set_controller_port(port);
+  location.set_master_port(port + 1);
+  location.SerializeToString(contents);
+}
+
+// Ensure that a node is read from zk once, and from the cache till its
+// watch fires
+TEST_F(HeronZKStateMgrTest, testGetCachesNode) {
+  const std::string topology_name = "dummy_topology";
+  const std::string expected_path = topleveldir + "/tmasters/" + topology_name;
+
+  HeronZKStateMgr* heron_zkstatemgr =
+      new HeronZKStateMgrWithMock(hostportlist, topleveldir, &ss, mock_zkclient_factory);
+
+  std::string contents;
+  MakeTMasterLocation(topology_name, 10000, &contents);
+  VCallback<> watcher;
+  EXPECT_CALL(*mock_zkclient, Exists(expected_path, _, _))
+      .Times(2)
+      .WillRepeatedly(Invoke([&watcher](const std::string&, VCallback<> _watcher,
+                                        VCallback<sp_int32> _cb) {
+        watcher = std::move(_watcher);
+        _cb(ZOK);
+      }));
+  EXPECT_CALL(*mock_zkclient, Get(expected_path, _, _))
+      .Times(2)
+      .WillRepeatedly(Invoke([&contents](const std::string&, std::string* _data,
+                                         VCallback<sp_int32> _cb) {
+        *_data = contents;
+        _cb(ZOK);
+      }));
+
+  proto::tmaster::TMasterLocation location;
+  EXPECT_EQ(proto::system::OK,
+            GetTMasterLocation(heron_zkstatemgr, &ss, topology_name, &location));
+  EXPECT_EQ(10000, location.controller_port());
+  EXPECT_EQ(0, heron_zkstatemgr->GetCacheHits());
+  EXPECT_EQ(1, heron_zkstatemgr->GetCacheMisses());
+
+  location.Clear();
+  EXPECT_EQ(proto::system::OK,
+            GetTMasterLocation(heron_zkstatemgr, &ss, topology_name, &location));
+  EXPECT_EQ(10000, location.controller_port());
+  EXPECT_EQ(1, heron_zkstatemgr->GetCacheHits());
+  EXPECT_EQ(1, heron_zkstatemgr->GetCacheMisses());
+
+  // The node changes
+  MakeTMasterLocation(topology_name, 20000, &contents);
+  ASSERT_TRUE(watcher);
+  watcher();
+
+  EXPECT_EQ(proto::system::OK,
+            GetTMasterLocation(heron_zkstatemgr, &ss, topology_name, &location));
+  EXPECT_EQ(20000, location.controller_port());
+  EXPECT_EQ(1, heron_zkstatemgr->GetCacheHits());
+  EXPECT_EQ(2, heron_zkstatemgr->GetCacheMisses());
+
+  EXPECT_CALL(*mock_zkclient, Die()).Times(1);
+  EXPECT_CALL(*mock_zkclient_factory, Die()).Times(1);
+
+  delete heron_zkstatemgr;
+}
+
+// Ensure that a node is not cached if it changed while it was read, or when
+// it is written
+TEST_F(HeronZKStateMgrTest, testNodeInvalidation) {
+  const std::string topology_name = "dummy_topology";
+  const std::string expected_path = topleveldir + "/tmasters/" + topology_name;
+
+  HeronZKStateMgr* heron_zkstatemgr =
+      new HeronZKStateMgrWithMock(hostportlist, topleveldir, &ss, mock_zkclient_factory);
+
+  std::string contents;
+  MakeTMasterLocation(topology_name, 10000, &contents);
+  // The first read sees the watch fire before it completes
+  EXPECT_CALL(*mock_zkclient, Exists(expected_path, _, _))
+      .Times(2)
+      .WillOnce(Invoke([](const std::string&, VCallback<> _watcher, VCallback<sp_int32> _cb) {
+        _watcher();
+        _cb(ZOK);
+      }))
+      .WillOnce(Invoke([](const std::string&, VCallback<>, VCallback<sp_int32> _cb) {
+        _cb(ZOK);
+      }));
+  // The last read does not set a watch again, since the one set is still there
+  EXPECT_CALL(*mock_zkclient, Get(expected_path, _, _))
+      .Times(3)
+      .WillRepeatedly(Invoke([&contents](const std::string&, std::string* _data,
+                                         VCallback<sp_int32> _cb) {
+        *_data = contents;
+        _cb(ZOK);
+      }));
+  EXPECT_CALL(*mock_zkclient, CreateNode(expected_path, _, true, _))
+      .WillOnce(Invoke([](const std::string&, const std::string&, bool,
+                          VCallback<sp_int32> _cb) { _cb(ZOK); }));
+
+  proto::tmaster::TMasterLocation location;
+  EXPECT_EQ(proto::system::OK,
+            GetTMasterLocation(heron_zkstatemgr, &ss, topology_name, &location));
+  EXPECT_EQ(proto::system::OK,
+            GetTMasterLocation(heron_zkstatemgr, &ss, topology_name, &location));
+  EXPECT_EQ(0, heron_zkstatemgr->GetCacheHits());
+  EXPECT_EQ(2, heron_zkstatemgr->GetCacheMisses());
+
+  heron_zkstatemgr->SetTMasterLocation(location, [](proto::system::StatusCode) {});
+  EXPECT_EQ(proto::system::OK,
+            GetTMasterLocation(heron_zkstatemgr, &ss, topology_name, &location));
+  EXPECT_EQ(0, heron_zkstatemgr->GetCacheHits());
+  EXPECT_EQ(3, heron_zkstatemgr->GetCacheMisses());
+
+  EXPECT_CALL(*mock_zkclient, Die()).Times(1);
+  EXPECT_CALL(*mock_zkclient_factory, Die()).Times(1);
+
+  delete heron_zkstatemgr;
+}
+
+// Ensure that a node that is not there is not cached, and that the watch set
+// on it tells when it is created
+TEST_F(HeronZKStateMgrTest, testGetMissingNode) {
+  const std::string topology_name = "dummy_topology";
+  const std::string expected_path = topleveldir + "/tmasters/" + topology_name;
+
+  HeronZKStateMgr* heron_zkstatemgr =
+      new HeronZKStateMgrWithMock(hostportlist, topleveldir, &ss, mock_zkclient_factory);
+
+  std::string contents;
+  VCallback<> watcher;
+  sp_int32 exists_rc = ZNONODE;
+  EXPECT_CALL(*mock_zkclient, Exists(expected_path, _, _))
+      .Times(2)
+      .WillRepeatedly(Invoke([&watcher, &exists_rc](const std::string&, VCallback<> _watcher,
+                                                    VCallback<sp_int32> _cb) {
+        watcher = std::move(_watcher);
+        _cb(exists_rc);
+      }));
+  EXPECT_CALL(*mock_zkclient, Get(expected_path, _, _))
+      .Times(2)
+      .WillOnce(Invoke([](const std::string&, std::string*, VCallback<sp_int32> _cb) {
+        _cb(ZNONODE);
+      }))
+      .WillOnce(Invoke([&contents](const std::string&, std::string* _data,
+                                   VCallback<sp_int32> _cb) {
+        *_data = contents;
+        _cb(ZOK);
+      }));
+
+  // The first read finds no node, and the second does not set another watch
+  proto::tmaster::TMasterLocation location;
+  EXPECT_EQ(proto::system::PATH_DOES_NOT_EXIST,
+            GetTMasterLocation(heron_zkstatemgr, &ss, topology_name, &location));
+  EXPECT_EQ(proto::system::PATH_DOES_NOT_EXIST,
+            GetTMasterLocation(heron_zkstatemgr, &ss, topology_name, &location));
+  EXPECT_EQ(0, heron_zkstatemgr->GetCacheHits());
+  EXPECT_EQ(2, heron_zkstatemgr->GetCacheMisses());
+
+  // The node is created
+  MakeTMasterLocation(topology_name, 10000, &contents);
+  exists_rc = ZOK;
+  ASSERT_TRUE(watcher);
+  watcher();
+
+  EXPECT_EQ(proto::system::OK,
+            GetTMasterLocation(heron_zkstatemgr, &ss, topology_name, &location));
+  EXPECT_EQ(10000, location.controller_port());
+  EXPECT_EQ(proto::system::OK,
+            GetTMasterLocation(heron_zkstatemgr, &ss, topology_name, &location));
+  EXPECT_EQ(1, heron_zkstatemgr->GetCacheHits());
+  EXPECT_EQ(3, heron_zkstatemgr->GetCacheMisses());
+
+  EXPECT_CALL(*mock_zkclient, Die()).Times(1);
+  EXPECT_CALL(*mock_zkclient_factory, Die()).Times(1);
+
+  delete heron_zkstatemgr;
+}
 }  // namespace common
 }  // namespace heron
 
@@ -41,5 +41,14 @@ void AllGrouping::GetListToSend(const proto::system::HeronDataTuple&,
   }
 }
 
+void AllGrouping::GetRoutes(const proto::system::HeronDataTupleSet& _tuples,
+                            TupleRoutes& _routes) {
+  for (sp_int32 i = 0; i < _tuples.tuples_size(); ++i) {
+    for (auto task_id : task_ids_) {
+      _routes.Add(i, task_id);
+    }
+  }
+}
+
 }  // namespace stmgr
 }  // namespace heron
@@ -33,6 +33,9 @@ class AllGrouping : public Grouping {
 
   virtual void GetListToSend(const proto::system::HeronDataTuple& _tuple,
                              std::vector<sp_int32>& _return);
+
+  virtual void GetRoutes(const proto::system::HeronDataTupleSet& _tuples,
+                         TupleRoutes& _routes);
 };
 
 }  // namespace stmgr
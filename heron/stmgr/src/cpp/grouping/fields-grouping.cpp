@@ -15,6 +15,7 @@
  */
 
 #include "grouping/fields-grouping.h"
+#include <cstring>
 #include <iostream>
 #include <list>
 #include <vector>
@@ -28,10 +29,78 @@
 namespace heron {
 namespace stmgr {
 
+namespace {
+
+const size_t PRIME_NUM = 633910111UL;
+
+// The fast hash reads 8 bytes at a time, and long values 32 bytes at a
+// time into four independent lanes that the cpu works on side by side
+const sp_uint64 PRIME64_1 = 0x9E3779B185EBCA87ULL;
+const sp_uint64 PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+
+inline sp_uint64 Load64(const char* _p) {
+  sp_uint64 value;
+  memcpy(&value, _p, sizeof(value));
+  return value;
+}
+
+inline sp_uint64 Rotl(sp_uint64 _x, int _r) { return (_x << _r) | (_x >> (64 - _r)); }
+
+inline sp_uint64 Round(sp_uint64 _acc, sp_uint64 _word) {
+  return Rotl(_acc + _word * PRIME64_2, 31) * PRIME64_1;
+}
+
+inline sp_uint64 Absorb(sp_uint64 _h, sp_uint64 _word) {
+  return Rotl(_h ^ Round(0, _word), 27) * PRIME64_1 + PRIME64_2;
+}
+
+sp_uint64 FastHash(const char* _data, size_t _len, sp_uint64 _seed) {
+  const char* p = _data;
+  const char* const end = _data + _len;
+  sp_uint64 h = _seed + PRIME64_1 + _len;
+  if (_len >= 32) {
+    sp_uint64 v1 = _seed + PRIME64_1 + PRIME64_2;
+    sp_uint64 v2 = _seed + PRIME64_2;
+    sp_uint64 v3 = _seed;
+    sp_uint64 v4 = _seed - PRIME64_1;
+    for (; end - p >= 32; p += 32) {
+      v1 = Round(v1, Load64(p));
+      v2 = Round(v2, Load64(p + 8));
+      v3 = Round(v3, Load64(p + 16));
+      v4 = Round(v4, Load64(p + 24));
+    }
+    h = Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) + Rotl(v4, 18) + _len;
+  }
+  for (; end - p >= 8; p += 8) {
+    h = Absorb(h, Load64(p));
+  }
+  if (p < end) {
+    sp_uint64 word = 0;
+    for (int shift = 0; p < end; shift += 8) {
+      word |= static_cast<sp_uint64>(static_cast<unsigned char>(*p++)) << shift;
+    }
+    h = Absorb(h, word);
+  }
+  // the murmur3 finalizer, so that the high bits depend on all the input
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+}  // namespace
+
 FieldsGrouping::FieldsGrouping(const proto::api::InputStream& _is,
                                const proto::api::StreamSchema& _schema,
-                               const std::vector<sp_int32>& _task_ids)
-    : Grouping(_task_ids) {
+                               const std::vector<sp_int32>& _task_ids,
+                               FieldsHash _fields_hash)
+    : Grouping(_task_ids), fields_hash_(_fields_hash) {
+  CHECK(!task_ids_.empty());
+  // x % n == ((x * m mod 2^64) * n) >> 64 for m = 2^64 / n rounded up, and
+  // every 32 bit x (Lemire et al, Faster Remainder by Direct Computation)
+  mod_multiplier_ = ~static_cast<sp_uint64>(0) / task_ids_.size() + 1;
   for (sp_int32 i = 0; i < _schema.keys_size(); ++i) {
     for (sp_int32 j = 0; j < _is.grouping_fields().keys_size(); ++j) {
       if (_schema.keys(i).key() == _is.grouping_fields().keys(j).key()) {
@@ -46,16 +115,64 @@ FieldsGrouping::~FieldsGrouping() {}
 
 void FieldsGrouping::GetListToSend(const proto::system::HeronDataTuple& _tuple,
                                    std::vector<sp_int32>& _return) {
-  sp_int32 task_index = 0;
-  size_t prime_num = 633910111UL;
-  for (auto iter = fields_grouping_indices_.begin();
-       iter != fields_grouping_indices_.end(); ++iter) {
-    CHECK(_tuple.values_size() > *iter);
-    size_t h = str_hash_fn(_tuple.values(*iter));
-    task_index += (h % prime_num);
-  }
-  task_index = task_index % task_ids_.size();
-  _return.push_back(task_ids_[task_index]);
+  _return.push_back(task_ids_[TaskIndex(Hash(_tuple))]);
+}
+
+void FieldsGrouping::GetListToSend(const proto::system::HeronDataTupleSet& _tuples,
+                                   std::vector<sp_int32>& _return) {
+  size_t first = _return.size();
+  _return.resize(first + _tuples.tuples_size());
+  std::vector<sp_uint64> hashes(_tuples.tuples_size());
+  for (sp_int32 i = 0; i < _tuples.tuples_size(); ++i) {
+    hashes[i] = Hash(_tuples.tuples(i));
+  }
+  for (size_t i = 0; i < hashes.size(); ++i) {
+    _return[first + i] = task_ids_[TaskIndex(hashes[i])];
+  }
+}
+
+void FieldsGrouping::GetRoutes(const proto::system::HeronDataTupleSet& _tuples,
+                               TupleRoutes& _routes) {
+  tasks_.clear();
+  GetListToSend(_tuples, tasks_);
+  for (size_t i = 0; i < tasks_.size(); ++i) {
+    _routes.Add(i, tasks_[i]);
+  }
+}
+
+sp_uint64 FieldsGrouping::Hash(const proto::system::HeronDataTuple& _tuple) const {
+  if (fields_hash_ == FIELDS_HASH_FAST) {
+    sp_uint64 h = 0;
+    for (auto index : fields_grouping_indices_) {
+      CHECK(_tuple.values_size() > index);
+      const sp_string& value = _tuple.values(index);
+      h = FastHash(value.data(), value.size(), h);
+    }
+    return h;
+  }
+
+  // This has to wrap around just like the sp_int32 it always was summed in
+  sp_uint32 sum = 0;
+  for (auto index : fields_grouping_indices_) {
+    CHECK(_tuple.values_size() > index);
+    sum += str_hash_fn(_tuple.values(index)) % PRIME_NUM;
+  }
+  return sum;
+}
+
+sp_uint32 FieldsGrouping::TaskIndex(sp_uint64 _hash) const {
+  if (fields_hash_ == FIELDS_HASH_FAST) {
+    return ((_hash >> 32) * task_ids_.size()) >> 32;
+  }
+
+  sp_int32 sum = static_cast<sp_int32>(_hash);
+  if (sum < 0) {
+    // A sum that wrapped to a negative number was sign extended before
+    // taking it modulo the number of tasks
+    return static_cast<size_t>(sum) % task_ids_.size();
+  }
+  sp_uint64 low = mod_multiplier_ * static_cast<sp_uint32>(sum);
+  return (static_cast<unsigned __int128>(low) * task_ids_.size()) >> 64;
 }
 
 }  // namespace stmgr
@@ -29,15 +29,38 @@ namespace stmgr {
 class FieldsGrouping : public Grouping {
  public:
   FieldsGrouping(const proto::api::InputStream& _is, const proto::api::StreamSchema& _schema,
-                 const std::vector<sp_int32>& _task_ids);
+                 const std::vector<sp_int32>& _task_ids,
+                 FieldsHash _fields_hash = FIELDS_HASH_LEGACY);
   virtual ~FieldsGrouping();
 
   virtual void GetListToSend(const proto::system::HeronDataTuple& _tuple,
                              std::vector<sp_int32>& _return);
 
+  virtual void GetRoutes(const proto::system::HeronDataTupleSet& _tuples,
+                         TupleRoutes& _routes);
+
+  // Append the task of every tuple of _tuples to _return, in order. The
+  // fields of all the tuples are hashed first, and then reduced to tasks
+  // in one go.
+  void GetListToSend(const proto::system::HeronDataTupleSet& _tuples,
+                     std::vector<sp_int32>& _return);
+
  private:
+  // the hash of the grouping fields of _tuple, before it is reduced to a
+  // task index
+  sp_uint64 Hash(const proto::system::HeronDataTuple& _tuple) const;
+
+  // the index of the task that _hash goes to
+  sp_uint32 TaskIndex(sp_uint64 _hash) const;
+
   std::vector<sp_int32> fields_grouping_indices_;
+  // the tasks of the batch that GetRoutes is working on
+  std::vector<sp_int32> tasks_;
   std::hash<sp_string> str_hash_fn;
+  FieldsHash fields_hash_;
+  // the multiplier that takes a 32 bit number modulo the number of tasks
+  // without dividing
+  sp_uint64 mod_multiplier_;
 };
 
 }  // namespace stmgr
@@ -37,9 +37,22 @@ Grouping::Grouping(const std::vector<sp_int32>& _task_ids) : task_ids_(_task_ids
 
 Grouping::~Grouping() {}
 
+void Grouping::GetRoutes(const proto::system::HeronDataTupleSet& _tuples,
+                         TupleRoutes& _routes) {
+  std::vector<sp_int32> tasks;
+  for (sp_int32 i = 0; i < _tuples.tuples_size(); ++i) {
+    tasks.clear();
+    GetListToSend(_tuples.tuples(i), tasks);
+    for (auto task : tasks) {
+      _routes.Add(i, task);
+    }
+  }
+}
+
 Grouping* Grouping::Create(proto::api::Grouping grouping_, const proto::api::InputStream& _is,
                            const proto::api::StreamSchema& _schema,
-                           const std::vector<sp_int32>& _task_ids) {
+                           const std::vector<sp_int32>& _task_ids,
+                           FieldsHash _fields_hash) {
   switch (grouping_) {
     case proto::api::SHUFFLE: {
       return new ShuffleGrouping(_task_ids);
@@ -47,7 +60,7 @@ Grouping* Grouping::Create(proto::api::Grouping grouping_, const proto::api::Inp
     }
 
     case proto::api::FIELDS: {
-      return new FieldsGrouping(_is, _schema, _task_ids);
+      return new FieldsGrouping(_is, _schema, _task_ids, _fields_hash);
       break;
     }
 
@@ -18,12 +18,25 @@
 #define SRC_CPP_SVCS_STMGR_SRC_GROUPING_GROUPING_H_
 
 #include <vector>
+#include "grouping/tuple-routes.h"
 #include "proto/messages.h"
 #include "basics/basics.h"
 
 namespace heron {
 namespace stmgr {
 
+// How fields grouping maps the values of the grouping fields to a task.
+// Keyed state is kept where this sends the keys, so a topology has to
+// stay with the one it started with.
+enum FieldsHash {
+  // the sum of std::hash of every field modulo a prime, modulo the number
+  // of tasks
+  FIELDS_HASH_LEGACY,
+  // one fast hash over all the fields, scaled to the number of tasks by a
+  // multiply and shift
+  FIELDS_HASH_FAST
+};
+
 class Grouping {
  public:
   explicit Grouping(const std::vector<sp_int32>& _task_ids);
@@ -31,11 +44,17 @@ class Grouping {
 
   static Grouping* Create(proto::api::Grouping grouping_, const proto::api::InputStream& _is,
                           const proto::api::StreamSchema& _schema,
-                          const std::vector<sp_int32>& _task_ids);
+                          const std::vector<sp_int32>& _task_ids,
+                          FieldsHash _fields_hash = FIELDS_HASH_LEGACY);
 
   virtual void GetListToSend(const proto::system::HeronDataTuple& _tuple,
                              std::vector<sp_int32>& _return) = 0;
 
+  // Add the routes of all the tuples of _tuples to _routes. This asks
+  // GetListToSend tuple by tuple unless a grouping knows better.
+  virtual void GetRoutes(const proto::system::HeronDataTupleSet& _tuples,
+                         TupleRoutes& _routes);
+
  protected:
   std::vector<sp_int32> task_ids_;
 };
@@ -41,5 +41,13 @@ void ShuffleGrouping::GetListToSend(const proto::system::HeronDataTuple&,
   next_index_ = (next_index_ + 1) % task_ids_.size();
 }
 
+void ShuffleGrouping::GetRoutes(const proto::system::HeronDataTupleSet& _tuples,
+                                TupleRoutes& _routes) {
+  for (sp_int32 i = 0; i < _tuples.tuples_size(); ++i) {
+    _routes.Add(i, task_ids_[next_index_]);
+    if (++next_index_ == static_cast<sp_int32>(task_ids_.size())) next_index_ = 0;
+  }
+}
+
 }  // namespace stmgr
 }  // namespace heron
@@ -34,6 +34,9 @@ class ShuffleGrouping : public Grouping {
   virtual void GetListToSend(const proto::system::HeronDataTuple& _tuple,
                              std::vector<sp_int32>& _return);
 
+  virtual void GetRoutes(const proto::system::HeronDataTupleSet& _tuples,
+                         TupleRoutes& _routes);
+
  private:
   sp_int32 next_index_;
 };
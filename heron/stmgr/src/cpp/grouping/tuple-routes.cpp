@@ -0,0 +1,51 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "grouping/tuple-routes.h"
+#include <algorithm>
+#include <vector>
+#include "basics/basics.h"
+
+namespace heron {
+namespace stmgr {
+
+void TupleRoutes::Clear() {
+  routes_.clear();
+  tasks_.clear();
+  offsets_.clear();
+  indices_.clear();
+}
+
+void TupleRoutes::Group() {
+  // Tuples are added in order, so sorting by (task, index) keeps every
+  // task's tuples in order. This needs no table over the task ids, which
+  // are not dense.
+  std::sort(routes_.begin(), routes_.end());
+  tasks_.clear();
+  offsets_.clear();
+  indices_.resize(routes_.size());
+  for (size_t i = 0; i < routes_.size(); ++i) {
+    if (i == 0 || routes_[i].first != routes_[i - 1].first) {
+      tasks_.push_back(routes_[i].first);
+      offsets_.push_back(i);
+    }
+    indices_[i] = routes_[i].second;
+  }
+  offsets_.push_back(routes_.size());
+}
+
+}  // namespace stmgr
+}  // namespace heron
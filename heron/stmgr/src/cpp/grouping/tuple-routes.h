@@ -0,0 +1,69 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_CPP_SVCS_STMGR_SRC_GROUPING_TUPLE_ROUTES_H_
+#define SRC_CPP_SVCS_STMGR_SRC_GROUPING_TUPLE_ROUTES_H_
+
+#include <utility>
+#include <vector>
+#include "basics/basics.h"
+
+namespace heron {
+namespace stmgr {
+
+// Where the tuples of a HeronDataTupleSet go. The groupings add a route
+// for every tuple and task it goes to, and Group then lays them out by
+// task, in compressed sparse row form: the i-th task gets the tuples with
+// the indices in [Begin(i), End(i)), in the order they were added. That
+// lets every destination be handed its tuples as one run.
+class TupleRoutes {
+ public:
+  TupleRoutes() {}
+  ~TupleRoutes() {}
+
+  // forget all routes, but keep the memory for the next batch
+  void Clear();
+
+  // the tuple at _index goes to _task_id
+  void Add(sp_int32 _index, sp_int32 _task_id) {
+    routes_.push_back(std::make_pair(_task_id, _index));
+  }
+
+  // lay out the routes added since Clear by task
+  void Group();
+
+  // the number of tasks that get tuples
+  size_t NumTasks() const { return tasks_.size(); }
+
+  sp_int32 Task(size_t _i) const { return tasks_[_i]; }
+
+  // the indices of the tuples that the _i-th task gets
+  const sp_int32* Begin(size_t _i) const { return indices_.data() + offsets_[_i]; }
+  const sp_int32* End(size_t _i) const { return indices_.data() + offsets_[_i + 1]; }
+
+ private:
+  // (task, tuple index) in the order they were added
+  std::vector<std::pair<sp_int32, sp_int32>> routes_;
+  std::vector<sp_int32> tasks_;
+  // where the indices of each task start in indices_, and one past the last
+  std::vector<size_t> offsets_;
+  std::vector<sp_int32> indices_;
+};
+
+}  // namespace stmgr
+}  // namespace heron
+
+#endif  // SRC_CPP_SVCS_STMGR_SRC_GROUPING_TUPLE_ROUTES_H_
@@ -15,6 +15,7 @@
  */
 
 #include "manager/ckptmgr-client.h"
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include "basics/basics.h"
@@ -27,13 +28,40 @@
 namespace heron {
 namespace stmgr {
 
+struct CkptMgrClient::StateTransfer {
+  StateTransfer() : id_(0), state_size_(0), next_offset_(0), done_offset_(0), in_flight_(0),
+                    save_(nullptr), restore_(nullptr), nattempts_(nullptr) {}
+
+  ~StateTransfer() {
+    delete save_;
+    delete restore_;
+    delete nattempts_;
+  }
+
+  sp_int64 id_;
+  proto::system::Instance instance_;
+  std::string checkpoint_id_;
+  sp_int64 state_size_;
+  // where the next chunk to send or ask for starts
+  sp_int64 next_offset_;
+  // how much of the state the ckptmgr has saved or sent back
+  sp_int64 done_offset_;
+  sp_int32 in_flight_;
+  // the request whose state is saved, for a save
+  proto::ckptmgr::SaveInstanceStateRequest* save_;
+  // the state put together, for a restore
+  proto::ckptmgr::InstanceStateCheckpoint* restore_;
+  int32_t* nattempts_;
+};
+
 CkptMgrClient::CkptMgrClient(EventLoop* eventloop, const NetworkOptions& _options,
                              const sp_string& _topology_name, const sp_string& _topology_id,
                              const sp_string& _ckptmgr_id, const sp_string& _stmgr_id,
                              std::function<void(const proto::system::Instance&,
                                                 const std::string&)> _ckpt_saved_watcher,
                              std::function<void(proto::system::StatusCode, sp_int32, sp_string,
-                               const proto::ckptmgr::InstanceStateCheckpoint&)> _ckpt_get_watcher,
+                               proto::ckptmgr::InstanceStateCheckpoint*)> _ckpt_get_watcher,
+                             std::function<void(sp_int32, const std::string&)> _ckpt_chunks_watcher,
                              std::function<void()> _register_watcher)
     : Client(eventloop, _options),
       topology_name_(_topology_name),
@@ -43,10 +71,18 @@ CkptMgrClient::CkptMgrClient(EventLoop* eventloop, const NetworkOptions& _option
       quit_(false),
       ckpt_saved_watcher_(_ckpt_saved_watcher),
       ckpt_get_watcher_(_ckpt_get_watcher),
-      register_watcher_(_register_watcher) {
+      ckpt_chunks_watcher_(_ckpt_chunks_watcher),
+      register_watcher_(_register_watcher),
+      takes_state_chunks_(false),
+      next_transfer_id_(1),
+      sending_(0) {
 
   reconnect_cpktmgr_interval_sec_ =
     config::HeronInternalsConfigReader::Instance()->GetHeronStreammgrClientReconnectIntervalSec();
+  chunk_size_ = static_cast<sp_int64>(config::HeronInternalsConfigReader::Instance()
+                                          ->GetHeronStreammgrStatefulChunkSizeMb()) * 1024 * 1024;
+  chunk_window_ =
+    config::HeronInternalsConfigReader::Instance()->GetHeronStreammgrStatefulChunkWindow();
 
   InstallResponseHandler(new proto::ckptmgr::RegisterStMgrRequest(),
                          &CkptMgrClient::HandleStMgrRegisterResponse);
@@ -56,10 +92,15 @@ CkptMgrClient::CkptMgrClient(EventLoop* eventloop, const NetworkOptions& _option
                          &CkptMgrClient::HandleGetInstanceStateResponse);
   InstallResponseHandler(new proto::ckptmgr::GetInstanceStateRequest(),
                          &CkptMgrClient::HandleGetInstanceStateResponse);
+  InstallResponseHandler(new proto::ckptmgr::SaveInstanceStateChunkRequest(),
+                         &CkptMgrClient::HandleSaveInstanceStateChunkResponse);
+  InstallResponseHandler(new proto::ckptmgr::GetInstanceStateChunkRequest(),
+                         &CkptMgrClient::HandleGetInstanceStateChunkResponse);
 }
 
 CkptMgrClient::~CkptMgrClient() {
   Stop();
+  for (auto& transfer : transfers_) delete transfer.second;
 }
 
 
@@ -104,6 +145,10 @@ void CkptMgrClient::HandleClose(NetworkErrorCode _code) {
               << get_clientoptions().get_host() << ":" << get_clientoptions().get_port()
               << " closed connection with code " << _code << std::endl;
   }
+  // The ckptmgr forgets the transfers with the connection
+  for (auto& transfer : transfers_) delete transfer.second;
+  transfers_.clear();
+  takes_state_chunks_ = false;
   if (quit_) {
     delete this;
   } else {
@@ -134,6 +179,7 @@ void CkptMgrClient::HandleStMgrRegisterResponse(void*,
     LOG(INFO) << "Register request got response OK from ckptmgr " << ckptmgr_id_
               << " running at " << get_clientoptions().get_host() << ":"
               << get_clientoptions().get_port();
+    takes_state_chunks_ = _response->takes_state_chunks();
     register_watcher_();
   }
   delete _response;
@@ -152,7 +198,24 @@ void CkptMgrClient::SendRegisterRequest() {
 
 
 void CkptMgrClient::SaveInstanceState(proto::ckptmgr::SaveInstanceStateRequest* _request) {
-  SendRequest(_request, NULL);
+  sp_int64 state_size = _request->checkpoint().state().size();
+  if (!takes_state_chunks_ || state_size <= chunk_size_) {
+    SendRequest(_request, NULL);
+    return;
+  }
+
+  // A large state goes in chunks, so that neither side has to put all of
+  // it in one packet
+  LOG(INFO) << "Saving the " << state_size << " bytes of state of task "
+            << _request->instance().info().task_id() << " for checkpoint "
+            << _request->checkpoint().checkpoint_id() << " in chunks";
+  auto transfer = new StateTransfer();
+  transfer->instance_.CopyFrom(_request->instance());
+  transfer->checkpoint_id_ = _request->checkpoint().checkpoint_id();
+  transfer->state_size_ = state_size;
+  transfer->save_ = _request;
+  AddTransfer(transfer);
+  SendChunks(transfer);
 }
 
 void CkptMgrClient::GetInstanceState(const proto::system::Instance& _instance,
@@ -170,9 +233,62 @@ void CkptMgrClient::GetInstanceState(const proto::system::Instance& _instance,
   auto request = new proto::ckptmgr::GetInstanceStateRequest();
   request->mutable_instance()->CopyFrom(_instance);
   request->set_checkpoint_id(_checkpoint_id);
+  if (takes_state_chunks_) {
+    request->set_max_chunk_size(chunk_size_);
+  }
   SendRequest(request, _nattempts);
 }
 
+void CkptMgrClient::SendChunks(StateTransfer* _transfer) {
+  while (_transfer->in_flight_ < chunk_window_ &&
+         _transfer->next_offset_ < _transfer->state_size_) {
+    sp_int64 size = std::min(chunk_size_, _transfer->state_size_ - _transfer->next_offset_);
+    google::protobuf::Message* request = nullptr;
+    if (_transfer->save_) {
+      auto chunk = new proto::ckptmgr::SaveInstanceStateChunkRequest();
+      chunk->mutable_instance()->CopyFrom(_transfer->instance_);
+      chunk->set_checkpoint_id(_transfer->checkpoint_id_);
+      chunk->set_state_size(_transfer->state_size_);
+      chunk->set_offset(_transfer->next_offset_);
+      chunk->set_data(_transfer->save_->checkpoint().state().data() + _transfer->next_offset_,
+                      size);
+      request = chunk;
+    } else {
+      auto chunk = new proto::ckptmgr::GetInstanceStateChunkRequest();
+      chunk->mutable_instance()->CopyFrom(_transfer->instance_);
+      chunk->set_checkpoint_id(_transfer->checkpoint_id_);
+      chunk->set_offset(_transfer->next_offset_);
+      chunk->set_size(size);
+      request = chunk;
+    }
+    _transfer->next_offset_ += size;
+    _transfer->in_flight_++;
+    // A request that can not be sent is answered right away with a
+    // WRITE_ERROR, and without its context, which then drops the transfer
+    sp_int64 id = _transfer->id_;
+    sending_ = id;
+    SendRequest(request, reinterpret_cast<void*>(static_cast<intptr_t>(id)));
+    sending_ = 0;
+    if (transfers_.find(id) == transfers_.end()) return;
+  }
+}
+
+CkptMgrClient::StateTransfer* CkptMgrClient::FindTransfer(void* _ctx) {
+  sp_int64 id = _ctx ? static_cast<sp_int64>(reinterpret_cast<intptr_t>(_ctx)) : sending_;
+  auto iter = transfers_.find(id);
+  return iter == transfers_.end() ? nullptr : iter->second;
+}
+
+void CkptMgrClient::AddTransfer(StateTransfer* _transfer) {
+  _transfer->id_ = next_transfer_id_++;
+  transfers_[_transfer->id_] = _transfer;
+}
+
+void CkptMgrClient::DropTransfer(StateTransfer* _transfer) {
+  transfers_.erase(_transfer->id_);
+  delete _transfer;
+}
+
 void CkptMgrClient::HandleSaveInstanceStateResponse(void*,
                              proto::ckptmgr::SaveInstanceStateResponse* _response,
                              NetworkErrorCode _status) {
@@ -207,21 +323,133 @@ void CkptMgrClient::HandleGetInstanceStateResponse(void* _ctx,
                << _response->instance().info().task_id()
                << " and checkpoint_id " << _response->checkpoint_id()
                << " because of reason: " << _response->status().status();
-    *nattempts = *nattempts + 1;
-    if (*nattempts >= 5) {
-      LOG(ERROR) << "Not Retrying because already tried too many times";
-      delete nattempts;
-      ckpt_get_watcher_(_response->status().status(),
-                        _response->instance().info().task_id(),
-                        _response->checkpoint_id(), _response->checkpoint());
-    } else {
-      LOG(INFO) << "Retrying...";
-      GetInstanceState(_response->instance(), _response->checkpoint_id(), nattempts);
-    }
+    RetryGetInstanceState(_response->status().status(), _response->instance(),
+                          _response->checkpoint_id(), nattempts);
+  } else if (!_response->has_checkpoint() && _response->has_state_size()) {
+    // The state is too large for one response, so fetch it in chunks
+    LOG(INFO) << "Getting the " << _response->state_size() << " bytes of state of task "
+              << _response->instance().info().task_id() << " for checkpoint "
+              << _response->checkpoint_id() << " in chunks";
+    auto transfer = new StateTransfer();
+    transfer->instance_.CopyFrom(_response->instance());
+    transfer->checkpoint_id_ = _response->checkpoint_id();
+    transfer->state_size_ = _response->state_size();
+    transfer->restore_ = new proto::ckptmgr::InstanceStateCheckpoint();
+    transfer->restore_->set_checkpoint_id(_response->checkpoint_id());
+    transfer->restore_->mutable_state()->reserve(_response->state_size());
+    transfer->nattempts_ = nattempts;
+    AddTransfer(transfer);
+    ckpt_chunks_watcher_(transfer->instance_.info().task_id(), transfer->checkpoint_id_);
+    SendChunks(transfer);
   } else {
+    delete nattempts;
     ckpt_get_watcher_(_response->status().status(),
                       _response->instance().info().task_id(), _response->checkpoint_id(),
-                      _response->checkpoint());
+                      _response->mutable_checkpoint());
+  }
+  delete _response;
+}
+
+void CkptMgrClient::RetryGetInstanceState(proto::system::StatusCode _status,
+                                          const proto::system::Instance& _instance,
+                                          const std::string& _checkpoint_id,
+                                          int32_t* _nattempts) {
+  *_nattempts = *_nattempts + 1;
+  if (*_nattempts >= 5) {
+    LOG(ERROR) << "Not Retrying because already tried too many times";
+    delete _nattempts;
+    proto::ckptmgr::InstanceStateCheckpoint checkpoint;
+    checkpoint.set_checkpoint_id(_checkpoint_id);
+    ckpt_get_watcher_(_status, _instance.info().task_id(), _checkpoint_id, &checkpoint);
+  } else {
+    LOG(INFO) << "Retrying...";
+    GetInstanceState(_instance, _checkpoint_id, _nattempts);
+  }
+}
+
+void CkptMgrClient::HandleSaveInstanceStateChunkResponse(void* _ctx,
+                             proto::ckptmgr::SaveInstanceStateChunkResponse* _response,
+                             NetworkErrorCode _status) {
+  auto transfer = FindTransfer(_ctx);
+  if (_status != OK) {
+    LOG(ERROR) << "NonOK response message for SaveInstanceStateChunkResponse";
+    if (transfer) DropTransfer(transfer);
+    delete _response;
+    Stop();
+    return;
+  }
+  if (!transfer) {
+    // The save failed already
+    delete _response;
+    return;
+  }
+  if (_response->status().status() != proto::system::OK) {
+    LOG(ERROR) << "CkptMgr could not save the chunk at " << _response->offset()
+               << " of the state of task " << transfer->instance_.info().task_id()
+               << " for checkpoint " << transfer->checkpoint_id_ << ": "
+               << _response->status().status();
+    DropTransfer(transfer);
+    delete _response;
+    return;
+  }
+
+  // The ckptmgr answers the chunks of a state in order
+  transfer->in_flight_--;
+  transfer->done_offset_ =
+      std::min(_response->offset() + chunk_size_, transfer->state_size_);
+  if (transfer->done_offset_ == transfer->state_size_) {
+    proto::system::Instance instance(transfer->instance_);
+    std::string checkpoint_id(transfer->checkpoint_id_);
+    DropTransfer(transfer);
+    ckpt_saved_watcher_(instance, checkpoint_id);
+  } else {
+    SendChunks(transfer);
+  }
+  delete _response;
+}
+
+void CkptMgrClient::HandleGetInstanceStateChunkResponse(void* _ctx,
+                             proto::ckptmgr::GetInstanceStateChunkResponse* _response,
+                             NetworkErrorCode _status) {
+  auto transfer = FindTransfer(_ctx);
+  if (_status != OK) {
+    LOG(ERROR) << "NonOK response message for GetInstanceStateChunkResponse";
+    if (transfer) DropTransfer(transfer);
+    delete _response;
+    Stop();
+    return;
+  }
+  if (!transfer) {
+    // Getting the state has failed already
+    delete _response;
+    return;
+  }
+  if (_response->status().status() != proto::system::OK ||
+      _response->offset() != transfer->done_offset_) {
+    LOG(ERROR) << "CkptMgr could not get the chunk at " << _response->offset()
+               << " of the state of task " << transfer->instance_.info().task_id()
+               << " for checkpoint " << transfer->checkpoint_id_ << ": "
+               << _response->status().status();
+    // Start over, since the ckptmgr has let go of the state
+    int32_t* nattempts = transfer->nattempts_;
+    transfer->nattempts_ = nullptr;
+    proto::system::Instance instance(transfer->instance_);
+    std::string checkpoint_id(transfer->checkpoint_id_);
+    DropTransfer(transfer);
+    RetryGetInstanceState(proto::system::NOTOK, instance, checkpoint_id, nattempts);
+    delete _response;
+    return;
+  }
+
+  transfer->in_flight_--;
+  transfer->restore_->mutable_state()->append(_response->data());
+  transfer->done_offset_ += _response->data().size();
+  if (transfer->done_offset_ == transfer->state_size_) {
+    ckpt_get_watcher_(proto::system::OK, transfer->instance_.info().task_id(),
+                      transfer->checkpoint_id_, transfer->restore_);
+    DropTransfer(transfer);
+  } else {
+    SendChunks(transfer);
   }
   delete _response;
 }
@@ -18,6 +18,7 @@
 #define SRC_CPP_SVCS_CKPTMGR_SRC_CKPTCLIENT_CLIENT_H_
 
 #include <string>
+#include <unordered_map>
 #include "basics/basics.h"
 #include "network/network.h"
 #include "network/network_error.h"
@@ -34,7 +35,8 @@ class CkptMgrClient : public Client {
                 std::function<void(const proto::system::Instance&,
                                    const std::string&)> _ckpt_saved_watcher,
                 std::function<void(proto::system::StatusCode, sp_int32, sp_string,
-                              const proto::ckptmgr::InstanceStateCheckpoint&)> _ckpt_get_watcher,
+                              proto::ckptmgr::InstanceStateCheckpoint*)> _ckpt_get_watcher,
+                std::function<void(sp_int32, const std::string&)> _ckpt_chunks_watcher,
                 std::function<void()> _register_watcher);
   virtual ~CkptMgrClient();
 
@@ -45,6 +47,9 @@ class CkptMgrClient : public Client {
   void GetInstanceState(const proto::system::Instance& _instance,
                         const std::string& _checkpoint_id);
 
+  // The states being saved or restored in chunks
+  size_t NumStateTransfers() const { return transfers_.size(); }
+
  protected:
   void GetInstanceState(const proto::system::Instance& _instance,
                         const std::string& _checkpoint_id, int32_t* _nattempts);
@@ -54,6 +59,12 @@ class CkptMgrClient : public Client {
   virtual void HandleGetInstanceStateResponse(void*,
                              proto::ckptmgr::GetInstanceStateResponse* _response,
                              NetworkErrorCode status);
+  virtual void HandleSaveInstanceStateChunkResponse(void*,
+                             proto::ckptmgr::SaveInstanceStateChunkResponse* _response,
+                             NetworkErrorCode status);
+  virtual void HandleGetInstanceStateChunkResponse(void*,
+                             proto::ckptmgr::GetInstanceStateChunkResponse* _response,
+                             NetworkErrorCode status);
   virtual void HandleConnect(NetworkErrorCode status);
   virtual void HandleClose(NetworkErrorCode status);
 
@@ -64,6 +75,21 @@ class CkptMgrClient : public Client {
 
   void OnReconnectTimer();
 
+  // A state that is saved to or restored from the ckptmgr in chunks
+  struct StateTransfer;
+
+  // send the chunks of the transfer that fit in the window
+  void SendChunks(StateTransfer* _transfer);
+  // the transfer a chunk response is for, or NULL if it is gone
+  StateTransfer* FindTransfer(void* _ctx);
+  // give the transfer the next id and track it
+  void AddTransfer(StateTransfer* _transfer);
+  void DropTransfer(StateTransfer* _transfer);
+  // retry getting the state, unless it has been tried too many times
+  void RetryGetInstanceState(proto::system::StatusCode _status,
+                             const proto::system::Instance& _instance,
+                             const std::string& _checkpoint_id, int32_t* _nattempts);
+
   // TODO(nlu): add response handler methods
 
   sp_string topology_name_;
@@ -74,11 +100,24 @@ class CkptMgrClient : public Client {
   std::function<void(const proto::system::Instance&,
                      const std::string&)> ckpt_saved_watcher_;
   std::function<void(proto::system::StatusCode, sp_int32, sp_string,
-                     const proto::ckptmgr::InstanceStateCheckpoint&)> ckpt_get_watcher_;
+                     proto::ckptmgr::InstanceStateCheckpoint*)> ckpt_get_watcher_;
+  // called when the chunks of a state start being fetched
+  std::function<void(sp_int32, const std::string&)> ckpt_chunks_watcher_;
   std::function<void()> register_watcher_;
 
+  // Whether the ckptmgr we are registered with takes states in chunks
+  bool takes_state_chunks_;
+  // The transfers by id. The id, not the transfer, is the context of its chunk
+  // requests, so that a late response never finds a new transfer at a reused address.
+  std::unordered_map<sp_int64, StateTransfer*> transfers_;
+  sp_int64 next_transfer_id_;
+  // the id of the transfer whose chunk is being sent, or 0
+  sp_int64 sending_;
+
   // Config
   sp_int32 reconnect_cpktmgr_interval_sec_;
+  sp_int64 chunk_size_;
+  sp_int32 chunk_window_;
 };
 
 }  // namespace stmgr
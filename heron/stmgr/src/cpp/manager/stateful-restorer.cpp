@@ -29,6 +29,7 @@
 #include "metrics/metrics.h"
 #include "proto/messages.h"
 #include "basics/basics.h"
+#include "config/heron-internals-config-reader.h"
 #include "errors/errors.h"
 #include "threads/threads.h"
 #include "network/network.h"
@@ -47,6 +48,12 @@ const sp_string METRIC_CKPT_RESPONSES_ERROR = "__ckpt_responses_error";
 const sp_string METRIC_INSTANCE_RESTORE_REQUESTS = "__instance_restore_requests";
 const sp_string METRIC_INSTANCE_RESTORE_RESPONSES = "__instance_restore_responses";
 const sp_string METRIC_INSTANCE_RESTORE_RESPONSES_IGNORED = "__instance_restore_response_ignored";
+// Phases of restoring one task: the ckptmgr getting its state, the state
+// coming over in chunks till it is handed to the instance, and the instance
+// restoring it
+const sp_string METRIC_PHASE_FETCH = "fetch";
+const sp_string METRIC_PHASE_TRANSFER = "transfer";
+const sp_string METRIC_PHASE_APPLY = "apply";
 
 StatefulRestorer::StatefulRestorer(CkptMgrClient* _ckptmgr,
                              StMgrClientMgr* _clientmgr, TupleCache* _tuple_cache,
@@ -62,17 +69,25 @@ StatefulRestorer::StatefulRestorer(CkptMgrClient* _ckptmgr,
   in_progress_ = false;
   restore_done_watcher_ = _restore_done_watcher;
   metrics_manager_client_ = _metrics_manager_client;
+  parallelism_ = config::HeronInternalsConfigReader::Instance()
+                     ->GetHeronStreammgrStatefulRestoreParallelism();
+  CHECK_GT(parallelism_, 0);
   multi_count_metric_ = new common::MultiCountMetric();
   time_spent_metric_ = new common::TimeSpentMetric();
+  phase_time_metric_ = new common::MultiMeanMetric();
   metrics_manager_client_->register_metric("__stateful_restore_count", multi_count_metric_);
   metrics_manager_client_->register_metric("__stateful_restore_time", time_spent_metric_);
+  metrics_manager_client_->register_metric("__stateful_restore_phase_time_ms",
+                                           phase_time_metric_);
 }
 
 StatefulRestorer::~StatefulRestorer() {
   metrics_manager_client_->unregister_metric("__stateful_restore_count");
   metrics_manager_client_->unregister_metric("__stateful_restore_time");
+  metrics_manager_client_->unregister_metric("__stateful_restore_phase_time_ms");
   delete multi_count_metric_;
   delete time_spent_metric_;
+  delete phase_time_metric_;
 }
 
 void StatefulRestorer::StartRestore(const std::string& _checkpoint_id, sp_int64 _restore_txid,
@@ -105,6 +120,8 @@ void StatefulRestorer::StartRestore(const std::string& _checkpoint_id, sp_int64
   }
   restore_pending_ = local_taskids_;
   get_ckpt_pending_ = local_taskids_;
+  // What is out for an earlier restore is ignored when it comes back
+  ClearInflight();
   checkpoint_id_ = _checkpoint_id;
   restore_txid_ = _restore_txid;
 
@@ -124,17 +141,38 @@ void StatefulRestorer::StartRestore(const std::string& _checkpoint_id, sp_int64
 }
 
 void StatefulRestorer::GetCheckpoints() {
+  // A state is handed to its instance as soon as it comes, while the
+  // ckptmgr gets the next ones. States of instances that are not connected
+  // yet would have nowhere to go, so they wait till they are.
   for (auto task_id : get_ckpt_pending_) {
+    if (get_ckpt_inflight_.size() >= static_cast<size_t>(parallelism_)) break;
+    if (get_ckpt_inflight_.find(task_id) != get_ckpt_inflight_.end() ||
+        !server_->IsInstanceConnected(task_id)) {
+      continue;
+    }
+    get_ckpt_inflight_[task_id] = std::chrono::high_resolution_clock::now();
     ckptmgr_->GetInstanceState(*(server_->GetInstanceInfo(task_id)), checkpoint_id_);
     multi_count_metric_->scope(METRIC_CKPT_REQUESTS)->incr();
   }
 }
 
+void StatefulRestorer::ClearInflight() {
+  get_ckpt_inflight_.clear();
+  get_ckpt_chunks_.clear();
+  restore_inflight_.clear();
+}
+
+void StatefulRestorer::RecordPhase(const sp_string& _phase, TimePoint _start) {
+  auto elapsed = std::chrono::high_resolution_clock::now() - _start;
+  phase_time_metric_->scope(_phase)->record(
+      std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+}
+
 void StatefulRestorer::HandleCheckpointState(proto::system::StatusCode _status, sp_int32 _task_id,
                                        sp_string _checkpoint_id,
-                                       const proto::ckptmgr::InstanceStateCheckpoint& _state) {
+                                       proto::ckptmgr::InstanceStateCheckpoint* _state) {
   LOG(INFO) << "Got InstanceState from checkpoint mgr for task " << _task_id
-            << " and checkpoint " << _state.checkpoint_id();
+            << " and checkpoint " << _state->checkpoint_id();
   multi_count_metric_->scope(METRIC_CKPT_RESPONSES)->incr();
   if (!in_progress_) {
     LOG(INFO) << "Ignoring it because we are not in restore";
@@ -148,19 +186,37 @@ void StatefulRestorer::HandleCheckpointState(proto::system::StatusCode _status,
     multi_count_metric_->scope(METRIC_CKPT_RESPONSES_IGNORED)->incr();
     return;
   }
+  // A state that came whole is only transferred to the instance from now
+  TimePoint transfer_start = std::chrono::high_resolution_clock::now();
+  auto inflight = get_ckpt_inflight_.find(_task_id);
+  if (inflight != get_ckpt_inflight_.end()) {
+    auto chunks = get_ckpt_chunks_.find(_task_id);
+    if (chunks != get_ckpt_chunks_.end()) {
+      transfer_start = chunks->second;
+      get_ckpt_chunks_.erase(chunks);
+    } else {
+      RecordPhase(METRIC_PHASE_FETCH, inflight->second);
+    }
+    get_ckpt_inflight_.erase(inflight);
+  }
   if (_status == proto::system::OK) {
-    if (_state.checkpoint_id() != checkpoint_id_) {
+    if (_state->checkpoint_id() != checkpoint_id_) {
       LOG(WARNING) << "Discarding state retrieved from checkpoint mgr because the checkpoint"
                    << " id in the response does not match ours " << checkpoint_id_;
       multi_count_metric_->scope(METRIC_CKPT_RESPONSES_IGNORED)->incr();
+      GetCheckpoints();
       return;
     }
     if (server_->SendRestoreInstanceStateRequest(_task_id, _state)) {
+      RecordPhase(METRIC_PHASE_TRANSFER, transfer_start);
+      restore_inflight_[_task_id] = std::chrono::high_resolution_clock::now();
       multi_count_metric_->scope(METRIC_INSTANCE_RESTORE_REQUESTS)->incr();
       get_ckpt_pending_.erase(_task_id);
     }
+    GetCheckpoints();
   } else {
     LOG(INFO) << "InstanceState from checkpont mgr contained non ok status " << _status;
+    ClearInflight();
     in_progress_ = false;
     time_spent_metric_->Stop();
     multi_count_metric_->scope(METRIC_CKPT_RESPONSES_ERROR)->incr();
@@ -169,6 +225,18 @@ void StatefulRestorer::HandleCheckpointState(proto::system::StatusCode _status,
   }
 }
 
+void StatefulRestorer::HandleCheckpointStateChunks(sp_int32 _task_id,
+                                                   const std::string& _checkpoint_id) {
+  if (!in_progress_ || _checkpoint_id != checkpoint_id_) return;
+  auto inflight = get_ckpt_inflight_.find(_task_id);
+  if (inflight == get_ckpt_inflight_.end()) return;
+  // A state that is fetched again because a chunk failed was transferred
+  // since its first chunk was asked for
+  if (get_ckpt_chunks_.emplace(_task_id, std::chrono::high_resolution_clock::now()).second) {
+    RecordPhase(METRIC_PHASE_FETCH, inflight->second);
+  }
+}
+
 void StatefulRestorer::HandleInstanceRestoredState(sp_int32 _task_id,
                                                    const std::string& _checkpoint_id) {
   LOG(INFO) << "Instance " << _task_id << " restored its state for " << _checkpoint_id;
@@ -183,6 +251,11 @@ void StatefulRestorer::HandleInstanceRestoredState(sp_int32 _task_id,
     multi_count_metric_->scope(METRIC_INSTANCE_RESTORE_RESPONSES_IGNORED)->incr();
     return;
   }
+  auto inflight = restore_inflight_.find(_task_id);
+  if (inflight != restore_inflight_.end()) {
+    RecordPhase(METRIC_PHASE_APPLY, inflight->second);
+    restore_inflight_.erase(inflight);
+  }
   restore_pending_.erase(_task_id);
   CheckAndFinishRestore();
 }
@@ -190,6 +263,9 @@ void StatefulRestorer::HandleInstanceRestoredState(sp_int32 _task_id,
 void StatefulRestorer::HandleCkptMgrRestart() {
   LOG(INFO) << "Checkpoint ClientMgr restarted";
   if (in_progress_) {
+    // The requests that were out are lost with the connection
+    get_ckpt_inflight_.clear();
+    get_ckpt_chunks_.clear();
     GetCheckpoints();
   }
 }
@@ -229,6 +305,7 @@ void StatefulRestorer::HandleDeadInstanceConnection(sp_int32 _task_id) {
     instance_connections_pending_ = true;
     CHECK(local_taskids_.find(_task_id) != local_taskids_.end());
     restore_pending_.insert(_task_id);
+    restore_inflight_.erase(_task_id);
     get_ckpt_pending_.insert(_task_id);
   }
 }
@@ -238,6 +315,7 @@ void StatefulRestorer::CheckAndFinishRestore() {
       restore_pending_.empty()) {
     LOG(INFO) << "Restore Done Successfully for " << checkpoint_id_
               << " " << restore_txid_;
+    ClearInflight();
     in_progress_ = false;
     time_spent_metric_->Stop();
     restore_done_watcher_(proto::system::OK, checkpoint_id_, restore_txid_);
@@ -17,6 +17,7 @@
 #ifndef SRC_CPP_SVCS_STMGR_SRC_MANAGER_STATEFUL_RESTORER_H_
 #define SRC_CPP_SVCS_STMGR_SRC_MANAGER_STATEFUL_RESTORER_H_
 
+#include <chrono>
 #include <ostream>
 #include <map>
 #include <set>
@@ -37,6 +38,7 @@ class PhysicalPlan;
 namespace common {
 class MetricsMgrSt;
 class MultiCountMetric;
+class MultiMeanMetric;
 class TimeSpentMetric;
 }
 }  // namespace heron
@@ -65,10 +67,13 @@ class StatefulRestorer {
   void HandleCkptMgrRestart();
   // Called when instance responds back with RestoredInstanceStateResponse
   void HandleInstanceRestoredState(sp_int32 _task_id, const std::string& _checkpoint_id);
-  // called when ckptmgr returns with instance state
+  // called when ckptmgr returns with instance state. _state may be
+  // taken over, by swapping it into the request to the instance.
   void HandleCheckpointState(proto::system::StatusCode _status, sp_int32 _task_id,
                              sp_string _checkpoint_id,
-                             const proto::ckptmgr::InstanceStateCheckpoint& _state);
+                             proto::ckptmgr::InstanceStateCheckpoint* _state);
+  // called when ckptmgr starts sending the state of the task in chunks
+  void HandleCheckpointStateChunks(sp_int32 _task_id, const std::string& _checkpoint_id);
   // called when a stmgr connection closes
   void HandleDeadStMgrConnection();
   // called when all clients get connected
@@ -80,11 +85,25 @@ class StatefulRestorer {
   bool InProgress() const { return in_progress_; }
 
  private:
+  typedef std::chrono::high_resolution_clock::time_point TimePoint;
+
+  // Ask the ckptmgr for the states of the connected instances that still
+  // need one, keeping at most parallelism_ requests out at once
   void GetCheckpoints();
   void CheckAndFinishRestore();
+  // Forget about the requests and restores that are out
+  void ClearInflight();
+  // Record the milliseconds since _start as the time of _phase
+  void RecordPhase(const sp_string& _phase, TimePoint _start);
 
   std::set<sp_int32> get_ckpt_pending_;
+  // when the state of each task was asked for
+  std::map<sp_int32, TimePoint> get_ckpt_inflight_;
+  // when the first chunk of the states that come in chunks was asked for
+  std::map<sp_int32, TimePoint> get_ckpt_chunks_;
   std::set<sp_int32> restore_pending_;
+  // when each instance was sent its state
+  std::map<sp_int32, TimePoint> restore_inflight_;
   bool clients_connections_pending_;
   bool instance_connections_pending_;
   std::string checkpoint_id_;
@@ -99,10 +118,15 @@ class StatefulRestorer {
 
   bool in_progress_;
   std::function<void(proto::system::StatusCode, std::string, sp_int64)> restore_done_watcher_;
+  sp_int32 parallelism_;
 
   // Different metrics
   common::MultiCountMetric* multi_count_metric_;
   common::TimeSpentMetric* time_spent_metric_;
+  // the mean time per task of fetching, transferring and applying states
+  common::MultiMeanMetric* phase_time_metric_;
+
+  friend class StatefulRestorerTest;
 };
 }  // namespace stmgr
 }  // namespace heron
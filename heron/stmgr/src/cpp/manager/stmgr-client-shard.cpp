@@ -0,0 +1,208 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "manager/stmgr-client-shard.h"
+#include <iostream>
+#include <map>
+#include <set>
+#include <utility>
+#include "manager/stmgr-client.h"
+#include "manager/stmgr-clientmgr.h"
+#include "proto/messages.h"
+#include "basics/basics.h"
+#include "errors/errors.h"
+#include "threads/threads.h"
+#include "network/network.h"
+
+namespace heron {
+namespace stmgr {
+
+StMgrClientShard::StMgrClientShard(const sp_string& _topology_name,
+                                   const sp_string& _topology_id, const sp_string& _stmgr_id,
+                                   const sp_string& _name, StMgrClientMgr* _client_manager,
+                                   Piper* _control_piper, sp_uint32 _queue_capacity)
+    : topology_name_(_topology_name),
+      topology_id_(_topology_id),
+      stmgr_id_(_stmgr_id),
+      name_(_name),
+      client_manager_(_client_manager),
+      control_piper_(_control_piper),
+      queue_(_queue_capacity),
+      drain_scheduled_(false),
+      overflowing_(false),
+      flush_scheduled_(false) {
+  // Everything touching the event loop is set up before the thread starts
+  eventLoop_ = new EventLoopImpl();
+  piper_ = new Piper(eventLoop_);
+  thread_ = std::thread([this]() { eventLoop_->loop(); });
+}
+
+StMgrClientShard::~StMgrClientShard() {
+  EventLoop* eventLoop = eventLoop_;
+  piper_->ExecuteInEventLoop([eventLoop]() { eventLoop->loopExit(); });
+  thread_.join();
+  // Like StMgrClientMgr, we leave the clients alone
+  OutgoingMessage message;
+  while (queue_.pop(&message)) Release(&message);
+  for (auto& message : overflow_) Release(&message);
+  delete piper_;
+  delete eventLoop_;
+}
+
+void StMgrClientShard::StartClient(const sp_string& _other_stmgr_id,
+                                   const NetworkOptions& _options,
+                                   sp_int32 _reconnect_interval_sec, sp_int64 _generation) {
+  piper_->ExecuteInEventLoop([this, _other_stmgr_id, _options, _reconnect_interval_sec,
+                              _generation]() {
+    CHECK(clients_.find(_other_stmgr_id) == clients_.end());
+    // The metrics of the client are kept by the client manager
+    StMgrClient* client = new StMgrClient(eventLoop_, _options, topology_name_, topology_id_,
+                                          stmgr_id_, _other_stmgr_id, client_manager_,
+                                          _generation, NULL, _reconnect_interval_sec);
+    client->Start();
+    clients_[_other_stmgr_id] = client;
+  });
+}
+
+void StMgrClientShard::QuitClient(const sp_string& _other_stmgr_id) {
+  piper_->ExecuteInEventLoop([this, _other_stmgr_id]() {
+    auto iter = clients_.find(_other_stmgr_id);
+    CHECK(iter != clients_.end());
+    iter->second->Quit();  // This will delete itself.
+    clients_.erase(iter);
+  });
+}
+
+void StMgrClientShard::SendTupleStreamMessage(sp_int32 _task_id, const sp_string& _stmgr_id,
+                                              proto::system::HeronTupleSet2* _msg) {
+  OutgoingMessage message;
+  message.stmgr_id_ = _stmgr_id;
+  message.task_id_ = _task_id;
+  message.tuple_set_ = _msg;
+  message.checkpoint_ = NULL;
+  Enqueue(&message);
+}
+
+void StMgrClientShard::SendDownstreamStatefulCheckpoint(
+    const sp_string& _stmgr_id, proto::ckptmgr::DownstreamStatefulCheckpoint* _message) {
+  // Goes through the queue so that it doesn't overtake the tuples sent before it
+  OutgoingMessage message;
+  message.stmgr_id_ = _stmgr_id;
+  message.task_id_ = -1;
+  message.tuple_set_ = NULL;
+  message.checkpoint_ = _message;
+  Enqueue(&message);
+}
+
+void StMgrClientShard::SendStartBackPressureMessage() {
+  piper_->ExecuteInEventLoop([this]() {
+    for (auto iter = clients_.begin(); iter != clients_.end(); ++iter) {
+      iter->second->SendStartBackPressureMessage();
+    }
+  });
+}
+
+void StMgrClientShard::SendStopBackPressureMessage() {
+  piper_->ExecuteInEventLoop([this]() {
+    for (auto iter = clients_.begin(); iter != clients_.end(); ++iter) {
+      iter->second->SendStopBackPressureMessage();
+    }
+  });
+}
+
+void StMgrClientShard::Enqueue(OutgoingMessage* _message) {
+  // A failed push leaves _message as it was
+  if (overflow_.empty() && queue_.push(std::move(*_message))) {
+    ScheduleDrain();
+    return;
+  }
+  if (overflow_.empty()) {
+    LOG(INFO) << "Client shard " << name_ << " is full, starting back pressure";
+    overflowing_.store(true);
+    client_manager_->StartBackPressureOnServer(name_);
+  }
+  // Nothing goes to queue_ before what is already waiting here
+  overflow_.push_back(std::move(*_message));
+  ScheduleDrain();
+}
+
+void StMgrClientShard::FlushOverflow() {
+  flush_scheduled_.store(false);
+  while (!overflow_.empty() && queue_.push(std::move(overflow_.front()))) {
+    overflow_.pop_front();
+  }
+  if (overflow_.empty()) {
+    LOG(INFO) << "Client shard " << name_ << " caught up, stopping back pressure";
+    overflowing_.store(false);
+    client_manager_->StopBackPressureOnServer(name_);
+  }
+  ScheduleDrain();
+}
+
+void StMgrClientShard::ScheduleDrain() {
+  if (!drain_scheduled_.exchange(true)) {
+    piper_->ExecuteInEventLoop([this]() { DrainQueue(); });
+  }
+}
+
+void StMgrClientShard::DrainQueue() {
+  // Reset before popping, anything pushed after the last pop schedules
+  // another drain
+  drain_scheduled_.store(false);
+
+  // The stmgrs we dropped tuples for, because we are not connected to them
+  std::set<sp_string> dropped;
+  proto::stmgr::TupleStreamMessage2* out = nullptr;
+  out = __global_protobuf_pool_acquire__(out);
+  OutgoingMessage message;
+  while (queue_.pop(&message)) {
+    auto iter = clients_.find(message.stmgr_id_);
+    if (iter == clients_.end()) {
+      // The stmgr has left the physical plan
+      Release(&message);
+    } else if (message.tuple_set_) {
+      out->set_task_id(message.task_id_);
+      out->set_src_task_id(message.tuple_set_->src_task_id());
+      message.tuple_set_->SerializePartialToString(out->mutable_set());
+      if (iter->second->SendTupleStreamMessage(*out)) {
+        dropped.insert(message.stmgr_id_);
+      }
+      Release(&message);
+    } else {
+      iter->second->SendDownstreamStatefulCheckpoint(message.checkpoint_);
+    }
+  }
+  __global_protobuf_pool_release__(out);
+
+  for (auto& stmgr_id : dropped) {
+    client_manager_->HandleDroppedTupleSet(stmgr_id);
+  }
+
+  if (overflowing_.load() && !flush_scheduled_.exchange(true)) {
+    control_piper_->ExecuteInEventLoop([this]() { FlushOverflow(); });
+  }
+}
+
+void StMgrClientShard::Release(OutgoingMessage* _message) {
+  if (_message->tuple_set_) {
+    __global_protobuf_pool_release__(_message->tuple_set_);
+  } else {
+    __global_protobuf_pool_release__(_message->checkpoint_);
+  }
+}
+
+}  // namespace stmgr
+}  // namespace heron
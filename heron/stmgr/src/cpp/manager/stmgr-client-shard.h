@@ -0,0 +1,118 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_CPP_SVCS_STMGR_SRC_MANAGER_STMGR_CLIENT_SHARD_H_
+#define SRC_CPP_SVCS_STMGR_SRC_MANAGER_STMGR_CLIENT_SHARD_H_
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <thread>
+#include "proto/messages.h"
+#include "threads/threads.h"
+#include "network/network.h"
+#include "basics/basics.h"
+
+namespace heron {
+namespace stmgr {
+class StMgrClient;
+class StMgrClientMgr;
+
+// A StMgrClientShard runs the clients to a subset of the other stream
+// managers on an event loop of its own thread. All its public methods
+// are called from the control loop, the one StMgrClientMgr runs on.
+// Tuple sets and checkpoint markers are handed over in order through a
+// single producer single consumer queue, everything else through a
+// Piper. The clients report back to the StMgrClientMgr, which forwards
+// their callbacks to the control loop, and so do we when a tuple set is
+// dropped because its client is not connected.
+// When the queue is full, messages wait in an overflow list on the control
+// loop, and the shard holds back pressure under _name until the list has
+// been handed over.
+class StMgrClientShard {
+ public:
+  StMgrClientShard(const sp_string& _topology_name, const sp_string& _topology_id,
+                   const sp_string& _stmgr_id, const sp_string& _name,
+                   StMgrClientMgr* _client_manager, Piper* _control_piper,
+                   sp_uint32 _queue_capacity);
+  // Stops the event loop and waits for the thread to finish
+  virtual ~StMgrClientShard();
+
+  // The client reports back with _generation, see StMgrClient
+  void StartClient(const sp_string& _other_stmgr_id, const NetworkOptions& _options,
+                   sp_int32 _reconnect_interval_sec, sp_int64 _generation);
+  void QuitClient(const sp_string& _other_stmgr_id);
+
+  // We own the _msg
+  void SendTupleStreamMessage(sp_int32 _task_id, const sp_string& _stmgr_id,
+                              proto::system::HeronTupleSet2* _msg);
+  // We own the _message
+  void SendDownstreamStatefulCheckpoint(const sp_string& _stmgr_id,
+                                        proto::ckptmgr::DownstreamStatefulCheckpoint* _message);
+  void SendStartBackPressureMessage();
+  void SendStopBackPressureMessage();
+
+ private:
+  // What is queued up for a client. Exactly one of the messages is set.
+  struct OutgoingMessage {
+    sp_string stmgr_id_;
+    sp_int32 task_id_;
+    proto::system::HeronTupleSet2* tuple_set_;
+    proto::ckptmgr::DownstreamStatefulCheckpoint* checkpoint_;
+  };
+
+  // Moves _message into the queue, or overflow_ if that is full
+  void Enqueue(OutgoingMessage* _message);
+  // Makes sure that DrainQueue runs after whatever was enqueued so far
+  void ScheduleDrain();
+  // Runs on the shard's event loop
+  void DrainQueue();
+  // Runs on the control loop. Moves what fits from overflow_ to queue_.
+  void FlushOverflow();
+  // Gives the messages back to the pool
+  void Release(OutgoingMessage* _message);
+
+  sp_string topology_name_;
+  sp_string topology_id_;
+  sp_string stmgr_id_;
+  sp_string name_;
+  StMgrClientMgr* client_manager_;
+  Piper* control_piper_;
+
+  EventLoop* eventLoop_;
+  // Runs callbacks of the control loop on eventLoop_
+  Piper* piper_;
+
+  SPSCQueue<OutgoingMessage> queue_;
+  // Whether a DrainQueue is pending on eventLoop_
+  std::atomic<bool> drain_scheduled_;
+  // What did not fit in queue_, in order, only accessed on the control loop
+  std::deque<OutgoingMessage> overflow_;
+  // Whether overflow_ is not empty
+  std::atomic<bool> overflowing_;
+  // Whether a FlushOverflow is pending on the control loop
+  std::atomic<bool> flush_scheduled_;
+
+  // map of stmgrid to its client, only accessed on eventLoop_
+  std::map<sp_string, StMgrClient*> clients_;
+
+  std::thread thread_;
+};
+
+}  // namespace stmgr
+}  // namespace heron
+
+#endif  // SRC_CPP_SVCS_STMGR_SRC_MANAGER_STMGR_CLIENT_SHARD_H_
@@ -24,7 +24,6 @@
 #include "errors/errors.h"
 #include "threads/threads.h"
 #include "network/network.h"
-#include "config/heron-internals-config-reader.h"
 #include "metrics/metrics.h"
 
 
@@ -53,8 +52,9 @@ const sp_string METRIC_HELLO_MESSAGES_TO_STMGRS = "__hello_messages_to_stmgrs";
 StMgrClient::StMgrClient(EventLoop* eventLoop, const NetworkOptions& _options,
                          const sp_string& _topology_name, const sp_string& _topology_id,
                          const sp_string& _our_id, const sp_string& _other_id,
-                         StMgrClientMgr* _client_manager,
-                         heron::common::MetricsMgrSt* _metrics_manager_client)
+                         StMgrClientMgr* _client_manager, sp_int64 _generation,
+                         heron::common::MetricsMgrSt* _metrics_manager_client,
+                         sp_int32 _reconnect_interval_sec)
     : Client(eventLoop, _options),
       topology_name_(_topology_name),
       topology_id_(_topology_id),
@@ -62,23 +62,31 @@ StMgrClient::StMgrClient(EventLoop* eventLoop, const NetworkOptions& _options,
       other_stmgr_id_(_other_id),
       quit_(false),
       client_manager_(_client_manager),
+      generation_(_generation),
       metrics_manager_client_(_metrics_manager_client),
+      reconnect_other_streammgrs_interval_sec_(_reconnect_interval_sec),
       ndropped_messages_(0),
       is_registered_(false) {
-  reconnect_other_streammgrs_interval_sec_ =
-      config::HeronInternalsConfigReader::Instance()->GetHeronStreammgrClientReconnectIntervalSec();
-
   InstallResponseHandler(new proto::stmgr::StrMgrHelloRequest(), &StMgrClient::HandleHelloResponse);
   InstallMessageHandler(&StMgrClient::HandleTupleStreamMessage);
+  // Other stmgrs are C++ servers, so tuples can be sent with type ids
+  EnableTypeIds();
 
-  stmgr_client_metrics_ = new heron::common::MultiCountMetric();
-  metrics_manager_client_->register_metric("__client_" + other_stmgr_id_, stmgr_client_metrics_);
+  // Clients running in a shard leave their metrics to the client manager
+  stmgr_client_metrics_ = NULL;
+  if (metrics_manager_client_) {
+    stmgr_client_metrics_ = new heron::common::MultiCountMetric();
+    metrics_manager_client_->register_metric("__client_" + other_stmgr_id_,
+                                             stmgr_client_metrics_);
+  }
 }
 
 StMgrClient::~StMgrClient() {
   Stop();
-  metrics_manager_client_->unregister_metric("__client_" + other_stmgr_id_);
-  delete stmgr_client_metrics_;
+  if (metrics_manager_client_) {
+    metrics_manager_client_->unregister_metric("__client_" + other_stmgr_id_);
+    delete stmgr_client_metrics_;
+  }
 }
 
 void StMgrClient::Quit() {
@@ -126,7 +134,7 @@ void StMgrClient::HandleClose(NetworkErrorCode _code) {
   if (quit_) {
     delete this;
   } else {
-    client_manager_->HandleDeadStMgrConnection(other_stmgr_id_);
+    client_manager_->HandleDeadStMgrConnection(other_stmgr_id_, generation_);
     LOG(INFO) << "Will try to reconnect again after 1 seconds" << std::endl;
     AddTimer([this]() { this->OnReConnectTimer(); },
              reconnect_other_streammgrs_interval_sec_ * 1000 * 1000);
@@ -157,7 +165,7 @@ void StMgrClient::HandleHelloResponse(void*, proto::stmgr::StrMgrHelloResponse*
   if (client_manager_->DidAnnounceBackPressure()) {
     SendStartBackPressureMessage();
   }
-  client_manager_->HandleStMgrClientRegistered();
+  client_manager_->HandleStMgrClientRegistered(other_stmgr_id_, generation_);
 }
 
 void StMgrClient::OnReConnectTimer() { Start(); }
@@ -168,7 +176,11 @@ void StMgrClient::SendHelloRequest() {
   request->set_topology_id(topology_id_);
   request->set_stmgr(our_stmgr_id_);
   SendRequest(request, NULL);
-  stmgr_client_metrics_->scope(METRIC_HELLO_MESSAGES_TO_STMGRS)->incr_by(1);
+  if (stmgr_client_metrics_) {
+    stmgr_client_metrics_->scope(METRIC_HELLO_MESSAGES_TO_STMGRS)->incr_by(1);
+  } else {
+    client_manager_->HandleHelloSent(other_stmgr_id_, generation_);
+  }
   return;
 }
 
@@ -35,10 +35,14 @@ class StMgrClientMgr;
 
 class StMgrClient : public Client {
  public:
+  // Without a _metrics_manager_client, the hello messages sent are counted
+  // by the _client_manager. What we report to the _client_manager carries
+  // _generation, which tells us apart from earlier clients to the same stmgr.
   StMgrClient(EventLoop* eventLoop, const NetworkOptions& _options, const sp_string& _topology_name,
               const sp_string& _topology_id, const sp_string& _our_id, const sp_string& _other_id,
-              StMgrClientMgr* _client_manager,
-              heron::common::MetricsMgrSt* _metrics_manager_client);
+              StMgrClientMgr* _client_manager, sp_int64 _generation,
+              heron::common::MetricsMgrSt* _metrics_manager_client,
+              sp_int32 _reconnect_interval_sec);
   virtual ~StMgrClient();
 
   void Quit();
@@ -71,6 +75,7 @@ class StMgrClient : public Client {
   bool quit_;
 
   StMgrClientMgr* client_manager_;
+  sp_int64 generation_;
   // Metrics
   heron::common::MetricsMgrSt* metrics_manager_client_;
   heron::common::MultiCountMetric* stmgr_client_metrics_;
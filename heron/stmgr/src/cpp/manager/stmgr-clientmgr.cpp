@@ -15,11 +15,14 @@
  */
 
 #include "manager/stmgr-clientmgr.h"
+#include <algorithm>
 #include <iostream>
 #include <set>
 #include <map>
+#include <vector>
 #include "manager/stmgr.h"
 #include "manager/stmgr-client.h"
+#include "manager/stmgr-client-shard.h"
 #include "proto/messages.h"
 #include "basics/basics.h"
 #include "errors/errors.h"
@@ -33,28 +36,63 @@ namespace stmgr {
 
 // New connections made with other stream managers.
 const sp_string METRIC_STMGR_NEW_CONNECTIONS = "__stmgr_new_connections";
+// Hello messages sent by a sharded client, like StMgrClient counts its own
+const sp_string METRIC_HELLO_MESSAGES_TO_STMGRS = "__hello_messages_to_stmgrs";
+
+// Number of messages that can be queued up for a shard before the rest
+// has to wait on the control loop, under back pressure
+const sp_uint32 SHARD_QUEUE_CAPACITY = 16 * 1024;
 
 StMgrClientMgr::StMgrClientMgr(EventLoop* eventLoop, const sp_string& _topology_name,
                                const sp_string& _topology_id, const sp_string& _stmgr_id,
                                StMgr* _stream_manager,
                                heron::common::MetricsMgrSt* _metrics_manager_client)
-    : topology_name_(_topology_name),
+    : control_piper_(NULL),
+      next_generation_(0),
+      did_announce_back_pressure_(false),
+      topology_name_(_topology_name),
       topology_id_(_topology_id),
       stmgr_id_(_stmgr_id),
       eventLoop_(eventLoop),
       stream_manager_(_stream_manager),
       metrics_manager_client_(_metrics_manager_client) {
+  reconnect_other_streammgrs_interval_sec_ =
+      config::HeronInternalsConfigReader::Instance()->GetHeronStreammgrClientReconnectIntervalSec();
   stmgr_clientmgr_metrics_ = new heron::common::MultiCountMetric();
   metrics_manager_client_->register_metric("__clientmgr", stmgr_clientmgr_metrics_);
+
+  sp_int32 nthreads =
+      config::HeronInternalsConfigReader::Instance()->GetHeronStreammgrClientThreads();
+  if (nthreads > 0) {
+    LOG(INFO) << "Running clients to other stmgrs in " << nthreads << " threads";
+    control_piper_ = new Piper(eventLoop_);
+    for (sp_int32 i = 0; i < nthreads; ++i) {
+      shards_.push_back(new StMgrClientShard(topology_name_, topology_id_, stmgr_id_,
+                                             "__client_shard_" + std::to_string(i), this,
+                                             control_piper_, SHARD_QUEUE_CAPACITY));
+    }
+  }
 }
 
 StMgrClientMgr::~StMgrClientMgr() {
   // This should not be called
+  for (auto shard : shards_) {
+    delete shard;
+  }
+  delete control_piper_;
+  for (auto kv : sharded_client_metrics_) {
+    metrics_manager_client_->unregister_metric("__client_" + kv.first);
+    delete kv.second;
+  }
   metrics_manager_client_->unregister_metric("__clientmgr");
   delete stmgr_clientmgr_metrics_;
 }
 
 void StMgrClientMgr::StartConnections(const proto::system::PhysicalPlan* _pplan) {
+  if (!shards_.empty()) {
+    StartShardedConnections(_pplan);
+    return;
+  }
   // TODO(vikasr) : Currently we establish connections with all streammanagers
   // In the next iteration we might want to make it better
   std::set<sp_string> all_stmgrs;
@@ -99,15 +137,100 @@ void StMgrClientMgr::StartConnections(const proto::system::PhysicalPlan* _pplan)
     clients_[*iter]->Quit();  // This will delete itself.
     clients_.erase(*iter);
   }
+
+  BuildTaskClients(_pplan);
+}
+
+void StMgrClientMgr::BuildTaskClients(const proto::system::PhysicalPlan* _pplan) {
+  sp_int32 max_task_id = -1;
+  for (sp_int32 i = 0; i < _pplan->instances_size(); ++i) {
+    max_task_id = std::max(max_task_id, _pplan->instances(i).info().task_id());
+  }
+  std::vector<StMgrClient*> task_clients(max_task_id + 1, NULL);
+  for (sp_int32 i = 0; i < _pplan->instances_size(); ++i) {
+    auto iter = clients_.find(_pplan->instances(i).stmgr_id());
+    if (iter != clients_.end()) {
+      task_clients[_pplan->instances(i).info().task_id()] = iter->second;
+    }
+  }
+  task_clients_.swap(task_clients);
+}
+
+void StMgrClientMgr::StartShardedConnections(const proto::system::PhysicalPlan* _pplan) {
+  std::set<sp_string> all_stmgrs;
+  for (sp_int32 i = 0; i < _pplan->stmgrs_size(); ++i) {
+    const proto::system::StMgr& s = _pplan->stmgrs(i);
+    if (s.id() == stmgr_id_) {
+      continue;  // dont want to connect to ourselves
+    }
+    all_stmgrs.insert(s.id());
+    auto iter = sharded_clients_.find(s.id());
+    if (iter == sharded_clients_.end()) {
+      LOG(INFO) << "Stmgr " << s.id() << " came on " << s.host_name() << ":" << s.data_port();
+      StartShardedClient(s.id(), s.host_name(), s.data_port());
+    } else if (iter->second.options_.get_host() != s.host_name() ||
+               iter->second.options_.get_port() != s.data_port()) {
+      LOG(INFO) << "Stmgr " << s.id() << " changed from " << iter->second.options_.get_host()
+                << ":" << iter->second.options_.get_port() << " to " << s.host_name() << ":"
+                << s.data_port();
+      QuitShardedClient(s.id());
+      StartShardedClient(s.id(), s.host_name(), s.data_port());
+    }
+  }
+
+  std::set<sp_string> to_remove;
+  for (auto iter = sharded_clients_.begin(); iter != sharded_clients_.end(); ++iter) {
+    if (all_stmgrs.find(iter->first) == all_stmgrs.end()) {
+      to_remove.insert(iter->first);
+    }
+  }
+  for (auto iter = to_remove.begin(); iter != to_remove.end(); ++iter) {
+    LOG(INFO) << "Stmgr " << *iter << " no longer required";
+    QuitShardedClient(*iter);
+  }
+}
+
+void StMgrClientMgr::StartShardedClient(const sp_string& _other_stmgr_id,
+                                        const sp_string& _hostname, sp_int32 _port) {
+  stmgr_clientmgr_metrics_->scope(METRIC_STMGR_NEW_CONNECTIONS)->incr();
+  // Spread the clients over the shards in the order they come up
+  StMgrClientShard* shard = shards_[sharded_clients_.size() % shards_.size()];
+  ShardedClient& client = sharded_clients_[_other_stmgr_id];
+  client.options_ = MakeClientOptions(_hostname, _port);
+  client.shard_ = shard;
+  client.generation_ = next_generation_++;
+  auto metrics = new heron::common::MultiCountMetric();
+  metrics_manager_client_->register_metric("__client_" + _other_stmgr_id, metrics);
+  sharded_client_metrics_[_other_stmgr_id] = metrics;
+  shard->StartClient(_other_stmgr_id, client.options_, reconnect_other_streammgrs_interval_sec_,
+                     client.generation_);
+}
+
+void StMgrClientMgr::QuitShardedClient(const sp_string& _other_stmgr_id) {
+  auto iter = sharded_clients_.find(_other_stmgr_id);
+  CHECK(iter != sharded_clients_.end());
+  iter->second.shard_->QuitClient(_other_stmgr_id);
+  sharded_clients_.erase(iter);
+  registered_clients_.erase(_other_stmgr_id);
+  metrics_manager_client_->unregister_metric("__client_" + _other_stmgr_id);
+  delete sharded_client_metrics_[_other_stmgr_id];
+  sharded_client_metrics_.erase(_other_stmgr_id);
+}
+
+bool StMgrClientMgr::IsCurrentShardedClient(const sp_string& _stmgr_id, sp_int64 _generation) {
+  auto iter = sharded_clients_.find(_stmgr_id);
+  return iter != sharded_clients_.end() && iter->second.generation_ == _generation;
 }
 
 bool StMgrClientMgr::DidAnnounceBackPressure() {
+  if (!shards_.empty()) {
+    // Called from a shard thread
+    return did_announce_back_pressure_.load();
+  }
   return stream_manager_->DidAnnounceBackPressure();
 }
 
-StMgrClient* StMgrClientMgr::CreateClient(const sp_string& _other_stmgr_id,
-                                          const sp_string& _hostname, sp_int32 _port) {
-  stmgr_clientmgr_metrics_->scope(METRIC_STMGR_NEW_CONNECTIONS)->incr();
+NetworkOptions StMgrClientMgr::MakeClientOptions(const sp_string& _hostname, sp_int32 _port) {
   NetworkOptions options;
   options.set_host(_hostname);
   options.set_port(_port);
@@ -115,78 +238,178 @@ StMgrClient* StMgrClientMgr::CreateClient(const sp_string& _other_stmgr_id,
                                   ->GetHeronStreammgrNetworkOptionsMaximumPacketMb() *
                               1024 * 1024);
   options.set_socket_family(PF_INET);
+  return options;
+}
+
+StMgrClient* StMgrClientMgr::CreateClient(const sp_string& _other_stmgr_id,
+                                          const sp_string& _hostname, sp_int32 _port) {
+  stmgr_clientmgr_metrics_->scope(METRIC_STMGR_NEW_CONNECTIONS)->incr();
+  NetworkOptions options = MakeClientOptions(_hostname, _port);
+  // Our own clients report back on eventLoop_, so they need no generation
   StMgrClient* client = new StMgrClient(eventLoop_, options, topology_name_, topology_id_,
-                                        stmgr_id_, _other_stmgr_id, this, metrics_manager_client_);
+                                        stmgr_id_, _other_stmgr_id, this, 0,
+                                        metrics_manager_client_,
+                                        reconnect_other_streammgrs_interval_sec_);
   client->Start();
   return client;
 }
 
 bool StMgrClientMgr::SendTupleStreamMessage(sp_int32 _task_id, const sp_string& _stmgr_id,
-                                            const proto::system::HeronTupleSet2& _msg) {
-  auto iter = clients_.find(_stmgr_id);
-  CHECK(iter != clients_.end());
+                                            proto::system::HeronTupleSet2* _msg) {
+  if (!shards_.empty()) {
+    auto iter = sharded_clients_.find(_stmgr_id);
+    CHECK(iter != sharded_clients_.end());
+    // The other stmgr drops tuples until we have registered with it
+    if (registered_clients_.find(_stmgr_id) == registered_clients_.end()) {
+      __global_protobuf_pool_release__(_msg);
+      return true;
+    }
+    // The shard serializes the tuples
+    iter->second.shard_->SendTupleStreamMessage(_task_id, _stmgr_id, _msg);
+    return false;
+  }
+
+  CHECK_GE(_task_id, 0);
+  CHECK_LT(static_cast<size_t>(_task_id), task_clients_.size());
+  StMgrClient* client = task_clients_[_task_id];
+  CHECK(client) << "No client to stmgr " << _stmgr_id << " of task " << _task_id;
 
   // Acquire the message
   proto::stmgr::TupleStreamMessage2* out = nullptr;
   out = __global_protobuf_pool_acquire__(out);
   out->set_task_id(_task_id);
-  out->set_src_task_id(_msg.src_task_id());
-  _msg.SerializePartialToString(out->mutable_set());
+  out->set_src_task_id(_msg->src_task_id());
+  _msg->SerializePartialToString(out->mutable_set());
 
-  bool dropped = clients_[_stmgr_id]->SendTupleStreamMessage(*out);
+  bool dropped = client->SendTupleStreamMessage(*out);
 
   // Release the message
   __global_protobuf_pool_release__(out);
+  __global_protobuf_pool_release__(_msg);
 
   return dropped;
 }
 
 void StMgrClientMgr::SendDownstreamStatefulCheckpoint(const sp_string& _stmgr_id,
                            proto::ckptmgr::DownstreamStatefulCheckpoint* _message) {
+  if (!shards_.empty()) {
+    auto iter = sharded_clients_.find(_stmgr_id);
+    CHECK(iter != sharded_clients_.end());
+    iter->second.shard_->SendDownstreamStatefulCheckpoint(_stmgr_id, _message);
+    return;
+  }
   auto iter = clients_.find(_stmgr_id);
   CHECK(iter != clients_.end());
   iter->second->SendDownstreamStatefulCheckpoint(_message);
 }
 
 void StMgrClientMgr::StartBackPressureOnServer(const sp_string& _other_stmgr_id) {
+  if (!shards_.empty()) {
+    control_piper_->ExecuteInEventLoop([this, _other_stmgr_id]() {
+      stream_manager_->StartBackPressureOnServer(_other_stmgr_id);
+    });
+    return;
+  }
   stream_manager_->StartBackPressureOnServer(_other_stmgr_id);
 }
 
 void StMgrClientMgr::StopBackPressureOnServer(const sp_string& _other_stmgr_id) {
+  if (!shards_.empty()) {
+    control_piper_->ExecuteInEventLoop([this, _other_stmgr_id]() {
+      stream_manager_->StopBackPressureOnServer(_other_stmgr_id);
+    });
+    return;
+  }
   // Call the StMgrServers removeBackPressure method
   stream_manager_->StopBackPressureOnServer(_other_stmgr_id);
 }
 
 void StMgrClientMgr::SendStartBackPressureToOtherStMgrs() {
+  did_announce_back_pressure_.store(true);
+  for (auto shard : shards_) {
+    shard->SendStartBackPressureMessage();
+  }
   for (auto iter = clients_.begin(); iter != clients_.end(); ++iter) {
     iter->second->SendStartBackPressureMessage();
   }
 }
 
 void StMgrClientMgr::SendStopBackPressureToOtherStMgrs() {
+  did_announce_back_pressure_.store(false);
+  for (auto shard : shards_) {
+    shard->SendStopBackPressureMessage();
+  }
   for (auto iter = clients_.begin(); iter != clients_.end(); ++iter) {
     iter->second->SendStopBackPressureMessage();
   }
 }
 
-void StMgrClientMgr::HandleDeadStMgrConnection(const sp_string& _dead_stmgr) {
+void StMgrClientMgr::HandleDeadStMgrConnection(const sp_string& _dead_stmgr,
+                                               sp_int64 _generation) {
+  if (!shards_.empty()) {
+    control_piper_->ExecuteInEventLoop([this, _dead_stmgr, _generation]() {
+      // Ignore clients that have been quit in the meantime
+      if (!IsCurrentShardedClient(_dead_stmgr, _generation)) return;
+      registered_clients_.erase(_dead_stmgr);
+      stream_manager_->HandleDeadStMgrConnection(_dead_stmgr);
+    });
+    return;
+  }
   stream_manager_->HandleDeadStMgrConnection(_dead_stmgr);
 }
 
-void StMgrClientMgr::HandleStMgrClientRegistered() {
+void StMgrClientMgr::HandleStMgrClientRegistered(const sp_string& _stmgr_id,
+                                                 sp_int64 _generation) {
+  if (!shards_.empty()) {
+    control_piper_->ExecuteInEventLoop([this, _stmgr_id, _generation]() {
+      // Ignore clients that have been quit in the meantime
+      if (!IsCurrentShardedClient(_stmgr_id, _generation)) return;
+      registered_clients_.insert(_stmgr_id);
+      if (AllStMgrClientsRegistered()) {
+        stream_manager_->HandleAllStMgrClientsRegistered();
+      }
+    });
+    return;
+  }
   if (AllStMgrClientsRegistered()) {
     stream_manager_->HandleAllStMgrClientsRegistered();
   }
 }
 
+void StMgrClientMgr::HandleHelloSent(const sp_string& _stmgr_id, sp_int64 _generation) {
+  // Called from a shard thread
+  control_piper_->ExecuteInEventLoop([this, _stmgr_id, _generation]() {
+    if (!IsCurrentShardedClient(_stmgr_id, _generation)) return;
+    sharded_client_metrics_[_stmgr_id]->scope(METRIC_HELLO_MESSAGES_TO_STMGRS)->incr();
+  });
+}
+
+void StMgrClientMgr::HandleDroppedTupleSet(const sp_string& _stmgr_id) {
+  // Called from a shard thread
+  control_piper_->ExecuteInEventLoop([this, _stmgr_id]() {
+    stream_manager_->HandleDroppedTupleSet(_stmgr_id);
+  });
+}
+
 void StMgrClientMgr::CloseConnectionsAndClear() {
+  std::vector<sp_string> sharded_clients;
+  for (auto kv : sharded_clients_) {
+    sharded_clients.push_back(kv.first);
+  }
+  for (auto& stmgr_id : sharded_clients) {
+    QuitShardedClient(stmgr_id);
+  }
   for (auto kv : clients_) {
     kv.second->Quit();  // It will delete itself
   }
   clients_.clear();
+  task_clients_.clear();
 }
 
 bool StMgrClientMgr::AllStMgrClientsRegistered() {
+  if (!shards_.empty()) {
+    return registered_clients_.size() == sharded_clients_.size();
+  }
   for (auto kv : clients_) {
     if (!kv.second->IsConnected()) {
       return false;
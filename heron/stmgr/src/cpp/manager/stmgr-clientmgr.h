@@ -17,7 +17,10 @@
 #ifndef SRC_CPP_SVCS_STMGR_SRC_MANAGER_STMGR_CLIENTMGR_H_
 #define SRC_CPP_SVCS_STMGR_SRC_MANAGER_STMGR_CLIENTMGR_H_
 
+#include <atomic>
 #include <map>
+#include <set>
+#include <vector>
 #include "proto/messages.h"
 #include "network/network.h"
 #include "basics/basics.h"
@@ -33,6 +36,7 @@ namespace heron {
 namespace stmgr {
 class StMgr;
 class StMgrClient;
+class StMgrClientShard;
 
 class StMgrClientMgr {
  public:
@@ -42,23 +46,31 @@ class StMgrClientMgr {
   virtual ~StMgrClientMgr();
 
   void StartConnections(const proto::system::PhysicalPlan* _pplan);
+  // We own the _msg. Returns true if it was dropped because we are not
+  // connected to _stmgr_id.
   bool SendTupleStreamMessage(sp_int32 _task_id,
                               const sp_string& _stmgr_id,
-                              const proto::system::HeronTupleSet2& _msg);
+                              proto::system::HeronTupleSet2* _msg);
 
   // Forward the call to the stmgr
-  void StartBackPressureOnServer(const sp_string& _other_stmgr_id);
+  virtual void StartBackPressureOnServer(const sp_string& _other_stmgr_id);
   // Forward the call to the stmgr
-  void StopBackPressureOnServer(const sp_string& _other_stmgr_id);
+  virtual void StopBackPressureOnServer(const sp_string& _other_stmgr_id);
   // Used by the server to tell the client to send the back pressure related
   // messages
   void SendStartBackPressureToOtherStMgrs();
   void SendStopBackPressureToOtherStMgrs();
-  bool DidAnnounceBackPressure();
-  // Called by StMgrClient when its connection closes
-  void HandleDeadStMgrConnection(const sp_string& _stmgr_id);
+  virtual bool DidAnnounceBackPressure();
+  // Called by StMgrClient when its connection closes. _generation is the
+  // one the client was created with, see StMgrClient.
+  virtual void HandleDeadStMgrConnection(const sp_string& _stmgr_id, sp_int64 _generation);
   // Called by StMgrClient when it successfully registers
-  void HandleStMgrClientRegistered();
+  virtual void HandleStMgrClientRegistered(const sp_string& _stmgr_id, sp_int64 _generation);
+  // Called by a StMgrClient without metrics of its own when it says hello
+  virtual void HandleHelloSent(const sp_string& _stmgr_id, sp_int64 _generation);
+  // Called by StMgrClientShard when it drops tuples because its client to
+  // _stmgr_id is not connected
+  virtual void HandleDroppedTupleSet(const sp_string& _stmgr_id);
   void SendDownstreamStatefulCheckpoint(const sp_string& _stmgr_id,
                                         proto::ckptmgr::DownstreamStatefulCheckpoint* _message);
 
@@ -69,16 +81,58 @@ class StMgrClientMgr {
   bool AllStMgrClientsRegistered();
 
  private:
+  friend class StMgrClientMgrTest;
+
   StMgrClient* CreateClient(const sp_string& _other_stmgr_id, const sp_string& _host_name,
                             sp_int32 _port);
+  NetworkOptions MakeClientOptions(const sp_string& _hostname, sp_int32 _port);
+
+  // Counterparts of the methods above when the clients run in shards
+  void StartShardedConnections(const proto::system::PhysicalPlan* _pplan);
+  void StartShardedClient(const sp_string& _other_stmgr_id, const sp_string& _hostname,
+                          sp_int32 _port);
+  void QuitShardedClient(const sp_string& _other_stmgr_id);
+  // Is the sharded client to _stmgr_id still the one of _generation. The
+  // callbacks of a client that has been quit may still be queued up for
+  // the control loop when its successor has started.
+  bool IsCurrentShardedClient(const sp_string& _stmgr_id, sp_int64 _generation);
+
+  // Rebuild task_clients_ for _pplan
+  void BuildTaskClients(const proto::system::PhysicalPlan* _pplan);
 
   // map of stmgrid to its client
   std::map<sp_string, StMgrClient*> clients_;
+  // The client of the stmgr of every task, indexed by task id, NULL for
+  // our own tasks. Rebuilt whenever clients_ changes.
+  std::vector<StMgrClient*> task_clients_;
+
+  // When heron.streammgr.client.threads is positive, the clients run in
+  // these shards instead of on eventLoop_, see StMgrClientShard. The
+  // callbacks of their clients come in on the shard threads and are
+  // forwarded to eventLoop_ through control_piper_.
+  std::vector<StMgrClientShard*> shards_;
+  Piper* control_piper_;
+  struct ShardedClient {
+    NetworkOptions options_;
+    StMgrClientShard* shard_;
+    sp_int64 generation_;
+  };
+  // map of stmgrid to its sharded client
+  std::map<sp_string, ShardedClient> sharded_clients_;
+  // The generation of the next sharded client started
+  sp_int64 next_generation_;
+  // map of stmgrid to the metrics of its sharded client
+  std::map<sp_string, heron::common::MultiCountMetric*> sharded_client_metrics_;
+  // The stmgrs whose clients have registered
+  std::set<sp_string> registered_clients_;
+  // What DidAnnounceBackPressure returns to the shards
+  std::atomic<bool> did_announce_back_pressure_;
 
   sp_string topology_name_;
   sp_string topology_id_;
   sp_string stmgr_id_;
   EventLoop* eventLoop_;
+  sp_int32 reconnect_other_streammgrs_interval_sec_;
 
   StMgr* stream_manager_;
   // Metrics
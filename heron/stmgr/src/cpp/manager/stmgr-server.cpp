@@ -15,6 +15,8 @@
  */
 
 #include "manager/stmgr-server.h"
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
 #include <iostream>
 #include <set>
 #include <string>
@@ -100,7 +102,8 @@ StMgrServer::StMgrServer(EventLoop* eventLoop, const NetworkOptions& _options,
       stateful_helper_(_stateful_helper) {
   // stmgr related handlers
   InstallRequestHandler(&StMgrServer::HandleStMgrHelloRequest);
-  InstallMessageHandler(&StMgrServer::HandleTupleStreamMessage);
+  InstallRawMessageHandler<proto::stmgr::TupleStreamMessage2>(
+      &StMgrServer::HandleTupleStreamMessage);
   InstallMessageHandler(&StMgrServer::HandleStartBackPressureMessage);
   InstallMessageHandler(&StMgrServer::HandleStopBackPressureMessage);
   InstallMessageHandler(&StMgrServer::HandleDownstreamStatefulCheckpointMessage);
@@ -197,6 +200,10 @@ proto::system::Instance* StMgrServer::GetInstanceInfo(sp_int32 _task_id) {
   }
 }
 
+bool StMgrServer::IsInstanceConnected(sp_int32 _task_id) const {
+  return GetInstanceConnection(_task_id) != NULL;
+}
+
 sp_string StMgrServer::MakeBackPressureCompIdMetricName(const sp_string& instanceid) {
   return METRIC_TIME_SPENT_BACK_PRESSURE_COMPID + instanceid;
 }
@@ -313,14 +320,13 @@ void StMgrServer::HandleStMgrHelloRequest(REQID _id, Connection* _conn,
   __global_protobuf_pool_release__(response);
 }
 
-void StMgrServer::HandleTupleStreamMessage(Connection* _conn,
-                                           proto::stmgr::TupleStreamMessage2* _message) {
+void StMgrServer::HandleTupleStreamMessage(Connection* _conn, IncomingPacket* _packet) {
   auto iter = rstmgrs_.find(_conn);
   if (iter == rstmgrs_.end()) {
     LOG(INFO) << "Recieved Tuple messages from unknown streammanager connection" << std::endl;
-    __global_protobuf_pool_release__(_message);
+    delete _packet;
   } else {
-    stmgr_->HandleStreamManagerData(iter->second, _message);
+    stmgr_->HandleStreamManagerData(iter->second, _packet);
   }
 }
 
@@ -372,6 +378,10 @@ void StMgrServer::HandleRegisterInstanceRequest(REQID _reqid, Connection* _conn,
     active_instances_[_conn] = task_id;
     if (instance_info_.find(task_id) == instance_info_.end()) {
       instance_info_[task_id] = new InstanceData(_request->release_instance());
+      if (static_cast<size_t>(task_id) >= task_instances_.size()) {
+        task_instances_.resize(task_id + 1, NULL);
+      }
+      task_instances_[task_id] = instance_info_[task_id];
       // Create a metric for this instance
       if (instance_metric_map_.find(instance_id) == instance_metric_map_.end()) {
         auto instance_metric = new heron::common::TimeSpentMetric();
@@ -429,18 +439,87 @@ void StMgrServer::SendToInstance2(proto::stmgr::TupleStreamMessage2* _message) {
   stateful_gateway_->SendToInstance(_message);
 }
 
+// Reads the task_id and locates the set of a serialized TupleStreamMessage2
+// without parsing the set itself. Returns false if the message is malformed.
+static bool PeekTupleStreamMessage(const char* _message, sp_int32 _size, sp_int32* _task_id,
+                                   const char** _set, sp_int32* _set_size) {
+  using google::protobuf::internal::WireFormatLite;
+  google::protobuf::io::CodedInputStream input(
+      reinterpret_cast<const google::protobuf::uint8*>(_message), _size);
+  bool has_task_id = false;
+  bool has_set = false;
+  while (true) {
+    google::protobuf::uint32 tag = input.ReadTag();
+    if (tag == 0) break;
+    switch (WireFormatLite::GetTagFieldNumber(tag)) {
+      case proto::stmgr::TupleStreamMessage2::kTaskIdFieldNumber: {
+        google::protobuf::uint32 task_id;
+        if (WireFormatLite::GetTagWireType(tag) != WireFormatLite::WIRETYPE_VARINT ||
+            !input.ReadVarint32(&task_id)) {
+          return false;
+        }
+        *_task_id = static_cast<sp_int32>(task_id);
+        has_task_id = true;
+        break;
+      }
+      case proto::stmgr::TupleStreamMessage2::kSetFieldNumber: {
+        google::protobuf::uint32 set_size;
+        if (WireFormatLite::GetTagWireType(tag) != WireFormatLite::WIRETYPE_LENGTH_DELIMITED ||
+            !input.ReadVarint32(&set_size)) {
+          return false;
+        }
+        *_set = _message + input.CurrentPosition();
+        *_set_size = static_cast<sp_int32>(set_size);
+        if (!input.Skip(set_size)) return false;
+        has_set = true;
+        break;
+      }
+      default:
+        if (!WireFormatLite::SkipField(&input, tag)) return false;
+        break;
+    }
+  }
+  return input.ConsumedEntireMessage() && has_task_id && has_set;
+}
+
+void StMgrServer::SendToInstance2(IncomingPacket* _packet) {
+  const char* message = NULL;
+  sp_int32 size = 0;
+  sp_int32 task_id = 0;
+  const char* set = NULL;
+  sp_int32 set_size = 0;
+  if (_packet->UnPackProtocolBuffer(&message, &size) != 0 ||
+      !PeekTupleStreamMessage(message, size, &task_id, &set, &set_size)) {
+    LOG(ERROR) << "Could not decode TupleStreamMessage2. Dropping..." << std::endl;
+    delete _packet;
+    return;
+  }
+
+  Connection* conn = GetInstanceConnection(task_id);
+  if (conn == NULL) {
+    LOG(ERROR) << "task_id " << task_id << " has not yet connected to us. Dropping..."
+               << std::endl;
+    delete _packet;
+    return;
+  }
+
+  // The set becomes the body of the packet to the instance, reusing the
+  // buffer it was received in.
+  SendMessage(conn, _packet, set_size, heron_tuple_set_2_, set);
+}
+
 void StMgrServer::DrainToInstance2(proto::stmgr::TupleStreamMessage2* _message) {
   sp_int32 task_id = _message->task_id();
   bool drop = false;
-  TaskIdInstanceDataMap::iterator iter = instance_info_.find(task_id);
-  if (iter == instance_info_.end() || iter->second->conn_ == NULL) {
+  Connection* conn = GetInstanceConnection(task_id);
+  if (conn == NULL) {
     LOG(ERROR) << "task_id " << task_id << " has not yet connected to us. Dropping..."
                << std::endl;
     drop = true;
   }
 
   if (!drop) {
-    SendMessage(iter->second->conn_, _message->set().size(),
+    SendMessage(conn, _message->set().size(),
                 heron_tuple_set_2_, _message->set().c_str());
   }
   __global_protobuf_pool_release__(_message);
@@ -454,8 +533,8 @@ void StMgrServer::SendToInstance2(sp_int32 _task_id,
 void StMgrServer::DrainToInstance1(sp_int32 _task_id,
                                    proto::system::HeronTupleSet2* _message) {
   bool drop = false;
-  TaskIdInstanceDataMap::iterator iter = instance_info_.find(_task_id);
-  if (iter == instance_info_.end() || iter->second->conn_ == NULL) {
+  Connection* conn = GetInstanceConnection(_task_id);
+  if (conn == NULL) {
     LOG(ERROR) << "task_id " << _task_id << " has not yet connected to us. Dropping..."
                << std::endl;
     drop = true;
@@ -474,7 +553,7 @@ void StMgrServer::DrainToInstance1(sp_int32 _task_id,
       stmgr_server_metrics_->scope(METRIC_FAIL_TUPLES_TO_INSTANCES)
           ->incr_by(_message->control().fails_size());
     }
-    SendMessage(iter->second->conn_, *_message);
+    SendMessage(conn, *_message);
   }
   __global_protobuf_pool_release__(_message);
 }
@@ -760,14 +839,15 @@ void StMgrServer::HandleCheckpointMarker(sp_int32 _src_task_id, sp_int32 _destin
 }
 
 bool StMgrServer::SendRestoreInstanceStateRequest(sp_int32 _task_id,
-            const proto::ckptmgr::InstanceStateCheckpoint& _state) {
+            proto::ckptmgr::InstanceStateCheckpoint* _state) {
   LOG(INFO) << "Sending RestoreInstanceState request to task " << _task_id;
   CHECK(instance_info_.find(_task_id) != instance_info_.end());
   Connection* conn = instance_info_[_task_id]->conn_;
   if (conn) {
     proto::ckptmgr::RestoreInstanceStateRequest* message = nullptr;
     message = __global_protobuf_pool_acquire__(message);
-    message->mutable_state()->CopyFrom(_state);
+    // The state can be large, and the caller is done with it
+    message->mutable_state()->Swap(_state);
     SendMessage(conn, *message);
     __global_protobuf_pool_release__(message);
     return true;
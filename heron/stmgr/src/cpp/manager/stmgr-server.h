@@ -58,6 +58,10 @@ class StMgrServer : public Server {
   void SendToInstance2(sp_int32 _task_id, proto::system::HeronTupleSet2* _message);
   // We own the _message
   void SendToInstance2(proto::stmgr::TupleStreamMessage2* _message);
+  // We own the _packet. It is positioned at a serialized TupleStreamMessage2
+  // whose tuple set is forwarded without being parsed. This bypasses the
+  // checkpoint gateway and is only meant for non-stateful topologies.
+  void SendToInstance2(IncomingPacket* _packet);
   void HandleCheckpointMarker(sp_int32 _src_task_id, sp_int32 _destination_task_id,
                               const sp_string& _checkpoint_id);
 
@@ -68,22 +72,27 @@ class StMgrServer : public Server {
   // Relieve back pressure
   void StopBackPressureClientCb(const sp_string& _other_stmgr_id);
 
-  bool HaveAllInstancesConnectedToUs() const {
+  // The instance methods the stateful restorer uses are virtual, so that
+  // its tests can stand in for the instances
+  virtual bool HaveAllInstancesConnectedToUs() const {
     return active_instances_.size() == expected_instances_.size();
   }
 
   // Gets all the Instance information
-  void GetInstanceInfo(std::vector<proto::system::Instance*>& _return);
+  virtual void GetInstanceInfo(std::vector<proto::system::Instance*>& _return);
   // Get instance info for this task_id
-  proto::system::Instance* GetInstanceInfo(sp_int32 _task_id);
+  virtual proto::system::Instance* GetInstanceInfo(sp_int32 _task_id);
+  // Whether the instance of this task_id is connected to us
+  virtual bool IsInstanceConnected(sp_int32 _task_id) const;
 
   bool DidAnnounceBackPressure() { return !remote_ends_who_caused_back_pressure_.empty(); }
 
   void InitiateStatefulCheckpoint(const sp_string& _checkpoint_tag);
-  bool SendRestoreInstanceStateRequest(sp_int32 _task_id,
-                                       const proto::ckptmgr::InstanceStateCheckpoint& _state);
+  // Sends _state to the task, leaving _state empty if it was sent
+  virtual bool SendRestoreInstanceStateRequest(sp_int32 _task_id,
+                                               proto::ckptmgr::InstanceStateCheckpoint* _state);
   void SendStartInstanceStatefulProcessing(const std::string& _ckpt_id);
-  void ClearCache();
+  virtual void ClearCache();
 
  protected:
   virtual void HandleNewConnection(Connection* newConnection);
@@ -103,7 +112,8 @@ class StMgrServer : public Server {
   // First from other stream managers
   void HandleStMgrHelloRequest(REQID _id, Connection* _conn,
                                proto::stmgr::StrMgrHelloRequest* _request);
-  void HandleTupleStreamMessage(Connection* _conn, proto::stmgr::TupleStreamMessage2* _message);
+  // Receives TupleStreamMessage2 unparsed, see SendToInstance2
+  void HandleTupleStreamMessage(Connection* _conn, IncomingPacket* _packet);
   void HandleDownstreamStatefulCheckpointMessage(Connection* _conn,
                                         proto::ckptmgr::DownstreamStatefulCheckpoint* _message);
 
@@ -166,6 +176,19 @@ class StMgrServer : public Server {
   // Once populated, will not change
   typedef std::map<sp_int32, InstanceData*> TaskIdInstanceDataMap;
   TaskIdInstanceDataMap instance_info_;
+  // The same InstanceData indexed by task id, NULL for the tasks that are
+  // not ours, for the paths that every tuple set takes
+  std::vector<InstanceData*> task_instances_;
+
+  // Get the connection of the instance of _task_id, or NULL if it is not
+  // connected to us
+  Connection* GetInstanceConnection(sp_int32 _task_id) const {
+    if (_task_id < 0 || static_cast<size_t>(_task_id) >= task_instances_.size() ||
+        !task_instances_[_task_id]) {
+      return NULL;
+    }
+    return task_instances_[_task_id]->conn_;
+  }
 
   // map of Instance_id/stmgrid to metric
   // Used for back pressure metrics
@@ -16,6 +16,7 @@
 
 #include "manager/stmgr.h"
 #include <sys/resource.h>
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 #include <limits>
@@ -107,6 +108,14 @@ void StMgr::Init() {
   // Create and Register Tuple cache
   CreateTupleCache();
 
+  // Don't let pooled tuple sets hold on to the memory of unusually large batches
+  size_t tuple_set_high_water_mark = config::HeronInternalsConfigReader::Instance()
+      ->GetHeronStreammgrMempoolTupleSetHighwatermarkBytes();
+  proto::system::HeronTupleSet* tuple_set = NULL;
+  __global_protobuf_pool_set_high_water_mark__(tuple_set, tuple_set_high_water_mark);
+  proto::system::HeronTupleSet2* tuple_set_2 = NULL;
+  __global_protobuf_pool_set_high_water_mark__(tuple_set_2, tuple_set_high_water_mark);
+
   FetchTMasterLocation();
 
   CHECK_GT(
@@ -237,6 +246,9 @@ void StMgr::CreateTMasterClient(proto::tmaster::TMasterLocation* tmasterLocation
   master_options.set_socket_family(PF_INET);
   master_options.set_max_packet_size(std::numeric_limits<sp_uint32>::max() - 1);
   auto pplan_watch = [this](proto::system::PhysicalPlan* pplan) { this->NewPhysicalPlan(pplan); };
+  auto pplan_delta_watch = [this](const proto::system::PhysicalPlanDelta& delta) {
+    this->NewPhysicalPlanDelta(delta);
+  };
   auto stateful_checkpoint_watch =
        [this](sp_string checkpoint_tag) {
     this->InitiateStatefulCheckpoint(checkpoint_tag);
@@ -252,6 +264,7 @@ void StMgr::CreateTMasterClient(proto::tmaster::TMasterLocation* tmasterLocation
 
   tmaster_client_ = new TMasterClient(eventLoop_, master_options, stmgr_id_, stmgr_port_,
                                       shell_port_, std::move(pplan_watch),
+                                      std::move(pplan_delta_watch),
                                       std::move(stateful_checkpoint_watch),
                                       std::move(restore_topology_watch),
                                       std::move(start_stateful_watch));
@@ -270,11 +283,14 @@ void StMgr::CreateCheckpointMgrClient() {
   auto get_watcher = std::bind(&StMgr::HandleGetInstanceState, this,
                            std::placeholders::_1, std::placeholders::_2,
                            std::placeholders::_3, std::placeholders::_4);
+  auto chunks_watcher = std::bind(&StMgr::HandleGetInstanceStateChunks, this,
+                           std::placeholders::_1, std::placeholders::_2);
   auto ckpt_watcher = std::bind(&StMgr::HandleCkptMgrRegistration, this);
   checkpoint_manager_client_ = new CkptMgrClient(eventLoop_, client_options,
                                                  topology_name_, topology_id_,
                                                  ckptmgr_id_, stmgr_id_,
-                                                 save_watcher, get_watcher, ckpt_watcher);
+                                                 save_watcher, get_watcher, chunks_watcher,
+                                                 ckpt_watcher);
   checkpoint_manager_client_->Start();
 }
 
@@ -317,7 +333,11 @@ void StMgr::BroadcastTmasterLocation(proto::tmaster::TMasterLocation* tmasterLoc
 
 void StMgr::OnTMasterLocationFetch(proto::tmaster::TMasterLocation* newTmasterLocation,
                                    proto::system::StatusCode _status) {
-  if (_status != proto::system::OK) {
+  if (_status == proto::system::PATH_DOES_NOT_EXIST) {
+    // The tmaster has not written its location yet. The watch on the
+    // location fetches it again once it does.
+    LOG(INFO) << "TMaster Location does not exist yet, waiting for the tmaster";
+  } else if (_status != proto::system::OK) {
     LOG(INFO) << "TMaster Location Fetch failed with status " << _status;
     LOG(INFO) << "Retrying after " << TMASTER_RETRY_FREQUENCY << " micro seconds ";
     CHECK_GT(eventLoop_->registerTimer([this](EventLoop::Status) {
@@ -422,10 +442,8 @@ void StMgr::NewPhysicalPlan(proto::system::PhysicalPlan* _pplan) {
 
   // Build out data structures
   std::map<sp_string, std::vector<sp_int32> > component_to_task_ids;
-  task_id_to_stmgr_.clear();
   for (sp_int32 i = 0; i < _pplan->instances_size(); ++i) {
     sp_int32 task_id = _pplan->instances(i).info().task_id();
-    task_id_to_stmgr_[task_id] = _pplan->instances(i).stmgr_id();
     const sp_string& component_name = _pplan->instances(i).info().component_name();
     if (component_to_task_ids.find(component_name) == component_to_task_ids.end()) {
       component_to_task_ids[component_name] = std::vector<sp_int32>();
@@ -440,6 +458,50 @@ void StMgr::NewPhysicalPlan(proto::system::PhysicalPlan* _pplan) {
 
   delete pplan_;
   pplan_ = _pplan;
+  PhysicalPlanChanged();
+}
+
+void StMgr::NewPhysicalPlanDelta(const proto::system::PhysicalPlanDelta& _delta) {
+  LOG(INFO) << "Received the changes to the physical plan from tmaster";
+  // The tmaster only sends changes on top of a plan it sent us first
+  CHECK(pplan_);
+  if (_delta.topology_state() != pplan_->topology().state()) {
+    LOG(INFO) << "Topology state changed from " << pplan_->topology().state() << " to "
+              << _delta.topology_state();
+  }
+  // The plan is changed in place, so its topology stays hydrated
+  config::PhysicalPlanHelper::ApplyDelta(_delta, *pplan_);
+
+  bool found = false;
+  for (sp_int32 i = 0; i < pplan_->stmgrs_size(); ++i) {
+    if (pplan_->stmgrs(i).id() == stmgr_id_) {
+      found = true;
+      break;
+    }
+  }
+  if (!found) {
+    LOG(FATAL) << "We have no role in this topology!!" << std::endl;
+  }
+  PhysicalPlanChanged();
+}
+
+void StMgr::BuildTaskRoutes(const proto::system::PhysicalPlan& _pplan,
+                            std::vector<TaskRoute>& _task_routes) const {
+  sp_int32 max_task_id = -1;
+  for (sp_int32 i = 0; i < _pplan.instances_size(); ++i) {
+    max_task_id = std::max(max_task_id, _pplan.instances(i).info().task_id());
+  }
+  // The routes point into _pplan
+  _task_routes.assign(max_task_id + 1, TaskRoute());
+  for (sp_int32 i = 0; i < _pplan.instances_size(); ++i) {
+    sp_int32 task_id = _pplan.instances(i).info().task_id();
+    _task_routes[task_id].stmgr_id_ = &_pplan.instances(i).stmgr_id();
+    _task_routes[task_id].local_ = _pplan.instances(i).stmgr_id() == stmgr_id_;
+  }
+}
+
+void StMgr::PhysicalPlanChanged() {
+  BuildTaskRoutes(*pplan_, task_routes_);
   stateful_helper_->Reconstruct(*pplan_);
   if (!is_stateful_) {
     clientmgr_->StartConnections(pplan_);
@@ -491,6 +553,14 @@ void StMgr::PopulateStreamConsumers(
     }
   }
 
+  sp_string fields_hash_name = config::TopologyConfigHelper::GetFieldsGroupingHash(*_topology);
+  FieldsHash fields_hash = FIELDS_HASH_LEGACY;
+  if (fields_hash_name == "fast") {
+    fields_hash = FIELDS_HASH_FAST;
+  } else if (fields_hash_name != "legacy") {
+    LOG(WARNING) << "Unknown fields grouping hash " << fields_hash_name << ", using legacy";
+  }
+
   // Only bolts can consume
   for (sp_int32 i = 0; i < _topology->bolts_size(); ++i) {
     for (sp_int32 j = 0; j < _topology->bolts(i).inputs_size(); ++j) {
@@ -502,9 +572,9 @@ void StMgr::PopulateStreamConsumers(
       CHECK(iter != _component_to_task_ids.end());
       const std::vector<sp_int32>& component_task_ids = iter->second;
       if (stream_consumers_.find(p) == stream_consumers_.end()) {
-        stream_consumers_[p] = new StreamConsumers(is, *schema, component_task_ids);
+        stream_consumers_[p] = new StreamConsumers(is, *schema, component_task_ids, fields_hash);
       } else {
-        stream_consumers_[p]->NewConsumer(is, *schema, component_task_ids);
+        stream_consumers_[p]->NewConsumer(is, *schema, component_task_ids, fields_hash);
       }
     }
   }
@@ -552,6 +622,27 @@ void StMgr::HandleStreamManagerData(const sp_string&,
   }
 }
 
+void StMgr::HandleStreamManagerData(const sp_string& _stmgr_id, IncomingPacket* _packet) {
+  // Without acking or state the tuple set goes to the instance as is, so the
+  // packet is forwarded without parsing the message.
+  if (!is_acking_enabled && !is_stateful_ && !stateful_restorer_->InProgress()) {
+    server_->SendToInstance2(_packet);
+    return;
+  }
+
+  proto::stmgr::TupleStreamMessage2* message = NULL;
+  message = __global_protobuf_pool_acquire__(message);
+  if (_packet->UnPackProtocolBuffer(message) != 0) {
+    LOG(ERROR) << "Could not decode TupleStreamMessage2 from stmgr " << _stmgr_id
+               << ". Dropping...";
+    __global_protobuf_pool_release__(message);
+    delete _packet;
+    return;
+  }
+  delete _packet;
+  HandleStreamManagerData(_stmgr_id, message);
+}
+
 void StMgr::SendInBound(sp_int32 _task_id, proto::system::HeronTupleSet2* _message) {
   if (_message->has_data()) {
     server_->SendToInstance2(_task_id, _message);
@@ -567,51 +658,31 @@ void StMgr::ProcessAcksAndFails(sp_int32 _src_task_id, sp_int32 _task_id,
                                 const proto::system::HeronControlTupleSet& _control) {
   proto::system::HeronTupleSet2* current_control_tuple_set = NULL;
   current_control_tuple_set = __global_protobuf_pool_acquire__(current_control_tuple_set);
+  // Pooled messages keep what they last held, and this one is built up
+  // field by field
+  current_control_tuple_set->Clear();
   current_control_tuple_set->set_src_task_id(_src_task_id);
 
-  // First go over emits. This makes sure that new emits makes
-  // a tuples stay alive before we process its acks
-  for (sp_int32 i = 0; i < _control.emits_size(); ++i) {
-    const proto::system::AckTuple& ack_tuple = _control.emits(i);
-    for (sp_int32 j = 0; j < ack_tuple.roots_size(); ++j) {
-      CHECK_EQ(_task_id, ack_tuple.roots(j).taskid());
-      CHECK(!xor_mgrs_->anchor(_task_id, ack_tuple.roots(j).key(), ack_tuple.ackedtuple()));
-    }
-  }
+  xor_mgrs_->process(_task_id, _control, &acked_roots_, &failed_roots_);
 
-  // Then go over acks
-  for (sp_int32 i = 0; i < _control.acks_size(); ++i) {
-    const proto::system::AckTuple& ack_tuple = _control.acks(i);
-    for (sp_int32 j = 0; j < ack_tuple.roots_size(); ++j) {
-      CHECK_EQ(_task_id, ack_tuple.roots(j).taskid());
-      if (xor_mgrs_->anchor(_task_id, ack_tuple.roots(j).key(), ack_tuple.ackedtuple())) {
-        // This tuple tree is all over
-        proto::system::AckTuple* a;
-        a = current_control_tuple_set->mutable_control()->add_acks();
-        proto::system::RootId* r = a->add_roots();
-        r->set_key(ack_tuple.roots(j).key());
-        r->set_taskid(_task_id);
-        a->set_ackedtuple(0);  // this is ignored
-        CHECK(xor_mgrs_->remove(_task_id, ack_tuple.roots(j).key()));
-      }
-    }
+  for (sp_int64 key : acked_roots_) {
+    // This tuple tree is all over
+    proto::system::AckTuple* a;
+    a = current_control_tuple_set->mutable_control()->add_acks();
+    proto::system::RootId* r = a->add_roots();
+    r->set_key(key);
+    r->set_taskid(_task_id);
+    a->set_ackedtuple(0);  // this is ignored
   }
 
-  // Now go over the fails
-  for (sp_int32 i = 0; i < _control.fails_size(); ++i) {
-    const proto::system::AckTuple& fail_tuple = _control.fails(i);
-    for (sp_int32 j = 0; j < fail_tuple.roots_size(); ++j) {
-      CHECK_EQ(_task_id, fail_tuple.roots(j).taskid());
-      if (xor_mgrs_->remove(_task_id, fail_tuple.roots(j).key())) {
-        // This tuple tree is failed
-        proto::system::AckTuple* f;
-        f = current_control_tuple_set->mutable_control()->add_fails();
-        proto::system::RootId* r = f->add_roots();
-        r->set_key(fail_tuple.roots(j).key());
-        r->set_taskid(_task_id);
-        f->set_ackedtuple(0);  // this is ignored
-      }
-    }
+  for (sp_int64 key : failed_roots_) {
+    // This tuple tree is failed
+    proto::system::AckTuple* f;
+    f = current_control_tuple_set->mutable_control()->add_fails();
+    proto::system::RootId* r = f->add_roots();
+    r->set_key(key);
+    r->set_taskid(_task_id);
+    f->set_ackedtuple(0);  // this is ignored
   }
 
   // Check if we need to send this out
@@ -641,23 +712,20 @@ void StMgr::HandleInstanceData(const sp_int32 _src_task_id, bool _local_spout,
     auto s = stream_consumers_.find(stream);
     if (s != stream_consumers_.end()) {
       StreamConsumers* s_consumer = s->second;
+      routes_.Clear();
+      s_consumer->GetRoutes(*d, routes_);
       for (sp_int32 i = 0; i < d->tuples_size(); ++i) {
-        proto::system::HeronDataTuple* _tuple = d->mutable_tuples(i);
+        const proto::system::HeronDataTuple& tuple = d->tuples(i);
         // just to make sure that instances do not set any key
-        CHECK_EQ(_tuple->key(), 0);
-        out_tasks_.clear();
-        s_consumer->GetListToSend(*_tuple, out_tasks_);
-        // In addition to out_tasks_, the instance might have asked
+        CHECK_EQ(tuple.key(), 0);
+        // In addition to the groupings, the instance might have asked
         // us to send the tuple to some more tasks
-        for (sp_int32 j = 0; j < _tuple->dest_task_ids_size(); ++j) {
-          out_tasks_.push_back(_tuple->dest_task_ids(j));
-        }
-        if (out_tasks_.empty()) {
-          LOG(ERROR) << "Nobody to send the tuple to";
+        for (sp_int32 j = 0; j < tuple.dest_task_ids_size(); ++j) {
+          routes_.Add(i, tuple.dest_task_ids(j));
         }
-        // TODO(vikasr) Do a fast path that does not involve copying
-        CopyDataOutBound(_src_task_id, _local_spout, d->stream(), _tuple, out_tasks_);
       }
+      routes_.Group();
+      CopyDataOutBound(_src_task_id, _local_spout, d, routes_);
     } else {
       LOG(ERROR) << "Nobody consumes stream " << stream.second << " from component "
                  << stream.first;
@@ -677,20 +745,27 @@ void StMgr::HandleInstanceData(const sp_int32 _src_task_id, bool _local_spout,
 
 // Called to drain cached instance data
 void StMgr::DrainInstanceData(sp_int32 _task_id, proto::system::HeronTupleSet2* _tuple) {
-  const sp_string& dest_stmgr_id = task_id_to_stmgr_[_task_id];
-  if (dest_stmgr_id == stmgr_id_) {
+  const TaskRoute& route = GetTaskRoute(_task_id);
+  if (route.local_) {
     // Our own loopback
     SendInBound(_task_id, _tuple);
   } else {
-    bool dropped = clientmgr_->SendTupleStreamMessage(_task_id, dest_stmgr_id, *_tuple);
-    if (dropped && is_stateful_ && !stateful_restorer_->InProgress()) {
-      LOG(INFO) << "We dropped some messages because we are not yet connected with stmgr "
-                << dest_stmgr_id << " and we are not in restore. Hence sending Reset "
-                << "message to TMaster";
-      tmaster_client_->SendResetTopologyState("Dropped Instance Tuples");
-      restore_initiated_metrics_->incr();
+    const sp_string& dest_stmgr_id = *route.stmgr_id_;
+    // The client manager takes ownership of _tuple
+    bool dropped = clientmgr_->SendTupleStreamMessage(_task_id, dest_stmgr_id, _tuple);
+    if (dropped) {
+      HandleDroppedTupleSet(dest_stmgr_id);
     }
-    __global_protobuf_pool_release__(_tuple);
+  }
+}
+
+void StMgr::HandleDroppedTupleSet(const sp_string& _stmgr_id) {
+  if (is_stateful_ && !stateful_restorer_->InProgress()) {
+    LOG(INFO) << "We dropped some messages because we are not yet connected with stmgr "
+              << _stmgr_id << " and we are not in restore. Hence sending Reset "
+              << "message to TMaster";
+    tmaster_client_->SendResetTopologyState("Dropped Instance Tuples");
+    restore_initiated_metrics_->incr();
   }
 }
 
@@ -709,33 +784,55 @@ void StMgr::CopyControlOutBound(sp_int32 _src_task_id,
 }
 
 void StMgr::CopyDataOutBound(sp_int32 _src_task_id, bool _local_spout,
-                             const proto::api::StreamId& _streamid,
-                             proto::system::HeronDataTuple* _tuple,
-                             const std::vector<sp_int32>& _out_tasks) {
-  bool first_iteration = true;
-  for (auto& i : _out_tasks) {
-    sp_int64 tuple_key = tuple_cache_->add_data_tuple(_src_task_id, i, _streamid, _tuple);
-    if (_tuple->roots_size() > 0) {
-      // Anchored tuple
+                             proto::system::HeronDataTupleSet* _tuples,
+                             const TupleRoutes& _routes) {
+  // Serialize every tuple just once. Every destination gets a copy of
+  // its bytes with its own key patched in.
+  size_t ntuples = _tuples->tuples_size();
+  if (serialized_tuples_.size() < ntuples) serialized_tuples_.resize(ntuples);
+  anchored_.assign(ntuples, false);
+  tuple_keys_.resize(ntuples);
+  routed_.assign(ntuples, false);
+  for (size_t i = 0; i < ntuples; ++i) {
+    TupleCache::serialize_data_tuple(_tuples->mutable_tuples(i), &serialized_tuples_[i]);
+    anchored_[i] = _tuples->tuples(i).roots_size() > 0;
+  }
+
+  for (size_t t = 0; t < _routes.NumTasks(); ++t) {
+    tuple_cache_->add_data_tuples(_src_task_id, _routes.Task(t), _tuples->stream(),
+                                  serialized_tuples_, anchored_, _routes.Begin(t),
+                                  _routes.End(t), tuple_keys_);
+    for (const sp_int32* index = _routes.Begin(t); index != _routes.End(t); ++index) {
+      bool first_route = !routed_[*index];
+      routed_[*index] = true;
+      if (!anchored_[*index]) continue;
+
+      const proto::system::HeronDataTuple& tuple = _tuples->tuples(*index);
+      sp_int64 tuple_key = tuple_keys_[*index];
       if (_local_spout) {
         // This is a local spout. We need to maintain xors
-        CHECK_EQ(_tuple->roots_size(), 1);
-        if (first_iteration) {
-          xor_mgrs_->create(_src_task_id, _tuple->roots(0).key(), tuple_key);
+        CHECK_EQ(tuple.roots_size(), 1);
+        if (first_route) {
+          xor_mgrs_->create(_src_task_id, tuple.roots(0).key(), tuple_key);
         } else {
-          CHECK(!xor_mgrs_->anchor(_src_task_id, _tuple->roots(0).key(), tuple_key));
+          CHECK(!xor_mgrs_->anchor(_src_task_id, tuple.roots(0).key(), tuple_key));
         }
       } else {
         // Anchored emits from local bolt
-        for (sp_int32 i = 0; i < _tuple->roots_size(); ++i) {
-          proto::system::AckTuple t;
-          t.add_roots()->CopyFrom(_tuple->roots(i));
-          t.set_ackedtuple(tuple_key);
-          tuple_cache_->add_emit_tuple(_src_task_id, _tuple->roots(i).taskid(), t);
+        for (sp_int32 i = 0; i < tuple.roots_size(); ++i) {
+          proto::system::AckTuple ack;
+          ack.add_roots()->CopyFrom(tuple.roots(i));
+          ack.set_ackedtuple(tuple_key);
+          tuple_cache_->add_emit_tuple(_src_task_id, tuple.roots(i).taskid(), ack);
         }
       }
     }
-    first_iteration = false;
+  }
+
+  for (size_t i = 0; i < ntuples; ++i) {
+    if (!routed_[i]) {
+      LOG(ERROR) << "Nobody to send the tuple to";
+    }
   }
 }
 
@@ -851,7 +948,8 @@ void StMgr::HandleInstanceStateCheckpointMessage(sp_int32 _task_id,
   proto::ckptmgr::SaveInstanceStateRequest* message =
          new proto::ckptmgr::SaveInstanceStateRequest();
   message->mutable_instance()->CopyFrom(*_instance);
-  message->mutable_checkpoint()->CopyFrom(*_message);
+  // The state can be large, and the message is done with after this
+  message->mutable_checkpoint()->Swap(_message);
   checkpoint_manager_client_->SaveInstanceState(message);
 }
 
@@ -865,22 +963,28 @@ void StMgr::HandleSavedInstanceState(const proto::system::Instance& _instance,
 
 void StMgr::HandleGetInstanceState(proto::system::StatusCode _status, sp_int32 _task_id,
                                    sp_string _checkpoint_id,
-                                   const proto::ckptmgr::InstanceStateCheckpoint& _msg) {
+                                   proto::ckptmgr::InstanceStateCheckpoint* _msg) {
   if (stateful_restorer_) {
     stateful_restorer_->HandleCheckpointState(_status, _task_id, _checkpoint_id, _msg);
   }
 }
 
+void StMgr::HandleGetInstanceStateChunks(sp_int32 _task_id, const std::string& _checkpoint_id) {
+  if (stateful_restorer_) {
+    stateful_restorer_->HandleCheckpointStateChunks(_task_id, _checkpoint_id);
+  }
+}
+
 // Send checkpoint message to this task_id
 // Send checkpoint message to this task_id
 void StMgr::DrainDownstreamCheckpoint(sp_int32 _task_id,
                                       proto::ckptmgr::DownstreamStatefulCheckpoint* _message) {
-  sp_string stmgr = task_id_to_stmgr_[_task_id];
-  if (stmgr == stmgr_id_) {
+  const TaskRoute& route = GetTaskRoute(_task_id);
+  if (route.local_) {
     HandleDownStreamStatefulCheckpoint(_message);
     delete _message;
   } else {
-    clientmgr_->SendDownstreamStatefulCheckpoint(stmgr, _message);
+    clientmgr_->SendDownstreamStatefulCheckpoint(*route.stmgr_id_, _message);
   }
 }
 
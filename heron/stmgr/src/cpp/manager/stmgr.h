@@ -25,6 +25,7 @@
 #include <vector>
 #include <chrono>
 #include <typeindex>
+#include "grouping/tuple-routes.h"
 #include "proto/messages.h"
 #include "network/network.h"
 #include "basics/basics.h"
@@ -69,8 +70,13 @@ class StMgr {
 
   // Called by tmaster client when a new physical plan is available
   void NewPhysicalPlan(proto::system::PhysicalPlan* pplan);
+  // Called by tmaster client when it got only what changed in the plan
+  void NewPhysicalPlanDelta(const proto::system::PhysicalPlanDelta& _delta);
   void HandleStreamManagerData(const sp_string& _stmgr_id,
                                proto::stmgr::TupleStreamMessage2* _message);
+  // Same as above, but with _packet positioned at the serialized
+  // TupleStreamMessage2, which is only parsed when it has to be. We own _packet.
+  void HandleStreamManagerData(const sp_string& _stmgr_id, IncomingPacket* _packet);
   void HandleInstanceData(sp_int32 _task_id, bool _local_spout,
                           proto::system::HeronTupleSet* _message);
   void HandleInstanceStateCheckpointMessage(sp_int32 _task_id,
@@ -94,6 +100,9 @@ class StMgr {
   void StartTMasterClient();
   bool DidAnnounceBackPressure();
   void HandleDeadStMgrConnection(const sp_string& _stmgr);
+  // Called when tuples for the instances of _stmgr are dropped because
+  // we are not connected to it
+  void HandleDroppedTupleSet(const sp_string& _stmgr);
   void HandleAllStMgrClientsRegistered();
   void HandleDeadInstance(sp_int32 _task_id);
   void HandleAllInstancesConnected();
@@ -118,7 +127,9 @@ class StMgr {
                                 const std::string& _checkpoint_id);
   void HandleGetInstanceState(proto::system::StatusCode _status, sp_int32 _task_id,
                               sp_string _checkpoint_id,
-                              const proto::ckptmgr::InstanceStateCheckpoint& _msg);
+                              proto::ckptmgr::InstanceStateCheckpoint* _msg);
+  // Called when ckpt mgr starts sending a state in chunks
+  void HandleGetInstanceStateChunks(sp_int32 _task_id, const std::string& _checkpoint_id);
 
   void CleanupStreamConsumers();
   void PopulateStreamConsumers(
@@ -132,10 +143,11 @@ class StMgr {
   void SendInBound(sp_int32 _task_id, proto::system::HeronTupleSet2* _message);
   void ProcessAcksAndFails(sp_int32 _src_task_id,
                            sp_int32 _task_id, const proto::system::HeronControlTupleSet& _control);
+  // Add the tuples of _tuples to the tuple cache of every task they are
+  // routed to, a run of them per task
   void CopyDataOutBound(sp_int32 _src_task_id, bool _local_spout,
-                        const proto::api::StreamId& _streamid,
-                        proto::system::HeronDataTuple* _tuple,
-                        const std::vector<sp_int32>& _out_tasks);
+                        proto::system::HeronDataTupleSet* _tuples,
+                        const TupleRoutes& _routes);
   void CopyControlOutBound(sp_int32 _src_task_id,
                            const proto::system::AckTuple& _control, bool _is_fail);
 
@@ -179,8 +191,25 @@ class StMgr {
 
   EventLoop* eventLoop_;
 
-  // Map of task_id to stmgr_id
-  std::unordered_map<sp_int32, sp_string> task_id_to_stmgr_;
+  // Where every task is, indexed by task id. Task ids are small and
+  // dense, so finding where a tuple set goes is one load. Rebuilt with
+  // every physical plan.
+  struct TaskRoute {
+    TaskRoute() : stmgr_id_(NULL), local_(false) {}
+    // the id of the stmgr of the task in pplan_, NULL if there is no such task
+    const sp_string* stmgr_id_;
+    bool local_;
+  };
+  std::vector<TaskRoute> task_routes_;
+  void BuildTaskRoutes(const proto::system::PhysicalPlan& _pplan,
+                       std::vector<TaskRoute>& _task_routes) const;
+  // Update everything that depends on pplan_ after it changed
+  void PhysicalPlanChanged();
+  const TaskRoute& GetTaskRoute(sp_int32 _task_id) const {
+    CHECK(_task_id >= 0 && static_cast<size_t>(_task_id) < task_routes_.size() &&
+          task_routes_[_task_id].stmgr_id_) << "Unknown task " << _task_id;
+    return task_routes_[_task_id];
+  }
   // map of <component, streamid> to its consumers
   std::unordered_map<std::pair<sp_string, sp_string>, StreamConsumers*> stream_consumers_;
   // xor managers
@@ -217,7 +246,18 @@ class StMgr {
   sp_int32 checkpoint_manager_port_;
   sp_string ckptmgr_id_;
 
-  std::vector<sp_int32> out_tasks_;
+  // Scratch space for routing a tuple set in HandleInstanceData
+  TupleRoutes routes_;
+  // Scratch buffers in CopyDataOutBound, indexed by tuple: the serialized
+  // tuples, whether they are anchored, their keys at the last task they
+  // were added for, and whether they were added for any task yet
+  std::vector<sp_string> serialized_tuples_;
+  std::vector<bool> anchored_;
+  std::vector<sp_int64> tuple_keys_;
+  std::vector<bool> routed_;
+  // Scratch buffers for the tuple trees completed in ProcessAcksAndFails
+  std::vector<sp_int64> acked_roots_;
+  std::vector<sp_int64> failed_roots_;
 
   bool is_acking_enabled;
   bool is_stateful_;
@@ -31,8 +31,9 @@ namespace stmgr {
 
 StreamConsumers::StreamConsumers(const proto::api::InputStream& _is,
                                  const proto::api::StreamSchema& _schema,
-                                 const std::vector<sp_int32>& _task_ids) {
-  consumers_.push_back(Grouping::Create(_is.gtype(), _is, _schema, _task_ids));
+                                 const std::vector<sp_int32>& _task_ids,
+                                 FieldsHash _fields_hash) {
+  consumers_.push_back(Grouping::Create(_is.gtype(), _is, _schema, _task_ids, _fields_hash));
 }
 
 StreamConsumers::~StreamConsumers() {
@@ -45,8 +46,9 @@ StreamConsumers::~StreamConsumers() {
 
 void StreamConsumers::NewConsumer(const proto::api::InputStream& _is,
                                   const proto::api::StreamSchema& _schema,
-                                  const std::vector<sp_int32>& _task_ids) {
-  consumers_.push_back(Grouping::Create(_is.gtype(), _is, _schema, _task_ids));
+                                  const std::vector<sp_int32>& _task_ids,
+                                  FieldsHash _fields_hash) {
+  consumers_.push_back(Grouping::Create(_is.gtype(), _is, _schema, _task_ids, _fields_hash));
 }
 
 void StreamConsumers::GetListToSend(const proto::system::HeronDataTuple& _tuple,
@@ -55,5 +57,12 @@ void StreamConsumers::GetListToSend(const proto::system::HeronDataTuple& _tuple,
     (*iter)->GetListToSend(_tuple, _return);
   }
 }
+
+void StreamConsumers::GetRoutes(const proto::system::HeronDataTupleSet& _tuples,
+                                TupleRoutes& _routes) {
+  for (auto consumer : consumers_) {
+    consumer->GetRoutes(_tuples, _routes);
+  }
+}
 }  // namespace stmgr
 }  // namespace heron
@@ -23,6 +23,7 @@
 #include "proto/messages.h"
 #include "network/network.h"
 #include "basics/basics.h"
+#include "grouping/grouping.h"
 #include "grouping/shuffle-grouping.h"
 
 namespace heron {
@@ -34,14 +35,19 @@ class ShuffleGrouping;
 class StreamConsumers {
  public:
   StreamConsumers(const proto::api::InputStream& _is, const proto::api::StreamSchema& _schema,
-                  const std::vector<sp_int32>& _task_ids);
+                  const std::vector<sp_int32>& _task_ids,
+                  FieldsHash _fields_hash = FIELDS_HASH_LEGACY);
   virtual ~StreamConsumers();
 
   void NewConsumer(const proto::api::InputStream& _is, const proto::api::StreamSchema& _schema,
-                   const std::vector<sp_int32>& _task_ids);
+                   const std::vector<sp_int32>& _task_ids,
+                   FieldsHash _fields_hash = FIELDS_HASH_LEGACY);
 
   void GetListToSend(const proto::system::HeronDataTuple& _tuple, std::vector<sp_int32>& _return);
 
+  // Add where every consumer sends each of _tuples to _routes
+  void GetRoutes(const proto::system::HeronDataTupleSet& _tuples, TupleRoutes& _routes);
+
   inline bool isShuffleGrouping() {
     ShuffleGrouping* grouping = dynamic_cast<ShuffleGrouping *>(consumers_.front());
 
@@ -34,6 +34,7 @@ namespace stmgr {
 TMasterClient::TMasterClient(EventLoop* eventLoop, const NetworkOptions& _options,
                              const sp_string& _stmgr_id, sp_int32 _stmgr_port, sp_int32 _shell_port,
                              VCallback<proto::system::PhysicalPlan*> _pplan_watch,
+                             VCallback<const proto::system::PhysicalPlanDelta&> _pplan_delta_watch,
                              VCallback<sp_string> _stateful_checkpoint_watch,
                              VCallback<sp_string, sp_int64> _restore_topology_watch,
                              VCallback<sp_string> _start_stateful_watch)
@@ -43,6 +44,8 @@ TMasterClient::TMasterClient(EventLoop* eventLoop, const NetworkOptions& _option
       shell_port_(_shell_port),
       to_die_(false),
       pplan_watch_(std::move(_pplan_watch)),
+      pplan_delta_watch_(std::move(_pplan_delta_watch)),
+      pplan_version_(-1),
       stateful_checkpoint_watch_(std::move(_stateful_checkpoint_watch)),
       restore_topology_watch_(std::move(_restore_topology_watch)),
       start_stateful_watch_(std::move(_start_stateful_watch)),
@@ -64,9 +67,11 @@ TMasterClient::TMasterClient(EventLoop* eventLoop, const NetworkOptions& _option
   InstallResponseHandler(new proto::tmaster::StMgrHeartbeatRequest(),
                          &TMasterClient::HandleHeartbeatResponse);
   InstallMessageHandler(&TMasterClient::HandleNewAssignmentMessage);
+  InstallMessageHandler(&TMasterClient::HandlePhysicalPlanDeltaMessage);
   InstallMessageHandler(&TMasterClient::HandleStatefulCheckpointMessage);
   InstallMessageHandler(&TMasterClient::HandleRestoreTopologyStateRequest);
   InstallMessageHandler(&TMasterClient::HandleStartStmgrStatefulProcessing);
+  EnableTypeIds();
 }
 
 TMasterClient::~TMasterClient() {}
@@ -146,7 +151,9 @@ void TMasterClient::HandleRegisterResponse(void*, proto::tmaster::StMgrRegisterR
     Stop();
   } else {
     LOG(INFO) << "Registered successfully with Tmaster" << std::endl;
+    pplan_version_ = -1;
     if (_response->has_pplan()) {
+      if (_response->has_pplan_version()) pplan_version_ = _response->pplan_version();
       pplan_watch_(_response->release_pplan());
     }
     // Shouldn't be in a state where a previous timer is not cleared yet.
@@ -181,10 +188,28 @@ void TMasterClient::HandleHeartbeatResponse(void*,
 
 void TMasterClient::HandleNewAssignmentMessage(proto::stmgr::NewPhysicalPlanMessage* _message) {
   LOG(INFO) << "Got a new assignment" << std::endl;
+  pplan_version_ = _message->has_version() ? _message->version() : -1;
   pplan_watch_(_message->release_new_pplan());
   __global_protobuf_pool_release__(_message);
 }
 
+void TMasterClient::HandlePhysicalPlanDeltaMessage(
+                                        proto::stmgr::PhysicalPlanDeltaMessage* _message) {
+  if (pplan_version_ < 0 || _message->base_version() != pplan_version_) {
+    // We cannot have missed a plan on the same connection, but if we did,
+    // registering again gets us the whole plan
+    LOG(ERROR) << "Got the changes to physical plan " << _message->base_version()
+               << " but we have " << pplan_version_ << ". Reconnecting to tmaster";
+    __global_protobuf_pool_release__(_message);
+    Stop();
+    return;
+  }
+  LOG(INFO) << "Got the changes for physical plan " << _message->version();
+  pplan_version_ = _message->version();
+  pplan_delta_watch_(_message->delta());
+  __global_protobuf_pool_release__(_message);
+}
+
 void TMasterClient::HandleStatefulCheckpointMessage(
                                         proto::ckptmgr::StartStatefulCheckpoint* _message) {
   LOG(INFO) << "Got a new checkpoint message from tmaster with id "
@@ -222,6 +247,7 @@ void TMasterClient::SendRegisterRequest() {
   for (auto iter = instances_.begin(); iter != instances_.end(); ++iter) {
     request->add_instances()->CopyFrom(*(*iter));
   }
+  request->set_takes_pplan_deltas(true);
 
   SendRequest(request, NULL);
 
@@ -233,6 +259,7 @@ void TMasterClient::SendHeartbeatRequest() {
   request->set_heartbeat_time(time(NULL));
   // TODO(vikasr) Send actual stats
   request->mutable_stats();
+  request->set_takes_pplan_deltas(true);
 
   SendRequest(request, NULL);
 
@@ -32,6 +32,7 @@ class TMasterClient : public Client {
   TMasterClient(EventLoop* eventLoop, const NetworkOptions& _options, const sp_string& _stmgr_id,
                 sp_int32 _stmgr_port, sp_int32 _shell_port,
                 VCallback<proto::system::PhysicalPlan*> _pplan_watch,
+                VCallback<const proto::system::PhysicalPlanDelta&> _pplan_delta_watch,
                 VCallback<sp_string> _stateful_checkpoint_watch,
                 VCallback<sp_string, sp_int64> _restore_topology_watch,
                 VCallback<sp_string> _start_stateful_watch);
@@ -71,6 +72,7 @@ class TMasterClient : public Client {
                                NetworkErrorCode);
 
   void HandleNewAssignmentMessage(proto::stmgr::NewPhysicalPlanMessage* _message);
+  void HandlePhysicalPlanDeltaMessage(proto::stmgr::PhysicalPlanDeltaMessage* _message);
   void HandleStatefulCheckpointMessage(proto::ckptmgr::StartStatefulCheckpoint* _message);
   void HandleRestoreTopologyStateRequest(proto::ckptmgr::RestoreTopologyStateRequest* _message);
   void HandleStartStmgrStatefulProcessing(proto::ckptmgr::StartStmgrStatefulProcessing* _msg);
@@ -87,6 +89,10 @@ class TMasterClient : public Client {
   std::vector<proto::system::Instance*> instances_;
   bool to_die_;
   VCallback<proto::system::PhysicalPlan*> pplan_watch_;
+  VCallback<const proto::system::PhysicalPlanDelta&> pplan_delta_watch_;
+  // The version of the last physical plan we got, that the next delta
+  // has to be based on. -1 if the tmaster did not tell us.
+  sp_int64 pplan_version_;
   VCallback<sp_string> stateful_checkpoint_watch_;
   VCallback<sp_string, sp_int64> restore_topology_watch_;
   VCallback<sp_string> start_stateful_watch_;
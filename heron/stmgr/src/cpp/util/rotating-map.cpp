@@ -15,8 +15,8 @@
  */
 
 #include "util/rotating-map.h"
-#include <iostream>
-#include <list>
+#include <string.h>
+#include <vector>
 #include "proto/messages.h"
 #include "basics/basics.h"
 #include "errors/errors.h"
@@ -26,55 +26,153 @@
 namespace heron {
 namespace stmgr {
 
-RotatingMap::RotatingMap(sp_int32 _nbuckets) {
+namespace {
+// Number of slots a table starts with. Must be a power of two
+const sp_uint64 INITIAL_TABLE_SLOTS = 1024;
+}
+
+RotatingMap::RotatingMap(sp_int32 _nbuckets) : front_(0) {
+  CHECK_GT(_nbuckets, 0);
   for (sp_int32 i = 0; i < _nbuckets; ++i) {
-    std::unordered_map<sp_int64, sp_int64>* head = new std::unordered_map<sp_int64, sp_int64>();
-    buckets_.push_back(head);
+    tables_.push_back(new Table());
   }
 }
 
 RotatingMap::~RotatingMap() {
-  while (!buckets_.empty()) {
-    std::unordered_map<sp_int64, sp_int64>* m = buckets_.front();
-    buckets_.pop_front();
-    delete m;
+  for (auto table : tables_) {
+    delete table;
   }
 }
 
 void RotatingMap::rotate() {
-  std::unordered_map<sp_int64, sp_int64>* m = buckets_.back();
-  buckets_.pop_back();
-  delete m;
-  buckets_.push_front(new std::unordered_map<sp_int64, sp_int64>());
+  // The oldest table sits just behind the front one
+  front_ = (front_ + tables_.size() - 1) % tables_.size();
+  tables_[front_]->clear();
 }
 
 void RotatingMap::create(sp_int64 _key, sp_int64 _value) {
-  std::unordered_map<sp_int64, sp_int64>* m = buckets_.front();
-  (*m)[_key] = _value;
+  tables_[front_]->insert(_key, _value);
 }
 
 bool RotatingMap::anchor(sp_int64 _key, sp_int64 _value) {
-  std::list<std::unordered_map<sp_int64, sp_int64>*>::iterator iter;
-  for (iter = buckets_.begin(); iter != buckets_.end(); ++iter) {
-    std::unordered_map<sp_int64, sp_int64>* m = *iter;
-    if (m->find(_key) != m->end()) {
-      sp_int64 current_value = (*m)[_key];
-      sp_int64 new_value = current_value ^ _value;
-      (*m)[_key] = new_value;
-      return new_value == 0;
+  for (size_t i = 0; i < tables_.size(); ++i) {
+    sp_int64* current_value = tables_[(front_ + i) % tables_.size()]->find(_key);
+    if (current_value) {
+      *current_value ^= _value;
+      return *current_value == 0;
     }
   }
   return false;
 }
 
 bool RotatingMap::remove(sp_int64 _key) {
-  std::list<std::unordered_map<sp_int64, sp_int64>*>::iterator iter;
-  for (iter = buckets_.begin(); iter != buckets_.end(); ++iter) {
-    size_t removed = (*iter)->erase(_key);
-    if (removed > 0) return true;
+  for (size_t i = 0; i < tables_.size(); ++i) {
+    if (tables_[(front_ + i) % tables_.size()]->erase(_key)) return true;
   }
   return false;
 }
 
+void RotatingMap::prefetch(sp_int64 _key) const {
+  for (auto table : tables_) {
+    table->prefetch(_key);
+  }
+}
+
+RotatingMap::Table::Table()
+    : mask_(INITIAL_TABLE_SLOTS - 1), size_(0), has_zero_key_(false), zero_key_value_(0) {
+  slots_ = new Slot[INITIAL_TABLE_SLOTS];
+  memset(slots_, 0, INITIAL_TABLE_SLOTS * sizeof(Slot));
+}
+
+RotatingMap::Table::~Table() { delete[] slots_; }
+
+sp_uint64 RotatingMap::Table::index(sp_int64 _key) const {
+  // Tuple keys are random, but mix them anyway so that
+  // sequential keys do not end up in one long run
+  sp_uint64 h = static_cast<sp_uint64>(_key) * 0x9E3779B97F4A7C15ULL;
+  return (h ^ (h >> 32)) & mask_;
+}
+
+sp_int64* RotatingMap::Table::find(sp_int64 _key) {
+  if (_key == 0) {
+    return has_zero_key_ ? &zero_key_value_ : NULL;
+  }
+  for (sp_uint64 i = index(_key);; i = (i + 1) & mask_) {
+    if (slots_[i].key_ == _key) return &slots_[i].value_;
+    if (slots_[i].key_ == 0) return NULL;
+  }
+}
+
+void RotatingMap::Table::insert(sp_int64 _key, sp_int64 _value) {
+  if (_key == 0) {
+    has_zero_key_ = true;
+    zero_key_value_ = _value;
+    return;
+  }
+  // Keep the table at most half full so that probe runs stay short
+  if ((size_ + 1) * 2 > mask_ + 1) {
+    grow();
+  }
+  sp_uint64 i = index(_key);
+  while (slots_[i].key_ != 0 && slots_[i].key_ != _key) {
+    i = (i + 1) & mask_;
+  }
+  if (slots_[i].key_ == 0) {
+    slots_[i].key_ = _key;
+    ++size_;
+  }
+  slots_[i].value_ = _value;
+}
+
+bool RotatingMap::Table::erase(sp_int64 _key) {
+  if (_key == 0) {
+    bool present = has_zero_key_;
+    has_zero_key_ = false;
+    return present;
+  }
+  sp_uint64 i = index(_key);
+  while (slots_[i].key_ != _key) {
+    if (slots_[i].key_ == 0) return false;
+    i = (i + 1) & mask_;
+  }
+  // Shift the following entries of the run back into the hole,
+  // unless that would move them in front of their home slot
+  for (sp_uint64 j = (i + 1) & mask_; slots_[j].key_ != 0; j = (j + 1) & mask_) {
+    sp_uint64 home = index(slots_[j].key_);
+    if (((j - home) & mask_) >= ((j - i) & mask_)) {
+      slots_[i] = slots_[j];
+      i = j;
+    }
+  }
+  slots_[i].key_ = 0;
+  --size_;
+  return true;
+}
+
+void RotatingMap::Table::clear() {
+  if (size_ > 0) {
+    memset(slots_, 0, (mask_ + 1) * sizeof(Slot));
+    size_ = 0;
+  }
+  has_zero_key_ = false;
+}
+
+void RotatingMap::Table::grow() {
+  Slot* old_slots = slots_;
+  sp_uint64 old_nslots = mask_ + 1;
+  mask_ = old_nslots * 2 - 1;
+  slots_ = new Slot[mask_ + 1];
+  memset(slots_, 0, (mask_ + 1) * sizeof(Slot));
+  for (sp_uint64 i = 0; i < old_nslots; ++i) {
+    if (old_slots[i].key_ == 0) continue;
+    sp_uint64 j = index(old_slots[i].key_);
+    while (slots_[j].key_ != 0) {
+      j = (j + 1) & mask_;
+    }
+    slots_[j] = old_slots[i];
+  }
+  delete[] old_slots;
+}
+
 }  // namespace stmgr
 }  // namespace heron
@@ -17,8 +17,7 @@
 #ifndef SRC_CPP_SVCS_STMGR_SRC_UTIL_ROTATING_MAP_H_
 #define SRC_CPP_SVCS_STMGR_SRC_UTIL_ROTATING_MAP_H_
 
-#include <unordered_map>
-#include <list>
+#include <vector>
 #include "proto/messages.h"
 #include "basics/basics.h"
 #include "network/network.h"
@@ -26,21 +25,26 @@
 namespace heron {
 namespace stmgr {
 
-// Rotating Map maintains a list of unordered maps.
-// Every time a rotate is called, it drops the
-// last map and intantiates a new map at the head
-// of the list. The create operation adds elements
-// to the front map of the list. The anchor and remove
+// Rotating Map maintains a ring of nbuckets hash tables.
+// Every time a rotate is called, it recycles the oldest
+// table as the new front of the ring. The create operation
+// adds elements to the front table. The anchor and remove
 // operation do their operations starting from the
-// front of the list to the back.
+// front table to the oldest one.
+//
+// Each table uses open addressing with linear probing over a flat
+// array of 16 byte slots, so there is no allocation per entry and
+// a lookup usually touches a single cache line. Tables are kept
+// across rotations and only grow, so a steady stream of tuples does
+// not allocate or free any memory.
 class RotatingMap {
  public:
   // Creates a rotating map with _nbuckets maps
   explicit RotatingMap(sp_int32 _nbuckets);
   ~RotatingMap();
 
-  // Deletes the last map on the list and
-  // instantiates a new map at the front of the list
+  // Clears the oldest table and makes it
+  // the front of the ring
   void rotate();
 
   // Adds an item to the map at the front of the list
@@ -58,8 +62,44 @@ class RotatingMap {
   // from some map. False otherwise.
   bool remove(sp_int64 _key);
 
+  // Hints that _key is about to be looked up, so that
+  // its slots can be brought into the cache meanwhile
+  void prefetch(sp_int64 _key) const;
+
  private:
-  std::list<std::unordered_map<sp_int64, sp_int64>*> buckets_;
+  struct Slot {
+    sp_int64 key_;
+    sp_int64 value_;
+  };
+
+  // Open addressing table. A key of 0 marks an empty slot, so
+  // the key 0 itself is kept outside of the slots.
+  class Table {
+   public:
+    Table();
+    ~Table();
+
+    // Returns the value of _key, or NULL if it is not present
+    sp_int64* find(sp_int64 _key);
+    void insert(sp_int64 _key, sp_int64 _value);
+    bool erase(sp_int64 _key);
+    void clear();
+    void prefetch(sp_int64 _key) const { __builtin_prefetch(&slots_[index(_key)]); }
+
+   private:
+    sp_uint64 index(sp_int64 _key) const;
+    void grow();
+
+    Slot* slots_;
+    sp_uint64 mask_;
+    sp_uint64 size_;
+    bool has_zero_key_;
+    sp_int64 zero_key_value_;
+  };
+
+  std::vector<Table*> tables_;
+  // Position of the front table in tables_
+  sp_uint32 front_;
 };
 
 }  // namespace stmgr
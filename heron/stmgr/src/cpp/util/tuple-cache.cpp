@@ -15,9 +15,11 @@
  */
 
 #include "util/tuple-cache.h"
+#include <google/protobuf/io/coded_stream.h>
 #include <iostream>
 #include <map>
 #include <string>
+#include <vector>
 #include "proto/messages.h"
 #include "basics/basics.h"
 #include "errors/errors.h"
@@ -28,6 +30,13 @@
 namespace heron {
 namespace stmgr {
 
+// HeronDataTuple's key is field 1 and is a sfixed64. Fields are serialized
+// in field number order, so a serialized tuple always starts with the one
+// byte tag for the key followed by its 8 byte little endian value.
+const sp_uint8 DATA_TUPLE_KEY_TAG = (1 << 3) | 1;
+const sp_uint32 DATA_TUPLE_KEY_OFFSET = 1;
+const sp_uint32 DATA_TUPLE_KEY_SIZE = 8;
+
 TupleCache::TupleCache(EventLoop* eventLoop, sp_uint32 _drain_threshold)
     : eventLoop_(eventLoop), drain_threshold_bytes_(_drain_threshold) {
   cache_drain_frequency_ms_ =
@@ -53,12 +62,54 @@ TupleCache::~TupleCache() {
 sp_int64 TupleCache::add_data_tuple(sp_int32 _src_task_id,
                                     sp_int32 _task_id, const proto::api::StreamId& _streamid,
                                     proto::system::HeronDataTuple* _tuple) {
+  sp_string serialized_tuple;
+  serialize_data_tuple(_tuple, &serialized_tuple);
+  sp_int64 tuple_key = add_data_tuple(_src_task_id, _task_id, _streamid,
+                                      _tuple->roots_size() > 0, serialized_tuple);
+  // Override in place
+  _tuple->set_key(tuple_key);
+  return tuple_key;
+}
+
+sp_int64 TupleCache::add_data_tuple(sp_int32 _src_task_id,
+                                    sp_int32 _task_id, const proto::api::StreamId& _streamid,
+                                    bool _anchored, const sp_string& _serialized_tuple) {
   if (total_size_ >= drain_threshold_bytes_) drain_impl();
   TupleList* l = get(_task_id);
-  return l->add_data_tuple(_src_task_id, _streamid, _tuple, &total_size_,
+  return l->add_data_tuple(_src_task_id, _streamid, _anchored, _serialized_tuple, &total_size_,
                            &tuples_cache_max_tuple_size_);
 }
 
+void TupleCache::add_data_tuples(sp_int32 _src_task_id,
+                                 sp_int32 _task_id, const proto::api::StreamId& _streamid,
+                                 const std::vector<sp_string>& _serialized_tuples,
+                                 const std::vector<bool>& _anchored,
+                                 const sp_int32* _begin, const sp_int32* _end,
+                                 std::vector<sp_int64>& _keys) {
+  // Draining keeps the lists, so the one of _task_id is looked up once
+  TupleList* l = get(_task_id);
+  for (const sp_int32* i = _begin; i != _end; ++i) {
+    if (total_size_ >= drain_threshold_bytes_) drain_impl();
+    _keys[*i] = l->add_data_tuple(_src_task_id, _streamid, _anchored[*i], _serialized_tuples[*i],
+                                  &total_size_, &tuples_cache_max_tuple_size_);
+  }
+}
+
+void TupleCache::serialize_data_tuple(proto::system::HeronDataTuple* _tuple,
+                                      sp_string* _serialized_tuple) {
+  // The key gets patched in later for every destination
+  _tuple->set_key(0);
+  _tuple->SerializePartialToString(_serialized_tuple);
+  CHECK_GE(_serialized_tuple->size(), DATA_TUPLE_KEY_OFFSET + DATA_TUPLE_KEY_SIZE);
+  CHECK_EQ(static_cast<sp_uint8>((*_serialized_tuple)[0]), DATA_TUPLE_KEY_TAG);
+}
+
+void TupleCache::set_serialized_tuple_key(sp_int64 _key, sp_string* _serialized_tuple) {
+  google::protobuf::io::CodedOutputStream::WriteLittleEndian64ToArray(
+      static_cast<google::protobuf::uint64>(_key),
+      reinterpret_cast<google::protobuf::uint8*>(&(*_serialized_tuple)[DATA_TUPLE_KEY_OFFSET]));
+}
+
 void TupleCache::add_ack_tuple(sp_int32 _src_task_id,
                                sp_int32 _task_id, const proto::system::AckTuple& _tuple) {
   if (total_size_ >= drain_threshold_bytes_) drain_impl();
@@ -144,7 +195,8 @@ void TupleCache::TupleList::clear() {
 
 sp_int64 TupleCache::TupleList::add_data_tuple(sp_int32 _src_task_id,
                                                const proto::api::StreamId& _streamid,
-                                               proto::system::HeronDataTuple* _tuple,
+                                               bool _anchored,
+                                               const sp_string& _serialized_tuple,
                                                sp_uint64* _total_size,
                                                sp_uint64* _tuples_cache_max_tuple_size) {
   if (!current_ || current_->has_control() || current_->src_task_id() != _src_task_id ||
@@ -161,16 +213,17 @@ sp_int64 TupleCache::TupleList::add_data_tuple(sp_int32 _src_task_id,
   }
 
   sp_int64 tuple_key = 0;
-  if (_tuple->roots_size() > 0) {
+  if (_anchored) {
      tuple_key = RandUtils::lrand();
   }
-  // Override in place
-  _tuple->set_key(tuple_key);
 
   std::string* added_tuple = current_->mutable_data()->add_tuples();
-  _tuple->SerializePartialToString(added_tuple);
+  added_tuple->assign(_serialized_tuple);
+  if (tuple_key != 0) {
+    TupleCache::set_serialized_tuple_key(tuple_key, added_tuple);
+  }
 
-  sp_int64 tuple_size = _tuple->GetCachedSize();
+  sp_int64 tuple_size = _serialized_tuple.size();
   current_size_ += tuple_size;
   *_total_size += tuple_size;
   return tuple_key;
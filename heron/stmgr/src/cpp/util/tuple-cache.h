@@ -49,6 +49,22 @@ class TupleCache {
   sp_int64 add_data_tuple(sp_int32 _src_task_id,
                           sp_int32 _task_id, const proto::api::StreamId& _streamid,
                           proto::system::HeronDataTuple* _tuple);
+  // Same as above, but for a tuple that was already serialized using
+  // serialize_data_tuple. This lets a tuple going to several destinations
+  // be serialized once; only its key is patched per destination.
+  // returns tuple key
+  sp_int64 add_data_tuple(sp_int32 _src_task_id,
+                          sp_int32 _task_id, const proto::api::StreamId& _streamid,
+                          bool _anchored, const sp_string& _serialized_tuple);
+  // Same as above, for the run of tuples _serialized_tuples[*i], for i in
+  // [_begin, _end), that all go to _task_id. The key of each tuple is put
+  // in _keys at its index.
+  void add_data_tuples(sp_int32 _src_task_id,
+                       sp_int32 _task_id, const proto::api::StreamId& _streamid,
+                       const std::vector<sp_string>& _serialized_tuples,
+                       const std::vector<bool>& _anchored,
+                       const sp_int32* _begin, const sp_int32* _end,
+                       std::vector<sp_int64>& _keys);
   void add_ack_tuple(sp_int32 _src_task_id,
                      sp_int32 _task_id, const proto::system::AckTuple& _tuple);
   void add_fail_tuple(sp_int32 _src_task_id,
@@ -61,6 +77,15 @@ class TupleCache {
   // Clear all data of all task_ids
   void clear();
 
+  // Serializes _tuple with a placeholder key, suitable for the
+  // serialized form of add_data_tuple
+  static void serialize_data_tuple(proto::system::HeronDataTuple* _tuple,
+                                   sp_string* _serialized_tuple);
+  // Overwrites the key of a tuple serialized by serialize_data_tuple.
+  // The key is a fixed width field serialized first, so this is a
+  // simple in place write
+  static void set_serialized_tuple_key(sp_int64 _key, sp_string* _serialized_tuple);
+
  private:
   void drain(EventLoop::Status);
   void drain_impl();
@@ -75,7 +100,8 @@ class TupleCache {
 
     sp_int64 add_data_tuple(sp_int32 _src_task_id,
                             const proto::api::StreamId& _streamid,
-                            proto::system::HeronDataTuple* _tuple, sp_uint64* total_size_,
+                            bool _anchored, const sp_string& _serialized_tuple,
+                            sp_uint64* total_size_,
                             sp_uint64* _tuples_cache_max_tuple_size);
     void add_ack_tuple(sp_int32 _src_task_id,
                        const proto::system::AckTuple& _tuple, sp_uint64* total_size_);
@@ -76,5 +76,65 @@ bool XorManager::remove(sp_int32 _task_id, sp_int64 _key) {
   return tasks_[_task_id]->remove(_key);
 }
 
+void XorManager::process(sp_int32 _task_id, const proto::system::HeronControlTupleSet& _control,
+                         std::vector<sp_int64>* _acked, std::vector<sp_int64>* _failed) {
+  auto iter = tasks_.find(_task_id);
+  CHECK(iter != tasks_.end());
+  RotatingMap* map = iter->second;
+  _acked->clear();
+  _acked->reserve(_control.acks_size());
+  _failed->clear();
+  _failed->reserve(_control.fails_size());
+
+  // Each lookup is a likely cache miss, so start fetching the slots
+  // of the tuple a few positions ahead of the one being processed
+  const sp_int32 prefetch_distance = 4;
+  auto prefetch = [map](const google::protobuf::RepeatedPtrField<proto::system::AckTuple>& _tuples,
+                        sp_int32 _index) {
+    if (_index < _tuples.size()) {
+      const proto::system::AckTuple& tuple = _tuples.Get(_index);
+      for (sp_int32 j = 0; j < tuple.roots_size(); ++j) {
+        map->prefetch(tuple.roots(j).key());
+      }
+    }
+  };
+
+  for (sp_int32 i = 0; i < prefetch_distance; ++i) prefetch(_control.emits(), i);
+  for (sp_int32 i = 0; i < _control.emits_size(); ++i) {
+    prefetch(_control.emits(), i + prefetch_distance);
+    const proto::system::AckTuple& ack_tuple = _control.emits(i);
+    for (sp_int32 j = 0; j < ack_tuple.roots_size(); ++j) {
+      CHECK_EQ(_task_id, ack_tuple.roots(j).taskid());
+      CHECK(!map->anchor(ack_tuple.roots(j).key(), ack_tuple.ackedtuple()));
+    }
+  }
+
+  for (sp_int32 i = 0; i < prefetch_distance; ++i) prefetch(_control.acks(), i);
+  for (sp_int32 i = 0; i < _control.acks_size(); ++i) {
+    prefetch(_control.acks(), i + prefetch_distance);
+    const proto::system::AckTuple& ack_tuple = _control.acks(i);
+    for (sp_int32 j = 0; j < ack_tuple.roots_size(); ++j) {
+      CHECK_EQ(_task_id, ack_tuple.roots(j).taskid());
+      if (map->anchor(ack_tuple.roots(j).key(), ack_tuple.ackedtuple())) {
+        // This tuple tree is all over
+        CHECK(map->remove(ack_tuple.roots(j).key()));
+        _acked->push_back(ack_tuple.roots(j).key());
+      }
+    }
+  }
+
+  for (sp_int32 i = 0; i < prefetch_distance; ++i) prefetch(_control.fails(), i);
+  for (sp_int32 i = 0; i < _control.fails_size(); ++i) {
+    prefetch(_control.fails(), i + prefetch_distance);
+    const proto::system::AckTuple& fail_tuple = _control.fails(i);
+    for (sp_int32 j = 0; j < fail_tuple.roots_size(); ++j) {
+      CHECK_EQ(_task_id, fail_tuple.roots(j).taskid());
+      if (map->remove(fail_tuple.roots(j).key())) {
+        _failed->push_back(fail_tuple.roots(j).key());
+      }
+    }
+  }
+}
+
 }  // namespace stmgr
 }  // namespace heron
@@ -55,6 +55,15 @@ class XorManager {
   // return true if this key was found. else false
   bool remove(sp_int32 _task_id, sp_int64 _key);
 
+  // Process all the emits, acks and fails in _control in one pass.
+  // All of them must be for tuples that originated from _task_id.
+  // Emits are anchored first, so that new emits keep a tuple tree
+  // alive before its acks are seen. The keys of the tuple trees that
+  // are now fully acked are removed and returned in _acked, and the
+  // keys of the failed ones that we were still tracking in _failed.
+  void process(sp_int32 _task_id, const proto::system::HeronControlTupleSet& _control,
+               std::vector<sp_int64>* _acked, std::vector<sp_int64>* _failed);
+
  private:
   void rotate(EventLoopImpl::Status _status);
 
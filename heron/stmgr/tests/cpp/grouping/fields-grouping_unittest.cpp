@@ -17,6 +17,7 @@
 #include <list>
 #include <set>
 #include <sstream>
+#include <string>
 #include <vector>
 #include "grouping/grouping.h"
 #include "grouping/fields-grouping.h"
@@ -119,6 +120,124 @@ TEST(FieldsGrouping, test_hashonlyrelavant) {
   delete g;
 }
 
+// Makes a fields grouping on the first _nfields of three fields
+heron::stmgr::FieldsGrouping* CreateGrouping(sp_int32 _nfields,
+                                             const std::vector<sp_int32>& _task_ids,
+                                             heron::stmgr::FieldsHash _fields_hash) {
+  heron::proto::api::InputStream is;
+  heron::proto::api::StreamSchema schema;
+  for (sp_int32 i = 0; i < 3; ++i) {
+    std::ostringstream o;
+    o << "field" << i;
+    heron::proto::api::StreamSchema::KeyType* kt = schema.add_keys();
+    kt->set_type(heron::proto::api::OBJECT);
+    kt->set_key(o.str());
+    if (i < _nfields) {
+      is.mutable_grouping_fields()->add_keys()->CopyFrom(*kt);
+    }
+  }
+  return new heron::stmgr::FieldsGrouping(is, schema, _task_ids, _fields_hash);
+}
+
+void FillTuples(sp_int32 _ntuples, heron::proto::system::HeronDataTupleSet& _tuples) {
+  for (sp_int32 i = 0; i < _ntuples; ++i) {
+    heron::proto::system::HeronDataTuple* tuple = _tuples.add_tuples();
+    std::ostringstream o;
+    o << "key " << i;
+    tuple->add_values(o.str());
+    tuple->add_values(std::string(i % 50, 'x'));
+    tuple->add_values(o.str() + " of a value long enough to be hashed 32 bytes at a time");
+  }
+}
+
+// Test that the legacy hash still sends every tuple where it always has,
+// so that keyed state stays where it is
+TEST(FieldsGrouping, test_legacy_mapping) {
+  std::hash<sp_string> str_hash_fn;
+  for (sp_int32 ntasks : {1, 7, 100, 1024}) {
+    std::vector<sp_int32> task_ids;
+    for (sp_int32 i = 0; i < ntasks; ++i) {
+      task_ids.push_back(i * 3);
+    }
+    heron::proto::system::HeronDataTupleSet tuples;
+    FillTuples(1000, tuples);
+    for (sp_int32 nfields = 1; nfields <= 3; ++nfields) {
+      heron::stmgr::FieldsGrouping* g =
+          CreateGrouping(nfields, task_ids, heron::stmgr::FIELDS_HASH_LEGACY);
+      for (sp_int32 i = 0; i < tuples.tuples_size(); ++i) {
+        sp_int32 task_index = 0;
+        for (sp_int32 j = 0; j < nfields; ++j) {
+          task_index += str_hash_fn(tuples.tuples(i).values(j)) % 633910111UL;
+        }
+        task_index = task_index % task_ids.size();
+
+        std::vector<sp_int32> dest;
+        g->GetListToSend(tuples.tuples(i), dest);
+        ASSERT_EQ(dest.size(), (sp_uint32)1);
+        EXPECT_EQ(dest.front(), task_ids[task_index]);
+      }
+      delete g;
+    }
+  }
+}
+
+// Test that a batch goes where its tuples go one by one
+TEST(FieldsGrouping, test_batch) {
+  std::vector<sp_int32> task_ids;
+  for (sp_int32 i = 0; i < 37; ++i) {
+    task_ids.push_back(i);
+  }
+  heron::proto::system::HeronDataTupleSet tuples;
+  FillTuples(500, tuples);
+
+  for (auto fields_hash : {heron::stmgr::FIELDS_HASH_LEGACY, heron::stmgr::FIELDS_HASH_FAST}) {
+    heron::stmgr::FieldsGrouping* g = CreateGrouping(3, task_ids, fields_hash);
+    std::vector<sp_int32> batch(1, -1);
+    g->GetListToSend(tuples, batch);
+    ASSERT_EQ(batch.size(), (size_t)tuples.tuples_size() + 1);
+    EXPECT_EQ(batch.front(), -1);
+    for (sp_int32 i = 0; i < tuples.tuples_size(); ++i) {
+      std::vector<sp_int32> dest;
+      g->GetListToSend(tuples.tuples(i), dest);
+      EXPECT_EQ(batch[i + 1], dest.front());
+    }
+    delete g;
+  }
+}
+
+// Test that the fast hash sends a key to one task, and spreads keys
+// evenly over all tasks
+TEST(FieldsGrouping, test_fast_spread) {
+  std::vector<sp_int32> task_ids;
+  for (sp_int32 i = 0; i < 100; ++i) {
+    task_ids.push_back(i);
+  }
+  heron::stmgr::FieldsGrouping* g = CreateGrouping(2, task_ids, heron::stmgr::FIELDS_HASH_FAST);
+
+  std::vector<sp_int32> counts(task_ids.size(), 0);
+  for (sp_int32 i = 0; i < 100000; ++i) {
+    heron::proto::system::HeronDataTuple tuple;
+    std::ostringstream o;
+    o << i;
+    tuple.add_values(o.str());
+    tuple.add_values("same");
+    tuple.add_values(o.str());
+
+    std::vector<sp_int32> dest;
+    g->GetListToSend(tuple, dest);
+    g->GetListToSend(tuple, dest);
+    ASSERT_EQ(dest.size(), (sp_uint32)2);
+    EXPECT_EQ(dest[0], dest[1]);
+    counts[dest[0]]++;
+  }
+  for (auto count : counts) {
+    EXPECT_GT(count, 800);
+    EXPECT_LT(count, 1200);
+  }
+
+  delete g;
+}
+
 int main(int argc, char** argv) {
   heron::common::Initialize(argv[0]);
   testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <map>
+#include <set>
+#include <sstream>
+#include <utility>
+#include <vector>
+#include "gtest/gtest.h"
+#include "proto/messages.h"
+#include "basics/basics.h"
+#include "errors/errors.h"
+#include "threads/threads.h"
+#include "network/network.h"
+
+#include "basics/modinit.h"
+#include "errors/modinit.h"
+#include "threads/modinit.h"
+#include "network/modinit.h"
+
+#include "grouping/grouping.h"
+#include "grouping/tuple-routes.h"
+
+// Gets the tuple indices of every task of _routes
+std::map<sp_int32, std::vector<sp_int32>> Runs(const heron::stmgr::TupleRoutes& _routes) {
+  std::map<sp_int32, std::vector<sp_int32>> runs;
+  for (size_t i = 0; i < _routes.NumTasks(); ++i) {
+    EXPECT_TRUE(runs.find(_routes.Task(i)) == runs.end());
+    runs[_routes.Task(i)].assign(_routes.Begin(i), _routes.End(i));
+  }
+  return runs;
+}
+
+// Test that routes are laid out by task, keeping the order of the tuples
+TEST(TupleRoutes, test_group) {
+  heron::stmgr::TupleRoutes routes;
+  routes.Group();
+  EXPECT_EQ(routes.NumTasks(), (size_t)0);
+
+  for (sp_int32 round = 0; round < 2; ++round) {
+    routes.Clear();
+    routes.Add(0, 7);
+    routes.Add(0, 3);
+    routes.Add(1, 7);
+    routes.Add(2, 5);
+    routes.Add(2, 3);
+    routes.Add(2, 3);
+    routes.Add(3, 7);
+    routes.Group();
+
+    ASSERT_EQ(routes.NumTasks(), (size_t)3);
+    EXPECT_EQ(routes.Task(0), 3);
+    EXPECT_EQ(routes.Task(1), 5);
+    EXPECT_EQ(routes.Task(2), 7);
+    std::map<sp_int32, std::vector<sp_int32>> runs = Runs(routes);
+    EXPECT_EQ(runs[3], std::vector<sp_int32>({0, 2, 2}));
+    EXPECT_EQ(runs[5], std::vector<sp_int32>({2}));
+    EXPECT_EQ(runs[7], std::vector<sp_int32>({0, 1, 3}));
+  }
+}
+
+// Test that the groupings route a tuple set just like its tuples one by one
+TEST(TupleRoutes, test_groupings) {
+  std::vector<sp_int32> task_ids;
+  for (sp_int32 i = 0; i < 10; ++i) {
+    task_ids.push_back(10 - i);
+  }
+
+  heron::proto::api::InputStream is;
+  heron::proto::api::StreamSchema schema;
+  heron::proto::api::StreamSchema::KeyType* kt = schema.add_keys();
+  kt->set_type(heron::proto::api::OBJECT);
+  kt->set_key("field1");
+  is.mutable_grouping_fields()->add_keys()->CopyFrom(*kt);
+
+  heron::proto::system::HeronDataTupleSet tuples;
+  for (sp_int32 i = 0; i < 200; ++i) {
+    std::ostringstream o;
+    o << "key " << i;
+    tuples.add_tuples()->add_values(o.str());
+  }
+
+  for (auto gtype : {heron::proto::api::FIELDS, heron::proto::api::ALL,
+                     heron::proto::api::LOWEST}) {
+    heron::stmgr::Grouping* g = heron::stmgr::Grouping::Create(gtype, is, schema, task_ids);
+    std::map<sp_int32, std::vector<sp_int32>> expected;
+    for (sp_int32 i = 0; i < tuples.tuples_size(); ++i) {
+      std::vector<sp_int32> dests;
+      g->GetListToSend(tuples.tuples(i), dests);
+      for (auto dest : dests) {
+        expected[dest].push_back(i);
+      }
+    }
+
+    heron::stmgr::TupleRoutes routes;
+    g->GetRoutes(tuples, routes);
+    routes.Group();
+    EXPECT_EQ(Runs(routes), expected);
+    delete g;
+  }
+
+  // shuffle grouping sends every tuple once, going round the tasks
+  heron::stmgr::Grouping* g =
+      heron::stmgr::Grouping::Create(heron::proto::api::SHUFFLE, is, schema, task_ids);
+  heron::stmgr::TupleRoutes routes;
+  g->GetRoutes(tuples, routes);
+  routes.Group();
+  EXPECT_EQ(routes.NumTasks(), task_ids.size());
+  std::set<sp_int32> indices;
+  for (size_t i = 0; i < routes.NumTasks(); ++i) {
+    EXPECT_EQ(routes.End(i) - routes.Begin(i), tuples.tuples_size() / 10);
+    indices.insert(routes.Begin(i), routes.End(i));
+  }
+  EXPECT_EQ(indices.size(), (size_t)tuples.tuples_size());
+  delete g;
+}
+
+int main(int argc, char** argv) {
+  heron::common::Initialize(argv[0]);
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "loadgen/load-stats.h"
+#include <algorithm>
+#include <ostream>
+#include <string>
+#include "basics/basics.h"
+
+namespace heron {
+namespace testing {
+
+namespace {
+// the values under 8 have a bucket each, and every power of two from 8 to
+// 2^62 has 8
+const size_t SUB_BUCKET_BITS = 3;
+const size_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+const size_t NUM_BUCKETS = (64 - SUB_BUCKET_BITS) * SUB_BUCKETS;
+}  // namespace
+
+LatencyHistogram::LatencyHistogram() : buckets_(NUM_BUCKETS, 0), count_(0), sum_(0), max_(0) {}
+
+size_t LatencyHistogram::Bucket(sp_int64 _micros) {
+  sp_uint64 value = _micros;
+  if (value < SUB_BUCKETS) return value;
+  size_t msb = 63 - __builtin_clzll(value);
+  size_t shift = msb - SUB_BUCKET_BITS;
+  return (shift + 1) * SUB_BUCKETS + ((value >> shift) & (SUB_BUCKETS - 1));
+}
+
+sp_int64 LatencyHistogram::BucketLimit(size_t _bucket) {
+  if (_bucket < SUB_BUCKETS) return _bucket;
+  size_t shift = _bucket / SUB_BUCKETS - 1;
+  sp_uint64 first = (SUB_BUCKETS + _bucket % SUB_BUCKETS) << shift;
+  return first + (static_cast<sp_uint64>(1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(sp_int64 _micros) {
+  if (_micros < 0) _micros = 0;
+  ++buckets_[Bucket(_micros)];
+  ++count_;
+  sum_ += _micros;
+  max_ = std::max(max_, _micros);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& _other) {
+  for (size_t i = 0; i < NUM_BUCKETS; ++i) buckets_[i] += _other.buckets_[i];
+  count_ += _other.count_;
+  sum_ += _other.sum_;
+  max_ = std::max(max_, _other.max_);
+}
+
+sp_int64 LatencyHistogram::Percentile(double _percent) const {
+  if (count_ == 0) return 0;
+  sp_int64 rank = std::max<sp_int64>(1, static_cast<sp_int64>(count_ * _percent / 100 + 0.5));
+  sp_int64 seen = 0;
+  for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+    seen += buckets_[i];
+    if (seen >= rank) return std::min(BucketLimit(i), max_);
+  }
+  return max_;
+}
+
+void LatencyHistogram::Print(std::ostream& _out, const std::string& _name) const {
+  _out << _name << ": count " << count_ << " mean " << Mean() << "us p50 " << Percentile(50)
+       << "us p90 " << Percentile(90) << "us p99 " << Percentile(99) << "us max " << max_
+       << "us" << std::endl;
+}
+
+LoadStats::LoadStats()
+    : tuples_emitted_(0),
+      bytes_emitted_(0),
+      tuples_received_(0),
+      tuples_anchored_(0),
+      tuples_acked_(0),
+      tuples_failed_(0),
+      spout_blocked_micros_(0),
+      metrics_published_(0) {}
+
+void LoadStats::ResetTraffic() {
+  tuples_emitted_ = 0;
+  bytes_emitted_ = 0;
+  tuples_received_ = 0;
+  tuples_anchored_ = 0;
+  tuples_acked_ = 0;
+  tuples_failed_ = 0;
+  latency_ = LatencyHistogram();
+  ack_latency_ = LatencyHistogram();
+  spout_blocked_micros_ = 0;
+  heartbeat_rtt_ = LatencyHistogram();
+  metrics_published_ = 0;
+}
+
+}  // namespace testing
+}  // namespace heron
@@ -0,0 +1,97 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __LOAD_STATS_H
+#define __LOAD_STATS_H
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "basics/basics.h"
+
+namespace heron {
+namespace testing {
+
+// microseconds on the steady clock, which every thread of the process shares
+inline sp_int64 NowMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// A histogram of latencies in microseconds. Every power of two is split
+// into 8 buckets, so a percentile is off by at most an eighth.
+class LatencyHistogram {
+ public:
+  LatencyHistogram();
+
+  void Record(sp_int64 _micros);
+  void Merge(const LatencyHistogram& _other);
+
+  sp_int64 Count() const { return count_; }
+  sp_int64 Max() const { return max_; }
+  sp_int64 Mean() const { return count_ ? sum_ / count_ : 0; }
+  // the latency that _percent percent of the samples are at or under
+  sp_int64 Percentile(double _percent) const;
+
+  // write count, mean, p50, p90, p99 and max on one line
+  void Print(std::ostream& _out, const std::string& _name) const;
+
+ private:
+  static size_t Bucket(sp_int64 _micros);
+  // the highest latency that falls into the bucket
+  static sp_int64 BucketLimit(size_t _bucket);
+
+  std::vector<sp_int64> buckets_;
+  sp_int64 count_;
+  sp_int64 sum_;
+  sp_int64 max_;
+};
+
+// What the simulated instances and stream managers saw. They all run on
+// the one load generator loop, so nothing here is locked.
+struct LoadStats {
+  LoadStats();
+
+  // start counting the traffic afresh, when the warm up is over
+  void ResetTraffic();
+
+  // stmgr mode
+  sp_int64 tuples_emitted_;
+  sp_int64 bytes_emitted_;
+  sp_int64 tuples_received_;
+  sp_int64 tuples_anchored_;
+  sp_int64 tuples_acked_;
+  sp_int64 tuples_failed_;
+  // emit to receive, at a bolt or a simulated stmgr
+  LatencyHistogram latency_;
+  // emit to the ack reaching the spout
+  LatencyHistogram ack_latency_;
+  // how long spouts could not emit because the stmgr did not drain them
+  sp_int64 spout_blocked_micros_;
+
+  // both modes
+  LatencyHistogram register_latency_;
+  LatencyHistogram heartbeat_rtt_;
+  sp_int64 metrics_published_;
+};
+
+}  // namespace testing
+}  // namespace heron
+
+#endif
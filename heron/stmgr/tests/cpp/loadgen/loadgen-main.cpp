@@ -0,0 +1,552 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Puts load on a real stmgr or tmaster from simulated instances and stmgrs,
+// all in this one process, and reports what it saw.
+//
+// In stmgr mode a real tmaster and a real stmgr run on their own threads.
+// All the spouts and a share of the bolts are simulated instances of the
+// real stmgr, and the other bolts live on simulated stmgrs that the real
+// one sends tuples to. The report has the throughput, the latency from
+// emit to bolt and from emit to ack, and how long there was back pressure.
+//
+// In tmaster mode only the tmaster is real. The simulated stmgrs register,
+// heartbeat and publish the metrics of their instances, and the report has
+// the register latency, how long the physical plan took to reach all of
+// them, and the heartbeat round trip times.
+//
+// Usage: heron-loadgen --key=value ...
+//   mode                stmgr or tmaster (stmgr)
+//   spouts, bolts       number of components (1, 1)
+//   spout_parallelism   instances per spout (2)
+//   bolt_parallelism    instances per bolt (4)
+//   stmgrs              simulated stmgrs (1 in stmgr mode, 4 in tmaster mode)
+//   grouping            shuffle, fields or all (shuffle)
+//   tuple_size          payload bytes of a tuple (100)
+//   emit_rate           tuples per second of every spout instance (10000)
+//   ack_ratio           fraction of the tuples that are anchored (0)
+//   max_spout_pending   most anchored tuples per spout in flight, 0 for any (0)
+//   duration            seconds to measure, after everything is up (10)
+//   heartbeat_ms        heartbeat interval of the simulated stmgrs (the configured one)
+//   metrics_ms          metrics publish interval in tmaster mode, 0 for none (1000)
+//   base_port           first of the local ports to use (43000)
+//   config              heron internals config file
+//   metrics_sinks       metrics sinks config file of the tmaster
+
+#include <stdio.h>
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "proto/messages.h"
+#include "basics/basics.h"
+#include "errors/errors.h"
+#include "threads/threads.h"
+#include "network/network.h"
+#include "basics/modinit.h"
+#include "errors/modinit.h"
+#include "threads/modinit.h"
+#include "network/modinit.h"
+#include "config/heron-internals-config-reader.h"
+#include "config/topology-config-vars.h"
+#include "statemgr/heron-localfilestatemgr.h"
+#include "manager/tmaster.h"
+#include "manager/stmgr.h"
+#include "loadgen/load-stats.h"
+#include "loadgen/sim-instance.h"
+#include "loadgen/sim-metricsmgr.h"
+#include "loadgen/sim-stmgr.h"
+
+namespace {
+
+const sp_string LOCALHOST = "127.0.0.1";
+const sp_string TOPOLOGY_NAME = "loadgen";
+const sp_string TOPOLOGY_ID = "loadgen-id";
+const sp_string SPOUT_NAME = "spout";
+const sp_string BOLT_NAME = "bolt";
+const sp_string STREAM_NAME = "stream";
+const sp_string STMGR_NAME = "stmgr-";
+
+// how long everything has to come up, and how long the last tuples and
+// acks have to arrive after the spouts stop, in seconds
+const sp_int64 STARTUP_TIMEOUT = 120;
+const sp_int64 DRAIN_TIME = 2;
+
+struct LoadOptions {
+  sp_string mode_ = "stmgr";
+  sp_int32 spouts_ = 1;
+  sp_int32 bolts_ = 1;
+  sp_int32 spout_parallelism_ = 2;
+  sp_int32 bolt_parallelism_ = 4;
+  sp_int32 stmgrs_ = -1;
+  sp_string grouping_ = "shuffle";
+  sp_int32 tuple_size_ = 100;
+  sp_int32 emit_rate_ = 10000;
+  double ack_ratio_ = 0;
+  sp_int32 max_spout_pending_ = 0;
+  sp_int32 duration_ = 10;
+  sp_int32 heartbeat_ms_ = -1;
+  sp_int32 metrics_ms_ = 1000;
+  sp_int32 base_port_ = 43000;
+  sp_string config_ = "heron/config/src/yaml/conf/test/test_heron_internals.yaml";
+  sp_string metrics_sinks_ = "heron/config/src/yaml/conf/local/metrics_sinks.yaml";
+
+  bool stmgr_mode() const { return mode_ == "stmgr"; }
+};
+
+bool ParseOptions(int argc, char* argv[], LoadOptions& _options) {
+  std::map<sp_string, sp_string> values;
+  for (int i = 1; i < argc; ++i) {
+    sp_string arg = argv[i];
+    size_t equals = arg.find('=');
+    if (arg.compare(0, 2, "--") != 0 || equals == sp_string::npos) {
+      std::cerr << "Expected --key=value but got " << arg << std::endl;
+      return false;
+    }
+    values[arg.substr(2, equals - 2)] = arg.substr(equals + 1);
+  }
+
+  auto take = [&values](const sp_string& _key, sp_string& _value) {
+    auto iter = values.find(_key);
+    if (iter == values.end()) return;
+    _value = iter->second;
+    values.erase(iter);
+  };
+  auto take_int = [&values](const sp_string& _key, sp_int32& _value) {
+    auto iter = values.find(_key);
+    if (iter == values.end()) return;
+    _value = atoi(iter->second.c_str());
+    values.erase(iter);
+  };
+  take("mode", _options.mode_);
+  take_int("spouts", _options.spouts_);
+  take_int("bolts", _options.bolts_);
+  take_int("spout_parallelism", _options.spout_parallelism_);
+  take_int("bolt_parallelism", _options.bolt_parallelism_);
+  take_int("stmgrs", _options.stmgrs_);
+  take("grouping", _options.grouping_);
+  take_int("tuple_size", _options.tuple_size_);
+  take_int("emit_rate", _options.emit_rate_);
+  sp_string ack_ratio;
+  take("ack_ratio", ack_ratio);
+  if (!ack_ratio.empty()) _options.ack_ratio_ = atof(ack_ratio.c_str());
+  take_int("max_spout_pending", _options.max_spout_pending_);
+  take_int("duration", _options.duration_);
+  take_int("heartbeat_ms", _options.heartbeat_ms_);
+  take_int("metrics_ms", _options.metrics_ms_);
+  take_int("base_port", _options.base_port_);
+  take("config", _options.config_);
+  take("metrics_sinks", _options.metrics_sinks_);
+  if (!values.empty()) {
+    std::cerr << "Unknown option " << values.begin()->first << std::endl;
+    return false;
+  }
+
+  if (_options.stmgrs_ < 0) _options.stmgrs_ = _options.stmgr_mode() ? 1 : 4;
+  if (_options.mode_ != "stmgr" && _options.mode_ != "tmaster") {
+    std::cerr << "The mode must be stmgr or tmaster" << std::endl;
+    return false;
+  }
+  if (_options.grouping_ != "shuffle" && _options.grouping_ != "fields" &&
+      _options.grouping_ != "all") {
+    std::cerr << "The grouping must be shuffle, fields or all" << std::endl;
+    return false;
+  }
+  if (_options.spouts_ < 1 || _options.bolts_ < 1 || _options.spout_parallelism_ < 1 ||
+      _options.bolt_parallelism_ < 1 || _options.emit_rate_ < 1 || _options.duration_ < 1 ||
+      _options.tuple_size_ < 0 || _options.ack_ratio_ < 0 || _options.ack_ratio_ > 1) {
+    std::cerr << "The topology shape, rate, duration, tuple size or ack ratio is out of range"
+              << std::endl;
+    return false;
+  }
+  if (!_options.stmgr_mode() && _options.stmgrs_ < 1) {
+    std::cerr << "Tmaster mode needs at least one simulated stmgr" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Every spout has a stream of its own. Bolt i consumes the stream of spout
+// i modulo the number of spouts.
+heron::proto::api::Topology* GenerateTopology(const LoadOptions& _options) {
+  auto topology = new heron::proto::api::Topology();
+  topology->set_id(TOPOLOGY_ID);
+  topology->set_name(TOPOLOGY_NAME);
+  auto set_parallelism = [](heron::proto::api::Component* _component, sp_int32 _parallelism) {
+    heron::proto::api::Config::KeyValue* kv = _component->mutable_config()->add_kvs();
+    kv->set_key(heron::config::TopologyConfigVars::TOPOLOGY_COMPONENT_PARALLELISM);
+    kv->set_value(std::to_string(_parallelism));
+  };
+
+  for (sp_int32 i = 0; i < _options.spouts_; ++i) {
+    heron::proto::api::Spout* spout = topology->add_spouts();
+    heron::proto::api::Component* component = spout->mutable_comp();
+    component->set_name(SPOUT_NAME + std::to_string(i));
+    component->set_spec(heron::proto::api::JAVA_CLASS_NAME);
+    set_parallelism(component, _options.spout_parallelism_);
+    heron::proto::api::OutputStream* ostream = spout->add_outputs();
+    ostream->mutable_stream()->set_id(STREAM_NAME + std::to_string(i));
+    ostream->mutable_stream()->set_component_name(component->name());
+    heron::proto::api::StreamSchema* schema = ostream->mutable_schema();
+    schema->add_keys()->set_key("emit_time");
+    schema->add_keys()->set_key("payload");
+    for (sp_int32 k = 0; k < schema->keys_size(); ++k) {
+      schema->mutable_keys(k)->set_type(heron::proto::api::OBJECT);
+    }
+  }
+
+  heron::proto::api::Grouping grouping = heron::proto::api::SHUFFLE;
+  if (_options.grouping_ == "fields") grouping = heron::proto::api::FIELDS;
+  if (_options.grouping_ == "all") grouping = heron::proto::api::ALL;
+  for (sp_int32 i = 0; i < _options.bolts_; ++i) {
+    heron::proto::api::Bolt* bolt = topology->add_bolts();
+    heron::proto::api::Component* component = bolt->mutable_comp();
+    component->set_name(BOLT_NAME + std::to_string(i));
+    component->set_spec(heron::proto::api::JAVA_CLASS_NAME);
+    set_parallelism(component, _options.bolt_parallelism_);
+    heron::proto::api::InputStream* istream = bolt->add_inputs();
+    sp_int32 spout = i % _options.spouts_;
+    istream->mutable_stream()->set_id(STREAM_NAME + std::to_string(spout));
+    istream->mutable_stream()->set_component_name(SPOUT_NAME + std::to_string(spout));
+    istream->set_gtype(grouping);
+    if (grouping == heron::proto::api::FIELDS) {
+      // Group by the emit time, which spreads about evenly
+      heron::proto::api::StreamSchema::KeyType* key =
+          istream->mutable_grouping_fields()->add_keys();
+      key->set_key("emit_time");
+      key->set_type(heron::proto::api::OBJECT);
+    }
+  }
+
+  heron::proto::api::Config* config = topology->mutable_topology_config();
+  heron::proto::api::Config::KeyValue* kv = config->add_kvs();
+  kv->set_key(heron::config::TopologyConfigVars::TOPOLOGY_MESSAGE_TIMEOUT_SECS);
+  kv->set_value("30");
+  kv = config->add_kvs();
+  kv->set_key(heron::config::TopologyConfigVars::TOPOLOGY_ENABLE_ACKING);
+  kv->set_value(_options.ack_ratio_ > 0 ? "true" : "false");
+  topology->set_state(heron::proto::api::RUNNING);
+  return topology;
+}
+
+// The instances of every stmgr. In stmgr mode the real stmgr is the first
+// one, and it has all the spouts, so that all the tuples go through it.
+// The bolts are dealt out to all the stmgrs in turn.
+std::vector<std::vector<heron::proto::system::Instance>> PlaceInstances(
+    const LoadOptions& _options, const heron::proto::api::Topology& _topology) {
+  sp_int32 nstmgrs = _options.stmgrs_ + (_options.stmgr_mode() ? 1 : 0);
+  std::vector<std::vector<heron::proto::system::Instance>> placement(nstmgrs);
+  sp_int32 task_id = 0;
+  sp_int32 next_stmgr = 0;
+  auto place = [&_options, nstmgrs, &placement, &task_id, &next_stmgr](
+      const sp_string& _component, sp_int32 _parallelism, bool _spout) {
+    for (sp_int32 index = 0; index < _parallelism; ++index) {
+      sp_int32 stmgr = _spout && _options.stmgr_mode() ? 0 : next_stmgr++ % nstmgrs;
+      heron::proto::system::Instance instance;
+      instance.set_instance_id(std::to_string(stmgr) + "_" + _component + "_" +
+                               std::to_string(index));
+      instance.set_stmgr_id(STMGR_NAME + std::to_string(stmgr));
+      instance.mutable_info()->set_task_id(task_id++);
+      instance.mutable_info()->set_component_index(index);
+      instance.mutable_info()->set_component_name(_component);
+      placement[stmgr].push_back(instance);
+    }
+  };
+  for (sp_int32 i = 0; i < _topology.spouts_size(); ++i) {
+    place(_topology.spouts(i).comp().name(), _options.spout_parallelism_, true);
+  }
+  for (sp_int32 i = 0; i < _topology.bolts_size(); ++i) {
+    place(_topology.bolts(i).comp().name(), _options.bolt_parallelism_, false);
+  }
+  return placement;
+}
+
+NetworkOptions MakeNetworkOptions(sp_int32 _port) {
+  NetworkOptions options;
+  options.set_host(LOCALHOST);
+  options.set_port(_port);
+  options.set_max_packet_size(std::numeric_limits<sp_uint32>::max() - 1);
+  options.set_socket_family(PF_INET);
+  return options;
+}
+
+// Runs an event loop of one of the daemons. The loop needs a timer so that
+// it notices loopExit even when nothing else happens.
+void RunLoop(EventLoopImpl* _ss) {
+  _ss->registerTimer([](EventLoop::Status) {}, true, 1000 * 1000);
+  _ss->loop();
+}
+
+class LoadGenerator {
+ public:
+  LoadGenerator(EventLoopImpl* _ss, const LoadOptions& _options)
+      : ss_(_ss), options_(_options), begin_(0), end_(0), pplan_time_(-1) {}
+
+  ~LoadGenerator() {
+    for (auto instance : instances_) {
+      instance->Stop();
+      delete instance;
+    }
+    for (auto stmgr : stmgrs_) delete stmgr;
+  }
+
+  void Start(const std::vector<std::vector<heron::proto::system::Instance>>& _placement,
+             sp_int32 _tmaster_port, sp_int32 _stmgr_port) {
+    sp_int64 heartbeat_interval = options_.heartbeat_ms_ * 1000LL;
+    sp_int64 metrics_interval = options_.stmgr_mode() ? 0 : options_.metrics_ms_ * 1000LL;
+    size_t first_sim = options_.stmgr_mode() ? 1 : 0;
+    for (size_t i = first_sim; i < _placement.size(); ++i) {
+      stmgrs_.push_back(new heron::testing::SimStMgr(
+          ss_, MakeNetworkOptions(_stmgr_port + i), TOPOLOGY_NAME, TOPOLOGY_ID,
+          STMGR_NAME + std::to_string(i), _tmaster_port,
+          options_.stmgr_mode() ? _stmgr_port : 0, _placement[i], heartbeat_interval,
+          metrics_interval, &stats_));
+      CHECK_EQ(stmgrs_.back()->Start(), 0);
+    }
+
+    if (options_.stmgr_mode()) {
+      NetworkOptions options = MakeNetworkOptions(_stmgr_port);
+      for (auto& instance : _placement[0]) {
+        const sp_string& component = instance.info().component_name();
+        heron::testing::SimInstance* sim = NULL;
+        if (component.compare(0, SPOUT_NAME.size(), SPOUT_NAME) == 0) {
+          auto spout = new heron::testing::SimSpout(
+              ss_, options, TOPOLOGY_NAME, TOPOLOGY_ID, instance, &stats_,
+              STREAM_NAME + component.substr(SPOUT_NAME.size()), options_.tuple_size_,
+              options_.emit_rate_, options_.ack_ratio_, options_.max_spout_pending_);
+          spouts_.push_back(spout);
+          sim = spout;
+        } else {
+          sim = new heron::testing::SimBolt(ss_, options, TOPOLOGY_NAME, TOPOLOGY_ID, instance,
+                                            &stats_);
+        }
+        instances_.push_back(sim);
+        sim->Start();
+      }
+    }
+
+    start_ = heron::testing::NowMicros();
+    ss_->registerTimer([this](EventLoop::Status) { this->OnCheckTimer(); }, true, 100 * 1000);
+  }
+
+  void Report(std::ostream& _out) const;
+
+ private:
+  bool Ready() const {
+    for (auto instance : instances_) {
+      if (!instance->active()) return false;
+    }
+    for (auto stmgr : stmgrs_) {
+      if (stmgr->tmaster_client()->pplan_at() == 0) return false;
+    }
+    return true;
+  }
+
+  void OnCheckTimer() {
+    sp_int64 now = heron::testing::NowMicros();
+    if (begin_ == 0) {
+      if (!Ready()) {
+        if (now - start_ > STARTUP_TIMEOUT * 1000 * 1000) {
+          LOG(FATAL) << "The topology did not come up in " << STARTUP_TIMEOUT << " seconds";
+        }
+        return;
+      }
+      begin_ = now;
+      RecordPhysicalPlanTime();
+      stats_.ResetTraffic();
+      for (auto stmgr : stmgrs_) backpressure_at_begin_.push_back(stmgr->backpressure_micros());
+      std::cout << "Everything is up after " << (now - start_) / 1000 << " ms, measuring for "
+                << options_.duration_ << " s" << std::endl;
+    } else if (end_ == 0) {
+      if (now - begin_ < options_.duration_ * 1000LL * 1000) return;
+      end_ = now;
+      for (auto spout : spouts_) spout->StopEmitting();
+      emitted_at_end_ = stats_.tuples_emitted_;
+      // The back pressure of the drain time does not count
+      for (auto stmgr : stmgrs_) backpressure_at_end_.push_back(stmgr->backpressure_micros());
+    } else if (now - end_ >= DRAIN_TIME * 1000 * 1000) {
+      ss_->loopExit();
+    }
+  }
+
+  // from the last register request that was sent to the last stmgr that
+  // got the physical plan
+  void RecordPhysicalPlanTime() {
+    sp_int64 last_register = 0;
+    sp_int64 last_pplan = 0;
+    for (auto stmgr : stmgrs_) {
+      last_register = std::max(last_register, stmgr->tmaster_client()->register_sent_at());
+      last_pplan = std::max(last_pplan, stmgr->tmaster_client()->pplan_at());
+    }
+    if (!stmgrs_.empty()) pplan_time_ = last_pplan - last_register;
+  }
+
+  EventLoopImpl* ss_;
+  const LoadOptions& options_;
+  heron::testing::LoadStats stats_;
+  std::vector<heron::testing::SimStMgr*> stmgrs_;
+  std::vector<heron::testing::SimInstance*> instances_;
+  std::vector<heron::testing::SimSpout*> spouts_;
+
+  sp_int64 start_;
+  sp_int64 begin_;
+  sp_int64 end_;
+  sp_int64 emitted_at_end_;
+  sp_int64 pplan_time_;
+  std::vector<sp_int64> backpressure_at_begin_;
+  std::vector<sp_int64> backpressure_at_end_;
+};
+
+void LoadGenerator::Report(std::ostream& _out) const {
+  double seconds = (end_ - begin_) / 1e6;
+  _out << "---- " << options_.mode_ << " mode, " << options_.spouts_ << "x"
+       << options_.spout_parallelism_ << " spouts, " << options_.bolts_ << "x"
+       << options_.bolt_parallelism_ << " bolts, " << options_.stmgrs_ << " simulated stmgrs, "
+       << options_.grouping_ << " grouping" << std::endl;
+  stats_.register_latency_.Print(_out, "stmgr register latency");
+  if (pplan_time_ >= 0) {
+    _out << "physical plan reached all simulated stmgrs in " << pplan_time_ << "us" << std::endl;
+  }
+  stats_.heartbeat_rtt_.Print(_out, "heartbeat round trip");
+  if (!options_.stmgr_mode()) {
+    _out << "metrics published: " << static_cast<sp_int64>(stats_.metrics_published_ / seconds)
+         << " per second" << std::endl;
+    return;
+  }
+
+  _out << "emitted: " << emitted_at_end_ << " tuples, "
+       << static_cast<sp_int64>(emitted_at_end_ / seconds) << " per second, "
+       << static_cast<sp_int64>(stats_.bytes_emitted_ / seconds / (1 << 20)) << " MB per second"
+       << std::endl;
+  _out << "received: " << stats_.tuples_received_ << " tuples, "
+       << static_cast<sp_int64>(stats_.tuples_received_ / seconds) << " per second" << std::endl;
+  stats_.latency_.Print(_out, "emit to receive latency");
+  if (options_.ack_ratio_ > 0) {
+    _out << "anchored: " << stats_.tuples_anchored_ << " acked: " << stats_.tuples_acked_
+         << " failed: " << stats_.tuples_failed_ << std::endl;
+    stats_.ack_latency_.Print(_out, "emit to ack latency");
+  }
+  _out << "spouts blocked: "
+       << 100.0 * stats_.spout_blocked_micros_ / (end_ - begin_) / spouts_.size()
+       << "% of the time" << std::endl;
+  sp_int64 backpressure = 0;
+  sp_int64 backpressure_count = 0;
+  for (size_t i = 0; i < stmgrs_.size(); ++i) {
+    backpressure = std::max(backpressure, backpressure_at_end_[i] - backpressure_at_begin_[i]);
+    backpressure_count = std::max(backpressure_count, stmgrs_[i]->backpressure_count());
+  }
+  _out << "stmgr back pressure: " << backpressure / 1000 << " ms in " << backpressure_count
+       << " episodes" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  heron::common::Initialize(argv[0]);
+  LoadOptions options;
+  if (!ParseOptions(argc, argv, options)) {
+    std::cerr << "Usage: " << argv[0] << " --key=value ..., see loadgen-main.cpp" << std::endl;
+    ::exit(1);
+  }
+  heron::config::HeronInternalsConfigReader::Create(options.config_);
+  if (options.heartbeat_ms_ <= 0) {
+    options.heartbeat_ms_ = heron::config::HeronInternalsConfigReader::Instance()
+                                ->GetHeronStreammgrTmasterHeartbeatIntervalSec() * 1000;
+  }
+
+  sp_int32 tmaster_port = options.base_port_;
+  sp_int32 tmaster_controller_port = options.base_port_ + 1;
+  sp_int32 tmaster_stats_port = options.base_port_ + 2;
+  sp_int32 metricsmgr_port = options.base_port_ + 3;
+  sp_int32 ckptmgr_port = options.base_port_ + 4;
+  sp_int32 shell_port = options.base_port_ + 5;
+  sp_int32 stmgr_port = options.base_port_ + 10;
+
+  heron::proto::api::Topology* topology = GenerateTopology(options);
+  std::vector<std::vector<heron::proto::system::Instance>> placement =
+      PlaceInstances(options, *topology);
+  std::vector<sp_string> stmgr_ids;
+  for (size_t i = 0; i < placement.size(); ++i) stmgr_ids.push_back(STMGR_NAME + std::to_string(i));
+
+  // The state of the topology is kept on the local file system
+  char dpath[255];
+  snprintf(dpath, sizeof(dpath), "%s", "/tmp/loadgen-XXXXXX");
+  CHECK(mkdtemp(dpath));
+  {
+    EventLoopImpl ss;
+    heron::common::HeronLocalFileStateMgr state_mgr(dpath, &ss);
+    state_mgr.CreateTopology(*topology, NULL);
+  }
+
+  std::vector<EventLoopImpl*> loops;
+  std::vector<std::thread*> threads;
+
+  EventLoopImpl* metricsmgr_ss = new EventLoopImpl();
+  auto metricsmgr = new heron::testing::SimMetricsMgr(metricsmgr_ss,
+                                                      MakeNetworkOptions(metricsmgr_port));
+  CHECK_EQ(metricsmgr->Start(), 0);
+  loops.push_back(metricsmgr_ss);
+  threads.push_back(new std::thread(RunLoop, metricsmgr_ss));
+
+  EventLoopImpl* tmaster_ss = new EventLoopImpl();
+  auto tmaster = new heron::tmaster::TMaster(
+      "", TOPOLOGY_NAME, TOPOLOGY_ID, dpath, stmgr_ids, tmaster_controller_port, tmaster_port,
+      tmaster_stats_port, metricsmgr_port, ckptmgr_port, options.metrics_sinks_, LOCALHOST,
+      tmaster_ss);
+  loops.push_back(tmaster_ss);
+  threads.push_back(new std::thread(RunLoop, tmaster_ss));
+
+  EventLoopImpl* stmgr_ss = NULL;
+  heron::stmgr::StMgr* stmgr = NULL;
+  if (options.stmgr_mode()) {
+    std::vector<sp_string> workers;
+    for (auto& instance : placement[0]) workers.push_back(instance.instance_id());
+    stmgr_ss = new EventLoopImpl();
+    // The stmgr owns its copy of the topology
+    stmgr = new heron::stmgr::StMgr(stmgr_ss, stmgr_port, TOPOLOGY_NAME, TOPOLOGY_ID,
+                                    new heron::proto::api::Topology(*topology), stmgr_ids[0],
+                                    workers, "", dpath, metricsmgr_port, shell_port,
+                                    ckptmgr_port, "ckptmgr-0");
+    stmgr->Init();
+    loops.push_back(stmgr_ss);
+    threads.push_back(new std::thread(RunLoop, stmgr_ss));
+  }
+
+  {
+    EventLoopImpl ss;
+    LoadGenerator generator(&ss, options);
+    generator.Start(placement, tmaster_port, stmgr_port);
+    ss.loop();
+    generator.Report(std::cout);
+  }
+
+  for (auto loop : loops) loop->loopExit();
+  for (auto thread : threads) {
+    thread->join();
+    delete thread;
+  }
+  delete stmgr;
+  delete tmaster;
+  delete metricsmgr;
+  for (auto loop : loops) delete loop;
+  delete topology;
+  FileUtils::removeRecursive(dpath, true);
+  return 0;
+}
@@ -0,0 +1,277 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "loadgen/sim-instance.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include "proto/messages.h"
+#include "basics/basics.h"
+#include "errors/errors.h"
+#include "threads/threads.h"
+#include "network/network.h"
+
+namespace heron {
+namespace testing {
+
+namespace {
+// how often spouts emit, in microseconds
+const sp_int64 EMIT_INTERVAL = 10 * 1000;
+// the most tuples in one tuple set
+const sp_int64 MAX_BATCH = 1024;
+// how far a spout catches up after it was blocked, in seconds of its rate
+const double MAX_CATCH_UP = 1.0;
+}  // namespace
+
+//////////////////////////////////////// EmitTime ////////////////////////////////////////////
+sp_string EmitTime::Encode(sp_int64 _micros) {
+  return sp_string(reinterpret_cast<const char*>(&_micros), sizeof(_micros));
+}
+
+sp_int64 EmitTime::Decode(const proto::system::HeronDataTuple& _tuple) {
+  if (_tuple.values_size() == 0 || _tuple.values(0).size() != sizeof(sp_int64)) return -1;
+  sp_int64 micros;
+  memcpy(&micros, _tuple.values(0).data(), sizeof(micros));
+  return micros;
+}
+
+sp_int64 EmitTime::RootKey(sp_int64 _micros, sp_int64 _sequence) {
+  return (_micros << ROOT_KEY_SEQUENCE_BITS) |
+         (_sequence & ((static_cast<sp_int64>(1) << ROOT_KEY_SEQUENCE_BITS) - 1));
+}
+
+//////////////////////////////////////// SimInstance /////////////////////////////////////////
+SimInstance::SimInstance(EventLoop* eventLoop, const NetworkOptions& _options,
+                         const sp_string& _topology_name, const sp_string& _topology_id,
+                         const proto::system::Instance& _instance, LoadStats* _stats)
+    : Client(eventLoop, _options),
+      instance_(_instance),
+      stats_(_stats),
+      topology_name_(_topology_name),
+      topology_id_(_topology_id),
+      active_(false) {
+  InstallResponseHandler(new proto::stmgr::RegisterInstanceRequest(),
+                         &SimInstance::HandleRegisterResponse);
+  InstallMessageHandler(&SimInstance::HandleTupleSetMessage);
+  InstallMessageHandler(&SimInstance::HandleAssignmentMessage);
+}
+
+SimInstance::~SimInstance() {}
+
+void SimInstance::HandleConnect(NetworkErrorCode _status) {
+  if (_status == OK) {
+    SendRegisterRequest();
+  } else {
+    // The stmgr might not be listening yet
+    AddTimer([this]() { this->Start(); }, 100 * 1000);
+  }
+}
+
+void SimInstance::HandleClose(NetworkErrorCode _status) {
+  if (_status != OK) {
+    LOG(ERROR) << "Instance " << instance_.instance_id() << " lost its stmgr connection";
+  }
+}
+
+void SimInstance::SendRegisterRequest() {
+  auto request = new proto::stmgr::RegisterInstanceRequest();
+  request->mutable_instance()->CopyFrom(instance_);
+  request->set_topology_name(topology_name_);
+  request->set_topology_id(topology_id_);
+  SendRequest(request, NULL);
+}
+
+void SimInstance::HandleRegisterResponse(void*, proto::stmgr::RegisterInstanceResponse* _response,
+                                         NetworkErrorCode _status) {
+  if (_status != OK || _response->status().status() != proto::system::OK) {
+    LOG(FATAL) << "Instance " << instance_.instance_id() << " could not register";
+  }
+  bool has_pplan = _response->has_pplan();
+  __global_protobuf_pool_release__(_response);
+  if (has_pplan && !active_) {
+    active_ = true;
+    Activate();
+  }
+}
+
+void SimInstance::HandleTupleSetMessage(proto::system::HeronTupleSet2* _message) {
+  HandleTupleMessage(_message);
+  __global_protobuf_pool_release__(_message);
+}
+
+void SimInstance::HandleAssignmentMessage(proto::stmgr::NewInstanceAssignmentMessage* _message) {
+  __global_protobuf_pool_release__(_message);
+  if (!active_) {
+    active_ = true;
+    Activate();
+  }
+}
+
+//////////////////////////////////////// SimSpout ////////////////////////////////////////////
+SimSpout::SimSpout(EventLoop* eventLoop, const NetworkOptions& _options,
+                   const sp_string& _topology_name, const sp_string& _topology_id,
+                   const proto::system::Instance& _instance, LoadStats* _stats,
+                   const sp_string& _stream_id, sp_int32 _tuple_size, sp_int32 _emit_rate,
+                   double _ack_ratio, sp_int32 _max_spout_pending)
+    : SimInstance(eventLoop, _options, _topology_name, _topology_id, _instance, _stats),
+      stream_id_(_stream_id),
+      payload_(_tuple_size, 'x'),
+      emit_rate_(_emit_rate),
+      ack_ratio_(_ack_ratio),
+      max_spout_pending_(_max_spout_pending),
+      emitting_(false),
+      last_emit_time_(0),
+      due_(0),
+      anchor_credit_(0),
+      sequence_(0),
+      pending_(0),
+      backpressure_(false),
+      blocked_(false),
+      blocked_since_(0) {}
+
+SimSpout::~SimSpout() {}
+
+void SimSpout::Activate() {
+  emitting_ = true;
+  last_emit_time_ = NowMicros();
+  AddTimer([this]() { this->OnEmitTimer(); }, EMIT_INTERVAL);
+}
+
+void SimSpout::StopEmitting() {
+  SetBlocked(false, NowMicros());
+  emitting_ = false;
+}
+
+void SimSpout::OnEmitTimer() {
+  if (!emitting_) return;
+  sp_int64 now = NowMicros();
+  due_ = std::min(due_ + emit_rate_ * (now - last_emit_time_) / 1e6, emit_rate_ * MAX_CATCH_UP);
+  last_emit_time_ = now;
+
+  sp_int64 count = static_cast<sp_int64>(due_);
+  if (max_spout_pending_ > 0 && ack_ratio_ > 0) {
+    // Only the anchored tuples count against max spout pending
+    sp_int64 room = static_cast<sp_int64>((max_spout_pending_ - pending_) / ack_ratio_);
+    count = std::min(count, std::max<sp_int64>(room, 0));
+  }
+  SetBlocked(backpressure_ || (count == 0 && due_ >= 1), now);
+  if (!backpressure_) {
+    while (count > 0) {
+      sp_int64 batch = std::min(count, MAX_BATCH);
+      Emit(batch, now);
+      count -= batch;
+      due_ -= batch;
+    }
+  }
+  AddTimer([this]() { this->OnEmitTimer(); }, EMIT_INTERVAL);
+}
+
+void SimSpout::Emit(sp_int64 _count, sp_int64 _now) {
+  proto::system::HeronTupleSet tuple_set;
+  tuple_set.set_src_task_id(task_id());
+  proto::system::HeronDataTupleSet* data = tuple_set.mutable_data();
+  data->mutable_stream()->set_id(stream_id_);
+  data->mutable_stream()->set_component_name(instance_.info().component_name());
+  sp_string emit_time = EmitTime::Encode(_now);
+  for (sp_int64 i = 0; i < _count; ++i) {
+    proto::system::HeronDataTuple* tuple = data->add_tuples();
+    tuple->set_key(0);
+    tuple->add_values(emit_time);
+    tuple->add_values(payload_);
+    anchor_credit_ += ack_ratio_;
+    if (anchor_credit_ >= 1) {
+      anchor_credit_ -= 1;
+      proto::system::RootId* root = tuple->add_roots();
+      root->set_taskid(task_id());
+      root->set_key(EmitTime::RootKey(_now, sequence_++));
+      ++pending_;
+      ++stats_->tuples_anchored_;
+    }
+  }
+  SendMessage(tuple_set);
+  stats_->tuples_emitted_ += _count;
+  stats_->bytes_emitted_ += _count * (emit_time.size() + payload_.size());
+}
+
+void SimSpout::SetBlocked(bool _blocked, sp_int64 _now) {
+  if (_blocked == blocked_) return;
+  if (_blocked) {
+    blocked_since_ = _now;
+  } else {
+    stats_->spout_blocked_micros_ += _now - blocked_since_;
+  }
+  blocked_ = _blocked;
+}
+
+void SimSpout::StartBackPressureConnectionCb(Connection* _connection) {
+  backpressure_ = true;
+  if (emitting_) SetBlocked(true, NowMicros());
+}
+
+void SimSpout::StopBackPressureConnectionCb(Connection* _connection) { backpressure_ = false; }
+
+void SimSpout::HandleTupleMessage(proto::system::HeronTupleSet2* _message) {
+  if (!_message->has_control()) return;
+  sp_int64 now = NowMicros();
+  const proto::system::HeronControlTupleSet& control = _message->control();
+  for (sp_int32 i = 0; i < control.acks_size(); ++i) {
+    for (sp_int32 j = 0; j < control.acks(i).roots_size(); ++j) {
+      stats_->ack_latency_.Record(now - EmitTime::FromRootKey(control.acks(i).roots(j).key()));
+      ++stats_->tuples_acked_;
+      --pending_;
+    }
+  }
+  for (sp_int32 i = 0; i < control.fails_size(); ++i) {
+    stats_->tuples_failed_ += control.fails(i).roots_size();
+    pending_ -= control.fails(i).roots_size();
+  }
+}
+
+//////////////////////////////////////// SimBolt /////////////////////////////////////////////
+SimBolt::SimBolt(EventLoop* eventLoop, const NetworkOptions& _options,
+                 const sp_string& _topology_name, const sp_string& _topology_id,
+                 const proto::system::Instance& _instance, LoadStats* _stats)
+    : SimInstance(eventLoop, _options, _topology_name, _topology_id, _instance, _stats) {}
+
+SimBolt::~SimBolt() {}
+
+void SimBolt::HandleTupleMessage(proto::system::HeronTupleSet2* _message) {
+  if (!_message->has_data()) return;
+  sp_int64 now = NowMicros();
+  proto::system::HeronTupleSet acks;
+  for (sp_int32 i = 0; i < _message->data().tuples_size(); ++i) {
+    if (!tuple_.ParseFromString(_message->data().tuples(i))) {
+      LOG(ERROR) << "Bolt " << instance_.instance_id() << " could not decode a tuple";
+      continue;
+    }
+    ++stats_->tuples_received_;
+    sp_int64 emit_time = EmitTime::Decode(tuple_);
+    if (emit_time >= 0) stats_->latency_.Record(now - emit_time);
+    if (tuple_.roots_size() > 0) {
+      proto::system::AckTuple* ack = acks.mutable_control()->add_acks();
+      ack->mutable_roots()->CopyFrom(tuple_.roots());
+      ack->set_ackedtuple(tuple_.key());
+    }
+  }
+  if (acks.has_control()) {
+    acks.set_src_task_id(task_id());
+    SendMessage(acks);
+  }
+}
+
+}  // namespace testing
+}  // namespace heron
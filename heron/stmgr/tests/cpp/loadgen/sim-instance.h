@@ -0,0 +1,149 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __SIM_INSTANCE_H
+#define __SIM_INSTANCE_H
+
+#include <string>
+#include "network/network_error.h"
+#include "proto/messages.h"
+#include "basics/basics.h"
+#include "network/network.h"
+#include "loadgen/load-stats.h"
+
+namespace heron {
+namespace testing {
+
+// An instance that registers with the stmgr like a heron instance does,
+// and records what it sees into the shared LoadStats
+class SimInstance : public Client {
+ public:
+  SimInstance(EventLoop* eventLoop, const NetworkOptions& _options,
+              const sp_string& _topology_name, const sp_string& _topology_id,
+              const proto::system::Instance& _instance, LoadStats* _stats);
+  virtual ~SimInstance();
+
+  sp_int32 task_id() const { return instance_.info().task_id(); }
+  // whether the stmgr has sent us our assignment
+  bool active() const { return active_; }
+
+ protected:
+  // called when the first assignment arrives
+  virtual void Activate() {}
+  virtual void HandleTupleMessage(proto::system::HeronTupleSet2* _message) = 0;
+
+  virtual void HandleConnect(NetworkErrorCode _status);
+  virtual void HandleClose(NetworkErrorCode _status);
+
+  const proto::system::Instance instance_;
+  LoadStats* stats_;
+
+ private:
+  void HandleRegisterResponse(void*, proto::stmgr::RegisterInstanceResponse* _response,
+                              NetworkErrorCode _status);
+  void HandleTupleSetMessage(proto::system::HeronTupleSet2* _message);
+  void HandleAssignmentMessage(proto::stmgr::NewInstanceAssignmentMessage* _message);
+  void SendRegisterRequest();
+
+  sp_string topology_name_;
+  sp_string topology_id_;
+  bool active_;
+};
+
+// Emits tuples at a fixed rate. The first value of every tuple is the time
+// it was emitted, and the second one a payload of the configured size. The
+// given fraction of the tuples is anchored, with a root key that carries
+// the emit time as well, so that acks tell how long the tuple tree took.
+class SimSpout : public SimInstance {
+ public:
+  SimSpout(EventLoop* eventLoop, const NetworkOptions& _options, const sp_string& _topology_name,
+           const sp_string& _topology_id, const proto::system::Instance& _instance,
+           LoadStats* _stats, const sp_string& _stream_id, sp_int32 _tuple_size,
+           sp_int32 _emit_rate, double _ack_ratio, sp_int32 _max_spout_pending);
+  virtual ~SimSpout();
+
+  // stop emitting, and account for the time we have been blocked till now
+  void StopEmitting();
+
+ protected:
+  virtual void Activate();
+  virtual void HandleTupleMessage(proto::system::HeronTupleSet2* _message);
+
+  // the stmgr connection has more than the high watermark outstanding
+  virtual void StartBackPressureConnectionCb(Connection* _connection);
+  virtual void StopBackPressureConnectionCb(Connection* _connection);
+
+ private:
+  void OnEmitTimer();
+  void Emit(sp_int64 _count, sp_int64 _now);
+  void SetBlocked(bool _blocked, sp_int64 _now);
+
+  sp_string stream_id_;
+  sp_string payload_;
+  sp_int32 emit_rate_;
+  double ack_ratio_;
+  sp_int32 max_spout_pending_;
+
+  bool emitting_;
+  sp_int64 last_emit_time_;
+  // how many tuples are due but not emitted yet
+  double due_;
+  // adds up the ack ratio, and anchors a tuple whenever it gets to 1
+  double anchor_credit_;
+  sp_int64 sequence_;
+  sp_int64 pending_;
+
+  bool backpressure_;
+  bool blocked_;
+  sp_int64 blocked_since_;
+};
+
+// Records the latency of every tuple it gets, and acks the anchored ones
+class SimBolt : public SimInstance {
+ public:
+  SimBolt(EventLoop* eventLoop, const NetworkOptions& _options, const sp_string& _topology_name,
+          const sp_string& _topology_id, const proto::system::Instance& _instance,
+          LoadStats* _stats);
+  virtual ~SimBolt();
+
+ protected:
+  virtual void HandleTupleMessage(proto::system::HeronTupleSet2* _message);
+
+ private:
+  proto::system::HeronDataTuple tuple_;
+};
+
+// Helpers for the emit time that spouts put into tuples and root keys
+class EmitTime {
+ public:
+  static sp_string Encode(sp_int64 _micros);
+  // the emit time in the first value of the tuple, or -1 if there is none
+  static sp_int64 Decode(const proto::system::HeronDataTuple& _tuple);
+
+  // the low bits of a root key tell apart tuples emitted in the same
+  // microsecond
+  static sp_int64 RootKey(sp_int64 _micros, sp_int64 _sequence);
+  static sp_int64 FromRootKey(sp_int64 _key) { return _key >> ROOT_KEY_SEQUENCE_BITS; }
+
+ private:
+  static const int ROOT_KEY_SEQUENCE_BITS = 10;
+};
+
+}  // namespace testing
+}  // namespace heron
+
+#endif
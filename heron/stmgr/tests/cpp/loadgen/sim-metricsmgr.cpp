@@ -0,0 +1,60 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "loadgen/sim-metricsmgr.h"
+#include "proto/messages.h"
+#include "basics/basics.h"
+#include "errors/errors.h"
+#include "threads/threads.h"
+#include "network/network.h"
+
+namespace heron {
+namespace testing {
+
+SimMetricsMgr::SimMetricsMgr(EventLoop* eventLoop, const NetworkOptions& _options)
+    : Server(eventLoop, _options) {
+  InstallRequestHandler(&SimMetricsMgr::HandleRegisterRequest);
+  InstallMessageHandler(&SimMetricsMgr::HandlePublishMessage);
+  InstallMessageHandler(&SimMetricsMgr::HandleTMasterLocationMessage);
+}
+
+SimMetricsMgr::~SimMetricsMgr() {}
+
+void SimMetricsMgr::HandleNewConnection(Connection* _conn) {}
+
+void SimMetricsMgr::HandleConnectionClose(Connection*, NetworkErrorCode) {}
+
+void SimMetricsMgr::HandleRegisterRequest(
+    REQID _id, Connection* _connection, proto::system::MetricPublisherRegisterRequest* _request) {
+  proto::system::MetricPublisherRegisterResponse response;
+  response.mutable_status()->set_status(proto::system::OK);
+  SendResponse(_id, _connection, response);
+  __global_protobuf_pool_release__(_request);
+}
+
+void SimMetricsMgr::HandlePublishMessage(Connection*,
+                                         proto::system::MetricPublisherPublishMessage* _message) {
+  __global_protobuf_pool_release__(_message);
+}
+
+void SimMetricsMgr::HandleTMasterLocationMessage(
+    Connection*, proto::system::TMasterLocationRefreshMessage* _message) {
+  __global_protobuf_pool_release__(_message);
+}
+
+}  // namespace testing
+}  // namespace heron
@@ -0,0 +1,52 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __SIM_METRICSMGR_H
+#define __SIM_METRICSMGR_H
+
+#include "network/network_error.h"
+#include "proto/messages.h"
+#include "basics/basics.h"
+#include "network/network.h"
+
+namespace heron {
+namespace testing {
+
+// Takes the metrics of the real tmaster and stmgr so that they do not keep
+// reconnecting, and drops them
+class SimMetricsMgr : public Server {
+ public:
+  SimMetricsMgr(EventLoop* eventLoop, const NetworkOptions& _options);
+  virtual ~SimMetricsMgr();
+
+ protected:
+  virtual void HandleNewConnection(Connection* _connection);
+  virtual void HandleConnectionClose(Connection* _connection, NetworkErrorCode _status);
+
+ private:
+  void HandleRegisterRequest(REQID _id, Connection* _connection,
+                             proto::system::MetricPublisherRegisterRequest* _request);
+  void HandlePublishMessage(Connection* _connection,
+                            proto::system::MetricPublisherPublishMessage* _message);
+  void HandleTMasterLocationMessage(Connection* _connection,
+                                    proto::system::TMasterLocationRefreshMessage* _message);
+};
+
+}  // namespace testing
+}  // namespace heron
+
+#endif
@@ -0,0 +1,334 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "loadgen/sim-stmgr.h"
+#include <map>
+#include <string>
+#include <vector>
+#include "proto/messages.h"
+#include "basics/basics.h"
+#include "errors/errors.h"
+#include "threads/threads.h"
+#include "network/network.h"
+#include "loadgen/sim-instance.h"
+
+namespace heron {
+namespace testing {
+
+namespace {
+// how long to wait before connecting again, in microseconds
+const sp_int64 RECONNECT_INTERVAL = 100 * 1000;
+}  // namespace
+
+///////////////////////////// SimTMasterClient ///////////////////////////////////////////////
+SimTMasterClient::SimTMasterClient(EventLoop* eventLoop, const NetworkOptions& _options,
+                                   const proto::system::StMgr& _stmgr,
+                                   const std::vector<proto::system::Instance>& _instances,
+                                   sp_int64 _heartbeat_interval, sp_int64 _metrics_interval,
+                                   LoadStats* _stats)
+    : Client(eventLoop, _options),
+      stmgr_(_stmgr),
+      instances_(_instances),
+      heartbeat_interval_(_heartbeat_interval),
+      metrics_interval_(_metrics_interval),
+      stats_(_stats),
+      register_sent_at_(0),
+      heartbeat_sent_at_(0),
+      pplan_at_(0) {
+  InstallResponseHandler(new proto::tmaster::StMgrRegisterRequest(),
+                         &SimTMasterClient::HandleRegisterResponse);
+  InstallResponseHandler(new proto::tmaster::StMgrHeartbeatRequest(),
+                         &SimTMasterClient::HandleHeartbeatResponse);
+  InstallMessageHandler(&SimTMasterClient::HandleNewPhysicalPlanMessage);
+  InstallMessageHandler(&SimTMasterClient::HandlePhysicalPlanDeltaMessage);
+}
+
+SimTMasterClient::~SimTMasterClient() {}
+
+void SimTMasterClient::HandleConnect(NetworkErrorCode _status) {
+  if (_status == OK) {
+    SendRegisterRequest();
+  } else {
+    AddTimer([this]() { this->Start(); }, RECONNECT_INTERVAL);
+  }
+}
+
+void SimTMasterClient::HandleClose(NetworkErrorCode _status) {
+  if (_status != OK) {
+    LOG(ERROR) << "Simulated stmgr " << stmgr_.id() << " lost its tmaster connection";
+  }
+}
+
+void SimTMasterClient::SendRegisterRequest() {
+  auto request = new proto::tmaster::StMgrRegisterRequest();
+  request->mutable_stmgr()->CopyFrom(stmgr_);
+  for (auto& instance : instances_) {
+    request->add_instances()->CopyFrom(instance);
+  }
+  request->set_takes_pplan_deltas(true);
+  register_sent_at_ = NowMicros();
+  SendRequest(request, NULL);
+}
+
+void SimTMasterClient::HandleRegisterResponse(void*,
+                                              proto::tmaster::StMgrRegisterResponse* _response,
+                                              NetworkErrorCode _status) {
+  if (_status != OK || _response->status().status() != proto::system::OK) {
+    LOG(FATAL) << "Simulated stmgr " << stmgr_.id() << " could not register with the tmaster";
+  }
+  stats_->register_latency_.Record(NowMicros() - register_sent_at_);
+  if (_response->has_pplan()) GotPhysicalPlan();
+  __global_protobuf_pool_release__(_response);
+
+  AddTimer([this]() { this->SendHeartbeatRequest(); }, heartbeat_interval_);
+  if (metrics_interval_ > 0) {
+    AddTimer([this]() { this->OnMetricsTimer(); }, metrics_interval_);
+  }
+}
+
+void SimTMasterClient::SendHeartbeatRequest() {
+  auto request = new proto::tmaster::StMgrHeartbeatRequest();
+  request->set_heartbeat_time(time(NULL));
+  request->mutable_stats();
+  request->set_takes_pplan_deltas(true);
+  heartbeat_sent_at_ = NowMicros();
+  SendRequest(request, NULL);
+}
+
+void SimTMasterClient::HandleHeartbeatResponse(void*,
+                                               proto::tmaster::StMgrHeartbeatResponse* _response,
+                                               NetworkErrorCode _status) {
+  if (_status != OK || _response->status().status() != proto::system::OK) {
+    LOG(ERROR) << "Heartbeat of simulated stmgr " << stmgr_.id() << " failed";
+  } else {
+    stats_->heartbeat_rtt_.Record(NowMicros() - heartbeat_sent_at_);
+  }
+  __global_protobuf_pool_release__(_response);
+  AddTimer([this]() { this->SendHeartbeatRequest(); }, heartbeat_interval_);
+}
+
+void SimTMasterClient::HandleNewPhysicalPlanMessage(
+    proto::stmgr::NewPhysicalPlanMessage* _message) {
+  __global_protobuf_pool_release__(_message);
+  GotPhysicalPlan();
+}
+
+void SimTMasterClient::HandlePhysicalPlanDeltaMessage(
+    proto::stmgr::PhysicalPlanDeltaMessage* _message) {
+  __global_protobuf_pool_release__(_message);
+  GotPhysicalPlan();
+}
+
+void SimTMasterClient::GotPhysicalPlan() {
+  if (pplan_at_ == 0) pplan_at_ = NowMicros();
+}
+
+void SimTMasterClient::OnMetricsTimer() {
+  // What the metrics manager of every instance would send on
+  proto::tmaster::PublishMetrics metrics;
+  for (auto& instance : instances_) {
+    proto::tmaster::MetricDatum* datum = metrics.add_metrics();
+    datum->set_component_name(instance.info().component_name());
+    datum->set_instance_id(instance.instance_id());
+    datum->set_name("__emit-count/default");
+    datum->set_value("1");
+  }
+  SendMessage(metrics);
+  stats_->metrics_published_ += metrics.metrics_size();
+  AddTimer([this]() { this->OnMetricsTimer(); }, metrics_interval_);
+}
+
+///////////////////////////// SimStMgrClient /////////////////////////////////////////////////
+SimStMgrClient::SimStMgrClient(EventLoop* eventLoop, const NetworkOptions& _options,
+                               const sp_string& _topology_name, const sp_string& _topology_id,
+                               const sp_string& _stmgr_id)
+    : Client(eventLoop, _options),
+      topology_name_(_topology_name),
+      topology_id_(_topology_id),
+      stmgr_id_(_stmgr_id),
+      ready_(false) {
+  InstallResponseHandler(new proto::stmgr::StrMgrHelloRequest(),
+                         &SimStMgrClient::HandleHelloResponse);
+}
+
+SimStMgrClient::~SimStMgrClient() {}
+
+void SimStMgrClient::HandleConnect(NetworkErrorCode _status) {
+  if (_status == OK) {
+    auto request = new proto::stmgr::StrMgrHelloRequest();
+    request->set_topology_name(topology_name_);
+    request->set_topology_id(topology_id_);
+    request->set_stmgr(stmgr_id_);
+    SendRequest(request, NULL);
+  } else {
+    AddTimer([this]() { this->Start(); }, RECONNECT_INTERVAL);
+  }
+}
+
+void SimStMgrClient::HandleClose(NetworkErrorCode) { ready_ = false; }
+
+void SimStMgrClient::HandleHelloResponse(void*, proto::stmgr::StrMgrHelloResponse* _response,
+                                         NetworkErrorCode _status) {
+  if (_status == OK && _response->status().status() == proto::system::OK) {
+    ready_ = true;
+  } else {
+    LOG(ERROR) << "The stmgr did not take the hello of simulated stmgr " << stmgr_id_;
+  }
+  __global_protobuf_pool_release__(_response);
+}
+
+void SimStMgrClient::SendAcks(sp_int32 _src_task_id, sp_int32 _task_id,
+                              const proto::system::HeronTupleSet2& _acks) {
+  if (!ready_) return;
+  message_.set_src_task_id(_src_task_id);
+  message_.set_task_id(_task_id);
+  _acks.SerializeToString(message_.mutable_set());
+  SendMessage(message_);
+}
+
+///////////////////////////// SimStMgr ///////////////////////////////////////////////////////
+SimStMgr::SimStMgr(EventLoop* eventLoop, const NetworkOptions& _options,
+                   const sp_string& _topology_name, const sp_string& _topology_id,
+                   const sp_string& _stmgr_id, sp_int32 _tmaster_port, sp_int32 _peer_port,
+                   const std::vector<proto::system::Instance>& _instances,
+                   sp_int64 _heartbeat_interval, sp_int64 _metrics_interval, LoadStats* _stats)
+    : Server(eventLoop, _options),
+      topology_name_(_topology_name),
+      topology_id_(_topology_id),
+      stats_(_stats),
+      peer_client_(NULL),
+      backpressure_since_(0),
+      backpressure_micros_(0),
+      backpressure_count_(0) {
+  InstallRequestHandler(&SimStMgr::HandleStMgrHelloRequest);
+  InstallMessageHandler(&SimStMgr::HandleTupleStreamMessage);
+  InstallMessageHandler(&SimStMgr::HandleStartBackPressureMessage);
+  InstallMessageHandler(&SimStMgr::HandleStopBackPressureMessage);
+
+  proto::system::StMgr stmgr;
+  stmgr.set_id(_stmgr_id);
+  stmgr.set_host_name(_options.get_host());
+  stmgr.set_data_port(_options.get_port());
+  stmgr.set_local_endpoint("/unused");
+  stmgr.set_pid(static_cast<sp_int32>(ProcessUtils::getPid()));
+
+  NetworkOptions client_options;
+  client_options.set_host(_options.get_host());
+  client_options.set_max_packet_size(_options.get_max_packet_size());
+  client_options.set_socket_family(PF_INET);
+
+  client_options.set_port(_tmaster_port);
+  tmaster_client_ = new SimTMasterClient(eventLoop, client_options, stmgr, _instances,
+                                         _heartbeat_interval, _metrics_interval, _stats);
+  tmaster_client_->Start();
+
+  if (_peer_port > 0) {
+    client_options.set_port(_peer_port);
+    peer_client_ =
+        new SimStMgrClient(eventLoop, client_options, _topology_name, _topology_id, _stmgr_id);
+    peer_client_->Start();
+  }
+}
+
+SimStMgr::~SimStMgr() {
+  tmaster_client_->Stop();
+  delete tmaster_client_;
+  if (peer_client_) {
+    peer_client_->Stop();
+    delete peer_client_;
+  }
+}
+
+sp_int64 SimStMgr::backpressure_micros() const {
+  if (backpressure_since_ == 0) return backpressure_micros_;
+  return backpressure_micros_ + NowMicros() - backpressure_since_;
+}
+
+void SimStMgr::HandleNewConnection(Connection* _conn) {}
+
+void SimStMgr::HandleConnectionClose(Connection*, NetworkErrorCode) {}
+
+void SimStMgr::HandleStMgrHelloRequest(REQID _id, Connection* _connection,
+                                       proto::stmgr::StrMgrHelloRequest* _request) {
+  proto::stmgr::StrMgrHelloResponse response;
+  if (_request->topology_name() == topology_name_ && _request->topology_id() == topology_id_) {
+    response.mutable_status()->set_status(proto::system::OK);
+  } else {
+    response.mutable_status()->set_status(proto::system::NOTOK);
+  }
+  SendResponse(_id, _connection, response);
+  __global_protobuf_pool_release__(_request);
+}
+
+void SimStMgr::HandleTupleStreamMessage(Connection*,
+                                        proto::stmgr::TupleStreamMessage2* _message) {
+  sp_int64 now = NowMicros();
+  sp_int32 task_id = _message->task_id();
+  if (!tuple_set_.ParseFromString(_message->set())) {
+    LOG(ERROR) << "Could not decode the tuple set for task " << task_id;
+    __global_protobuf_pool_release__(_message);
+    return;
+  }
+  __global_protobuf_pool_release__(_message);
+  if (!tuple_set_.has_data()) return;
+
+  for (sp_int32 i = 0; i < tuple_set_.data().tuples_size(); ++i) {
+    if (!tuple_.ParseFromString(tuple_set_.data().tuples(i))) {
+      LOG(ERROR) << "Could not decode a tuple for task " << task_id;
+      continue;
+    }
+    ++stats_->tuples_received_;
+    sp_int64 emit_time = EmitTime::Decode(tuple_);
+    if (emit_time >= 0) stats_->latency_.Record(now - emit_time);
+    if (peer_client_ && tuple_.roots_size() > 0) {
+      for (sp_int32 j = 0; j < tuple_.roots_size(); ++j) {
+        proto::system::AckTuple* ack =
+            acks_[tuple_.roots(j).taskid()].mutable_control()->add_acks();
+        ack->add_roots()->CopyFrom(tuple_.roots(j));
+        ack->set_ackedtuple(tuple_.key());
+      }
+    }
+  }
+
+  for (auto& acks : acks_) {
+    if (acks.second.control().acks_size() == 0) continue;
+    acks.second.set_src_task_id(task_id);
+    peer_client_->SendAcks(task_id, acks.first, acks.second);
+    acks.second.Clear();
+  }
+}
+
+void SimStMgr::HandleStartBackPressureMessage(Connection*,
+                                              proto::stmgr::StartBackPressureMessage* _message) {
+  __global_protobuf_pool_release__(_message);
+  if (backpressure_since_ == 0) {
+    backpressure_since_ = NowMicros();
+    ++backpressure_count_;
+  }
+}
+
+void SimStMgr::HandleStopBackPressureMessage(Connection*,
+                                             proto::stmgr::StopBackPressureMessage* _message) {
+  __global_protobuf_pool_release__(_message);
+  if (backpressure_since_ != 0) {
+    backpressure_micros_ += NowMicros() - backpressure_since_;
+    backpressure_since_ = 0;
+  }
+}
+
+}  // namespace testing
+}  // namespace heron
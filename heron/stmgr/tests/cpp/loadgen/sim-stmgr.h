@@ -0,0 +1,156 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __SIM_STMGR_H
+#define __SIM_STMGR_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "network/network_error.h"
+#include "proto/messages.h"
+#include "basics/basics.h"
+#include "network/network.h"
+#include "loadgen/load-stats.h"
+
+namespace heron {
+namespace testing {
+
+// Registers a simulated stmgr with the tmaster, heartbeats, and publishes
+// metrics for its instances the way the metrics manager would
+class SimTMasterClient : public Client {
+ public:
+  SimTMasterClient(EventLoop* eventLoop, const NetworkOptions& _options,
+                   const proto::system::StMgr& _stmgr,
+                   const std::vector<proto::system::Instance>& _instances,
+                   sp_int64 _heartbeat_interval, sp_int64 _metrics_interval, LoadStats* _stats);
+  virtual ~SimTMasterClient();
+
+  sp_int64 register_sent_at() const { return register_sent_at_; }
+  // when the first physical plan arrived, or 0 if none has
+  sp_int64 pplan_at() const { return pplan_at_; }
+
+ protected:
+  virtual void HandleConnect(NetworkErrorCode _status);
+  virtual void HandleClose(NetworkErrorCode _status);
+
+ private:
+  void HandleRegisterResponse(void*, proto::tmaster::StMgrRegisterResponse* _response,
+                              NetworkErrorCode _status);
+  void HandleHeartbeatResponse(void*, proto::tmaster::StMgrHeartbeatResponse* _response,
+                               NetworkErrorCode _status);
+  void HandleNewPhysicalPlanMessage(proto::stmgr::NewPhysicalPlanMessage* _message);
+  void HandlePhysicalPlanDeltaMessage(proto::stmgr::PhysicalPlanDeltaMessage* _message);
+  void GotPhysicalPlan();
+
+  void SendRegisterRequest();
+  void SendHeartbeatRequest();
+  void OnMetricsTimer();
+
+  proto::system::StMgr stmgr_;
+  std::vector<proto::system::Instance> instances_;
+  sp_int64 heartbeat_interval_;
+  sp_int64 metrics_interval_;
+  LoadStats* stats_;
+
+  sp_int64 register_sent_at_;
+  sp_int64 heartbeat_sent_at_;
+  sp_int64 pplan_at_;
+};
+
+// Says hello to the real stmgr, and sends it the acks of the simulated
+// stmgr's bolts
+class SimStMgrClient : public Client {
+ public:
+  SimStMgrClient(EventLoop* eventLoop, const NetworkOptions& _options,
+                 const sp_string& _topology_name, const sp_string& _topology_id,
+                 const sp_string& _stmgr_id);
+  virtual ~SimStMgrClient();
+
+  // send the acks of _src_task_id to _task_id. They are dropped if the
+  // real stmgr has not answered our hello yet.
+  void SendAcks(sp_int32 _src_task_id, sp_int32 _task_id,
+                const proto::system::HeronTupleSet2& _acks);
+
+ protected:
+  virtual void HandleConnect(NetworkErrorCode _status);
+  virtual void HandleClose(NetworkErrorCode _status);
+
+ private:
+  void HandleHelloResponse(void*, proto::stmgr::StrMgrHelloResponse* _response,
+                           NetworkErrorCode _status);
+
+  sp_string topology_name_;
+  sp_string topology_id_;
+  sp_string stmgr_id_;
+  bool ready_;
+  proto::stmgr::TupleStreamMessage2 message_;
+};
+
+// A stmgr that the bolts of other stmgrs send their tuples to. It records
+// their latency, acks the anchored ones, and times the back pressure that
+// the real stmgr asks for.
+class SimStMgr : public Server {
+ public:
+  // _peer_port is the data port of the real stmgr to ack to, or 0 if
+  // there is none
+  SimStMgr(EventLoop* eventLoop, const NetworkOptions& _options, const sp_string& _topology_name,
+           const sp_string& _topology_id, const sp_string& _stmgr_id, sp_int32 _tmaster_port,
+           sp_int32 _peer_port, const std::vector<proto::system::Instance>& _instances,
+           sp_int64 _heartbeat_interval, sp_int64 _metrics_interval, LoadStats* _stats);
+  virtual ~SimStMgr();
+
+  const SimTMasterClient* tmaster_client() const { return tmaster_client_; }
+
+  // the back pressure time till now, including any that is still on
+  sp_int64 backpressure_micros() const;
+  sp_int64 backpressure_count() const { return backpressure_count_; }
+
+ protected:
+  virtual void HandleNewConnection(Connection* _connection);
+  virtual void HandleConnectionClose(Connection* _connection, NetworkErrorCode _status);
+
+ private:
+  void HandleStMgrHelloRequest(REQID _id, Connection* _connection,
+                               proto::stmgr::StrMgrHelloRequest* _request);
+  void HandleTupleStreamMessage(Connection* _connection,
+                                proto::stmgr::TupleStreamMessage2* _message);
+  void HandleStartBackPressureMessage(Connection* _connection,
+                                      proto::stmgr::StartBackPressureMessage* _message);
+  void HandleStopBackPressureMessage(Connection* _connection,
+                                     proto::stmgr::StopBackPressureMessage* _message);
+
+  sp_string topology_name_;
+  sp_string topology_id_;
+  LoadStats* stats_;
+  SimTMasterClient* tmaster_client_;
+  SimStMgrClient* peer_client_;
+
+  proto::system::HeronTupleSet2 tuple_set_;
+  proto::system::HeronDataTuple tuple_;
+  // the acks for each spout task
+  std::map<sp_int32, proto::system::HeronTupleSet2> acks_;
+
+  sp_int64 backpressure_since_;
+  sp_int64 backpressure_micros_;
+  sp_int64 backpressure_count_;
+};
+
+}  // namespace testing
+}  // namespace heron
+
+#endif
@@ -0,0 +1,371 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "glog/logging.h"
+#include "proto/messages.h"
+#include "basics/basics.h"
+#include "errors/errors.h"
+#include "threads/threads.h"
+#include "network/network.h"
+#include "basics/modinit.h"
+#include "errors/modinit.h"
+#include "threads/modinit.h"
+#include "network/modinit.h"
+#include "config/heron-internals-config-reader.h"
+#include "manager/ckptmgr-client.h"
+
+const sp_string LOCALHOST = "127.0.0.1";
+const sp_string CHECKPOINT_ID = "ckpt-1";
+sp_string heron_internals_config_filename =
+    "../../../../../../../../heron/config/heron_internals.yaml";
+
+// Stands in for a ckptmgr that takes states in chunks. It holds on to the
+// chunk requests till a window of them has come in, or the last chunk has,
+// so that the test sees how many the client keeps in flight. The chunks of a
+// restore after a failed one are answered only once the state has been asked
+// for again, so that their responses come in when the next restore is going on.
+class FakeCkptMgr : public Server {
+ public:
+  FakeCkptMgr(EventLoopImpl* eventLoop, const NetworkOptions& _options, sp_int32 _window,
+              const std::string& _state)
+      : Server(eventLoop, _options), window_(_window), state_(_state), max_pending_(0),
+        num_gets_(0), fail_at_(-1) {
+    InstallRequestHandler(&FakeCkptMgr::HandleStMgrRegisterRequest);
+    InstallRequestHandler(&FakeCkptMgr::HandleGetInstanceStateRequest);
+    InstallRequestHandler(&FakeCkptMgr::HandleSaveInstanceStateChunkRequest);
+    InstallRequestHandler(&FakeCkptMgr::HandleGetInstanceStateChunkRequest);
+  }
+
+  // Fail the chunk at this offset, once
+  void FailAt(sp_int64 _offset) { fail_at_ = _offset; }
+
+  const std::string& saved() const { return saved_; }
+  size_t max_pending() const { return max_pending_; }
+  sp_int32 num_gets() const { return num_gets_; }
+
+ protected:
+  virtual void HandleNewConnection(Connection* _conn) {}
+  virtual void HandleConnectionClose(Connection*, NetworkErrorCode) {}
+
+ private:
+  struct Pending {
+    REQID id_;
+    Connection* conn_;
+    heron::proto::system::Instance instance_;
+    sp_int64 offset_;
+    sp_int64 size_;
+    bool save_;
+  };
+
+  void HandleStMgrRegisterRequest(REQID _id, Connection* _conn,
+                                  heron::proto::ckptmgr::RegisterStMgrRequest* _request) {
+    heron::proto::ckptmgr::RegisterStMgrResponse response;
+    response.mutable_status()->set_status(heron::proto::system::OK);
+    response.set_takes_state_chunks(true);
+    SendResponse(_id, _conn, response);
+    __global_protobuf_pool_release__(_request);
+  }
+
+  void HandleGetInstanceStateRequest(REQID _id, Connection* _conn,
+                                     heron::proto::ckptmgr::GetInstanceStateRequest* _request) {
+    EXPECT_GT(_request->max_chunk_size(), 0);
+    num_gets_++;
+    heron::proto::ckptmgr::GetInstanceStateResponse response;
+    response.mutable_status()->set_status(heron::proto::system::OK);
+    response.mutable_instance()->CopyFrom(_request->instance());
+    response.set_checkpoint_id(_request->checkpoint_id());
+    response.set_state_size(state_.size());
+    SendResponse(_id, _conn, response);
+    __global_protobuf_pool_release__(_request);
+    for (auto& held : held_) SendPending(held, heron::proto::system::OK);
+    held_.clear();
+  }
+
+  void HandleSaveInstanceStateChunkRequest(REQID _id, Connection* _conn,
+                                 heron::proto::ckptmgr::SaveInstanceStateChunkRequest* _request) {
+    EXPECT_EQ(_request->offset(), static_cast<sp_int64>(saved_.size()));
+    EXPECT_EQ(_request->state_size(), static_cast<sp_int64>(state_.size()));
+    saved_.append(_request->data());
+    AddPending(_id, _conn, _request->instance(), _request->offset(), _request->data().size(),
+               true);
+    __global_protobuf_pool_release__(_request);
+  }
+
+  void HandleGetInstanceStateChunkRequest(REQID _id, Connection* _conn,
+                                 heron::proto::ckptmgr::GetInstanceStateChunkRequest* _request) {
+    sp_int64 size = std::min<sp_int64>(_request->size(), state_.size() - _request->offset());
+    AddPending(_id, _conn, _request->instance(), _request->offset(), size, false);
+    __global_protobuf_pool_release__(_request);
+  }
+
+  void AddPending(REQID _id, Connection* _conn, const heron::proto::system::Instance& _instance,
+                  sp_int64 _offset, sp_int64 _size, bool _save) {
+    pending_.push_back(Pending{_id, _conn, _instance, _offset, _size, _save});
+    max_pending_ = std::max(max_pending_, pending_.size());
+    if (pending_.size() < static_cast<size_t>(window_) &&
+        _offset + _size < static_cast<sp_int64>(state_.size())) {
+      return;
+    }
+    bool failed = false;
+    for (auto& pending : pending_) {
+      if (pending.offset_ == fail_at_) {
+        SendPending(pending, heron::proto::system::NOTOK);
+        fail_at_ = -1;
+        failed = true;
+      } else if (failed && !pending.save_) {
+        held_.push_back(pending);
+      } else {
+        SendPending(pending, heron::proto::system::OK);
+      }
+    }
+    pending_.clear();
+  }
+
+  void SendPending(const Pending& _pending, heron::proto::system::StatusCode _status) {
+    if (_pending.save_) {
+      heron::proto::ckptmgr::SaveInstanceStateChunkResponse response;
+      response.mutable_status()->set_status(_status);
+      response.mutable_instance()->CopyFrom(_pending.instance_);
+      response.set_checkpoint_id(CHECKPOINT_ID);
+      response.set_offset(_pending.offset_);
+      SendResponse(_pending.id_, _pending.conn_, response);
+    } else {
+      heron::proto::ckptmgr::GetInstanceStateChunkResponse response;
+      response.mutable_status()->set_status(_status);
+      response.mutable_instance()->CopyFrom(_pending.instance_);
+      response.set_checkpoint_id(CHECKPOINT_ID);
+      response.set_offset(_pending.offset_);
+      if (_status == heron::proto::system::OK) {
+        response.set_data(state_.data() + _pending.offset_, _pending.size_);
+      }
+      SendResponse(_pending.id_, _pending.conn_, response);
+    }
+  }
+
+  sp_int32 window_;
+  std::string state_;
+  std::string saved_;
+  std::vector<Pending> pending_;
+  // the restore chunks answered once the state is asked for again
+  std::vector<Pending> held_;
+  size_t max_pending_;
+  sp_int32 num_gets_;
+  sp_int64 fail_at_;
+};
+
+NetworkOptions MakeOptions(sp_int32 _port) {
+  NetworkOptions options;
+  options.set_host(LOCALHOST);
+  options.set_port(_port);
+  options.set_max_packet_size(64 * 1024 * 1024);
+  options.set_socket_family(PF_INET);
+  return options;
+}
+
+heron::proto::system::Instance MakeInstance() {
+  heron::proto::system::Instance instance;
+  instance.set_instance_id("instance-3");
+  instance.set_stmgr_id("stmgr-1");
+  instance.mutable_info()->set_task_id(3);
+  instance.mutable_info()->set_component_index(0);
+  instance.mutable_info()->set_component_name("word");
+  return instance;
+}
+
+sp_int64 ChunkSize() {
+  return static_cast<sp_int64>(heron::config::HeronInternalsConfigReader::Instance()
+                                   ->GetHeronStreammgrStatefulChunkSizeMb()) * 1024 * 1024;
+}
+
+sp_int32 ChunkWindow() {
+  return heron::config::HeronInternalsConfigReader::Instance()
+      ->GetHeronStreammgrStatefulChunkWindow();
+}
+
+// A state of a few chunks more than fit in the window, with a short last one
+std::string MakeState() {
+  std::string state((ChunkWindow() + 1) * ChunkSize() + ChunkSize() / 2, 0);
+  for (size_t i = 0; i < state.size(); ++i) state[i] = static_cast<char>(i * 7 + i / 1000);
+  return state;
+}
+
+// Runs the loop till the condition holds, or it has run for too long
+void RunUntil(EventLoopImpl* _loop, std::function<bool()> _done) {
+  sp_int32 ticks = 0;
+  sp_int64 timer = _loop->registerTimer([_loop, _done, &ticks](EventLoop::Status) {
+    if (_done() || ++ticks > 3000) _loop->loopExit();
+  }, true, 10 * 1000);
+  _loop->loop();
+  _loop->unRegisterTimer(timer);
+  EXPECT_TRUE(_done());
+}
+
+// Drives a CkptMgrClient against a FakeCkptMgr on one event loop
+struct ClientFixture {
+  ClientFixture(sp_int32 _port, const std::string& _state,
+                std::function<void(ClientFixture*)> _on_register = nullptr)
+      : ckptmgr_(&loop_, MakeOptions(_port), ChunkWindow(), _state), registered_(0),
+        num_saved_(0), num_got_(0), num_chunked_(0), got_status_(heron::proto::system::NOTOK) {
+    EXPECT_EQ(ckptmgr_.Start(), 0);
+    client_ = new heron::stmgr::CkptMgrClient(
+        &loop_, MakeOptions(_port), "mytopology", "abcd-9999", "ckptmgr-1", "stmgr-1",
+        [this](const heron::proto::system::Instance& _instance, const std::string& _ckpt) {
+          EXPECT_EQ(_instance.info().task_id(), 3);
+          EXPECT_EQ(_ckpt, CHECKPOINT_ID);
+          num_saved_++;
+        },
+        [this](heron::proto::system::StatusCode _status, sp_int32 _task_id, sp_string _ckpt,
+               heron::proto::ckptmgr::InstanceStateCheckpoint* _checkpoint) {
+          EXPECT_EQ(_task_id, 3);
+          EXPECT_EQ(_ckpt, CHECKPOINT_ID);
+          got_status_ = _status;
+          got_state_ = _checkpoint->state();
+          num_got_++;
+        },
+        [this](sp_int32 _task_id, const std::string& _ckpt) {
+          EXPECT_EQ(_task_id, 3);
+          EXPECT_EQ(_ckpt, CHECKPOINT_ID);
+          num_chunked_++;
+        },
+        [this, _on_register]() {
+          registered_++;
+          if (_on_register) _on_register(this);
+        });
+    client_->Start();
+    RunUntil(&loop_, [this]() { return registered_ > 0; });
+  }
+
+  ~ClientFixture() {
+    delete client_;
+    ckptmgr_.Stop();
+  }
+
+  void Save(const std::string& _state) {
+    auto request = new heron::proto::ckptmgr::SaveInstanceStateRequest();
+    request->mutable_instance()->CopyFrom(MakeInstance());
+    request->mutable_checkpoint()->set_checkpoint_id(CHECKPOINT_ID);
+    request->mutable_checkpoint()->set_state(_state);
+    client_->SaveInstanceState(request);
+  }
+
+  EventLoopImpl loop_;
+  FakeCkptMgr ckptmgr_;
+  heron::stmgr::CkptMgrClient* client_;
+  sp_int32 registered_;
+  sp_int32 num_saved_;
+  sp_int32 num_got_;
+  // how many times the chunks of a state started being fetched
+  sp_int32 num_chunked_;
+  heron::proto::system::StatusCode got_status_;
+  std::string got_state_;
+};
+
+// Test that a large state is saved in chunks, a window of them at a time
+TEST(CkptMgrClient, test_save_in_chunks) {
+  std::string state = MakeState();
+  ClientFixture fixture(62000, state);
+
+  fixture.Save(state);
+  EXPECT_EQ(fixture.client_->NumStateTransfers(), (size_t)1);
+  RunUntil(&fixture.loop_, [&fixture]() { return fixture.num_saved_ > 0; });
+
+  EXPECT_EQ(fixture.num_saved_, 1);
+  EXPECT_TRUE(fixture.ckptmgr_.saved() == state);
+  EXPECT_EQ(fixture.ckptmgr_.max_pending(), static_cast<size_t>(ChunkWindow()));
+  EXPECT_EQ(fixture.client_->NumStateTransfers(), (size_t)0);
+}
+
+// Test that a large state is restored in chunks, a window of them at a time
+TEST(CkptMgrClient, test_restore_in_chunks) {
+  std::string state = MakeState();
+  ClientFixture fixture(62001, state);
+
+  fixture.client_->GetInstanceState(MakeInstance(), CHECKPOINT_ID);
+  RunUntil(&fixture.loop_, [&fixture]() { return fixture.num_got_ > 0; });
+
+  EXPECT_EQ(fixture.num_got_, 1);
+  EXPECT_EQ(fixture.got_status_, heron::proto::system::OK);
+  EXPECT_TRUE(fixture.got_state_ == state);
+  EXPECT_EQ(fixture.ckptmgr_.num_gets(), 1);
+  EXPECT_EQ(fixture.num_chunked_, 1);
+  EXPECT_EQ(fixture.ckptmgr_.max_pending(), static_cast<size_t>(ChunkWindow()));
+  EXPECT_EQ(fixture.client_->NumStateTransfers(), (size_t)0);
+}
+
+// Test that a chunk the ckptmgr could not save drops the save
+TEST(CkptMgrClient, test_save_chunk_fails) {
+  std::string state = MakeState();
+  ClientFixture fixture(62002, state);
+  fixture.ckptmgr_.FailAt(ChunkSize());
+
+  fixture.Save(state);
+  RunUntil(&fixture.loop_,
+           [&fixture]() { return fixture.client_->NumStateTransfers() == 0; });
+
+  EXPECT_EQ(fixture.num_saved_, 0);
+}
+
+// Test that a chunk the ckptmgr could not send starts the restore over, and
+// that the late responses to the chunks of the failed restore are ignored
+TEST(CkptMgrClient, test_restore_chunk_fails) {
+  std::string state = MakeState();
+  ClientFixture fixture(62003, state);
+  fixture.ckptmgr_.FailAt(2 * ChunkSize());
+
+  fixture.client_->GetInstanceState(MakeInstance(), CHECKPOINT_ID);
+  RunUntil(&fixture.loop_, [&fixture]() { return fixture.num_got_ > 0; });
+
+  EXPECT_EQ(fixture.num_got_, 1);
+  EXPECT_EQ(fixture.got_status_, heron::proto::system::OK);
+  EXPECT_TRUE(fixture.got_state_ == state);
+  EXPECT_EQ(fixture.ckptmgr_.num_gets(), 2);
+  EXPECT_EQ(fixture.num_chunked_, 2);
+  EXPECT_EQ(fixture.client_->NumStateTransfers(), (size_t)0);
+}
+
+// Test that a save whose chunks can not be sent is dropped right away
+TEST(CkptMgrClient, test_save_not_connected) {
+  std::string state = MakeState();
+  size_t num_transfers = 1;
+  // The connection closes only once the callback is done, so the client
+  // still sends the state in chunks
+  ClientFixture fixture(62004, state, [&state, &num_transfers](ClientFixture* _fixture) {
+    _fixture->client_->Stop();
+    _fixture->Save(state);
+    num_transfers = _fixture->client_->NumStateTransfers();
+  });
+
+  EXPECT_EQ(num_transfers, (size_t)0);
+  EXPECT_EQ(fixture.num_saved_, 0);
+}
+
+int main(int argc, char** argv) {
+  heron::common::Initialize(argv[0]);
+  testing::InitGoogleTest(&argc, argv);
+  if (argc > 1) {
+    std::cerr << "Using config file " << argv[1] << std::endl;
+    heron_internals_config_filename = argv[1];
+  }
+  // The client reads its chunk size and window from here
+  heron::config::HeronInternalsConfigReader::Create(heron_internals_config_filename);
+  return RUN_ALL_TESTS();
+}
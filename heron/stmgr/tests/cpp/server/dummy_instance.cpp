@@ -192,3 +192,83 @@ void DummyBoltInstance::HandleNewInstanceAssignmentMsg(
     getEventLoop()->loopExit();
   }
 }
+
+//////////////////////////////////// DummyAckingSpoutInstance //////////////////////////////////
+DummyAckingSpoutInstance::DummyAckingSpoutInstance(
+    EventLoopImpl* eventLoop, const NetworkOptions& _options, const sp_string& _topology_name,
+    const sp_string& _topology_id, const sp_string& _instance_id,
+    const sp_string& _component_name, sp_int32 _task_id, sp_int32 _component_index,
+    const sp_string& _stmgr_id, const sp_string& _stream_id, sp_int32 _batch_size,
+    sp_int32 _num_batches)
+    : DummyInstance(eventLoop, _options, _topology_name, _topology_id, _instance_id,
+                    _component_name, _task_id, _component_index, _stmgr_id),
+      stream_id_(_stream_id),
+      batch_size_(_batch_size),
+      num_batches_(_num_batches),
+      batches_sent_(0),
+      unexpected_acks_(0) {}
+
+void DummyAckingSpoutInstance::HandleNewInstanceAssignmentMsg(
+    heron::proto::stmgr::NewInstanceAssignmentMessage* _msg) {
+  DummyInstance::HandleNewInstanceAssignmentMsg(_msg);
+  if (batches_sent_ == 0) SendBatch();
+}
+
+void DummyAckingSpoutInstance::SendBatch() {
+  heron::proto::system::HeronTupleSet tuple_set;
+  heron::proto::system::HeronDataTupleSet* data_set = tuple_set.mutable_data();
+  heron::proto::api::StreamId* tstream = data_set->mutable_stream();
+  tstream->set_id(stream_id_);
+  tstream->set_component_name(component_name_);
+  for (sp_int32 i = 0; i < batch_size_; ++i) {
+    heron::proto::system::HeronDataTuple* tuple = data_set->add_tuples();
+    tuple->set_key(0);
+    heron::proto::system::RootId* root = tuple->add_roots();
+    root->set_taskid(task_id_);
+    // Roots are numbered from 1 across the batches
+    root->set_key(batches_sent_ * batch_size_ + i + 1);
+    *(tuple->add_values()) = "dummy data";
+  }
+  SendMessage(tuple_set);
+  ++batches_sent_;
+}
+
+void DummyAckingSpoutInstance::HandleTupleMessage(heron::proto::system::HeronTupleSet2* _message) {
+  if (!_message->has_control()) return;
+  const heron::proto::system::HeronControlTupleSet& control = _message->control();
+  for (sp_int32 i = 0; i < control.acks_size(); ++i) {
+    sp_int64 key = control.acks(i).roots(0).key();
+    if (key < 1 || key > batches_sent_ * batch_size_ || !acked_.insert(key).second) {
+      ++unexpected_acks_;
+    }
+  }
+  if (NumAcked() < batches_sent_ * batch_size_) return;
+  if (batches_sent_ < num_batches_) {
+    SendBatch();
+  } else {
+    getEventLoop()->loopExit();
+  }
+}
+
+//////////////////////////////////// DummyAckingBoltInstance ///////////////////////////////////
+DummyAckingBoltInstance::DummyAckingBoltInstance(
+    EventLoopImpl* eventLoop, const NetworkOptions& _options, const sp_string& _topology_name,
+    const sp_string& _topology_id, const sp_string& _instance_id,
+    const sp_string& _component_name, sp_int32 _task_id, sp_int32 _component_index,
+    const sp_string& _stmgr_id)
+    : DummyInstance(eventLoop, _options, _topology_name, _topology_id, _instance_id,
+                    _component_name, _task_id, _component_index, _stmgr_id) {}
+
+void DummyAckingBoltInstance::HandleTupleMessage(heron::proto::system::HeronTupleSet2* _message) {
+  if (!_message->has_data()) return;
+  heron::proto::system::HeronTupleSet acks;
+  heron::proto::system::HeronDataTuple tuple;
+  for (sp_int32 i = 0; i < _message->data().tuples_size(); ++i) {
+    CHECK(tuple.ParseFromString(_message->data().tuples(i)));
+    heron::proto::system::AckTuple* ack = acks.mutable_control()->add_acks();
+    ack->mutable_roots()->CopyFrom(tuple.roots());
+    ack->set_ackedtuple(tuple.key());
+  }
+  acks.set_src_task_id(task_id_);
+  SendMessage(acks);
+}
@@ -17,6 +17,7 @@
 #ifndef __DUMMY_INSTANCE_H
 #define __DUMMY_INSTANCE_H
 
+#include <set>
 #include "proto/messages.h"
 #include "network/network_error.h"
 
@@ -114,4 +115,49 @@ class DummyBoltInstance : public DummyInstance {
   sp_int32 msgs_recvd_;
 };
 
+// A spout that anchors every tuple it emits. It emits a batch at a time, and
+// the next batch once every tuple of the last one is acked.
+class DummyAckingSpoutInstance : public DummyInstance {
+ public:
+  DummyAckingSpoutInstance(EventLoopImpl* eventLoop, const NetworkOptions& _options,
+                           const sp_string& _topology_name, const sp_string& _topology_id,
+                           const sp_string& _instance_id, const sp_string& _component_name,
+                           sp_int32 _task_id, sp_int32 _component_index,
+                           const sp_string& _stmgr_id, const sp_string& _stream_id,
+                           sp_int32 _batch_size, sp_int32 _num_batches);
+
+  sp_int32 NumAcked() { return acked_.size(); }
+  // Acks of roots that were already acked, or never emitted
+  sp_int32 NumUnexpectedAcks() { return unexpected_acks_; }
+
+ protected:
+  virtual void HandleTupleMessage(heron::proto::system::HeronTupleSet2* _message);
+  virtual void HandleNewInstanceAssignmentMsg(
+      heron::proto::stmgr::NewInstanceAssignmentMessage* _msg);
+
+ private:
+  void SendBatch();
+
+  sp_string stream_id_;
+  sp_int32 batch_size_;
+  sp_int32 num_batches_;
+  sp_int32 batches_sent_;
+  std::set<sp_int64> acked_;
+  sp_int32 unexpected_acks_;
+};
+
+// A bolt that acks every tuple it gets, one tuple set of acks for every
+// tuple set it gets
+class DummyAckingBoltInstance : public DummyInstance {
+ public:
+  DummyAckingBoltInstance(EventLoopImpl* eventLoop, const NetworkOptions& _options,
+                          const sp_string& _topology_name, const sp_string& _topology_id,
+                          const sp_string& _instance_id, const sp_string& _component_name,
+                          sp_int32 _task_id, sp_int32 _component_index,
+                          const sp_string& _stmgr_id);
+
+ protected:
+  virtual void HandleTupleMessage(heron::proto::system::HeronTupleSet2* _message);
+};
+
 #endif
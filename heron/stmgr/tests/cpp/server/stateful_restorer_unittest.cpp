@@ -0,0 +1,325 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "glog/logging.h"
+#include "proto/messages.h"
+#include "basics/basics.h"
+#include "errors/errors.h"
+#include "threads/threads.h"
+#include "network/network.h"
+#include "basics/modinit.h"
+#include "errors/modinit.h"
+#include "threads/modinit.h"
+#include "network/modinit.h"
+#include "config/heron-internals-config-reader.h"
+#include "metrics/metrics.h"
+#include "manager/ckptmgr-client.h"
+#include "manager/stateful-restorer.h"
+#include "manager/stmgr-clientmgr.h"
+#include "manager/stmgr-server.h"
+#include "util/tuple-cache.h"
+
+const sp_string LOCALHOST = "127.0.0.1";
+const sp_string STMGR_ID = "stmgr-1";
+const sp_string CHECKPOINT_ID = "ckpt-1";
+sp_string heron_internals_config_filename =
+    "../../../../../../../../heron/config/heron_internals.yaml";
+
+// Stands in for a ckptmgr. It never answers the requests for states, which
+// the tests answer by calling the restorer instead.
+class FakeCkptMgr : public Server {
+ public:
+  FakeCkptMgr(EventLoopImpl* eventLoop, const NetworkOptions& _options)
+      : Server(eventLoop, _options) {
+    InstallRequestHandler(&FakeCkptMgr::HandleStMgrRegisterRequest);
+    InstallRequestHandler(&FakeCkptMgr::HandleGetInstanceStateRequest);
+  }
+
+  const std::vector<sp_int32>& gets() const { return gets_; }
+
+ protected:
+  virtual void HandleNewConnection(Connection* _conn) {}
+  virtual void HandleConnectionClose(Connection*, NetworkErrorCode) {}
+
+ private:
+  void HandleStMgrRegisterRequest(REQID _id, Connection* _conn,
+                                  heron::proto::ckptmgr::RegisterStMgrRequest* _request) {
+    heron::proto::ckptmgr::RegisterStMgrResponse response;
+    response.mutable_status()->set_status(heron::proto::system::OK);
+    response.set_takes_state_chunks(true);
+    SendResponse(_id, _conn, response);
+    __global_protobuf_pool_release__(_request);
+  }
+
+  void HandleGetInstanceStateRequest(REQID, Connection*,
+                                     heron::proto::ckptmgr::GetInstanceStateRequest* _request) {
+    gets_.push_back(_request->instance().info().task_id());
+    __global_protobuf_pool_release__(_request);
+  }
+
+  std::vector<sp_int32> gets_;
+};
+
+// Stands in for the local instances, which are all connected
+class MockStMgrServer : public heron::stmgr::StMgrServer {
+ public:
+  MockStMgrServer(EventLoopImpl* eventLoop, const NetworkOptions& _options,
+                  heron::common::MetricsMgrSt* _metrics, const std::vector<sp_int32>& _task_ids)
+      : StMgrServer(eventLoop, _options, "mytopology", "abcd-9999", STMGR_ID,
+                    std::vector<sp_string>(), NULL, _metrics, NULL) {
+    for (auto task_id : _task_ids) {
+      auto& instance = instances_[task_id];
+      instance.set_instance_id("instance-" + std::to_string(task_id));
+      instance.set_stmgr_id(STMGR_ID);
+      instance.mutable_info()->set_task_id(task_id);
+      instance.mutable_info()->set_component_index(task_id);
+      instance.mutable_info()->set_component_name("word");
+    }
+  }
+
+  virtual bool HaveAllInstancesConnectedToUs() const { return true; }
+
+  virtual void GetInstanceInfo(std::vector<heron::proto::system::Instance*>& _return) {
+    for (auto& kv : instances_) _return.push_back(&kv.second);
+  }
+
+  virtual heron::proto::system::Instance* GetInstanceInfo(sp_int32 _task_id) {
+    return &instances_[_task_id];
+  }
+
+  virtual bool IsInstanceConnected(sp_int32) const { return true; }
+
+  virtual bool SendRestoreInstanceStateRequest(
+      sp_int32 _task_id, heron::proto::ckptmgr::InstanceStateCheckpoint* _state) {
+    restored_[_task_id] = _state->state();
+    _state->Clear();
+    return true;
+  }
+
+  virtual void ClearCache() {}
+
+  // the state sent to each task
+  std::map<sp_int32, std::string> restored_;
+
+ private:
+  std::map<sp_int32, heron::proto::system::Instance> instances_;
+};
+
+NetworkOptions MakeOptions(sp_int32 _port) {
+  NetworkOptions options;
+  options.set_host(LOCALHOST);
+  options.set_port(_port);
+  options.set_max_packet_size(64 * 1024 * 1024);
+  options.set_socket_family(PF_INET);
+  return options;
+}
+
+// Runs the loop till the condition holds, or it has run for too long
+void RunUntil(EventLoopImpl* _loop, std::function<bool()> _done) {
+  sp_int32 ticks = 0;
+  sp_int64 timer = _loop->registerTimer([_loop, _done, &ticks](EventLoop::Status) {
+    if (_done() || ++ticks > 3000) _loop->loopExit();
+  }, true, 10 * 1000);
+  _loop->loop();
+  _loop->unRegisterTimer(timer);
+  EXPECT_TRUE(_done());
+}
+
+void Sleep(sp_int32 _ms) { std::this_thread::sleep_for(std::chrono::milliseconds(_ms)); }
+
+namespace heron {
+namespace stmgr {
+
+// Drives a StatefulRestorer whose ckptmgr answers and instances are played
+// by the test
+class StatefulRestorerTest : public ::testing::Test {
+ protected:
+  void SetUp() {
+    sp_int32 port = next_port_;
+    next_port_ += 3;
+    metrics_ = new common::MetricsMgrSt(LOCALHOST, port, port + 1, "__stmgr__", STMGR_ID, 60,
+                                        &loop_);
+    ckptmgr_ = new FakeCkptMgr(&loop_, MakeOptions(port));
+    EXPECT_EQ(ckptmgr_->Start(), 0);
+    registered_ = false;
+    client_ = new CkptMgrClient(&loop_, MakeOptions(port), "mytopology", "abcd-9999",
+        "ckptmgr-1", STMGR_ID,
+        [](const proto::system::Instance&, const std::string&) {},
+        [](proto::system::StatusCode, sp_int32, sp_string,
+           proto::ckptmgr::InstanceStateCheckpoint*) {},
+        [](sp_int32, const std::string&) {},
+        [this]() { registered_ = true; });
+    client_->Start();
+    RunUntil(&loop_, [this]() { return registered_; });
+
+    server_ = new MockStMgrServer(&loop_, MakeOptions(port + 2), metrics_, {1, 2});
+    EXPECT_EQ(server_->Start(), 0);
+    clientmgr_ = new StMgrClientMgr(&loop_, "mytopology", "abcd-9999", STMGR_ID, NULL,
+                                    metrics_);
+    tuple_cache_ = new TupleCache(&loop_, 1024 * 1024);
+    done_status_ = proto::system::NOTOK;
+    num_done_ = 0;
+    restorer_ = new StatefulRestorer(client_, clientmgr_, tuple_cache_, server_, metrics_,
+        [this](proto::system::StatusCode _status, std::string, sp_int64) {
+          done_status_ = _status;
+          num_done_++;
+        });
+  }
+
+  void TearDown() {
+    delete restorer_;
+    delete tuple_cache_;
+    delete clientmgr_;
+    delete server_;
+    delete client_;
+    ckptmgr_->Stop();
+    delete ckptmgr_;
+    delete metrics_;
+  }
+
+  void StartRestore() {
+    proto::system::PhysicalPlan pplan;
+    restorer_->StartRestore(CHECKPOINT_ID, 1, &pplan);
+    RunUntil(&loop_, [this]() { return ckptmgr_->gets().size() == 2; });
+  }
+
+  // The ckptmgr sends the whole state of the task
+  void GotState(sp_int32 _task_id, const std::string& _state) {
+    proto::ckptmgr::InstanceStateCheckpoint checkpoint;
+    checkpoint.set_checkpoint_id(CHECKPOINT_ID);
+    checkpoint.set_state(_state);
+    restorer_->HandleCheckpointState(proto::system::OK, _task_id, CHECKPOINT_ID, &checkpoint);
+  }
+
+  // The mean milliseconds recorded for each phase since the last call
+  std::map<std::string, double> Phases() {
+    proto::system::MetricPublisherPublishMessage message;
+    restorer_->phase_time_metric_->GetAndReset("phase", &message);
+    std::map<std::string, double> phases;
+    for (auto& metric : message.metrics()) {
+      phases[metric.name().substr(std::string("phase/").size())] = std::stod(metric.value());
+    }
+    return phases;
+  }
+
+  static sp_int32 next_port_;
+
+  EventLoopImpl loop_;
+  common::MetricsMgrSt* metrics_;
+  FakeCkptMgr* ckptmgr_;
+  CkptMgrClient* client_;
+  bool registered_;
+  MockStMgrServer* server_;
+  StMgrClientMgr* clientmgr_;
+  TupleCache* tuple_cache_;
+  StatefulRestorer* restorer_;
+  proto::system::StatusCode done_status_;
+  sp_int32 num_done_;
+};
+
+sp_int32 StatefulRestorerTest::next_port_ = 62100;
+
+// Test that a state that comes whole is timed from the request to the
+// answer, and the instance from the hand over to its restore
+TEST_F(StatefulRestorerTest, test_phases_whole) {
+  StartRestore();
+  Sleep(100);
+  GotState(1, "state-1");
+  GotState(2, "state-2");
+  EXPECT_EQ(server_->restored_[1], "state-1");
+  EXPECT_EQ(server_->restored_[2], "state-2");
+  Sleep(100);
+  restorer_->HandleInstanceRestoredState(1, CHECKPOINT_ID);
+  restorer_->HandleInstanceRestoredState(2, CHECKPOINT_ID);
+  EXPECT_EQ(num_done_, 1);
+  EXPECT_EQ(done_status_, proto::system::OK);
+
+  auto phases = Phases();
+  EXPECT_GE(phases["fetch"], 100);
+  EXPECT_LT(phases["transfer"], 100);
+  EXPECT_GE(phases["apply"], 100);
+}
+
+// Test that a state that comes in chunks is transferred from its first
+// chunk to when it is handed to the instance, and fetched till then
+TEST_F(StatefulRestorerTest, test_phases_chunks) {
+  StartRestore();
+  Sleep(100);
+  restorer_->HandleCheckpointStateChunks(1, CHECKPOINT_ID);
+  restorer_->HandleCheckpointStateChunks(2, CHECKPOINT_ID);
+  Sleep(300);
+  GotState(1, "state-1");
+  GotState(2, "state-2");
+  restorer_->HandleInstanceRestoredState(1, CHECKPOINT_ID);
+  restorer_->HandleInstanceRestoredState(2, CHECKPOINT_ID);
+  EXPECT_EQ(num_done_, 1);
+
+  auto phases = Phases();
+  EXPECT_GE(phases["fetch"], 100);
+  EXPECT_LT(phases["fetch"], 300);
+  EXPECT_GE(phases["transfer"], 300);
+  EXPECT_LT(phases["apply"], 100);
+}
+
+// Test that a state fetched again because a chunk failed is timed once,
+// from its first fetch
+TEST_F(StatefulRestorerTest, test_phases_chunks_again) {
+  StartRestore();
+  Sleep(100);
+  restorer_->HandleCheckpointStateChunks(1, CHECKPOINT_ID);
+  Sleep(300);
+  restorer_->HandleCheckpointStateChunks(1, CHECKPOINT_ID);
+  GotState(1, "state-1");
+
+  auto phases = Phases();
+  EXPECT_GE(phases["fetch"], 100);
+  EXPECT_LT(phases["fetch"], 300);
+  EXPECT_GE(phases["transfer"], 300);
+}
+
+// Test that chunks of another checkpoint, or of a state no longer asked
+// for, are not timed
+TEST_F(StatefulRestorerTest, test_phases_ignored) {
+  StartRestore();
+  restorer_->HandleCheckpointStateChunks(1, "ckpt-0");
+  restorer_->HandleCheckpointStateChunks(3, CHECKPOINT_ID);
+
+  auto phases = Phases();
+  EXPECT_EQ(phases.count("fetch"), (size_t)0);
+  EXPECT_EQ(phases.count("transfer"), (size_t)0);
+}
+
+}  // namespace stmgr
+}  // namespace heron
+
+int main(int argc, char** argv) {
+  heron::common::Initialize(argv[0]);
+  testing::InitGoogleTest(&argc, argv);
+  if (argc > 1) {
+    std::cerr << "Using config file " << argv[1] << std::endl;
+    heron_internals_config_filename = argv[1];
+  }
+  heron::config::HeronInternalsConfigReader::Create(heron_internals_config_filename);
+  return RUN_ALL_TESTS();
+}
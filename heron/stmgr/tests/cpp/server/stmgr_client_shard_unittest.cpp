@@ -0,0 +1,300 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "glog/logging.h"
+#include "proto/messages.h"
+#include "basics/basics.h"
+#include "errors/errors.h"
+#include "threads/threads.h"
+#include "threads/spcountdownlatch.h"
+#include "network/network.h"
+#include "basics/modinit.h"
+#include "errors/modinit.h"
+#include "threads/modinit.h"
+#include "network/modinit.h"
+#include "config/heron-internals-config-reader.h"
+#include "metrics/metrics.h"
+#include "manager/stmgr-clientmgr.h"
+#include "manager/stmgr-client-shard.h"
+
+const sp_string LOCALHOST = "127.0.0.1";
+const sp_string OUR_STMGR = "stmgr0";
+const sp_string OTHER_STMGR = "stmgr1";
+sp_string heron_internals_config_filename =
+    "../../../../../../../../heron/config/heron_internals.yaml";
+
+// Stands in for the stmgr the shard's client talks to. Says hello back and
+// checks that the tuple sets come in the order they were sent in.
+class ShardPeer : public Server {
+ public:
+  ShardPeer(EventLoopImpl* eventLoop, const NetworkOptions& _options, sp_int32 _expected,
+            std::function<void()> _done)
+      : Server(eventLoop, _options), expected_(_expected), received_(0), in_order_(true),
+        done_(_done) {
+    InstallRequestHandler(&ShardPeer::HandleStMgrHelloRequest);
+    InstallMessageHandler(&ShardPeer::HandleTupleStreamMessage);
+  }
+
+  sp_int32 Received() { return received_; }
+  bool InOrder() { return in_order_; }
+
+ protected:
+  virtual void HandleNewConnection(Connection* _conn) {}
+  virtual void HandleConnectionClose(Connection*, NetworkErrorCode) {}
+
+  void HandleStMgrHelloRequest(REQID _id, Connection* _conn,
+                               heron::proto::stmgr::StrMgrHelloRequest* _request) {
+    heron::proto::stmgr::StrMgrHelloResponse response;
+    response.mutable_status()->set_status(heron::proto::system::OK);
+    SendResponse(_id, _conn, response);
+    delete _request;
+  }
+
+  void HandleTupleStreamMessage(Connection*, heron::proto::stmgr::TupleStreamMessage2* _message) {
+    // We number the tuple sets by their task id
+    if (_message->task_id() != received_) in_order_ = false;
+    if (++received_ == expected_) done_();
+    __global_protobuf_pool_release__(_message);
+  }
+
+ private:
+  sp_int32 expected_;
+  std::atomic<sp_int32> received_;
+  std::atomic<bool> in_order_;
+  std::function<void()> done_;
+};
+
+// Records what the shard and its clients report, instead of passing it
+// on to a stmgr
+class FakeClientMgr : public heron::stmgr::StMgrClientMgr {
+ public:
+  FakeClientMgr(EventLoop* eventLoop, heron::common::MetricsMgrSt* _metrics_manager_client)
+      : heron::stmgr::StMgrClientMgr(eventLoop, "mytopology", "abcd-9999", OUR_STMGR, NULL,
+                                     _metrics_manager_client),
+        registered_(1), registered_generation_(-1), dropped_(1), back_pressure_starts_(0),
+        back_pressure_stops_(0) {}
+
+  virtual void StartBackPressureOnServer(const sp_string& _other_stmgr_id) {
+    EXPECT_EQ(_other_stmgr_id, "__client_shard_0");
+    ++back_pressure_starts_;
+  }
+  virtual void StopBackPressureOnServer(const sp_string& _other_stmgr_id) {
+    EXPECT_EQ(_other_stmgr_id, "__client_shard_0");
+    ++back_pressure_stops_;
+  }
+  virtual bool DidAnnounceBackPressure() { return false; }
+  virtual void HandleDeadStMgrConnection(const sp_string& _stmgr_id, sp_int64 _generation) {}
+  virtual void HandleStMgrClientRegistered(const sp_string& _stmgr_id, sp_int64 _generation) {
+    registered_generation_ = _generation;
+    registered_.countDown();
+  }
+  virtual void HandleHelloSent(const sp_string& _stmgr_id, sp_int64 _generation) {}
+  virtual void HandleDroppedTupleSet(const sp_string& _stmgr_id) {
+    dropped_stmgr_ = _stmgr_id;
+    dropped_.countDown();
+  }
+
+  CountDownLatch registered_;
+  sp_int64 registered_generation_;
+  CountDownLatch dropped_;
+  sp_string dropped_stmgr_;
+  sp_int32 back_pressure_starts_;
+  sp_int32 back_pressure_stops_;
+};
+
+NetworkOptions MakeOptions(sp_int32 _port) {
+  NetworkOptions options;
+  options.set_host(LOCALHOST);
+  options.set_port(_port);
+  options.set_max_packet_size(1024 * 1024);
+  options.set_socket_family(PF_INET);
+  return options;
+}
+
+heron::proto::system::HeronTupleSet2* MakeTupleSet() {
+  heron::proto::system::HeronTupleSet2* tuple_set = NULL;
+  tuple_set = __global_protobuf_pool_acquire__(tuple_set);
+  tuple_set->set_src_task_id(0);
+  *(tuple_set->mutable_data()->add_tuples()) = "dummy data";
+  return tuple_set;
+}
+
+// Test that tuple sets get through a shard in order, also when there are more
+// than fit in its queue
+TEST(StMgrClientShard, test_tuples_go_through) {
+  const sp_int32 num_tuple_sets = 1000;
+  sp_int32 port = 61000;
+
+  // The test thread runs the control loop
+  EventLoopImpl control_loop;
+  Piper control_piper(&control_loop);
+  heron::common::MetricsMgrSt metrics(LOCALHOST, 61001, 61002, "__stmgr__", OUR_STMGR, 60,
+                                      &control_loop);
+  FakeClientMgr client_manager(&control_loop, &metrics);
+
+  EventLoopImpl peer_loop;
+  Piper peer_piper(&peer_loop);
+  ShardPeer peer(&peer_loop, MakeOptions(port), num_tuple_sets, [&control_piper, &control_loop]() {
+    control_piper.ExecuteInEventLoop([&control_loop]() { control_loop.loopExit(); });
+  });
+  EXPECT_EQ(peer.Start(), 0);
+  std::thread peer_thread([&peer_loop]() { peer_loop.loop(); });
+
+  // A queue of 4 can't take the tuple sets sent while the control loop
+  // is not running
+  heron::stmgr::StMgrClientShard* shard = new heron::stmgr::StMgrClientShard(
+      "mytopology", "abcd-9999", OUR_STMGR, "__client_shard_0", &client_manager, &control_piper,
+      4);
+  shard->StartClient(OTHER_STMGR, MakeOptions(port), 1, 7);
+  client_manager.registered_.wait();
+  EXPECT_EQ(client_manager.registered_generation_, 7);
+
+  for (sp_int32 i = 0; i < num_tuple_sets; ++i) {
+    shard->SendTupleStreamMessage(i, OTHER_STMGR, MakeTupleSet());
+  }
+  EXPECT_EQ(client_manager.back_pressure_starts_, 1);
+
+  // Flushing what did not fit happens on the control loop
+  control_loop.loop();
+
+  EXPECT_EQ(peer.Received(), num_tuple_sets);
+  EXPECT_TRUE(peer.InOrder());
+  EXPECT_EQ(client_manager.back_pressure_stops_, client_manager.back_pressure_starts_);
+  EXPECT_EQ(client_manager.dropped_.getCount(), (sp_uint32)1);
+
+  delete shard;
+  peer_piper.ExecuteInEventLoop([&peer_loop]() { peer_loop.loopExit(); });
+  peer_thread.join();
+}
+
+// Test that tuple sets dropped on the shard thread are reported to the
+// client manager
+TEST(StMgrClientShard, test_drops_are_reported) {
+  EventLoopImpl control_loop;
+  Piper control_piper(&control_loop);
+  heron::common::MetricsMgrSt metrics(LOCALHOST, 61011, 61012, "__stmgr__", OUR_STMGR, 60,
+                                      &control_loop);
+  FakeClientMgr client_manager(&control_loop, &metrics);
+
+  heron::stmgr::StMgrClientShard* shard = new heron::stmgr::StMgrClientShard(
+      "mytopology", "abcd-9999", OUR_STMGR, "__client_shard_0", &client_manager, &control_piper,
+      1024);
+  // Nobody listens on this port, so the client never connects
+  shard->StartClient(OTHER_STMGR, MakeOptions(61010), 1, 0);
+  shard->SendTupleStreamMessage(0, OTHER_STMGR, MakeTupleSet());
+  client_manager.dropped_.wait();
+
+  EXPECT_EQ(client_manager.dropped_stmgr_, OTHER_STMGR);
+  EXPECT_EQ(client_manager.registered_.getCount(), (sp_uint32)1);
+  EXPECT_EQ(client_manager.back_pressure_starts_, 0);
+
+  delete shard;
+}
+
+namespace heron {
+namespace stmgr {
+
+// Runs a StMgrClientMgr with a shard, without a stmgr behind it
+class StMgrClientMgrTest : public ::testing::Test {
+ protected:
+  void SetUp() {
+    metrics_ = new heron::common::MetricsMgrSt(LOCALHOST, 61021, 61022, "__stmgr__", OUR_STMGR,
+                                               60, &control_loop_);
+    client_manager_ = new StMgrClientMgr(&control_loop_, "mytopology", "abcd-9999", OUR_STMGR,
+                                         NULL, metrics_);
+    client_manager_->control_piper_ = new Piper(&control_loop_);
+    client_manager_->shards_.push_back(new StMgrClientShard(
+        "mytopology", "abcd-9999", OUR_STMGR, "__client_shard_0", client_manager_,
+        client_manager_->control_piper_, 1024));
+  }
+
+  void TearDown() {
+    delete client_manager_;
+    delete metrics_;
+  }
+
+  // Nobody listens on these ports, so the clients never connect by themselves
+  void StartClient(const sp_string& _stmgr_id, sp_int32 _port) {
+    client_manager_->StartShardedClient(_stmgr_id, LOCALHOST, _port);
+  }
+
+  void QuitClient(const sp_string& _stmgr_id) { client_manager_->QuitShardedClient(_stmgr_id); }
+
+  sp_int64 Generation(const sp_string& _stmgr_id) {
+    return client_manager_->sharded_clients_[_stmgr_id].generation_;
+  }
+
+  bool IsRegistered(const sp_string& _stmgr_id) {
+    return client_manager_->registered_clients_.count(_stmgr_id) > 0;
+  }
+
+  // Runs what has been forwarded to the control loop so far
+  void RunControlLoop() {
+    EventLoopImpl* loop = &control_loop_;
+    client_manager_->control_piper_->ExecuteInEventLoop([loop]() { loop->loopExit(); });
+    control_loop_.loop();
+  }
+
+  EventLoopImpl control_loop_;
+  heron::common::MetricsMgrSt* metrics_;
+  StMgrClientMgr* client_manager_;
+};
+
+// Test that the callbacks of a client that has been replaced are ignored
+TEST_F(StMgrClientMgrTest, test_stale_callbacks_ignored) {
+  // Another stmgr that never registers, so that not all of them are
+  StartClient("stmgr2", 61023);
+  StartClient(OTHER_STMGR, 61024);
+  sp_int64 old_generation = Generation(OTHER_STMGR);
+  // The stmgr moves
+  QuitClient(OTHER_STMGR);
+  StartClient(OTHER_STMGR, 61025);
+  sp_int64 generation = Generation(OTHER_STMGR);
+  EXPECT_NE(generation, old_generation);
+
+  client_manager_->HandleStMgrClientRegistered(OTHER_STMGR, old_generation);
+  RunControlLoop();
+  EXPECT_FALSE(IsRegistered(OTHER_STMGR));
+
+  client_manager_->HandleStMgrClientRegistered(OTHER_STMGR, generation);
+  RunControlLoop();
+  EXPECT_TRUE(IsRegistered(OTHER_STMGR));
+
+  client_manager_->HandleDeadStMgrConnection(OTHER_STMGR, old_generation);
+  RunControlLoop();
+  EXPECT_TRUE(IsRegistered(OTHER_STMGR));
+}
+
+}  // namespace stmgr
+}  // namespace heron
+
+int main(int argc, char** argv) {
+  heron::common::Initialize(argv[0]);
+  testing::InitGoogleTest(&argc, argv);
+  if (argc > 1) {
+    std::cerr << "Using config file " << argv[1] << std::endl;
+    heron_internals_config_filename = argv[1];
+  }
+  // The client manager reads its configs from here
+  heron::config::HeronInternalsConfigReader::Create(heron_internals_config_filename);
+  return RUN_ALL_TESTS();
+}
@@ -313,6 +313,7 @@ struct CommonResources {
   sp_int32 num_spout_instances_;
   sp_int32 num_bolts_;
   sp_int32 num_bolt_instances_;
+  bool enable_acking_;
 
   heron::proto::api::Grouping grouping_;
 
@@ -350,7 +351,8 @@ struct CommonResources {
   std::map<sp_string, heron::proto::system::Instance*> instanceid_instance_;
 
   std::map<sp_string, sp_int32> instanceid_stmgr_;
-  CommonResources() : topology_(NULL), tmaster_(NULL), tmaster_thread_(NULL) {
+  CommonResources()
+      : enable_acking_(false), topology_(NULL), tmaster_(NULL), tmaster_thread_(NULL) {
     // Create the sington for heron_internals_config_reader
     // if it does not exist
     if (!heron::config::HeronInternalsConfigReader::Exists()) {
@@ -370,6 +372,12 @@ void StartTMaster(CommonResources& common) {
   common.topology_ = GenerateDummyTopology(
       common.topology_name_, common.topology_id_, common.num_spouts_, common.num_spout_instances_,
       common.num_bolts_, common.num_bolt_instances_, common.grouping_);
+  if (common.enable_acking_) {
+    heron::proto::api::Config::KeyValue* kv =
+        common.topology_->mutable_topology_config()->add_kvs();
+    kv->set_key(heron::config::TopologyConfigVars::TOPOLOGY_ENABLE_ACKING);
+    kv->set_value("true");
+  }
 
   // Create the zk state on the local file system
   CreateLocalStateOnFS(common.topology_, common.dpath_);
@@ -736,6 +744,104 @@ TEST(StMgr, test_tuple_route) {
   TearCommonResources(common);
 }
 
+// Test to make sure that an ack tuple set going to a spout carries only the
+// acks that came in since the last one, even though the stmgr reuses it
+TEST(StMgr, test_acks_not_resent) {
+  CommonResources common;
+  // Initialize dummy params
+  common.tmaster_port_ = 16000;
+  common.tmaster_controller_port_ = 16001;
+  common.tmaster_stats_port_ = 16002;
+  common.stmgr_baseport_ = 26000;
+  common.metricsmgr_port_ = 36000;
+  common.shell_port_ = 46000;
+  common.checkpoint_manager_port_ = 56000;
+  common.topology_name_ = "mytopology";
+  common.topology_id_ = "abcd-9999";
+  common.num_stmgrs_ = 1;
+  common.num_spouts_ = 1;
+  common.num_spout_instances_ = 1;
+  common.num_bolts_ = 1;
+  common.num_bolt_instances_ = 1;
+  common.enable_acking_ = true;
+  common.grouping_ = heron::proto::api::SHUFFLE;
+  // Empty so that we don't attempt to connect to the zk
+  // but instead connect to the local filesytem
+  common.zkhostportlist_ = "";
+
+  sp_int32 batch_size = 10;
+  sp_int32 num_batches = 2;
+
+  // Start the tmaster etc.
+  StartTMaster(common);
+
+  // Start the metrics mgr
+  StartMetricsMgr(common);
+
+  // Distribute workers across stmgrs
+  DistributeWorkersAcrossStmgrs(common);
+
+  // Start the stream managers
+  StartStMgrs(common);
+
+  NetworkOptions options;
+  options.set_host(LOCALHOST);
+  options.set_port(common.stmgr_baseport_);
+  options.set_max_packet_size(1024 * 1024);
+  options.set_socket_family(PF_INET);
+
+  // Start the bolt, then the spout that sends its second batch only once
+  // the first one has been acked
+  sp_string bolt_id = CreateInstanceId(0, 0, false);
+  const heron::proto::system::Instance* bolt_imap = common.instanceid_instance_[bolt_id];
+  EventLoopImpl* bolt_ss = new EventLoopImpl();
+  DummyAckingBoltInstance* bolt = new DummyAckingBoltInstance(
+      bolt_ss, options, common.topology_name_, common.topology_id_, bolt_id,
+      bolt_imap->info().component_name(), bolt_imap->info().task_id(),
+      bolt_imap->info().component_index(), bolt_imap->stmgr_id());
+  bolt->Start();
+  std::thread* bolt_thread = new std::thread(StartServer, bolt_ss);
+  common.ss_list_.push_back(bolt_ss);
+
+  sp_string spout_id = CreateInstanceId(0, 0, true);
+  const heron::proto::system::Instance* spout_imap = common.instanceid_instance_[spout_id];
+  EventLoopImpl* spout_ss = new EventLoopImpl();
+  DummyAckingSpoutInstance* spout = new DummyAckingSpoutInstance(
+      spout_ss, options, common.topology_name_, common.topology_id_, spout_id,
+      spout_imap->info().component_name(), spout_imap->info().task_id(),
+      spout_imap->info().component_index(), spout_imap->stmgr_id(), STREAM_NAME + "0",
+      batch_size, num_batches);
+  spout->Start();
+  std::thread* spout_thread = new std::thread(StartServer, spout_ss);
+  common.ss_list_.push_back(spout_ss);
+
+  // Wait for the spout to get all its acks
+  spout_thread->join();
+
+  // Stop the schedulers
+  for (size_t i = 0; i < common.ss_list_.size(); ++i) {
+    common.ss_list_[i]->loopExit();
+  }
+
+  // Wait for the threads to terminate. We have already waited for the spout
+  // thread
+  common.tmaster_thread_->join();
+  common.metrics_mgr_thread_->join();
+  for (size_t i = 0; i < common.stmgrs_threads_list_.size(); ++i) {
+    common.stmgrs_threads_list_[i]->join();
+  }
+  bolt_thread->join();
+
+  EXPECT_EQ(spout->NumAcked(), batch_size * num_batches);
+  EXPECT_EQ(spout->NumUnexpectedAcks(), 0);
+
+  delete spout_thread;
+  delete spout;
+  delete bolt_thread;
+  delete bolt;
+  TearCommonResources(common);
+}
+
 // Test to make sure that custom grouping routing works
 TEST(StMgr, test_custom_grouping_route) {
   CommonResources common;
@@ -0,0 +1,160 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the RotatingMap against the list of unordered_maps it used to
+// be, for the create/anchor/remove/rotate pattern of the XorManager.
+// Every phase reports the average nanoseconds per key, except rotate,
+// which reports the milliseconds spent rotating all the keys out.
+//
+// Usage: rotating-map_benchmark [num_keys ...]
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include "basics/basics.h"
+#include "errors/errors.h"
+#include "threads/threads.h"
+#include "network/network.h"
+#include "basics/modinit.h"
+#include "errors/modinit.h"
+#include "threads/modinit.h"
+#include "network/modinit.h"
+#include "util/rotating-map.h"
+
+// The RotatingMap as it was before it moved to open addressing
+class ListRotatingMap {
+ public:
+  explicit ListRotatingMap(sp_int32 _nbuckets) {
+    for (sp_int32 i = 0; i < _nbuckets; ++i) {
+      buckets_.push_back(new std::unordered_map<sp_int64, sp_int64>());
+    }
+  }
+
+  ~ListRotatingMap() {
+    for (auto m : buckets_) {
+      delete m;
+    }
+  }
+
+  void rotate() {
+    delete buckets_.back();
+    buckets_.pop_back();
+    buckets_.push_front(new std::unordered_map<sp_int64, sp_int64>());
+  }
+
+  void create(sp_int64 _key, sp_int64 _value) { (*buckets_.front())[_key] = _value; }
+
+  bool anchor(sp_int64 _key, sp_int64 _value) {
+    for (auto m : buckets_) {
+      auto iter = m->find(_key);
+      if (iter != m->end()) {
+        iter->second ^= _value;
+        return iter->second == 0;
+      }
+    }
+    return false;
+  }
+
+  bool remove(sp_int64 _key) {
+    for (auto m : buckets_) {
+      if (m->erase(_key) > 0) return true;
+    }
+    return false;
+  }
+
+ private:
+  std::list<std::unordered_map<sp_int64, sp_int64>*> buckets_;
+};
+
+static double Elapsed(std::chrono::high_resolution_clock::time_point _start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::high_resolution_clock::now() - _start)
+      .count();
+}
+
+// Keys are created spread over all the buckets, like tuple trees
+// created across rotations, and then half of them are acked (anchored
+// to zero and removed) and the rest are rotated out.
+template <typename Map>
+static void Run(const char* _name, const std::vector<sp_int64>& _keys) {
+  const sp_int32 nbuckets = 3;
+  const size_t n = _keys.size();
+  Map map(nbuckets);
+
+  auto start = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < n; ++i) {
+    if (i > 0 && i % (n / nbuckets) == 0) map.rotate();
+    map.create(_keys[i], _keys[i]);
+  }
+  double create_ns = Elapsed(start) / n;
+
+  start = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < n; ++i) {
+    map.anchor(_keys[i], 1);
+  }
+  double anchor_ns = Elapsed(start) / n;
+
+  start = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < n; i += 2) {
+    map.anchor(_keys[i], _keys[i] ^ 1);
+    map.remove(_keys[i]);
+  }
+  double ack_ns = Elapsed(start) / (n / 2);
+
+  // Looking up keys that are gone probes every bucket
+  start = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < n; i += 2) {
+    map.remove(_keys[i]);
+  }
+  double miss_ns = Elapsed(start) / (n / 2);
+
+  start = std::chrono::high_resolution_clock::now();
+  for (sp_int32 i = 0; i < nbuckets; ++i) {
+    map.rotate();
+  }
+  double rotate_ms = Elapsed(start) / 1e6;
+
+  std::cout << n << "," << _name << "," << std::fixed << std::setprecision(1) << create_ns << ","
+            << anchor_ns << "," << ack_ns << "," << miss_ns << "," << rotate_ms << std::endl;
+}
+
+int main(int argc, char** argv) {
+  heron::common::Initialize(argv[0]);
+  std::vector<size_t> sizes;
+  for (sp_int32 i = 1; i < argc; ++i) {
+    sizes.push_back(atol(argv[i]));
+  }
+  if (sizes.empty()) {
+    sizes.push_back(1000000);
+    sizes.push_back(10000000);
+  }
+
+  std::cout << "keys,map,create_ns,anchor_ns,ack_ns,miss_ns,rotate_ms" << std::endl;
+  for (size_t size : sizes) {
+    std::vector<sp_int64> keys;
+    keys.reserve(size);
+    for (size_t i = 0; i < size; ++i) {
+      keys.push_back(RandUtils::lrand());
+    }
+    Run<ListRotatingMap>("list", keys);
+    Run<heron::stmgr::RotatingMap>("open_addressing", keys);
+  }
+  return 0;
+}
@@ -162,6 +162,62 @@ TEST(RotatingMap, test_anchors) {
   delete g;
 }
 
+// Test many keys, so that the tables grow and probe runs
+// get broken up by removes
+TEST(RotatingMap, test_many_keys) {
+  sp_int32 nbuckets = 3;
+  heron::stmgr::RotatingMap* g = new heron::stmgr::RotatingMap(nbuckets);
+
+  std::vector<sp_int64> keys;
+  for (sp_int32 i = 0; i < 100000; ++i) {
+    keys.push_back(RandUtils::lrand());
+    g->create(keys.back(), keys.back());
+  }
+
+  // Remove every other key
+  for (size_t i = 0; i < keys.size(); i += 2) {
+    EXPECT_EQ(g->remove(keys[i]), true);
+  }
+
+  // The rest are still there with their values
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (i % 2 == 0) {
+      EXPECT_EQ(g->anchor(keys[i], keys[i]), false);
+    } else {
+      EXPECT_EQ(g->anchor(keys[i], keys[i]), true);
+      EXPECT_EQ(g->remove(keys[i]), true);
+    }
+  }
+
+  // Recycled tables start out empty
+  for (size_t i = 0; i < keys.size(); ++i) {
+    g->create(keys[i], 1);
+  }
+  for (sp_int32 i = 0; i < nbuckets; ++i) {
+    g->rotate();
+  }
+  for (size_t i = 0; i < keys.size(); ++i) {
+    EXPECT_EQ(g->remove(keys[i]), false);
+  }
+
+  delete g;
+}
+
+// Test that 0 works like any other key
+TEST(RotatingMap, test_zero_key) {
+  heron::stmgr::RotatingMap* g = new heron::stmgr::RotatingMap(3);
+
+  EXPECT_EQ(g->remove(0), false);
+  g->create(0, 5);
+  EXPECT_EQ(g->anchor(0, 4), false);
+  g->rotate();
+  EXPECT_EQ(g->anchor(0, 1), true);
+  EXPECT_EQ(g->remove(0), true);
+  EXPECT_EQ(g->remove(0), false);
+
+  delete g;
+}
+
 int main(int argc, char** argv) {
   heron::common::Initialize(argv[0]);
   testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,117 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the cost of adding one data tuple to the TupleCache for a
+// varying number of destinations, both when the tuple is serialized once
+// per destination and when it is serialized once and only its key is
+// patched per destination.
+//
+// Usage: tuple-cache_benchmark <heron_internals.yaml> [num_rounds]
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include "proto/messages.h"
+#include "basics/basics.h"
+#include "errors/errors.h"
+#include "threads/threads.h"
+#include "network/network.h"
+#include "basics/modinit.h"
+#include "errors/modinit.h"
+#include "threads/modinit.h"
+#include "network/modinit.h"
+#include "config/heron-internals-config-reader.h"
+#include "util/tuple-cache.h"
+
+class NullDrainer {
+ public:
+  void Drain(sp_int32, heron::proto::system::HeronTupleSet2* _t) {
+    __global_protobuf_pool_release__(_t);
+  }
+};
+
+static void MakeTuple(heron::proto::system::HeronDataTuple* _tuple) {
+  heron::proto::system::RootId* root = _tuple->add_roots();
+  root->set_taskid(1);
+  root->set_key(RandUtils::lrand());
+  for (sp_int32 i = 0; i < 4; ++i) {
+    _tuple->add_values(sp_string(32, 'a' + i));
+  }
+}
+
+// Returns the average nanoseconds spent per tuple. Tuples are added in
+// rounds and the cache is cleared in between, outside of the measurement,
+// so that pooled tuple sets get reused like they are in the stmgr.
+static double Run(heron::stmgr::TupleCache* _cache, sp_int32 _num_rounds,
+                  sp_int32 _num_destinations, bool _serialize_once) {
+  const sp_int32 tuples_per_round = 1000;
+  heron::proto::api::StreamId stream;
+  stream.set_id("stream");
+  stream.set_component_name("comp");
+  heron::proto::system::HeronDataTuple tuple;
+  MakeTuple(&tuple);
+  sp_string serialized;
+
+  std::chrono::nanoseconds elapsed(0);
+  for (sp_int32 round = 0; round < _num_rounds; ++round) {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (sp_int32 i = 0; i < tuples_per_round; ++i) {
+      if (_serialize_once) {
+        heron::stmgr::TupleCache::serialize_data_tuple(&tuple, &serialized);
+        for (sp_int32 j = 0; j < _num_destinations; ++j) {
+          _cache->add_data_tuple(1, j, stream, true, serialized);
+        }
+      } else {
+        for (sp_int32 j = 0; j < _num_destinations; ++j) {
+          _cache->add_data_tuple(1, j, stream, &tuple);
+        }
+      }
+    }
+    elapsed += std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::high_resolution_clock::now() - start);
+    _cache->clear();
+  }
+  return elapsed.count() / static_cast<double>(_num_rounds * tuples_per_round);
+}
+
+int main(int argc, char** argv) {
+  heron::common::Initialize(argv[0]);
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <heron_internals.yaml> [num_rounds]" << std::endl;
+    return 1;
+  }
+  heron::config::HeronInternalsConfigReader::Create(argv[1]);
+  sp_int32 num_rounds = argc > 2 ? atoi(argv[2]) : 50;
+
+  EventLoopImpl ss;
+  // Never drain while measuring. The cache is cleared after each run.
+  heron::stmgr::TupleCache cache(&ss, std::numeric_limits<sp_uint32>::max());
+  NullDrainer drainer;
+  cache.RegisterDrainer(&NullDrainer::Drain, &drainer);
+
+  std::cout << "destinations,serialize_per_destination_ns,serialize_once_ns" << std::endl;
+  const sp_int32 destinations[] = {1, 8, 64};
+  for (sp_int32 num_destinations : destinations) {
+    double per_destination = Run(&cache, num_rounds, num_destinations, false);
+    double once = Run(&cache, num_rounds, num_destinations, true);
+    std::cout << num_destinations << "," << std::fixed << std::setprecision(1)
+              << per_destination << "," << once << std::endl;
+  }
+  return 0;
+}
@@ -16,6 +16,7 @@
 
 #include <algorithm>
 #include <map>
+#include <vector>
 #include "gtest/gtest.h"
 #include "proto/messages.h"
 #include "basics/basics.h"
@@ -243,6 +244,70 @@ TEST(TupleCache, test_different_stream_mix) {
   delete g;
 }
 
+class KeyCollector {
+ public:
+  KeyCollector() {}
+  ~KeyCollector() {}
+
+  void Drain(sp_int32 _task_id, heron::proto::system::HeronTupleSet2* _t) {
+    for (sp_int32 i = 0; i < _t->data().tuples_size(); ++i) {
+      heron::proto::system::HeronDataTuple tuple;
+      EXPECT_TRUE(tuple.ParseFromString(_t->data().tuples(i)));
+      EXPECT_EQ(tuple.values_size(), 1);
+      EXPECT_EQ(tuple.values(0), "value");
+      keys_[_task_id].push_back(tuple.key());
+    }
+    delete _t;
+  }
+
+  std::map<sp_int32, std::vector<sp_int64> > keys_;
+};
+
+// Test that a tuple serialized once carries its own key to every destination
+TEST(TupleCache, test_serialized_data_tuple_fanout) {
+  sp_int32 num_destinations = 8;
+  EventLoopImpl ss;
+  sp_uint32 drain_threshold = 1024 * 1024;
+  heron::stmgr::TupleCache* g = new heron::stmgr::TupleCache(&ss, drain_threshold);
+  KeyCollector* collector = new KeyCollector();
+  g->RegisterDrainer(&KeyCollector::Drain, collector);
+
+  heron::proto::api::StreamId dummy;
+  dummy.set_id("stream");
+  dummy.set_component_name("comp");
+  heron::proto::system::HeronDataTuple tuple;
+  tuple.add_values("value");
+  heron::proto::system::RootId* root = tuple.add_roots();
+  root->set_taskid(1);
+  root->set_key(RandUtils::lrand());
+
+  sp_string serialized;
+  heron::stmgr::TupleCache::serialize_data_tuple(&tuple, &serialized);
+  std::map<sp_int32, sp_int64> expected_keys;
+  for (sp_int32 i = 0; i < num_destinations; ++i) {
+    expected_keys[i] = g->add_data_tuple(1, i, dummy, true, serialized);
+  }
+  // unanchored tuples keep a zero key
+  tuple.clear_roots();
+  heron::stmgr::TupleCache::serialize_data_tuple(&tuple, &serialized);
+  g->add_data_tuple(1, num_destinations, dummy, false, serialized);
+
+  auto cb = [&ss](EventLoopImpl::Status status) { DoneHandler(&ss, status); };
+  ss.registerTimer(std::move(cb), false, 300000);
+
+  ss.loop();
+
+  EXPECT_EQ(collector->keys_.size(), static_cast<size_t>(num_destinations + 1));
+  for (sp_int32 i = 0; i < num_destinations; ++i) {
+    ASSERT_EQ(collector->keys_[i].size(), static_cast<size_t>(1));
+    EXPECT_EQ(collector->keys_[i][0], expected_keys[i]);
+  }
+  ASSERT_EQ(collector->keys_[num_destinations].size(), static_cast<size_t>(1));
+  EXPECT_EQ(collector->keys_[num_destinations][0], 0);
+  delete collector;
+  delete g;
+}
+
 int main(int argc, char** argv) {
   heron::common::Initialize(argv[0]);
   testing::InitGoogleTest(&argc, argv);
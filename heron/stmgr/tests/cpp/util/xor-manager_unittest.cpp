@@ -135,6 +135,60 @@ TEST(XorManager, test_all) {
   delete g;
 }
 
+static void AddRoot(google::protobuf::RepeatedPtrField<heron::proto::system::AckTuple>* _tuples,
+                    sp_int32 _task_id, sp_int64 _key, sp_int64 _value) {
+  heron::proto::system::AckTuple* t = _tuples->Add();
+  heron::proto::system::RootId* r = t->add_roots();
+  r->set_taskid(_task_id);
+  r->set_key(_key);
+  t->set_ackedtuple(_value);
+}
+
+// Test processing a whole control tuple set at once
+TEST(XorManager, test_process) {
+  std::vector<sp_int32> task_ids;
+  task_ids.push_back(1);
+  heron::stmgr::XorManager* g = new heron::stmgr::XorManager(&ss, 100, task_ids);
+
+  for (sp_int32 i = 0; i < 100; ++i) {
+    g->create(1, i, 1);
+  }
+
+  // Every tree gets one more emit. Acking with the xor of both
+  // completes the even ones, the odd ones get acked only partially
+  heron::proto::system::HeronControlTupleSet control;
+  for (sp_int32 i = 0; i < 100; ++i) {
+    AddRoot(control.mutable_emits(), 1, i, 2);
+    AddRoot(control.mutable_acks(), 1, i, i % 2 == 0 ? 3 : 1);
+  }
+  // Fail a few odd ones, as well as some unknown ones
+  for (sp_int32 i = 1; i < 10; i += 2) {
+    AddRoot(control.mutable_fails(), 1, i, 0);
+  }
+  AddRoot(control.mutable_fails(), 1, 1000, 0);
+
+  std::vector<sp_int64> acked;
+  std::vector<sp_int64> failed;
+  g->process(1, control, &acked, &failed);
+
+  EXPECT_EQ(acked.size(), 50u);
+  for (sp_int32 i = 0; i < 50; ++i) {
+    EXPECT_EQ(acked[i], i * 2);
+    EXPECT_EQ(g->remove(1, i * 2), false);
+  }
+  EXPECT_EQ(failed.size(), 5u);
+  for (sp_int32 i = 0; i < 5; ++i) {
+    EXPECT_EQ(failed[i], i * 2 + 1);
+  }
+
+  // The rest of the odd ones are still pending on the 2 they were anchored with
+  for (sp_int32 i = 11; i < 100; i += 2) {
+    EXPECT_EQ(g->anchor(1, i, 2), true);
+  }
+
+  delete g;
+}
+
 int main(int argc, char** argv) {
   heron::common::Initialize(argv[0]);
   testing::InitGoogleTest(&argc, argv);
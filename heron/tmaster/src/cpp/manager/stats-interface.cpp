@@ -17,7 +17,6 @@
 #include "tmaster/src/cpp/manager/stats-interface.h"
 #include <iostream>
 #include <sstream>
-#include "manager/tmaster.h"
 #include "manager/tmetrics-collector.h"
 #include "metrics/tmaster-metrics.h"
 #include "basics/basics.h"
@@ -30,8 +29,9 @@ namespace heron {
 namespace tmaster {
 
 StatsInterface::StatsInterface(EventLoop* eventLoop, const NetworkOptions& _options,
-                               TMetricsCollector* _collector, TMaster* _tmaster)
-    : metrics_collector_(_collector), tmaster_(_tmaster) {
+                               TMetricsCollector* _collector,
+                               const proto::api::Topology* _topology)
+    : metrics_collector_(_collector), topology_(_topology) {
   http_server_ = new HTTPServer(eventLoop, _options);
   // Install the handlers
   auto cbHandleStats = [this](IncomingHTTPRequest* request) { this->HandleStatsRequest(request); };
@@ -69,7 +69,7 @@ void StatsInterface::HandleStatsRequest(IncomingHTTPRequest* _request) {
     return;
   }
   proto::tmaster::MetricResponse* res =
-    metrics_collector_->GetMetrics(req, tmaster_->getInitialTopology());
+    metrics_collector_->GetMetrics(req, topology_);
   sp_string response_string;
   CHECK(res->SerializeToString(&response_string));
   OutgoingHTTPResponse* response = new OutgoingHTTPResponse(_request);
@@ -19,18 +19,18 @@
 
 #include "network/network.h"
 #include "proto/tmaster.pb.h"
+#include "proto/topology.pb.h"
 #include "basics/basics.h"
 
 namespace heron {
 namespace tmaster {
 
 class TMetricsCollector;
-class TMaster;
 
 class StatsInterface {
  public:
   StatsInterface(EventLoop* eventLoop, const NetworkOptions& options,
-                 TMetricsCollector* _collector, TMaster* tmaster);
+                 TMetricsCollector* _collector, const proto::api::Topology* _topology);
   virtual ~StatsInterface();
 
  private:
@@ -41,7 +41,8 @@ class StatsInterface {
 
   HTTPServer* http_server_;  // Our http server
   TMetricsCollector* metrics_collector_;
-  TMaster* tmaster_;
+  // The topology as first submitted by the user
+  const proto::api::Topology* topology_;
 };
 }  // namespace tmaster
 }  // namespace heron
@@ -36,6 +36,8 @@ StMgrState::StMgrState(Connection* _conn, const proto::system::StMgr& _stmgr,
   instances_ = _instances;
   stmgr_ = new proto::system::StMgr(_stmgr);
   connection_ = _conn;
+  pplan_version_ = -1;
+  takes_pplan_deltas_ = false;
   tmaster_ = _server;
 }
 
@@ -59,6 +61,8 @@ void StMgrState::UpdateWithNewStMgr(const proto::system::StMgr& _stmgr,
   stmgr_ = new proto::system::StMgr(_stmgr);
   instances_ = _instances;
   connection_ = _conn;
+  pplan_version_ = -1;
+  takes_pplan_deltas_ = false;
 }
 
 bool StMgrState::VerifyInstances(const std::vector<proto::system::Instance*>& _instances) {
@@ -109,11 +113,14 @@ void StMgrState::SendStartStatefulProcessingMessage(const std::string& _checkpoi
   tmaster_->SendMessage(connection_, message);
 }
 
-void StMgrState::NewPhysicalPlan(const proto::system::PhysicalPlan& _pplan) {
-  LOG(INFO) << "Sending a new physical plan to stmgr " << stmgr_->id();
-  proto::stmgr::NewPhysicalPlanMessage message;
-  message.mutable_new_pplan()->CopyFrom(_pplan);
-  tmaster_->SendMessage(connection_, message);
+void StMgrState::NewPhysicalPlan(const std::string& _message, bool _delta, sp_int64 _version) {
+  LOG(INFO) << "Sending " << (_delta ? "the changes to the" : "a new") << " physical plan "
+            << _version << " to stmgr " << stmgr_->id();
+  const sp_string& type_name =
+      _delta ? proto::stmgr::PhysicalPlanDeltaMessage::descriptor()->full_name()
+             : proto::stmgr::NewPhysicalPlanMessage::descriptor()->full_name();
+  tmaster_->SendMessage(connection_, _message.size(), type_name, _message.data());
+  pplan_version_ = _version;
 }
 
 /*
@@ -50,8 +50,10 @@ class StMgrState {
   // Update the heartbeat. Note:- We own _stats now
   void heartbeat(sp_int64 _time, proto::system::StMgrStats* _stats);
 
-  // Send messages to the stmgr
-  void NewPhysicalPlan(const proto::system::PhysicalPlan& _pplan);
+  // Send messages to the stmgr. The plan goes out already serialized, as
+  // a NewPhysicalPlanMessage, or as a PhysicalPlanDeltaMessage if _delta,
+  // so that the tmaster serializes it only once for all stmgrs.
+  void NewPhysicalPlan(const std::string& _message, bool _delta, sp_int64 _version);
 
   // Send stateful checkpoint message to the stmgr
   void StatefulNewCheckpoint(const proto::ckptmgr::StartStatefulCheckpoint& _request);
@@ -70,6 +72,12 @@ class StMgrState {
   sp_uint32 get_num_instances() const { return instances_.size(); }
   const std::vector<proto::system::Instance*>& get_instances() const { return instances_; }
   const proto::system::StMgr* get_stmgr() const { return stmgr_; }
+  // The version of the physical plan that the stmgr has, or -1 if none
+  sp_int64 get_pplan_version() const { return pplan_version_; }
+  void set_pplan_version(sp_int64 _version) { pplan_version_ = _version; }
+  // Whether the stmgr takes the changes to the physical plan as deltas
+  bool takes_pplan_deltas() const { return takes_pplan_deltas_; }
+  void set_takes_pplan_deltas(bool _takes) { takes_pplan_deltas_ = _takes; }
   bool VerifyInstances(const std::vector<proto::system::Instance*>& _instances);
 
  private:
@@ -85,6 +93,8 @@ class StMgrState {
   proto::system::StMgr* stmgr_;
   // The connection used by the nodemanager to contact us
   Connection* connection_;
+  sp_int64 pplan_version_;
+  bool takes_pplan_deltas_;
   // Our link to our TMaster
   Server* tmaster_;
 };
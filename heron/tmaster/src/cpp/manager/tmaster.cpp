@@ -22,9 +22,8 @@
 #include <string>
 #include <set>
 #include <vector>
-#include "manager/tmetrics-collector.h"
+#include "manager/tmetrics-loop.h"
 #include "manager/tcontroller.h"
-#include "manager/stats-interface.h"
 #include "manager/tmasterserver.h"
 #include "manager/stmgrstate.h"
 #include "manager/stateful-helper.h"
@@ -51,6 +50,7 @@ const sp_string METRIC_UPTIME = "__uptime_sec";
 const sp_string METRIC_MEM_USED = "__mem_used_bytes";
 const sp_int64 PROCESS_METRICS_FREQUENCY = 60 * 1000 * 1000;
 const sp_string METRIC_PREFIX = "__process";
+const sp_string METRIC_METRICS_DROPPED = "__metrics_dropped";
 
 TMaster::TMaster(const std::string& _zk_hostport, const std::string& _topology_name,
                  const std::string& _topology_id, const std::string& _topdir,
@@ -66,15 +66,14 @@ TMaster::TMaster(const std::string& _zk_hostport, const std::string& _topology_n
   controller_port_ = _controller_port;
   master_ = NULL;
   master_port_ = _master_port;
-  stats_ = NULL;
   stats_port_ = _stats_port;
   myhost_name_ = _myhost_name;
   eventLoop_ = eventLoop;
-  metrics_collector_ =
-      new TMetricsCollector(config::HeronInternalsConfigReader::Instance()
-                                    ->GetHeronTmasterMetricsCollectorMaximumIntervalMin() *
-                                60,
-                            eventLoop_, _metrics_sinks_yaml);
+  metrics_loop_ =
+      new TMetricsLoop(config::HeronInternalsConfigReader::Instance()
+                               ->GetHeronTmasterMetricsCollectorMaximumIntervalMin() *
+                           60,
+                       _metrics_sinks_yaml);
 
   mMetricsMgrPort = metricsMgrPort;
 
@@ -88,6 +87,8 @@ TMaster::TMaster(const std::string& _zk_hostport, const std::string& _topology_n
 
   tmasterProcessMetrics = new heron::common::MultiAssignableMetric();
   mMetricsMgrClient->register_metric(METRIC_PREFIX, tmasterProcessMetrics);
+  tmasterMetricsDropped = new heron::common::CountMetric();
+  mMetricsMgrClient->register_metric(METRIC_METRICS_DROPPED, tmasterMetricsDropped);
 
   // Establish connection to ckptmgr
   NetworkOptions ckpt_options;
@@ -111,6 +112,7 @@ TMaster::TMaster(const std::string& _zk_hostport, const std::string& _topology_n
   }
 
   current_pplan_ = NULL;
+  pplan_version_ = 0;
 
   // The topology as first submitted by the user
   // It shall only be used to construct the physical plan when TMaster first time starts
@@ -173,17 +175,18 @@ TMaster::~TMaster() {
     master_->Stop();
   }
   delete master_;
-  delete stats_;
   delete tmaster_location_;
   for (StMgrMapIter iter = stmgrs_.begin(); iter != stmgrs_.end(); ++iter) {
     delete iter->second;
   }
   stmgrs_.clear();
-  delete metrics_collector_;
+  delete metrics_loop_;
 
   mMetricsMgrClient->unregister_metric(METRIC_PREFIX);
+  mMetricsMgrClient->unregister_metric(METRIC_METRICS_DROPPED);
   delete mMetricsMgrClient;
   delete tmasterProcessMetrics;
+  delete tmasterMetricsDropped;
   delete stateful_helper_;
   delete ckptmgr_client_;
 }
@@ -205,6 +208,9 @@ void TMaster::UpdateProcessMetrics(EventLoop::Status) {
   // Memory
   size_t totalmemory = ProcessUtils::getTotalMemoryUsed();
   tmasterProcessMetrics->scope(METRIC_MEM_USED)->SetValue(totalmemory);
+
+  // PublishMetrics messages the metrics loop could not keep up with
+  tmasterMetricsDropped->incr_by(metrics_loop_->TakeDropped());
 }
 
 void TMaster::SetTMasterLocationDone(proto::system::StatusCode _code) {
@@ -414,6 +420,7 @@ void TMaster::GetPhysicalPlanDone(proto::system::PhysicalPlan* _pplan,
     LOG(INFO) << "There was an existing assignment\n";
     CHECK_EQ(_code, proto::system::OK);
     current_pplan_ = _pplan;
+    ++pplan_version_;
     if (stateful_helper_) {
       stateful_helper_->RegisterNewPplan(*current_pplan_);
     }
@@ -432,7 +439,7 @@ void TMaster::GetPhysicalPlanDone(proto::system::PhysicalPlan* _pplan,
                                          ->GetHeronTmasterNetworkMasterOptionsMaximumPacketMb() *
                                      1024 * 1024);
   master_options.set_socket_family(PF_INET);
-  master_ = new TMasterServer(eventLoop_, master_options, metrics_collector_, this);
+  master_ = new TMasterServer(eventLoop_, master_options, metrics_loop_, this);
 
   sp_int32 retval = master_->Start();
   if (retval != SP_OK) {
@@ -468,7 +475,7 @@ void TMaster::GetPhysicalPlanDone(proto::system::PhysicalPlan* _pplan,
                                         ->GetHeronTmasterNetworkStatsOptionsMaximumPacketMb() *
                                     1024 * 1024);
   stats_options.set_socket_family(PF_INET);
-  stats_ = new StatsInterface(eventLoop_, stats_options, metrics_collector_, this);
+  metrics_loop_->StartStatsInterface(stats_options, *topology_);
 }
 
 void TMaster::ActivateTopology(VCallback<proto::system::StatusCode> cb) {
@@ -519,7 +526,7 @@ void TMaster::HandleCleanStatefulCheckpointResponse(proto::system::StatusCode _s
 
 proto::system::Status* TMaster::RegisterStMgr(
     const proto::system::StMgr& _stmgr, const std::vector<proto::system::Instance*>& _instances,
-    Connection* _conn, proto::system::PhysicalPlan*& _pplan) {
+    bool _takes_pplan_deltas, Connection* _conn, proto::system::PhysicalPlan*& _pplan) {
   const std::string& stmgr_id = _stmgr.id();
   LOG(INFO) << "Got a register stmgr request from " << stmgr_id << std::endl;
 
@@ -568,7 +575,12 @@ proto::system::Status* TMaster::RegisterStMgr(
       CHECK_GE(eventLoop_->registerTimer(std::move(cb), false, 0), 0);
     }
   }
+  stmgrs_[stmgr_id]->set_takes_pplan_deltas(_takes_pplan_deltas);
   _pplan = current_pplan_;
+  if (current_pplan_) {
+    // The stmgr gets this plan in the response
+    stmgrs_[stmgr_id]->set_pplan_version(pplan_version_);
+  }
   proto::system::Status* status = new proto::system::Status();
   status->set_status(proto::system::OK);
   status->set_message("Welcome StreamManager");
@@ -632,11 +644,13 @@ void TMaster::SetPhysicalPlanDone(proto::system::PhysicalPlan* _pplan,
     CHECK_GE(eventLoop_->registerTimer(std::move(cb), false, 0), 0);
   } else {
     bool first_time_pplan = current_pplan_ == NULL;
-    delete current_pplan_;
+    proto::system::PhysicalPlan* old_pplan = current_pplan_;
     current_pplan_ = _pplan;
+    ++pplan_version_;
     assignment_in_progress_ = false;
     // We need to pass that on to all streammanagers
-    DistributePhysicalPlan();
+    DistributePhysicalPlan(old_pplan);
+    delete old_pplan;
     if (stateful_helper_) {
       stateful_helper_->RegisterNewPplan(*current_pplan_);
       LOG(INFO) << "Starting Stateful Restore now that all stmgrs have connected";
@@ -647,16 +661,42 @@ void TMaster::SetPhysicalPlanDone(proto::system::PhysicalPlan* _pplan,
   }
 }
 
-bool TMaster::DistributePhysicalPlan() {
+bool TMaster::DistributePhysicalPlan(const proto::system::PhysicalPlan* _old_pplan) {
   if (current_pplan_) {
     // First valid the physical plan to distribute
     LOG(INFO) << "To distribute new pplan:" << std::endl;
     config::PhysicalPlanHelper::LogPhysicalPlan(*current_pplan_);
 
+    // The plan is serialized once for all stmgrs, and so is the delta for
+    // the ones that have the previous plan and take deltas. The full plan
+    // is only serialized if some stmgr needs it.
+    std::string delta;
+    if (_old_pplan) {
+      proto::stmgr::PhysicalPlanDeltaMessage message;
+      if (config::PhysicalPlanHelper::MakeDelta(*_old_pplan, *current_pplan_,
+                                                *message.mutable_delta())) {
+        message.set_base_version(pplan_version_ - 1);
+        message.set_version(pplan_version_);
+        message.SerializeToString(&delta);
+      }
+    }
+    std::string full;
+
     // Distribute physical plan to all active stmgrs
     StMgrMapIter iter;
     for (iter = stmgrs_.begin(); iter != stmgrs_.end(); ++iter) {
-      iter->second->NewPhysicalPlan(*current_pplan_);
+      if (!delta.empty() && iter->second->takes_pplan_deltas() &&
+          iter->second->get_pplan_version() == pplan_version_ - 1) {
+        iter->second->NewPhysicalPlan(delta, true, pplan_version_);
+        continue;
+      }
+      if (full.empty()) {
+        proto::stmgr::NewPhysicalPlanMessage message;
+        message.mutable_new_pplan()->CopyFrom(*current_pplan_);
+        message.set_version(pplan_version_);
+        message.SerializeToString(&full);
+      }
+      iter->second->NewPhysicalPlan(full, false, pplan_version_);
     }
 
     return true;
@@ -709,7 +749,8 @@ proto::system::PhysicalPlan* TMaster::MakePhysicalPlan() {
 }
 
 proto::system::Status* TMaster::UpdateStMgrHeartbeat(Connection* _conn, sp_int64 _time,
-                                                     proto::system::StMgrStats* _stats) {
+                                                     proto::system::StMgrStats* _stats,
+                                                     bool _takes_pplan_deltas) {
   proto::system::Status* retval = new proto::system::Status();
   if (connection_to_stmgr_id_.find(_conn) == connection_to_stmgr_id_.end()) {
     retval->set_status(proto::system::INVALID_STMGR);
@@ -729,6 +770,7 @@ proto::system::Status* TMaster::UpdateStMgrHeartbeat(Connection* _conn, sp_int64
     return retval;
   }
   stmgrs_[stmgr]->heartbeat(_time, _stats);
+  stmgrs_[stmgr]->set_takes_pplan_deltas(_takes_pplan_deltas);
   retval->set_status(proto::system::OK);
   return retval;
 }
@@ -33,9 +33,8 @@ namespace tmaster {
 
 class StMgrState;
 class TController;
-class StatsInterface;
 class TMasterServer;
-class TMetricsCollector;
+class TMetricsLoop;
 class StatefulHelper;
 class CkptMgrClient;
 
@@ -61,10 +60,12 @@ class TMaster {
   void DeActivateTopology(VCallback<proto::system::StatusCode> cb);
   proto::system::Status* RegisterStMgr(const proto::system::StMgr& _stmgr,
                                        const std::vector<proto::system::Instance*>& _instances,
-                                       Connection* _conn, proto::system::PhysicalPlan*& _pplan);
+                                       bool _takes_pplan_deltas, Connection* _conn,
+                                       proto::system::PhysicalPlan*& _pplan);
   // function to update heartbeat for a nodemgr
   proto::system::Status* UpdateStMgrHeartbeat(Connection* _conn, sp_int64 _time,
-                                              proto::system::StMgrStats* _stats);
+                                              proto::system::StMgrStats* _stats,
+                                              bool _takes_pplan_deltas);
 
   // When stmgr disconnects from us
   proto::system::StatusCode RemoveStMgrConnection(Connection* _conn);
@@ -76,6 +77,9 @@ class TMaster {
 
   // Accessors
   const proto::system::PhysicalPlan* getPhysicalPlan() const { return current_pplan_; }
+  // Counts up with every new physical plan, so that stmgrs can be sent
+  // only what changed since the plan they have
+  sp_int64 getPhysicalPlanVersion() const { return pplan_version_; }
   // TODO(mfu): Should we provide this?
   // topology_ should only be used to construct physical plan when TMaster first starts
   // Providing an accessor is bug prone.
@@ -123,8 +127,9 @@ class TMaster {
   bool ValidateStMgrsWithPhysicalPlan(proto::system::PhysicalPlan _pplan);
 
   // If the assignment is already done, then:
-  // 1. Distribute physical plan to all active stmgrs
-  bool DistributePhysicalPlan();
+  // 1. Distribute physical plan to all active stmgrs. The ones that have
+  //    _old_pplan only get what changed since.
+  bool DistributePhysicalPlan(const proto::system::PhysicalPlan* _old_pplan);
 
   // Function called after we set the tmasterlocation
   void SetTMasterLocationDone(proto::system::StatusCode _code);
@@ -164,6 +169,7 @@ class TMaster {
 
   // The current physical plan
   proto::system::PhysicalPlan* current_pplan_;
+  sp_int64 pplan_version_;
 
   // The topology as first submitted by the user
   // It shall only be used to construct the physical plan when TMaster first time starts
@@ -190,7 +196,6 @@ class TMaster {
   sp_int32 controller_port_;
   TMasterServer* master_;
   sp_int32 master_port_;
-  StatsInterface* stats_;
   sp_int32 stats_port_;
   std::string myhost_name_;
 
@@ -198,8 +203,8 @@ class TMaster {
   // ourselves as master
   sp_int32 master_establish_attempts_;
 
-  // collector
-  TMetricsCollector* metrics_collector_;
+  // Collects the metrics and answers stat queries on a thread of its own
+  TMetricsLoop* metrics_loop_;
 
   sp_int32 mMetricsMgrPort;
   // Metrics Manager
@@ -210,6 +215,8 @@ class TMaster {
 
   // Process related metrics
   heron::common::MultiAssignableMetric* tmasterProcessMetrics;
+  // The metrics messages dropped since the metrics loop could not keep up
+  heron::common::CountMetric* tmasterMetricsDropped;
 
   // The time at which the stmgr was started up
   std::chrono::high_resolution_clock::time_point start_time_;
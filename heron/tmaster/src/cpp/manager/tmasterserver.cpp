@@ -16,7 +16,7 @@
 
 #include "manager/tmasterserver.h"
 #include <iostream>
-#include "manager/tmetrics-collector.h"
+#include "manager/tmetrics-loop.h"
 #include "manager/tmaster.h"
 #include "processor/processor.h"
 #include "proto/messages.h"
@@ -30,14 +30,14 @@ namespace heron {
 namespace tmaster {
 
 TMasterServer::TMasterServer(EventLoop* eventLoop, const NetworkOptions& _options,
-                             TMetricsCollector* _collector, TMaster* _tmaster)
-    : Server(eventLoop, _options), collector_(_collector), tmaster_(_tmaster) {
+                             TMetricsLoop* _metrics_loop, TMaster* _tmaster)
+    : Server(eventLoop, _options), metrics_loop_(_metrics_loop), tmaster_(_tmaster) {
   // Install the stmgr handlers
   InstallRequestHandler(&TMasterServer::HandleStMgrRegisterRequest);
   InstallRequestHandler(&TMasterServer::HandleStMgrHeartbeatRequest);
 
   // Install the metricsmgr handlers
-  InstallMessageHandler(&TMasterServer::HandleMetricsMgrStats);
+  InstallRawMessageHandler<proto::tmaster::PublishMetrics>(&TMasterServer::HandleMetricsMgrStats);
   InstallMessageHandler(&TMasterServer::HandleInstanceStateStored);
   InstallMessageHandler(&TMasterServer::HandleRestoreTopologyStateResponse);
   InstallMessageHandler(&TMasterServer::HandleResetTopologyStateMessage);
@@ -74,9 +74,8 @@ void TMasterServer::HandleStMgrHeartbeatRequest(REQID _reqid, Connection* _conn,
   processor->Start();
 }
 
-void TMasterServer::HandleMetricsMgrStats(Connection*, proto::tmaster::PublishMetrics* _request) {
-  collector_->AddMetric(*_request);
-  __global_protobuf_pool_release__(_request);
+void TMasterServer::HandleMetricsMgrStats(Connection*, IncomingPacket* _packet) {
+  metrics_loop_->AddMetric(_packet);
 }
 
 void TMasterServer::HandleInstanceStateStored(Connection*,
@@ -35,11 +35,11 @@ namespace heron {
 namespace tmaster {
 
 class TMaster;
-class TMetricsCollector;
+class TMetricsLoop;
 
 class TMasterServer : public Server {
  public:
-  TMasterServer(EventLoop* eventLoop, const NetworkOptions& options, TMetricsCollector* _collector,
+  TMasterServer(EventLoop* eventLoop, const NetworkOptions& options, TMetricsLoop* _metrics_loop,
                 TMaster* _tmaster);
   virtual ~TMasterServer();
 
@@ -53,7 +53,8 @@ class TMasterServer : public Server {
                                   proto::tmaster::StMgrRegisterRequest* _request);
   void HandleStMgrHeartbeatRequest(REQID _id, Connection* _conn,
                                    proto::tmaster::StMgrHeartbeatRequest* _request);
-  void HandleMetricsMgrStats(Connection*, proto::tmaster::PublishMetrics* _request);
+  // The PublishMetrics are handed to the metrics loop unparsed
+  void HandleMetricsMgrStats(Connection*, IncomingPacket* _packet);
   void HandleInstanceStateStored(Connection*, proto::ckptmgr::InstanceStateStored* _message);
   void HandleRestoreTopologyStateResponse(Connection*,
                                      proto::ckptmgr::RestoreTopologyStateResponse* _message);
@@ -61,7 +62,7 @@ class TMasterServer : public Server {
                                      proto::ckptmgr::ResetTopologyState* _message);
 
   // our tmaster
-  TMetricsCollector* collector_;
+  TMetricsLoop* metrics_loop_;
   TMaster* tmaster_;
 };
 }  // namespace tmaster
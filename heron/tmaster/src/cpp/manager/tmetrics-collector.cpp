@@ -20,6 +20,8 @@
 #include <map>
 #include <sstream>
 #include <string>
+#include <utility>
+#include <vector>
 #include "metrics/tmaster-metrics.h"
 #include "basics/basics.h"
 #include "errors/errors.h"
@@ -55,6 +57,8 @@ TMetricsCollector::TMetricsCollector(sp_int32 _max_interval, EventLoop* eventLoo
       start_time_(time(NULL)) {
   interval_ = config::HeronInternalsConfigReader::Instance()
                   ->GetHeronTmasterMetricsCollectorPurgeIntervalSec();
+  max_exceptions_ = config::HeronInternalsConfigReader::Instance()
+                        ->GetHeronTmasterMetricsCollectorMaximumException();
   CHECK_EQ(max_interval_ % interval_, 0);
   nintervals_ = max_interval_ / interval_;
   auto cb = [this](EventLoop::Status status) { this->Purge(status); };
@@ -246,32 +250,51 @@ void TMetricsCollector::AggregateExceptions(const ExceptionLogResponse& all_exce
 TMetricsCollector::ComponentMetrics* TMetricsCollector::GetOrCreateComponentMetrics(
     const sp_string& component_name) {
   if (metrics_.find(component_name) == metrics_.end()) {
-    metrics_[component_name] = new ComponentMetrics(component_name, nintervals_, interval_);
+    metrics_[component_name] =
+        new ComponentMetrics(component_name, nintervals_, interval_, max_exceptions_);
   }
   return metrics_[component_name];
 }
 
 TMetricsCollector::ComponentMetrics::ComponentMetrics(const sp_string& component_name,
-                                                      sp_int32 nbuckets, sp_int32 bucket_interval)
-    : component_name_(component_name), nbuckets_(nbuckets), bucket_interval_(bucket_interval) {}
+                                                      sp_int32 nbuckets, sp_int32 bucket_interval,
+                                                      sp_uint32 max_exceptions)
+    : component_name_(component_name),
+      nbuckets_(nbuckets),
+      bucket_interval_(bucket_interval),
+      max_exceptions_(max_exceptions) {}
 
 TMetricsCollector::ComponentMetrics::~ComponentMetrics() {
   for (auto iter = metrics_.begin(); iter != metrics_.end(); ++iter) {
     delete iter->second;
   }
+  for (auto iter = aggregate_metrics_.begin(); iter != aggregate_metrics_.end(); ++iter) {
+    delete iter->second;
+  }
 }
 
 void TMetricsCollector::ComponentMetrics::Purge() {
   for (auto iter = metrics_.begin(); iter != metrics_.end(); ++iter) {
     iter->second->Purge();
   }
+  for (auto iter = aggregate_metrics_.begin(); iter != aggregate_metrics_.end(); ++iter) {
+    iter->second->Purge();
+  }
 }
 
 void TMetricsCollector::ComponentMetrics::AddMetricForInstance(
     const sp_string& instance_id, const sp_string& name, TMasterMetrics::MetricAggregationType type,
     const sp_string& value) {
   InstanceMetrics* instance_metrics = GetOrCreateInstanceMetrics(instance_id);
-  instance_metrics->AddMetricWithName(name, type, value);
+  MetricDelta delta;
+  instance_metrics->AddMetricWithName(name, type, value, &delta);
+
+  auto iter = aggregate_metrics_.find(name);
+  if (iter == aggregate_metrics_.end()) {
+    iter = aggregate_metrics_.insert(
+        std::make_pair(name, new Metric(name, type, nbuckets_, bucket_interval_))).first;
+  }
+  iter->second->AddDelta(delta);
 }
 
 void TMetricsCollector::ComponentMetrics::AddExceptionForInstance(
@@ -283,7 +306,8 @@ void TMetricsCollector::ComponentMetrics::AddExceptionForInstance(
 TMetricsCollector::InstanceMetrics* TMetricsCollector::ComponentMetrics::GetOrCreateInstanceMetrics(
     const sp_string& instance_id) {
   if (metrics_.find(instance_id) == metrics_.end()) {
-    metrics_[instance_id] = new InstanceMetrics(instance_id, nbuckets_, bucket_interval_);
+    metrics_[instance_id] =
+        new InstanceMetrics(instance_id, nbuckets_, bucket_interval_, max_exceptions_);
   }
   return metrics_[instance_id];
 }
@@ -291,7 +315,9 @@ TMetricsCollector::InstanceMetrics* TMetricsCollector::ComponentMetrics::GetOrCr
 void TMetricsCollector::ComponentMetrics::GetMetrics(const MetricRequest& _request,
                                                      sp_int64 start_time, sp_int64 end_time,
                                                      MetricResponse* _response) {
-  if (_request.instance_id_size() == 0) {
+  if (_request.instance_id_size() == 0 && _request.aggregate()) {
+    GetAggregateMetrics(_request, start_time, end_time, _response);
+  } else if (_request.instance_id_size() == 0) {
     // This means that all instances need to be returned
     for (auto iter = metrics_.begin(); iter != metrics_.end(); ++iter) {
       iter->second->GetMetrics(_request, start_time, end_time, _response);
@@ -317,6 +343,20 @@ void TMetricsCollector::ComponentMetrics::GetMetrics(const MetricRequest& _reque
   _response->mutable_status()->set_status(proto::system::OK);
 }
 
+void TMetricsCollector::ComponentMetrics::GetAggregateMetrics(const MetricRequest& _request,
+                                                              sp_int64 start_time,
+                                                              sp_int64 end_time,
+                                                              MetricResponse* _response) {
+  MetricResponse::TaskMetric* m = _response->add_metric();
+  m->set_instance_id(component_name_);
+  for (sp_int32 i = 0; i < _request.metric_size(); ++i) {
+    auto iter = aggregate_metrics_.find(_request.metric(i));
+    if (iter != aggregate_metrics_.end()) {
+      iter->second->GetMetrics(_request.minutely(), start_time, end_time, m->add_metric());
+    }
+  }
+}
+
 void TMetricsCollector::ComponentMetrics::GetExceptionsForInstance(const sp_string& instance_id,
                                                                    ExceptionLogResponse* response) {
   if (metrics_.find(instance_id) != metrics_.end()) {
@@ -331,8 +371,12 @@ void TMetricsCollector::ComponentMetrics::GetAllExceptions(ExceptionLogResponse*
 }
 
 TMetricsCollector::InstanceMetrics::InstanceMetrics(const sp_string& instance_id, sp_int32 nbuckets,
-                                                    sp_int32 bucket_interval)
-    : instance_id_(instance_id), nbuckets_(nbuckets), bucket_interval_(bucket_interval) {}
+                                                    sp_int32 bucket_interval,
+                                                    sp_uint32 max_exceptions)
+    : instance_id_(instance_id),
+      nbuckets_(nbuckets),
+      bucket_interval_(bucket_interval),
+      max_exceptions_(max_exceptions) {}
 
 TMetricsCollector::InstanceMetrics::~InstanceMetrics() {
   for (auto iter = metrics_.begin(); iter != metrics_.end(); ++iter) {
@@ -351,9 +395,9 @@ void TMetricsCollector::InstanceMetrics::Purge() {
 
 void TMetricsCollector::InstanceMetrics::AddMetricWithName(
     const sp_string& name, common::TMasterMetrics::MetricAggregationType type,
-    const sp_string& value) {
+    const sp_string& value, MetricDelta* _delta) {
   Metric* metric_data = GetOrCreateMetric(name, type);
-  metric_data->AddValueToMetric(value);
+  metric_data->AddValueToMetric(value, _delta);
 }
 
 // Creates a copy of exception and takes ownership of the pointer.
@@ -364,9 +408,7 @@ void TMetricsCollector::InstanceMetrics::AddExceptions(const TmasterExceptionLog
   auto new_exception = new TmasterExceptionLog();
   new_exception->CopyFrom(exception);
   exceptions_.push_back(new_exception);
-  sp_uint32 max_exception = config::HeronInternalsConfigReader::Instance()
-                                ->GetHeronTmasterMetricsCollectorMaximumException();
-  while (exceptions_.size() > max_exception) {
+  while (exceptions_.size() > max_exceptions_) {
     TmasterExceptionLog* e = exceptions_.front();
     exceptions_.pop_front();
     delete e;
@@ -408,58 +450,74 @@ TMetricsCollector::Metric::Metric(const sp_string& name,
       all_time_cumulative_(0),
       all_time_nitems_(0),
       bucket_interval_(bucket_interval) {
-  for (sp_int32 i = 0; i < nbuckets; ++i) {
-    data_.push_back(new TimeBucket(bucket_interval_));
-  }
-}
-
-TMetricsCollector::Metric::~Metric() {
+  data_.resize(nbuckets);
+  head_ = 0;
   for (auto iter = data_.begin(); iter != data_.end(); ++iter) {
-    delete *iter;
+    iter->reset(bucket_interval_);
   }
 }
 
+TMetricsCollector::Metric::~Metric() {}
+
 void TMetricsCollector::Metric::Purge() {
-  TimeBucket* b = data_.back();
-  data_.pop_back();
-  data_.push_front(new TimeBucket(bucket_interval_));
-  delete b;
+  // The oldest bucket becomes the current one
+  head_ = (head_ + data_.size() - 1) % data_.size();
+  data_[head_].reset(bucket_interval_);
 }
 
-void TMetricsCollector::Metric::AddValueToMetric(const sp_string& _value) {
+void TMetricsCollector::Metric::AddValueToMetric(const sp_string& _value, MetricDelta* _delta) {
+  sp_double64 value = strtod(_value.c_str(), NULL);
+  TimeBucket& current = data_[head_];
   if (metric_type_ == common::TMasterMetrics::LAST) {
-    // Just keep one value per time bucket
-    data_.front()->data_.clear();
-    data_.front()->data_.push_front(_value);
+    // Just keep one value per time bucket. The delta replaces the previous value
+    _delta->total_ = value - current.total_;
+    _delta->count_ = 1 - current.count_;
+    _delta->all_time_total_ = value - all_time_cumulative_;
+    _delta->all_time_count_ = 1 - all_time_nitems_;
+    current.total_ = value;
+    current.count_ = 1;
     // Do thsi for the cumulative as well
-    all_time_cumulative_ = strtod(_value.c_str(), NULL);
+    all_time_cumulative_ = value;
     all_time_nitems_ = 1;
   } else {
-    data_.front()->data_.push_front(_value);
-    all_time_cumulative_ += strtod(_value.c_str(), NULL);
+    _delta->total_ = value;
+    _delta->count_ = 1;
+    _delta->all_time_total_ = value;
+    _delta->all_time_count_ = 1;
+    current.total_ += value;
+    current.count_++;
+    all_time_cumulative_ += value;
     all_time_nitems_++;
   }
 }
 
+void TMetricsCollector::Metric::AddDelta(const MetricDelta& _delta) {
+  TimeBucket& current = data_[head_];
+  current.total_ += _delta.total_;
+  current.count_ += _delta.count_;
+  all_time_cumulative_ += _delta.all_time_total_;
+  all_time_nitems_ += _delta.all_time_count_;
+}
+
 void TMetricsCollector::Metric::GetMetrics(bool minutely, sp_int64 start_time, sp_int64 end_time,
                                            IndividualMetric* _response) {
   _response->set_name(name_);
   if (minutely) {
     // we need minutely data
-    for (auto iter = data_.begin(); iter != data_.end(); ++iter) {
-      TimeBucket* bucket = *iter;
+    for (size_t i = 0; i < data_.size(); ++i) {
+      const TimeBucket& bucket = this->bucket(i);
       // Does this time bucket have overlap with needed range
-      if (bucket->overlaps(start_time, end_time)) {
+      if (bucket.overlaps(start_time, end_time)) {
         IntervalValue* val = _response->add_interval_values();
-        val->mutable_interval()->set_start(bucket->start_time_);
-        val->mutable_interval()->set_end(bucket->end_time_);
-        sp_double64 result = bucket->aggregate();
+        val->mutable_interval()->set_start(bucket.start_time_);
+        val->mutable_interval()->set_end(bucket.end_time_);
+        sp_double64 result = bucket.aggregate();
         if (metric_type_ == common::TMasterMetrics::SUM) {
           std::ostringstream str;
           str << result;
           val->set_value(str.str());
         } else if (metric_type_ == common::TMasterMetrics::AVG) {
-          sp_double64 avg = result / bucket->count();
+          sp_double64 avg = result / bucket.count();
           std::ostringstream str;
           str << avg;
           val->set_value(str.str());
@@ -472,7 +530,7 @@ void TMetricsCollector::Metric::GetMetrics(bool minutely, sp_int64 start_time, s
         }
       }
       // The timebuckets are reverse chronologically arranged
-      if (start_time > bucket->end_time_) break;
+      if (start_time > bucket.end_time_) break;
     }
   } else {
     // We don't need minutely data
@@ -492,16 +550,16 @@ void TMetricsCollector::Metric::GetMetrics(bool minutely, sp_int64 start_time, s
       // we want only for a specific interval
       sp_int64 total_items = 0;
       sp_double64 total_count = 0;
-      for (auto iter = data_.begin(); iter != data_.end(); ++iter) {
-        TimeBucket* bucket = *iter;
+      for (size_t i = 0; i < data_.size(); ++i) {
+        const TimeBucket& bucket = this->bucket(i);
         // Does this time bucket have overlap with needed range
-        if (bucket->overlaps(start_time, end_time)) {
-          total_count += bucket->aggregate();
-          total_items += bucket->count();
+        if (bucket.overlaps(start_time, end_time)) {
+          total_count += bucket.aggregate();
+          total_items += bucket.count();
           if (metric_type_ == TMasterMetrics::LAST) break;
         }
         // The timebuckets are reverse chronologically arranged
-        if (start_time > bucket->end_time_) break;
+        if (start_time > bucket.end_time_) break;
       }
       if (metric_type_ == TMasterMetrics::SUM) {
         result = total_count;
@@ -20,6 +20,7 @@
 #include <map>
 #include <list>
 #include <string>
+#include <vector>
 #include "basics/callback.h"
 #include "basics/sptypes.h"
 #include "network/event_loop.h"
@@ -59,6 +60,8 @@ class TMetricsCollector {
       const proto::tmaster::ExceptionLogRequest& request);
 
  private:
+  friend class TMetricsCollectorTest;
+
   // Fetches exceptions for ExceptionLogRequest. Save the returned exception in
   // 'all_exceptions'.
   //  Doesn't own 'all_exceptions' pointer
@@ -80,37 +83,39 @@ class TMetricsCollector {
   // Clean all metrics.
   void Purge(EventLoop::Status _status);
 
-  // Timeseries of metrics.
+  // Timeseries of metrics. Values are parsed when they are added, and a bucket only keeps
+  // the sum and the number of the values accumulated inside the time that it represents.
   struct TimeBucket {
-    // A list of metrics each accumulated inside the time
-    // that this bucket represents
-    std::list<sp_string> data_;
+    sp_double64 total_;
+    sp_int64 count_;
     // Whats the start and end time that this TimeBucket contains metrics for
     sp_int32 start_time_;
     sp_int32 end_time_;
 
-    explicit TimeBucket(sp_int32 bucket_interval) {
+    // Empties the bucket and starts it now
+    void reset(sp_int32 bucket_interval) {
+      total_ = 0;
+      count_ = 0;
       start_time_ = time(NULL);
       end_time_ = start_time_ + bucket_interval;
     }
 
-    bool overlaps(sp_int64 start_time, sp_int64 end_time) {
+    bool overlaps(sp_int64 start_time, sp_int64 end_time) const {
       return start_time_ <= end_time && start_time <= end_time_;
     }
 
-    sp_double64 aggregate() {
-      if (data_.empty()) {
-        return 0;
-      } else {
-        sp_double64 total = 0;
-        for (std::list<sp_string>::iterator it = data_.begin(); it != data_.end(); ++it) {
-          total += strtod(it->c_str(), NULL);
-        }
-        return total;
-      }
-    }
+    sp_double64 aggregate() const { return total_; }
+
+    sp_int64 count() const { return count_; }
+  };
 
-    sp_int64 count() { return data_.size(); }
+  // How much the current bucket and the all time aggregates of a Metric changed
+  // when a value was added to it.
+  struct MetricDelta {
+    sp_double64 total_;
+    sp_int64 count_;
+    sp_double64 all_time_total_;
+    sp_int64 all_time_count_;
   };
 
   // Data structure to store metrics. A metric is a Time series of data.
@@ -121,22 +126,33 @@ class TMetricsCollector {
     Metric(const sp_string& name, common::TMasterMetrics::MetricAggregationType type,
            sp_int32 nbuckets, sp_int32 bucket_interval);
 
-    // Deletes all TimeBucket.
     virtual ~Metric();
 
     void Purge();
 
     // Add a new value to the end of 'data_' extending the time series.
-    void AddValueToMetric(const sp_string& value);
+    // Fills in '_delta' with what that changed.
+    void AddValueToMetric(const sp_string& value, MetricDelta* _delta);
+
+    // Apply the change that a value made to the same metric of another instance,
+    // which rolls the metrics of all instances up into this one.
+    void AddDelta(const MetricDelta& _delta);
 
     // Return  past '_nbuckets' value for this metric.
     void GetMetrics(bool minutely, sp_int64 start_time, sp_int64 end_time,
                     proto::tmaster::MetricResponse::IndividualMetric* response);
 
    private:
+    friend class TMetricsCollectorTest;
+
+    // Returns the i-th most recent TimeBucket
+    const TimeBucket& bucket(size_t i) const { return data_[(head_ + i) % data_.size()]; }
+
     sp_string name_;
-    // Time series. data_ will be ordered by their time of arrival.
-    std::list<TimeBucket*> data_;
+    // Time series, as a ring of buckets. data_[head_] is the current bucket,
+    // and the ones after it (wrapping around) are older and older.
+    std::vector<TimeBucket> data_;
+    size_t head_;
     // Type of metric. This can be SUM or AVG. It specify how to aggregate these metrics for
     // display.
     common::TMasterMetrics::MetricAggregationType metric_type_;
@@ -154,7 +170,9 @@ class TMetricsCollector {
    public:
     // ctor. '_instance_id' is the id generated by heron. '_nbuckets' number of metrics buckets
     // stored for instances belonging to this component.
-    InstanceMetrics(const sp_string& instance_id, sp_int32 nbuckets, sp_int32 bucket_interval);
+    // '_max_exceptions' is how many of its latest exceptions are kept.
+    InstanceMetrics(const sp_string& instance_id, sp_int32 nbuckets, sp_int32 bucket_interval,
+                    sp_uint32 max_exceptions);
     // dtor
     virtual ~InstanceMetrics();
 
@@ -162,9 +180,10 @@ class TMetricsCollector {
     void Purge();
 
     // Add metrics with name '_name' of type '_type' and value _value.
+    // Fills in '_delta' with how the metric changed.
     void AddMetricWithName(const sp_string& name,
                            common::TMasterMetrics::MetricAggregationType type,
-                           const sp_string& value);
+                           const sp_string& value, MetricDelta* _delta);
 
     // Add TmasterExceptionLog to the list of exceptions for this instance_id.
     void AddExceptions(const proto::tmaster::TmasterExceptionLog& exception);
@@ -184,6 +203,7 @@ class TMetricsCollector {
     sp_string instance_id_;
     sp_int32 nbuckets_;
     sp_int32 bucket_interval_;
+    sp_uint32 max_exceptions_;
     // map between metric name and its values
     std::map<sp_string, Metric*> metrics_;
     // list of exceptions
@@ -196,7 +216,8 @@ class TMetricsCollector {
    public:
     // ctor. '_component_name' is the user supplied name given to the spout/bolt. '_nbuckets' is
     // number of buckets stored for this component.
-    ComponentMetrics(const sp_string& component_name, sp_int32 nbuckets, sp_int32 bucket_interval);
+    ComponentMetrics(const sp_string& component_name, sp_int32 nbuckets, sp_int32 bucket_interval,
+                     sp_uint32 max_exceptions);
     // dtor
     virtual ~ComponentMetrics();
 
@@ -228,11 +249,19 @@ class TMetricsCollector {
     // Doesn't transfer ownership of returned InstanceMetrics.
     InstanceMetrics* GetOrCreateInstanceMetrics(const sp_string& instance_id);
 
+    // Fills response with the metrics rolled up over all instances
+    void GetAggregateMetrics(const proto::tmaster::MetricRequest& request, sp_int64 start_time,
+                             sp_int64 end_time, proto::tmaster::MetricResponse* response);
+
     sp_string component_name_;
     sp_int32 nbuckets_;
     sp_int32 bucket_interval_;
+    sp_uint32 max_exceptions_;
     // map between instance id and its set of metrics
     std::map<sp_string, InstanceMetrics*> metrics_;
+    // map between metric name and its value over all instances. Kept up to date
+    // as metrics are added, so that they dont have to be computed per request.
+    std::map<sp_string, Metric*> aggregate_metrics_;
   };
 
   // Create or return existing mutable ComponentMetrics associated with 'component_name'.
@@ -244,6 +273,8 @@ class TMetricsCollector {
   sp_int32 max_interval_;
   sp_int32 nintervals_;
   sp_int32 interval_;
+  // Read from the config up front, as the collector may run on a thread of its own
+  sp_uint32 max_exceptions_;
   EventLoop* eventLoop_;
   std::string metrics_sinks_yaml_;
   common::TMasterMetrics* tmetrics_info_;
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "manager/tmetrics-loop.h"
+#include <string>
+#include "manager/stats-interface.h"
+#include "manager/tmetrics-collector.h"
+#include "proto/tmaster.pb.h"
+#include "basics/basics.h"
+#include "errors/errors.h"
+#include "threads/threads.h"
+#include "network/network.h"
+
+namespace heron {
+namespace tmaster {
+
+// Number of metrics messages that can be waiting for the metrics loop
+// before new ones are dropped
+const sp_int32 MAX_PENDING_METRICS = 16 * 1024;
+
+TMetricsLoop::TMetricsLoop(sp_int32 _max_interval, const std::string& _metrics_sinks_yaml)
+    : stats_(NULL), pending_(0), dropped_(0), unreported_dropped_(0) {
+  // Everything touching the event loop is set up before the thread starts
+  eventLoop_ = new EventLoopImpl();
+  piper_ = new Piper(eventLoop_);
+  collector_ = new TMetricsCollector(_max_interval, eventLoop_, _metrics_sinks_yaml);
+  thread_ = std::thread([this]() { eventLoop_->loop(); });
+}
+
+TMetricsLoop::~TMetricsLoop() {
+  EventLoop* eventLoop = eventLoop_;
+  piper_->ExecuteInEventLoop([eventLoop]() { eventLoop->loopExit(); });
+  thread_.join();
+  delete stats_;
+  delete collector_;
+  delete piper_;
+  delete eventLoop_;
+}
+
+void TMetricsLoop::StartStatsInterface(const NetworkOptions& _options,
+                                       const proto::api::Topology& _topology) {
+  // The lambda keeps copies of _options and _topology
+  piper_->ExecuteInEventLoop([this, _options, _topology]() {
+    CHECK(!stats_);
+    topology_.CopyFrom(_topology);
+    stats_ = new StatsInterface(eventLoop_, _options, collector_, &topology_);
+  });
+}
+
+void TMetricsLoop::AddMetric(IncomingPacket* _packet) {
+  if (pending_.fetch_add(1, std::memory_order_relaxed) >= MAX_PENDING_METRICS) {
+    pending_.fetch_sub(1, std::memory_order_relaxed);
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    unreported_dropped_.fetch_add(1, std::memory_order_relaxed);
+    delete _packet;
+    return;
+  }
+  // The packet may wait in the queue for a while
+  _packet->CopyOutOfSlab();
+  piper_->ExecuteInEventLoop([this, _packet]() { DoAddMetric(_packet); });
+}
+
+sp_int64 TMetricsLoop::TakeDropped() {
+  return unreported_dropped_.exchange(0, std::memory_order_relaxed);
+}
+
+void TMetricsLoop::DoAddMetric(IncomingPacket* _packet) {
+  pending_.fetch_sub(1, std::memory_order_relaxed);
+  sp_int64 dropped = dropped_.exchange(0, std::memory_order_relaxed);
+  if (dropped > 0) {
+    LOG(WARNING) << "Dropped " << dropped << " metrics messages since the metrics loop "
+                 << "could not keep up";
+  }
+
+  proto::tmaster::PublishMetrics metrics;
+  if (_packet->UnPackProtocolBuffer(&metrics) != 0) {
+    LOG(ERROR) << "Could not decode PublishMetrics message. Dropping...";
+  } else {
+    collector_->AddMetric(metrics);
+  }
+  delete _packet;
+}
+}  // namespace tmaster
+}  // namespace heron
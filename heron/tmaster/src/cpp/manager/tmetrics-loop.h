@@ -0,0 +1,86 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __TMETRICS_LOOP_H_
+#define __TMETRICS_LOOP_H_
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include "network/network.h"
+#include "proto/topology.pb.h"
+#include "basics/basics.h"
+
+namespace heron {
+namespace tmaster {
+
+class StatsInterface;
+class TMetricsCollector;
+
+// A TMetricsLoop runs the metrics collector and the http server for stat
+// queries on an event loop of its own thread. However many metrics come
+// in, and however long the queries take, the tmaster's own loop, that
+// registers the stmgrs, answers their heartbeats and hands out physical
+// plans, never waits on them.
+// All its public methods are called from the tmaster's loop. Everything
+// is handed over through a Piper; the metrics as the packets they came in,
+// which are only parsed on the metrics loop.
+class TMetricsLoop {
+ public:
+  TMetricsLoop(sp_int32 _max_interval, const std::string& _metrics_sinks_yaml);
+  // Stops the event loop and waits for the thread to finish
+  virtual ~TMetricsLoop();
+
+  // Start answering stat queries about _topology with a http server
+  void StartStatsInterface(const NetworkOptions& _options, const proto::api::Topology& _topology);
+
+  // Add the metrics of the PublishMetrics message that _packet is
+  // positioned at. We own _packet.
+  void AddMetric(IncomingPacket* _packet);
+
+  // Returns how many metrics messages were dropped since the last call
+  sp_int64 TakeDropped();
+
+ private:
+  friend class TMetricsLoopTest;
+
+  // Runs on the metrics loop
+  void DoAddMetric(IncomingPacket* _packet);
+
+  EventLoop* eventLoop_;
+  // Runs callbacks of the tmaster's loop on eventLoop_
+  Piper* piper_;
+  TMetricsCollector* collector_;
+  // Only accessed on eventLoop_
+  StatsInterface* stats_;
+  proto::api::Topology topology_;
+
+  // The metrics handed over but not added yet. Past a limit, new ones are
+  // dropped, so that a metrics loop that falls behind does not make the
+  // tmaster run out of memory.
+  std::atomic<sp_int32> pending_;
+  // Dropped since the metrics loop last logged them, and since they were
+  // last taken to be exported
+  std::atomic<sp_int64> dropped_;
+  std::atomic<sp_int64> unreported_dropped_;
+
+  std::thread thread_;
+};
+}  // namespace tmaster
+}  // namespace heron
+
+#endif
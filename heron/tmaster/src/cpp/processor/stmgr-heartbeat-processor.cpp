@@ -41,7 +41,8 @@ void StMgrHeartbeatProcessor::Start() {
       static_cast<proto::tmaster::StMgrHeartbeatRequest*>(request_);
 
   proto::system::Status* status = tmaster_->UpdateStMgrHeartbeat(
-      GetConnection(), request->heartbeat_time(), request->release_stats());
+      GetConnection(), request->heartbeat_time(), request->release_stats(),
+      request->takes_pplan_deltas());
 
   proto::tmaster::StMgrHeartbeatResponse response;
   response.set_allocated_status(status);
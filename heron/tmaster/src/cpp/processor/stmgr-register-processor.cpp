@@ -51,7 +51,8 @@ void StMgrRegisterProcessor::Start() {
   proto::system::PhysicalPlan* pplan = NULL;
 
   proto::system::Status* status =
-      tmaster_->RegisterStMgr(request->stmgr(), instances, GetConnection(), pplan);
+      tmaster_->RegisterStMgr(request->stmgr(), instances, request->takes_pplan_deltas(),
+                              GetConnection(), pplan);
 
   // Send the response
   proto::tmaster::StMgrRegisterResponse response;
@@ -59,6 +60,7 @@ void StMgrRegisterProcessor::Start() {
   if (status->status() == proto::system::OK) {
     if (pplan) {
       response.mutable_pplan()->CopyFrom(*pplan);
+      response.set_pplan_version(tmaster_->getPhysicalPlanVersion());
     }
   }
   SendResponse(response);
@@ -24,19 +24,24 @@
 #include "errors/errors.h"
 #include "threads/threads.h"
 #include "network/network.h"
+#include "config/physical-plan-helper.h"
 
 namespace heron {
 namespace testing {
 
 DummyStMgr::DummyStMgr(EventLoop* eventLoop, const NetworkOptions& options,
                        const sp_string& stmgr_id, const sp_string& myhost, sp_int32 myport,
-                       const std::vector<proto::system::Instance*>& instances)
+                       const std::vector<proto::system::Instance*>& instances,
+                       bool takes_pplan_deltas)
     : Client(eventLoop, options),
       my_id_(stmgr_id),
       my_host_(myhost),
       my_port_(myport),
       instances_(instances),
+      takes_pplan_deltas_(takes_pplan_deltas),
       pplan_(NULL),
+      num_pplans_(0),
+      num_pplan_deltas_(0),
       got_restore_message_(false),
       got_start_message_(false) {
   InstallResponseHandler(new proto::tmaster::StMgrRegisterRequest(),
@@ -44,6 +49,7 @@ DummyStMgr::DummyStMgr(EventLoop* eventLoop, const NetworkOptions& options,
   InstallResponseHandler(new proto::tmaster::StMgrHeartbeatRequest(),
                          &DummyStMgr::HandleHeartbeatResponse);
   InstallMessageHandler(&DummyStMgr::HandleNewAssignmentMessage);
+  InstallMessageHandler(&DummyStMgr::HandlePhysicalPlanDeltaMessage);
   InstallMessageHandler(&DummyStMgr::HandleRestoreTopologyStateRequest);
   InstallMessageHandler(&DummyStMgr::HandleStartProcessingMessage);
 }
@@ -123,9 +129,20 @@ void DummyStMgr::HandleNewAssignmentMessage(proto::stmgr::NewPhysicalPlanMessage
   delete message;
 }
 
+void DummyStMgr::HandlePhysicalPlanDeltaMessage(
+    proto::stmgr::PhysicalPlanDeltaMessage* message) {
+  LOG(INFO) << "Got the changes to the assignment";
+  CHECK(takes_pplan_deltas_);
+  CHECK(pplan_);
+  config::PhysicalPlanHelper::ApplyDelta(message->delta(), *pplan_);
+  ++num_pplan_deltas_;
+  delete message;
+}
+
 void DummyStMgr::HandleNewPhysicalPlan(const proto::system::PhysicalPlan& pplan) {
   delete pplan_;
   pplan_ = new proto::system::PhysicalPlan(pplan);
+  ++num_pplans_;
 }
 
 void DummyStMgr::OnReConnectTimer() { Start(); }
@@ -146,6 +163,7 @@ void DummyStMgr::SendRegisterRequest() {
        iter != instances_.end(); ++iter) {
     request->add_instances()->CopyFrom(**iter);
   }
+  request->set_takes_pplan_deltas(takes_pplan_deltas_);
   SendRequest(request, NULL);
   return;
 }
@@ -154,6 +172,7 @@ void DummyStMgr::SendHeartbeatRequest() {
   proto::tmaster::StMgrHeartbeatRequest* request = new proto::tmaster::StMgrHeartbeatRequest();
   request->set_heartbeat_time(time(NULL));
   request->mutable_stats();
+  request->set_takes_pplan_deltas(takes_pplan_deltas_);
   SendRequest(request, NULL);
   return;
 }
@@ -33,7 +33,8 @@ class DummyStMgr : public Client {
  public:
   DummyStMgr(EventLoop* eventLoop, const NetworkOptions& options, const sp_string& stmgr_id,
              const sp_string& myhost, sp_int32 myport,
-             const std::vector<proto::system::Instance*>& instances);
+             const std::vector<proto::system::Instance*>& instances,
+             bool takes_pplan_deltas);
   ~DummyStMgr();
 
   proto::system::PhysicalPlan* GetPhysicalPlan();
@@ -42,6 +43,8 @@ class DummyStMgr : public Client {
   bool GotStartProcessingMessage() const { return got_start_message_; }
   void ResetGotStartProcessingMessage() { got_start_message_ = false; }
   const std::string& stmgrid() const { return my_id_; }
+  sp_int32 NumPhysicalPlans() const { return num_pplans_; }
+  sp_int32 NumPhysicalPlanDeltas() const { return num_pplan_deltas_; }
 
  protected:
   virtual void HandleConnect(NetworkErrorCode status);
@@ -53,6 +56,7 @@ class DummyStMgr : public Client {
   void HandleHeartbeatResponse(void*, proto::tmaster::StMgrHeartbeatResponse* response,
                                NetworkErrorCode);
   void HandleNewAssignmentMessage(proto::stmgr::NewPhysicalPlanMessage* message);
+  void HandlePhysicalPlanDeltaMessage(proto::stmgr::PhysicalPlanDeltaMessage* message);
   void HandleNewPhysicalPlan(const proto::system::PhysicalPlan& pplan);
   void HandleRestoreTopologyStateRequest(proto::ckptmgr::RestoreTopologyStateRequest* message);
   void HandleStartProcessingMessage(proto::ckptmgr::StartStmgrStatefulProcessing* message);
@@ -66,8 +70,11 @@ class DummyStMgr : public Client {
   std::string my_host_;
   sp_int32 my_port_;
   std::vector<proto::system::Instance*> instances_;
+  bool takes_pplan_deltas_;
 
   proto::system::PhysicalPlan* pplan_;
+  sp_int32 num_pplans_;
+  sp_int32 num_pplan_deltas_;
   bool got_restore_message_;
   bool got_start_message_;
 };
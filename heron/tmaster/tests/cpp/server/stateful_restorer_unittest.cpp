@@ -189,7 +189,8 @@ void StartDummyStMgr(EventLoopImpl*& ss, heron::testing::DummyStMgr*& mgr,
   options.set_max_packet_size(1024 * 1024);
   options.set_socket_family(PF_INET);
 
-  mgr = new heron::testing::DummyStMgr(ss, options, stmgr_id, LOCALHOST, stmgr_port, instances);
+  mgr = new heron::testing::DummyStMgr(ss, options, stmgr_id, LOCALHOST, stmgr_port, instances,
+                                       true);
   mgr->Start();
   stmgr_thread = new std::thread(StartServer, ss);
   // Start the stream manager
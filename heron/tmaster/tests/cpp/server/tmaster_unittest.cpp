@@ -203,7 +203,8 @@ void StartTMaster(EventLoopImpl*& ss, heron::tmaster::TMaster*& tmaster,
 void StartDummyStMgr(EventLoopImpl*& ss, heron::testing::DummyStMgr*& mgr,
                      std::thread*& stmgr_thread, const sp_string tmaster_host,
                      sp_int32 tmaster_port, const sp_string& stmgr_id, sp_int32 stmgr_port,
-                     const std::vector<heron::proto::system::Instance*>& instances) {
+                     const std::vector<heron::proto::system::Instance*>& instances,
+                     bool takes_pplan_deltas) {
   // Create the select server for this stmgr to use
   ss = new EventLoopImpl();
 
@@ -213,7 +214,8 @@ void StartDummyStMgr(EventLoopImpl*& ss, heron::testing::DummyStMgr*& mgr,
   options.set_max_packet_size(1024 * 1024);
   options.set_socket_family(PF_INET);
 
-  mgr = new heron::testing::DummyStMgr(ss, options, stmgr_id, LOCALHOST, stmgr_port, instances);
+  mgr = new heron::testing::DummyStMgr(ss, options, stmgr_id, LOCALHOST, stmgr_port, instances,
+                                       takes_pplan_deltas);
   mgr->Start();
   stmgr_thread = new std::thread(StartServer, ss);
   // Start the stream manager
@@ -335,14 +337,14 @@ void DistributeWorkersAcrossStmgrs(CommonResources& common) {
 }
 
 void StartStMgrs(CommonResources& common) {
-  // Spawn and start the stmgrs
+  // Spawn and start the stmgrs, every other one taking physical plan deltas
   for (int i = 0; i < common.num_stmgrs_; ++i) {
     EventLoopImpl* stmgr_ss = NULL;
     heron::testing::DummyStMgr* mgr = NULL;
     std::thread* stmgr_thread = NULL;
     StartDummyStMgr(stmgr_ss, mgr, stmgr_thread, LOCALHOST, common.tmaster_port_,
                     common.stmgrs_id_list_[i], common.stmgr_baseport_ + i,
-                    common.stmgr_instance_list_[i]);
+                    common.stmgr_instance_list_[i], i % 2 == 0);
 
     common.ss_list_.push_back(stmgr_ss);
     common.stmgrs_list_.push_back(mgr);
@@ -502,6 +504,18 @@ TEST(StMgr, test_activate_deactivate) {
               heron::proto::api::PAUSED);
   }
 
+  // Only the stmgrs that take deltas got the change as one, the others
+  // got the whole new plan
+  for (size_t i = 0; i < common.stmgrs_list_.size(); ++i) {
+    if (i % 2 == 0) {
+      EXPECT_EQ(common.stmgrs_list_[i]->NumPhysicalPlans(), 1);
+      EXPECT_EQ(common.stmgrs_list_[i]->NumPhysicalPlanDeltas(), 1);
+    } else {
+      EXPECT_EQ(common.stmgrs_list_[i]->NumPhysicalPlans(), 2);
+      EXPECT_EQ(common.stmgrs_list_[i]->NumPhysicalPlanDeltas(), 0);
+    }
+  }
+
   std::thread* activate_thread =
       new std::thread(ControlTopology, common.topology_id_, common.tmaster_controller_port_, true);
   // activate_thread->start();
@@ -0,0 +1,441 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "proto/messages.h"
+#include "basics/basics.h"
+#include "errors/errors.h"
+#include "threads/threads.h"
+#include "network/network.h"
+#include "basics/modinit.h"
+#include "errors/modinit.h"
+#include "threads/modinit.h"
+#include "network/modinit.h"
+#include "config/heron-internals-config-reader.h"
+#include "manager/tmetrics-collector.h"
+
+sp_string heron_internals_config_filename =
+    "../../../../../../../../heron/config/heron_internals.yaml";
+sp_string metrics_sinks_config_filename = "../../../../../../../../heron/config/metrics_sinks.yaml";
+
+const sp_string COMPONENT_NAME = "bolt";
+const sp_int32 NUM_INSTANCES = 4;
+// One metric of each aggregation type, as set in the metrics sinks config
+const sp_string SUM_METRIC = "__emit-count/default";
+const sp_string AVG_METRIC = "__execute-latency/default";
+const sp_string LAST_METRIC = "__jvm-memory-used-mb";
+const sp_int32 BUCKET_INTERVAL = 60;
+
+namespace heron {
+namespace tmaster {
+
+// Feeds the metrics of several instances to a TMetricsCollector, over
+// several buckets, and compares what it rolls up for the component with
+// what it returns per instance. Also runs single metrics through their
+// ring of time buckets.
+class TMetricsCollectorTest : public ::testing::Test {
+ public:
+  void SetUp() {
+    sp_int32 interval = config::HeronInternalsConfigReader::Instance()
+                            ->GetHeronTmasterMetricsCollectorPurgeIntervalSec();
+    nbuckets_ = 5;
+    collector_ = new TMetricsCollector(nbuckets_ * interval, &ss_, metrics_sinks_config_filename);
+  }
+
+  void TearDown() { delete collector_; }
+
+  static sp_string InstanceId(sp_int32 _instance) {
+    return "container_1_" + COMPONENT_NAME + "_" + std::to_string(_instance + 1);
+  }
+
+  // Starts a new bucket, as the purge timer does
+  void Purge() { collector_->Purge(EventLoop::TIMEOUT_EVENT); }
+
+  // Instance i sends i + 1 values of each metric into every bucket, except
+  // that the last instance skips the LAST metric in the second bucket.
+  // Returns how many AVG values each instance sent.
+  std::vector<sp_int64> AddMetrics(sp_int32 _nbuckets) {
+    std::vector<sp_int64> counts(NUM_INSTANCES, 0);
+    for (sp_int32 b = 0; b < _nbuckets; ++b) {
+      if (b > 0) Purge();
+      proto::tmaster::PublishMetrics metrics;
+      for (sp_int32 i = 0; i < NUM_INSTANCES; ++i) {
+        for (sp_int32 k = 0; k <= i; ++k) {
+          Add(&metrics, i, SUM_METRIC, 10 * i + b + k);
+          Add(&metrics, i, AVG_METRIC, 100 * (i + 1) + 10 * b + 3 * k);
+          if (!(i == NUM_INSTANCES - 1 && b == 1)) {
+            Add(&metrics, i, LAST_METRIC, 1000 * i + 10 * b + k);
+          }
+          counts[i]++;
+        }
+      }
+      collector_->AddMetric(metrics);
+    }
+    return counts;
+  }
+
+  proto::tmaster::MetricResponse* GetMetrics(bool _aggregate, bool _minutely,
+                                             sp_int64 _interval) {
+    proto::tmaster::MetricRequest request;
+    request.set_component_name(COMPONENT_NAME);
+    request.add_metric(SUM_METRIC);
+    request.add_metric(AVG_METRIC);
+    request.add_metric(LAST_METRIC);
+    request.set_aggregate(_aggregate);
+    request.set_minutely(_minutely);
+    request.set_interval(_interval);
+    proto::tmaster::MetricResponse* response = collector_->GetMetrics(request, &topology_);
+    EXPECT_EQ(response->status().status(), proto::system::OK);
+    return response;
+  }
+
+  // The value of _metric for _instance_id in _response
+  static sp_double64 Value(const proto::tmaster::MetricResponse& _response,
+                           const sp_string& _instance_id, const sp_string& _metric) {
+    const auto& metric = Find(_response, _instance_id, _metric);
+    EXPECT_TRUE(metric.has_value());
+    return strtod(metric.value().c_str(), NULL);
+  }
+
+  // The minutely values of _metric for _instance_id in _response, newest first
+  static std::vector<sp_double64> Values(const proto::tmaster::MetricResponse& _response,
+                                         const sp_string& _instance_id,
+                                         const sp_string& _metric) {
+    const auto& metric = Find(_response, _instance_id, _metric);
+    std::vector<sp_double64> values;
+    for (sp_int32 i = 0; i < metric.interval_values_size(); ++i) {
+      values.push_back(strtod(metric.interval_values(i).value().c_str(), NULL));
+    }
+    return values;
+  }
+
+  // A metric with a ring of _nbuckets buckets, as the collector keeps them
+  static TMetricsCollector::Metric* NewMetric(common::TMasterMetrics::MetricAggregationType _type,
+                                              sp_int32 _nbuckets) {
+    return new TMetricsCollector::Metric("metric", _type, _nbuckets, BUCKET_INTERVAL);
+  }
+
+  // Lets a bucket interval pass. The buckets so far move one interval into
+  // the past, and the metric starts a new one, as on purge.
+  static void Tick(TMetricsCollector::Metric* _metric) {
+    for (auto& bucket : _metric->data_) {
+      bucket.start_time_ -= BUCKET_INTERVAL;
+      bucket.end_time_ -= BUCKET_INTERVAL;
+    }
+    _metric->Purge();
+  }
+
+  // When the current bucket of _metric started
+  static sp_int64 Now(const TMetricsCollector::Metric* _metric) {
+    return _metric->bucket(0).start_time_;
+  }
+
+  static void AddValues(TMetricsCollector::Metric* _metric,
+                        const std::vector<sp_int32>& _values) {
+    TMetricsCollector::MetricDelta delta;
+    for (sp_int32 value : _values) {
+      _metric->AddValueToMetric(std::to_string(value), &delta);
+    }
+  }
+
+  // The value of _metric between _start and _end, or all time if _start is 0
+  static sp_double64 Total(TMetricsCollector::Metric* _metric, sp_int64 _start, sp_int64 _end) {
+    proto::tmaster::MetricResponse::IndividualMetric response;
+    _metric->GetMetrics(false, _start, _end, &response);
+    return strtod(response.value().c_str(), NULL);
+  }
+
+  // The minutely values of _metric between _start and _end, newest first.
+  // Fills in when each of their buckets started.
+  static std::vector<sp_double64> Minutely(TMetricsCollector::Metric* _metric, sp_int64 _start,
+                                           sp_int64 _end, std::vector<sp_int64>* _starts) {
+    proto::tmaster::MetricResponse::IndividualMetric response;
+    _metric->GetMetrics(true, _start, _end, &response);
+    std::vector<sp_double64> values;
+    for (sp_int32 i = 0; i < response.interval_values_size(); ++i) {
+      values.push_back(strtod(response.interval_values(i).value().c_str(), NULL));
+      _starts->push_back(response.interval_values(i).interval().start());
+    }
+    return values;
+  }
+
+ protected:
+  sp_int32 nbuckets_;
+  TMetricsCollector* collector_;
+
+ private:
+  static void Add(proto::tmaster::PublishMetrics* _metrics, sp_int32 _instance,
+                  const sp_string& _name, sp_int32 _value) {
+    proto::tmaster::MetricDatum* datum = _metrics->add_metrics();
+    datum->set_component_name(COMPONENT_NAME);
+    datum->set_instance_id(InstanceId(_instance));
+    datum->set_name(_name);
+    datum->set_value(std::to_string(_value));
+  }
+
+  static const proto::tmaster::MetricResponse::IndividualMetric& Find(
+      const proto::tmaster::MetricResponse& _response, const sp_string& _instance_id,
+      const sp_string& _metric) {
+    for (sp_int32 i = 0; i < _response.metric_size(); ++i) {
+      const auto& task_metric = _response.metric(i);
+      if (task_metric.instance_id() != _instance_id) continue;
+      for (sp_int32 j = 0; j < task_metric.metric_size(); ++j) {
+        if (task_metric.metric(j).name() == _metric) return task_metric.metric(j);
+      }
+    }
+    ADD_FAILURE() << "No " << _metric << " for " << _instance_id;
+    return proto::tmaster::MetricResponse::IndividualMetric::default_instance();
+  }
+
+  EventLoopImpl ss_;
+  proto::api::Topology topology_;
+};
+
+// Test that the rolled up answer is one metric named after the component
+TEST_F(TMetricsCollectorTest, test_aggregate_response) {
+  AddMetrics(1);
+  proto::tmaster::MetricResponse* response = GetMetrics(true, false, 0);
+  ASSERT_EQ(response->metric_size(), 1);
+  EXPECT_EQ(response->metric(0).instance_id(), COMPONENT_NAME);
+  EXPECT_EQ(response->metric(0).metric_size(), 3);
+  delete response;
+
+  response = GetMetrics(false, false, 0);
+  EXPECT_EQ(response->metric_size(), NUM_INSTANCES);
+  delete response;
+}
+
+// Test that the rolled up SUM and LAST metrics are the sum of the
+// per instance ones, all time and over an interval
+TEST_F(TMetricsCollectorTest, test_aggregate_sum_last) {
+  AddMetrics(3);
+  for (sp_int64 interval : {0, 3600}) {
+    proto::tmaster::MetricResponse* aggregate = GetMetrics(true, false, interval);
+    proto::tmaster::MetricResponse* instances = GetMetrics(false, false, interval);
+    for (const sp_string& metric : {SUM_METRIC, LAST_METRIC}) {
+      sp_double64 sum = 0;
+      for (sp_int32 i = 0; i < NUM_INSTANCES; ++i) {
+        sum += Value(*instances, InstanceId(i), metric);
+      }
+      EXPECT_DOUBLE_EQ(Value(*aggregate, COMPONENT_NAME, metric), sum)
+          << metric << " over " << interval;
+    }
+    delete aggregate;
+    delete instances;
+  }
+}
+
+// Test that the rolled up AVG metric averages over all values of all
+// instances, all time and over an interval
+TEST_F(TMetricsCollectorTest, test_aggregate_avg) {
+  std::vector<sp_int64> counts = AddMetrics(3);
+  for (sp_int64 interval : {0, 3600}) {
+    proto::tmaster::MetricResponse* aggregate = GetMetrics(true, false, interval);
+    proto::tmaster::MetricResponse* instances = GetMetrics(false, false, interval);
+    sp_double64 total = 0;
+    sp_int64 count = 0;
+    for (sp_int32 i = 0; i < NUM_INSTANCES; ++i) {
+      total += Value(*instances, InstanceId(i), AVG_METRIC) * counts[i];
+      count += counts[i];
+    }
+    EXPECT_NEAR(Value(*aggregate, COMPONENT_NAME, AVG_METRIC), total / count, 1e-3)
+        << "over " << interval;
+    delete aggregate;
+    delete instances;
+  }
+}
+
+// Test that the rolled up minutely metrics match the per instance ones
+// bucket by bucket
+TEST_F(TMetricsCollectorTest, test_aggregate_minutely) {
+  const sp_int32 nused = 3;
+  AddMetrics(nused);
+  proto::tmaster::MetricResponse* aggregate = GetMetrics(true, true, 3600);
+  proto::tmaster::MetricResponse* instances = GetMetrics(false, true, 3600);
+
+  for (const sp_string& metric : {SUM_METRIC, LAST_METRIC}) {
+    std::vector<sp_double64> values = Values(*aggregate, COMPONENT_NAME, metric);
+    ASSERT_EQ(values.size(), static_cast<size_t>(nbuckets_));
+    std::vector<sp_double64> sums(nbuckets_, 0);
+    for (sp_int32 i = 0; i < NUM_INSTANCES; ++i) {
+      std::vector<sp_double64> instance_values = Values(*instances, InstanceId(i), metric);
+      ASSERT_EQ(instance_values.size(), static_cast<size_t>(nbuckets_));
+      for (sp_int32 b = 0; b < nbuckets_; ++b) sums[b] += instance_values[b];
+    }
+    for (sp_int32 b = 0; b < nbuckets_; ++b) {
+      EXPECT_DOUBLE_EQ(values[b], sums[b]) << metric << " in bucket " << b;
+    }
+  }
+
+  // Every instance sent i + 1 AVG values into each of the used buckets
+  std::vector<sp_double64> values = Values(*aggregate, COMPONENT_NAME, AVG_METRIC);
+  ASSERT_EQ(values.size(), static_cast<size_t>(nbuckets_));
+  for (sp_int32 b = 0; b < nused; ++b) {
+    sp_double64 total = 0;
+    sp_int64 count = 0;
+    for (sp_int32 i = 0; i < NUM_INSTANCES; ++i) {
+      total += Values(*instances, InstanceId(i), AVG_METRIC)[b] * (i + 1);
+      count += i + 1;
+    }
+    EXPECT_NEAR(values[b], total / count, 1e-3) << "in bucket " << b;
+  }
+
+  // The LAST metric of the last instance is missing in the second bucket,
+  // and so from its roll up
+  std::vector<sp_double64> last = Values(*instances, InstanceId(NUM_INSTANCES - 1), LAST_METRIC);
+  EXPECT_DOUBLE_EQ(last[1], 0);
+  EXPECT_GT(last[0], 0);
+  EXPECT_GT(last[2], 0);
+
+  delete aggregate;
+  delete instances;
+}
+
+// Test that each purge starts a new bucket, and that minutely queries
+// return the buckets newest first
+TEST_F(TMetricsCollectorTest, test_ring_rotation) {
+  auto metric = NewMetric(common::TMasterMetrics::SUM, 3);
+  AddValues(metric, {1});
+  Tick(metric);
+  AddValues(metric, {2, 3});
+  Tick(metric);
+  AddValues(metric, {4});
+
+  sp_int64 now = Now(metric);
+  std::vector<sp_int64> starts;
+  std::vector<sp_double64> values = Minutely(metric, now - 2 * BUCKET_INTERVAL, now, &starts);
+  ASSERT_EQ(values.size(), 3u);
+  EXPECT_DOUBLE_EQ(values[0], 4);
+  EXPECT_DOUBLE_EQ(values[1], 5);
+  EXPECT_DOUBLE_EQ(values[2], 1);
+  EXPECT_EQ(starts[0], now);
+  EXPECT_GE(starts[0] - starts[1], BUCKET_INTERVAL);
+  EXPECT_GE(starts[1] - starts[2], BUCKET_INTERVAL);
+
+  // Only the buckets in the range are returned
+  starts.clear();
+  values = Minutely(metric, now - BUCKET_INTERVAL / 2, now, &starts);
+  ASSERT_EQ(values.size(), 2u);
+  EXPECT_DOUBLE_EQ(values[0], 4);
+  EXPECT_DOUBLE_EQ(values[1], 5);
+  delete metric;
+}
+
+// Test that once the ring wraps around, the oldest buckets are reused, and
+// that queries over buckets on both sides of the wrap add up
+TEST_F(TMetricsCollectorTest, test_ring_wrap) {
+  auto metric = NewMetric(common::TMasterMetrics::SUM, 3);
+  for (sp_int32 i = 1; i <= 5; ++i) {
+    if (i > 1) Tick(metric);
+    AddValues(metric, {i});
+  }
+
+  sp_int64 now = Now(metric);
+  std::vector<sp_int64> starts;
+  std::vector<sp_double64> values = Minutely(metric, now - 4 * BUCKET_INTERVAL, now, &starts);
+  ASSERT_EQ(values.size(), 3u);
+  EXPECT_DOUBLE_EQ(values[0], 5);
+  EXPECT_DOUBLE_EQ(values[1], 4);
+  EXPECT_DOUBLE_EQ(values[2], 3);
+
+  EXPECT_DOUBLE_EQ(Total(metric, now - 4 * BUCKET_INTERVAL, now), 12);
+  EXPECT_DOUBLE_EQ(Total(metric, now - BUCKET_INTERVAL / 2, now), 9);
+  EXPECT_DOUBLE_EQ(Total(metric, now - 3 * BUCKET_INTERVAL / 2, now - 7 * BUCKET_INTERVAL / 6),
+                   3);
+  // All time still counts what has left the ring
+  EXPECT_DOUBLE_EQ(Total(metric, 0, now), 15);
+  delete metric;
+}
+
+// Test that buckets older than the ring are purged, and that values added
+// after count on their own
+TEST_F(TMetricsCollectorTest, test_ring_purge_expired) {
+  auto metric = NewMetric(common::TMasterMetrics::SUM, 3);
+  AddValues(metric, {1});
+  Tick(metric);
+  AddValues(metric, {2});
+  for (sp_int32 i = 0; i < 3; ++i) Tick(metric);
+
+  sp_int64 now = Now(metric);
+  std::vector<sp_int64> starts;
+  std::vector<sp_double64> values = Minutely(metric, now - 4 * BUCKET_INTERVAL, now, &starts);
+  ASSERT_EQ(values.size(), 3u);
+  for (sp_double64 value : values) EXPECT_DOUBLE_EQ(value, 0);
+  EXPECT_DOUBLE_EQ(Total(metric, now - 4 * BUCKET_INTERVAL, now), 0);
+  EXPECT_DOUBLE_EQ(Total(metric, 0, now), 3);
+
+  AddValues(metric, {7});
+  Tick(metric);
+  now = Now(metric);
+  EXPECT_DOUBLE_EQ(Total(metric, now - 4 * BUCKET_INTERVAL, now), 7);
+  EXPECT_DOUBLE_EQ(Total(metric, 0, now), 10);
+  delete metric;
+}
+
+// Test AVG and LAST metrics over buckets on both sides of the wrap
+TEST_F(TMetricsCollectorTest, test_ring_wrap_avg_last) {
+  auto avg = NewMetric(common::TMasterMetrics::AVG, 3);
+  auto last = NewMetric(common::TMasterMetrics::LAST, 3);
+  const std::vector<std::vector<sp_int32>> values = {{10, 20}, {30}, {40, 50, 60}, {70}};
+  for (size_t i = 0; i < values.size(); ++i) {
+    if (i > 0) {
+      Tick(avg);
+      Tick(last);
+    }
+    AddValues(avg, values[i]);
+    // The third bucket gets no LAST value
+    if (i != 2) AddValues(last, values[i]);
+  }
+
+  sp_int64 now = Now(avg);
+  // The first bucket has left the ring
+  EXPECT_DOUBLE_EQ(Total(avg, now - 3 * BUCKET_INTERVAL, now), 50);
+  EXPECT_DOUBLE_EQ(Total(avg, now - BUCKET_INTERVAL / 2, now), 55);
+  EXPECT_DOUBLE_EQ(Total(avg, now - 3 * BUCKET_INTERVAL / 2, now - 7 * BUCKET_INTERVAL / 6), 30);
+  EXPECT_DOUBLE_EQ(Total(avg, 0, now), 40);
+
+  now = Now(last);
+  // LAST takes the newest bucket in the range, even one without a value
+  EXPECT_DOUBLE_EQ(Total(last, now - 3 * BUCKET_INTERVAL, now), 70);
+  EXPECT_DOUBLE_EQ(Total(last, now - 3 * BUCKET_INTERVAL / 2, now - 7 * BUCKET_INTERVAL / 6),
+                   30);
+  EXPECT_DOUBLE_EQ(Total(last, now - 5 * BUCKET_INTERVAL / 6, now - BUCKET_INTERVAL / 6), 0);
+  EXPECT_DOUBLE_EQ(Total(last, 0, now), 70);
+  delete avg;
+  delete last;
+}
+
+}  // namespace tmaster
+}  // namespace heron
+
+int main(int argc, char** argv) {
+  heron::common::Initialize(argv[0]);
+  testing::InitGoogleTest(&argc, argv);
+  if (argc > 1) {
+    std::cerr << "Using config file " << argv[1] << std::endl;
+    heron_internals_config_filename = argv[1];
+  }
+  if (argc > 2) {
+    std::cerr << "Using metrics sinks file " << argv[2] << std::endl;
+    metrics_sinks_config_filename = argv[2];
+  }
+  // The collector reads its intervals and limits from here
+  heron::config::HeronInternalsConfigReader::Create(heron_internals_config_filename);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,176 @@
+/*
+ * Copyright 2015 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include "gtest/gtest.h"
+#include "proto/messages.h"
+#include "basics/basics.h"
+#include "errors/errors.h"
+#include "threads/threads.h"
+#include "threads/spcountdownlatch.h"
+#include "network/network.h"
+#include "basics/modinit.h"
+#include "errors/modinit.h"
+#include "threads/modinit.h"
+#include "network/modinit.h"
+#include "config/heron-internals-config-reader.h"
+#include "manager/tmetrics-collector.h"
+#include "manager/tmetrics-loop.h"
+
+sp_string heron_internals_config_filename =
+    "../../../../../../../../heron/config/heron_internals.yaml";
+sp_string metrics_sinks_config_filename = "../../../../../../../../heron/config/metrics_sinks.yaml";
+
+const sp_string COMPONENT_NAME = "bolt";
+
+namespace heron {
+namespace tmaster {
+
+// Reaches into the TMetricsLoop to run things on its loop, and to see what
+// its collector got
+class TMetricsLoopTest : public ::testing::Test {
+ public:
+  void SetUp() {
+    // Keep a minute of metrics, in buckets of the purge interval
+    loop_ = new TMetricsLoop(60, metrics_sinks_config_filename);
+  }
+
+  void TearDown() { delete loop_; }
+
+  // Runs _cb on the metrics loop, and waits for it to finish
+  void RunOnLoop(std::function<void()> _cb) {
+    CountDownLatch done(1);
+    loop_->piper_->ExecuteInEventLoop([&_cb, &done]() {
+      _cb();
+      done.countDown();
+    });
+    done.wait();
+  }
+
+  // Keeps the metrics loop busy till _release is counted down
+  void BlockLoop(CountDownLatch* _release) {
+    loop_->piper_->ExecuteInEventLoop([_release]() { _release->wait(); });
+  }
+
+  sp_int32 Pending() { return loop_->pending_.load(); }
+
+  // The number of exceptions the collector has for the bolt
+  sp_int32 NumExceptions() {
+    sp_int32 num = -1;
+    RunOnLoop([this, &num]() {
+      proto::tmaster::ExceptionLogRequest request;
+      request.set_component_name(COMPONENT_NAME);
+      proto::tmaster::ExceptionLogResponse* response = loop_->collector_->GetExceptions(request);
+      if (response->status().status() == proto::system::OK) num = response->exceptions_size();
+      delete response;
+    });
+    return num;
+  }
+
+  // A packet positioned at a PublishMetrics message, like the tmaster
+  // server hands over, with _nexceptions exceptions of one bolt instance
+  static IncomingPacket* MakePacket(sp_int32 _nexceptions) {
+    proto::tmaster::PublishMetrics metrics;
+    for (sp_int32 i = 0; i < _nexceptions; ++i) {
+      proto::tmaster::TmasterExceptionLog* exception = metrics.add_exceptions();
+      exception->set_component_name(COMPONENT_NAME);
+      exception->set_hostname("localhost");
+      exception->set_instance_id("instance-1");
+      exception->set_stacktrace("java.lang.RuntimeException: " + std::to_string(i));
+      exception->set_lasttime("now");
+      exception->set_firsttime("now");
+      exception->set_count(1);
+    }
+    sp_int32 byte_size = metrics.ByteSize();
+    OutgoingPacket packet(OutgoingPacket::SizeRequiredToPackProtocolBuffer(byte_size));
+    EXPECT_EQ(packet.PackProtocolBuffer(metrics, byte_size), 0);
+    return new IncomingPacket(packet.get_header());
+  }
+
+ protected:
+  TMetricsLoop* loop_;
+};
+
+// Test that the metrics handed over are added on the metrics loop
+TEST_F(TMetricsLoopTest, test_hand_off) {
+  EXPECT_EQ(NumExceptions(), -1);
+  loop_->AddMetric(MakePacket(1));
+  loop_->AddMetric(MakePacket(2));
+  EXPECT_EQ(NumExceptions(), 3);
+  EXPECT_EQ(Pending(), 0);
+  EXPECT_EQ(loop_->TakeDropped(), 0);
+}
+
+// Test that the collector keeps only as many exceptions as configured
+TEST_F(TMetricsLoopTest, test_max_exceptions) {
+  sp_int32 max_exceptions = config::HeronInternalsConfigReader::Instance()
+                                ->GetHeronTmasterMetricsCollectorMaximumException();
+  loop_->AddMetric(MakePacket(max_exceptions + 10));
+  EXPECT_EQ(NumExceptions(), max_exceptions);
+}
+
+// Test that metrics are dropped, and counted, once too many are waiting
+// for a metrics loop that does not keep up
+TEST_F(TMetricsLoopTest, test_drop_when_full) {
+  const sp_int32 max_pending = 16 * 1024;
+  CountDownLatch release(1);
+  BlockLoop(&release);
+  for (sp_int32 i = 0; i < max_pending + 5; ++i) {
+    loop_->AddMetric(MakePacket(1));
+  }
+  EXPECT_EQ(Pending(), max_pending);
+  EXPECT_EQ(loop_->TakeDropped(), 5);
+  EXPECT_EQ(loop_->TakeDropped(), 0);
+
+  release.countDown();
+  // All that made it in get added, and there is room again after
+  sp_int32 max_exceptions = config::HeronInternalsConfigReader::Instance()
+                                ->GetHeronTmasterMetricsCollectorMaximumException();
+  EXPECT_EQ(NumExceptions(), std::min(max_pending, max_exceptions));
+  EXPECT_EQ(Pending(), 0);
+  loop_->AddMetric(MakePacket(1));
+  EXPECT_EQ(loop_->TakeDropped(), 0);
+}
+
+// Test that shutting down with metrics still waiting does not hang
+TEST_F(TMetricsLoopTest, test_shutdown) {
+  CountDownLatch release(1);
+  BlockLoop(&release);
+  for (sp_int32 i = 0; i < 1000; ++i) {
+    loop_->AddMetric(MakePacket(1));
+  }
+  release.countDown();
+  delete loop_;
+  loop_ = NULL;
+}
+
+}  // namespace tmaster
+}  // namespace heron
+
+int main(int argc, char** argv) {
+  heron::common::Initialize(argv[0]);
+  testing::InitGoogleTest(&argc, argv);
+  if (argc > 1) {
+    std::cerr << "Using config file " << argv[1] << std::endl;
+    heron_internals_config_filename = argv[1];
+  }
+  // The collector reads its intervals and limits from here
+  heron::config::HeronInternalsConfigReader::Create(heron_internals_config_filename);
+  return RUN_ALL_TESTS();
+}